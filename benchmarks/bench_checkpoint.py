@@ -0,0 +1,37 @@
+"""Time of CHECKPOINT on a 4 MB file with one sentence edited between
+checkpoints, so nearly every chunk is already stored and reused.
+
+    python3 benchmarks/bench_checkpoint.py [rounds]
+"""
+import os
+import re
+import statistics
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, commit
+
+ROUNDS = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE book.txt")
+    with open(os.path.join(c.data_dir(1), "book.txt"), "w") as f:
+        f.write("".join(f"Sentence number {i} of the book. " for i in range(4 * 1024 * 1024 // 33)))
+    c.request("CHECKPOINT book.txt v0\n")
+
+    times = []
+    for i in range(1, ROUNDS + 1):
+        commit(c, "book.txt", 1 + i * 997 % 100000, f"Edited in round {i}.")
+        start = time.perf_counter()
+        reply = c.request(f"CHECKPOINT book.txt v{i}\n").strip()
+        times.append((time.perf_counter() - start) * 1000)
+        assert reply == "ACK_CHECKPOINT", reply
+    stats = dict(re.findall(r"(\w+)=(\S+)", c.request("SSSTATS\n")))
+    times.sort()
+    chunks = ""
+    if "chunks_written" in stats:  # Builds before the chunk store have none
+        chunks = f" ({stats['chunks_written']} chunks written, {stats['chunks_reused']} reused)"
+    print(f"CHECKPOINT of a 4 MB file, {ROUNDS} rounds: p50 {statistics.median(times):.1f} ms, "
+          f"max {times[-1]:.1f} ms{chunks}")
@@ -0,0 +1,47 @@
+"""Checkpoint creation time, restore time (VIEWCHECKPOINT) and manifest disk
+usage for twenty checkpoints of a file, one sentence changed between each,
+at 1 MB and 16 MB.
+
+    python3 benchmarks/bench_checkpoint_chain.py [checkpoints]
+"""
+import glob
+import os
+import statistics
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, commit, ss_request
+
+CHECKPOINTS = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+SENTENCE = "Sentence number %d of the file. "
+
+with Cluster(servers=1, policy="batched") as c:
+    nm = c.user()
+    for mb in (1, 16):
+        name = f"doc{mb}.txt"
+        nm(f"CREATE {name}")
+        count = mb * 1024 * 1024 // len(SENTENCE % 100000)
+        with open(os.path.join(c.data_dir(1), name), "w") as f:
+            f.write("".join(SENTENCE % i for i in range(count)))
+        c.request(f"READ {name}\n", timeout=60)
+
+        creates = []
+        for k in range(CHECKPOINTS):
+            if k > 0:
+                assert commit(c, name, 997 * k + 7, f"Edited in round {k}.") == "ACK_WRITE_SUCCESS"
+            start = time.perf_counter()
+            reply = c.request(f"CHECKPOINT {name} v{k}\n", timeout=60).strip()
+            creates.append((time.perf_counter() - start) * 1000)
+            assert reply == "ACK_CHECKPOINT", reply
+        restores = []
+        for k in range(CHECKPOINTS):
+            start = time.perf_counter()
+            ss_request(c.client_port(1), f"VIEWCHECKPOINT {name} v{k}\n", timeout=60)
+            restores.append((time.perf_counter() - start) * 1000)
+        manifests = sum(os.path.getsize(p) for p in
+                        glob.glob(os.path.join(c.data_dir(1), ".checkpoints", name, "*.chk")))
+
+        print(f"{mb:2d} MB: create p50 {statistics.median(creates[1:]):.1f} ms, "
+              f"restore p50 {statistics.median(restores):.1f} ms, "
+              f"manifests {manifests / 1024:.0f} KB")
@@ -0,0 +1,50 @@
+"""Connections per second served by one SS: each connection sends a READ of a
+short file and reads the reply until the SS closes it.
+
+    python3 benchmarks/bench_connections.py [connections]
+"""
+import os
+import socket
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster
+
+CONNECTIONS = int(sys.argv[1]) if len(sys.argv) > 1 else 4000
+TEXT = "Short file for benchmarking."
+
+
+def read(port):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.sendall(b"READ b.txt\n")
+    data = b""
+    while True:
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    sock.close()
+    return data
+
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE b.txt")
+    with open(os.path.join(c.data_dir(1), "b.txt"), "w") as f:
+        f.write(TEXT)
+    assert read(c.client_port(1)).decode() == TEXT
+
+    for clients in (1, 8, 64):
+        def run(n):
+            for _ in range(n):
+                read(c.client_port(1))
+        threads = [threading.Thread(target=run, args=(CONNECTIONS // clients,)) for _ in range(clients)]
+        start = time.perf_counter()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        rate = clients * (CONNECTIONS // clients) / (time.perf_counter() - start)
+        print(f"{clients:2d} concurrent: {rate:.0f} connections/s")
@@ -0,0 +1,39 @@
+"""Time of a one-sentence COMMIT as the document grows: edits at random
+sentences and at the last one, on documents of 1, 10 and 50 MB.
+
+    python3 benchmarks/bench_edits.py [edits]
+"""
+import os
+import random
+import statistics
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, commit
+
+EDITS = int(sys.argv[1]) if len(sys.argv) > 1 else 100
+SENTENCE = "Sentence number %07d of the document. "
+
+random.seed(1)
+with Cluster(servers=1) as c:
+    nm = c.user()
+    for mb in (1, 10, 50):
+        name = f"doc{mb}.txt"
+        nm(f"CREATE {name}")
+        count = mb * 1024 * 1024 // len(SENTENCE % 0)
+        with open(os.path.join(c.data_dir(1), name), "w") as f:
+            f.write("".join(SENTENCE % i for i in range(count)))
+        c.request(f"READ {name}\n")  # Loaded
+
+        for where in ("random", "last"):
+            times = []
+            for k in range(EDITS):
+                sentence = random.randint(1, count) if where == "random" else count
+                start = time.perf_counter()
+                reply = commit(c, name, sentence, f"Edit {k} here.")
+                times.append((time.perf_counter() - start) * 1000)
+                assert reply == "ACK_WRITE_SUCCESS", reply
+            times.sort()
+            print(f"{mb:2d} MB ({count} sentences), {where:6s} sentence: "
+                  f"p50 {statistics.median(times):.2f} ms, p90 {times[len(times) * 9 // 10]:.2f} ms")
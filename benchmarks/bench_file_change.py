@@ -0,0 +1,36 @@
+"""Time of an UNDO on a small file while a large one has edits the WAL has
+not yet written out. An UNDO first writes its own file's logged edits to it;
+it should not have to write out the large file as well.
+
+    python3 benchmarks/bench_file_change.py [rounds]
+"""
+import os
+import statistics
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, commit
+
+ROUNDS = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE big.txt")
+    nm("CREATE small.txt")
+    sentence = "A sentence that makes the file large. "
+    with open(os.path.join(c.data_dir(1), "big.txt"), "w") as f:
+        f.write(sentence * (16 * 1024 * 1024 // len(sentence)))
+    c.request("READ big.txt\n")  # Cached
+
+    times = []
+    for i in range(ROUNDS):
+        commit(c, "small.txt", 1, f"Small {i}.")
+        commit(c, "big.txt", 2, f"Big {i}.")  # Dirty until the next checkpoint
+        start = time.perf_counter()
+        reply = c.request("UNDO small.txt\n")
+        times.append((time.perf_counter() - start) * 1000)
+        assert reply.startswith("ACK_UNDO"), reply
+    times.sort()
+    print(f"UNDO of small.txt with a dirty 16 MB big.txt, {ROUNDS} rounds: "
+          f"p50 {statistics.median(times):.1f} ms, max {times[-1]:.1f} ms")
@@ -0,0 +1,59 @@
+"""COMMIT latency and throughput, and the time of a REVERT that replaces a
+1 MB file, on one SS under each fsync policy (the SS's fourth argument).
+
+    python3 benchmarks/bench_fsync.py [commits]
+"""
+import os
+import statistics
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, commit
+
+COMMITS = int(sys.argv[1]) if len(sys.argv) > 1 else 30
+WRITERS = 16
+REVERTS = 20
+
+for policy in ("always", "batched", "never"):
+    with Cluster(servers=1, policy=policy) as c:
+        nm = c.user()
+        nm("CREATE f.txt")
+        with open(os.path.join(c.data_dir(1), "f.txt"), "w") as f:
+            f.write(" ".join(f"Sentence {k}." for k in range(WRITERS)))
+
+        times = []
+        for k in range(COMMITS):
+            start = time.perf_counter()
+            reply = commit(c, "f.txt", 1, f"Edit {k}.")
+            times.append((time.perf_counter() - start) * 1000)
+            assert reply == "ACK_WRITE_SUCCESS", reply
+
+        def write(w):
+            for k in range(COMMITS):
+                reply = commit(c, "f.txt", w + 1, f"Writer {w} edit {k}.")
+                assert reply == "ACK_WRITE_SUCCESS", reply
+        threads = [threading.Thread(target=write, args=(w,)) for w in range(WRITERS)]
+        start = time.perf_counter()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        rate = WRITERS * COMMITS / (time.perf_counter() - start)
+
+        # Each REVERT writes the whole file to a temporary one and renames it
+        nm("CREATE r.txt")
+        with open(os.path.join(c.data_dir(1), "r.txt"), "w") as f:
+            f.write("".join(f"Sentence {k} of the file. " for k in range(40000)))
+        assert c.request("CHECKPOINT r.txt v1\n").strip() == "ACK_CHECKPOINT"
+        reverts = []
+        for k in range(REVERTS):
+            start = time.perf_counter()
+            reply = c.request("REVERT r.txt v1\n")
+            reverts.append((time.perf_counter() - start) * 1000)
+            assert reply.startswith("ACK"), reply
+
+        print(f"{policy:8s} 1 writer: p50 {statistics.median(times):.2f} ms; "
+              f"{WRITERS} writers: {rate:.0f} commits/s; "
+              f"REVERT of 1 MB: p50 {statistics.median(reverts):.1f} ms")
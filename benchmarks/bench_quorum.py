@@ -0,0 +1,52 @@
+"""Latency and throughput of WRITEs to files held by two SSs, in ASYNC mode
+and in QUORUM 2 mode (acknowledged once the replica holds the write too).
+
+    python3 benchmarks/bench_quorum.py [writes]
+"""
+import os
+import statistics
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster, write
+
+WRITES = int(sys.argv[1]) if len(sys.argv) > 1 else 40
+WRITERS = 8
+
+with Cluster(servers=2) as c:
+    nm = c.user()
+    for mode in ("ASYNC", "QUORUM 2"):
+        prefix = "async" if mode == "ASYNC" else "quorum"
+        names = [f"{prefix}{w}.txt" for w in range(WRITERS)]
+        for name in names:
+            nm(f"CREATE {name}", settle=0.05)
+            reply = nm(f"SETDURABILITY {name} {mode}", settle=0.05)
+            assert reply.startswith("ACK_SETDURABILITY"), reply
+
+        # One writer: time of each WRITE
+        times = []
+        for k in range(WRITES):
+            start = time.perf_counter()
+            reply = write(c, names[0], 1, f"Edit {k}.")
+            times.append((time.perf_counter() - start) * 1000)
+            assert reply == "ACK_WRITE_SUCCESS", reply
+        times.sort()
+
+        # Several writers, each on its own file: WRITEs per second
+        def run(w):
+            for k in range(WRITES):
+                reply = write(c, names[w], 1, f"Writer {w} edit {k}.")
+                assert reply == "ACK_WRITE_SUCCESS", reply
+        threads = [threading.Thread(target=run, args=(w,)) for w in range(WRITERS)]
+        start = time.perf_counter()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        rate = WRITERS * WRITES / (time.perf_counter() - start)
+
+        print(f"{mode:9s} 1 writer: p50 {statistics.median(times):.2f} ms, "
+              f"p90 {times[len(times) * 9 // 10]:.2f} ms; "
+              f"{WRITERS} writers: {rate:.0f} writes/s")
@@ -0,0 +1,59 @@
+"""READ and VIEWCHECKPOINT throughput of large files, and the SS's CPU time
+per GB sent (from /proc).
+
+    python3 benchmarks/bench_read.py [repeats]
+"""
+import os
+import socket
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+from harness import Cluster
+
+REPEATS = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+LINE = "The quick brown fox jumps over the lazy dog number %07d. "
+buf = bytearray(1 << 22)
+
+
+def fetch(port, msg):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.sendall(msg.encode())
+    total = 0
+    while True:
+        n = sock.recv_into(buf)
+        if not n:
+            break
+        total += n
+    sock.close()
+    return total
+
+
+def cpu_seconds(pid):
+    fields = open(f"/proc/{pid}/stat").read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    port = c.client_port(1)
+    for mb in (8, 32, 128):
+        name = f"big{mb}.txt"
+        nm(f"CREATE {name}")
+        body = "".join(LINE % i for i in range(mb * 1024 * 1024 // len(LINE % 0)))
+        with open(os.path.join(c.data_dir(1), name), "w") as f:
+            f.write(body)
+        assert fetch(port, f"READ {name}\n") == len(body)
+        runs = [("READ", f"READ {name}\n")]
+        if mb <= 32:
+            assert c.request(f"CHECKPOINT {name} v1\n", timeout=60).strip() == "ACK_CHECKPOINT"
+            runs.append(("VIEWCHECKPOINT", f"VIEWCHECKPOINT {name} v1\n"))
+        for what, msg in runs:
+            fetch(port, msg)
+            cpu = cpu_seconds(c.pid(1))
+            start = time.perf_counter()
+            total = sum(fetch(port, msg) for _ in range(REPEATS))
+            elapsed = time.perf_counter() - start
+            cpu = cpu_seconds(c.pid(1)) - cpu
+            print(f"{what:14s} {mb:3d} MB: {total / elapsed / 1e6:6.0f} MB/s, "
+                  f"server CPU {cpu / (total / 1e9):5.2f} s/GB")
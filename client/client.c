@@ -115,6 +115,79 @@ static int read_line(int fd, char *buf, size_t max_len) {
     return (int)pos;
 }
 
+// Renews a LOCK's lease in the background while the user is editing, so
+// the lease can be short and an editor that crashed loses it quickly.
+typedef struct {
+    char ip[64];
+    int port;
+    char file[256];
+    unsigned long token;
+    int interval;            // Seconds between renewals
+    int stop;
+    pthread_mutex_t mutex;   // Protects stop
+    pthread_cond_t cond;     // Signalled to stop
+} LeaseKeepalive;
+
+static void* lease_keepalive_thread(void* arg) {
+    LeaseKeepalive* ka = (LeaseKeepalive*)arg;
+    pthread_mutex_lock(&ka->mutex);
+    while (!ka->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ka->interval;
+        while (!ka->stop && pthread_cond_timedwait(&ka->cond, &ka->mutex, &deadline) == 0);
+        if (ka->stop) break;
+        pthread_mutex_unlock(&ka->mutex);
+
+        // A failed connection is retried next time round; an error reply
+        // means the lock is gone and COMMIT will say so
+        int lost = 0;
+        int sock = connect_to_server_timeout(ka->ip, ka->port, 2);
+        if (sock >= 0) {
+            struct timeval tv = {2, 0};
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            char msg[BUFFER_SIZE];
+            snprintf(msg, sizeof(msg), "RENEW %s %lu\n", ka->file, ka->token);
+            if (write(sock, msg, strlen(msg)) > 0 && read_line(sock, msg, sizeof(msg)) > 0) {
+                lost = strncmp(msg, "ERR_", 4) == 0;
+            }
+            close(sock);
+        }
+
+        pthread_mutex_lock(&ka->mutex);
+        if (lost) break;
+    }
+    pthread_mutex_unlock(&ka->mutex);
+    return NULL;
+}
+
+// Starts renewing a lease every third of `lease` seconds. Returns 1 if the
+// thread is running; either way stop_lease_keepalive must be called.
+static int start_lease_keepalive(LeaseKeepalive* ka, pthread_t* tid, const char* ss_ip, int ss_port,
+                                 const char* file, unsigned long token, int lease) {
+    memset(ka, 0, sizeof(*ka));
+    strncpy(ka->ip, ss_ip, sizeof(ka->ip) - 1);
+    ka->port = ss_port;
+    strncpy(ka->file, file, sizeof(ka->file) - 1);
+    ka->token = token;
+    ka->interval = lease > 3 ? lease / 3 : 1;
+    pthread_mutex_init(&ka->mutex, NULL);
+    pthread_cond_init(&ka->cond, NULL);
+    return pthread_create(tid, NULL, lease_keepalive_thread, ka) == 0;
+}
+
+static void stop_lease_keepalive(LeaseKeepalive* ka, pthread_t tid, int running) {
+    if (running) {
+        pthread_mutex_lock(&ka->mutex);
+        ka->stop = 1;
+        pthread_cond_signal(&ka->cond);
+        pthread_mutex_unlock(&ka->mutex);
+        pthread_join(tid, NULL);
+    }
+    pthread_cond_destroy(&ka->cond);
+    pthread_mutex_destroy(&ka->mutex);
+}
+
 // --- Helper Functions for Pretty Output ---
 void print_separator(int width) {
     for (int i = 0; i < width; i++) printf("%s", HORIZONTAL);
@@ -194,7 +267,7 @@ void print_man_page(const char* cmd) {
     // Match command and print detailed manual
     if (strcasecmp(cmd, "CREATE") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
-        print_box_line("  CREATE <filename>", width, RESET);
+        print_box_line("  CREATE <filename> [RF=n] [MODE=m] [W=n] [PREFER=ids]", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("DESCRIPTION", width, CYAN);
         print_box_line("  Creates a new empty file with the specified name.", width, RESET);
@@ -205,10 +278,19 @@ void print_man_page(const char* cmd) {
         print_box_line("  The file is stored on a storage server and tracked by", width, RESET);
         print_box_line("  the name server. After creation, use WRITE to add", width, RESET);
         print_box_line("  content or ADDACCESS to share with other users.", width, RESET);
+        print_box_line("  ", width, RESET);
+        print_box_line("  Optional replication policy (default: the folder's):", width, RESET);
+        width+=2;
+        print_box_line("  • RF=n: number of copies to keep", width, RESET);
+        print_box_line("  • MODE=ASYNC|SYNC|QUORUM|CHAIN: see SETDURABILITY", width, RESET);
+        print_box_line("  • W=n: copies to wait for with MODE=QUORUM", width, RESET);
+        print_box_line("  • PREFER=1,3: storage servers to place copies on", width, RESET);
+        width-=2;
         print_box_line("", width, RESET);
         print_box_line("EXAMPLES", width, CYAN);
         print_box_line("  CREATE myfile.txt", width, RESET);
         print_box_line("  CREATE document.doc", width, RESET);
+        print_box_line("  CREATE critical.txt RF=3 MODE=SYNC", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("SEE ALSO", width, CYAN);
         print_box_line("  DELETE, WRITE, ADDACCESS, INFO", width, RESET);
@@ -366,6 +448,10 @@ void print_man_page(const char* cmd) {
     else if (strcasecmp(cmd, "WRITE") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
         print_box_line("  WRITE <filename> <sentence_number>", width, RESET);
+        print_box_line("  WRITE <filename> <sentence_number> -o", width, RESET);
+        print_box_line("  WRITE <filename> <sentence_number> -w <seconds>", width, RESET);
+        print_box_line("  WRITE <filename> <first>-<last>", width, RESET);
+        print_box_line("  WRITE <filename> <n>,<n>,...", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("DESCRIPTION", width, CYAN);
         print_box_line("  Opens an interactive mode to edit a specific sentence", width, RESET);
@@ -376,6 +462,15 @@ void print_man_page(const char* cmd) {
         print_box_line("  The sentence is locked during editing to prevent", width, RESET);
         print_box_line("  concurrent modifications. Requires WRITE permission.", width, RESET);
         print_box_line("  ", width, RESET);
+        print_box_line("  -o edits optimistically without a lock. The save is", width, RESET);
+        print_box_line("  rejected if someone changed the sentence meanwhile.", width, RESET);
+        print_box_line("  ", width, RESET);
+        print_box_line("  -w waits up to <seconds> for a sentence someone else", width, RESET);
+        print_box_line("  is editing. Waiting editors get it in arrival order.", width, RESET);
+        print_box_line("  ", width, RESET);
+        print_box_line("  A range or list locks all of those sentences at once.", width, RESET);
+        print_box_line("  Each is edited in turn and they are saved together.", width, RESET);
+        print_box_line("  ", width, RESET);
         print_box_line("  Position 1 = first word, Position N+1 = append after", width, RESET);
         print_box_line("  last word. Content can include multiple words.", width, RESET);
         print_box_line("", width, RESET);
@@ -407,14 +502,16 @@ void print_man_page(const char* cmd) {
     }
     else if (strcasecmp(cmd, "UNDO") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
-        print_box_line("  UNDO <filename>", width, RESET);
+        print_box_line("  UNDO <filename> [steps]", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("DESCRIPTION", width, CYAN);
-        print_box_line("  Reverts the last WRITE operation on the file.", width, RESET);
+        print_box_line("  Reverts the last WRITE operation on the file, or the", width, RESET);
+        print_box_line("  last <steps> writes (up to 64).", width, RESET);
         print_box_line("  Requires WRITE permission.", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("EXAMPLE", width, CYAN);
         print_box_line("  UNDO myfile.txt", width, RESET);
+        print_box_line("  UNDO myfile.txt 3", width, RESET);
     }
     else if (strcasecmp(cmd, "CHECKPOINT") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
@@ -453,13 +550,20 @@ void print_man_page(const char* cmd) {
     }
     else if (strcasecmp(cmd, "LISTCHECKPOINTS") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
-        print_box_line("  LISTCHECKPOINTS <filename>", width, RESET);
+        print_box_line("  LISTCHECKPOINTS <filename> [offset] [count]", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("DESCRIPTION", width, CYAN);
-        print_box_line("  Lists all available checkpoint tags for a file.", width, RESET);
+        print_box_line("  Lists a file's checkpoints oldest first, with", width, RESET);
+        print_box_line("  when each was taken, its size and content hash.", width, RESET);
+        print_box_line("  Shows 20 from `offset` unless `count` says.", width, RESET);
+        print_box_line("  Ends with the retention rule, if one applies.", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("EXAMPLE", width, CYAN);
         print_box_line("  LISTCHECKPOINTS myfile.txt", width, RESET);
+        print_box_line("  LISTCHECKPOINTS myfile.txt 20 10", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("SEE ALSO", width, CYAN);
+        print_box_line("  SETRETENTION", width, RESET);
     }
     else if (strcasecmp(cmd, "REVERT") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
@@ -559,13 +663,16 @@ void print_man_page(const char* cmd) {
     }
     else if (strcasecmp(cmd, "CREATEFOLDER") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
-        print_box_line("  CREATEFOLDER <foldername>", width, RESET);
+        print_box_line("  CREATEFOLDER <foldername> [RF=n] [MODE=m] [W=n] [PREFER=ids]", width, RESET);
         print_box_line("", width, RESET);
         print_box_line("DESCRIPTION", width, CYAN);
         print_box_line("  Creates a new folder for organizing files.", width, RESET);
+        print_box_line("  A replication policy given here (see CREATE) applies", width, RESET);
+        print_box_line("  to every file created inside the folder.", width, RESET);
         print_box_line("", width, RESET);
-        print_box_line("EXAMPLE", width, CYAN);
+        print_box_line("EXAMPLES", width, CYAN);
         print_box_line("  CREATEFOLDER documents", width, RESET);
+        print_box_line("  CREATEFOLDER scratch RF=1", width, RESET);
     }
     else if (strcasecmp(cmd, "MOVE") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
@@ -656,6 +763,63 @@ void print_man_page(const char* cmd) {
         print_box_line("EXAMPLE", width, CYAN);
         print_box_line("  DENY 3", width, RESET);
     }
+    else if (strcasecmp(cmd, "SETDURABILITY") == 0) {
+        print_box_line("SYNOPSIS", width, CYAN);
+        print_box_line("  SETDURABILITY <file|folder> <mode> [w]", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("DESCRIPTION", width, CYAN);
+        print_box_line("  Chooses when a WRITE is acknowledged. Only the owner", width, RESET);
+        print_box_line("  can change it.", width, RESET);
+        print_box_line("  ", width, RESET);
+        width+=2;
+        print_box_line("  • ASYNC: ack at once, replicate in the background", width, RESET);
+        print_box_line("  • QUORUM w: ack once w copies (primary included)", width, RESET);
+        print_box_line("    have applied the write", width, RESET);
+        print_box_line("  • SYNC: QUORUM over every copy", width, RESET);
+        print_box_line("  • CHAIN: primary forwards to each replica in", width, RESET);
+        print_box_line("    turn; ack once the last one has it", width, RESET);
+        print_box_line("  • INHERIT: use the enclosing folder's mode", width, RESET);
+        width-=2;
+        print_box_line("  ", width, RESET);
+        print_box_line("  Files inherit their folder's mode unless set. If the", width, RESET);
+        print_box_line("  quorum cannot be reached the write stays on the", width, RESET);
+        print_box_line("  primary and ERR_QUORUM_NOT_MET is returned.", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("EXAMPLES", width, CYAN);
+        print_box_line("  SETDURABILITY report.txt QUORUM 2", width, RESET);
+        print_box_line("  SETDURABILITY scratch ASYNC", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("SEE ALSO", width, CYAN);
+        print_box_line("  WRITE, CREATEFOLDER", width, RESET);
+    }
+    else if (strcasecmp(cmd, "SETRETENTION") == 0) {
+        print_box_line("SYNOPSIS", width, CYAN);
+        print_box_line("  SETRETENTION <file|folder> <rule>", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("DESCRIPTION", width, CYAN);
+        print_box_line("  Limits which checkpoints are kept. Only the owner", width, RESET);
+        print_box_line("  can change it. A checkpoint stays if any part of", width, RESET);
+        print_box_line("  the rule keeps it:", width, RESET);
+        print_box_line("  ", width, RESET);
+        width+=2;
+        print_box_line("  • KEEP=n: the n newest", width, RESET);
+        print_box_line("  • HOURLY=n: the newest of each of the last n hours", width, RESET);
+        print_box_line("  • DAILY=n: the newest of each of the last n days", width, RESET);
+        print_box_line("  • ALL: every checkpoint", width, RESET);
+        print_box_line("  • INHERIT: use the enclosing folder's rule", width, RESET);
+        width-=2;
+        print_box_line("  ", width, RESET);
+        print_box_line("  Files follow their folder's rule unless set; with", width, RESET);
+        print_box_line("  none, every checkpoint is kept. The rest are deleted", width, RESET);
+        print_box_line("  in the background within a minute or so.", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("EXAMPLES", width, CYAN);
+        print_box_line("  SETRETENTION notes.txt KEEP=10", width, RESET);
+        print_box_line("  SETRETENTION reports HOURLY=24 DAILY=30", width, RESET);
+        print_box_line("", width, RESET);
+        print_box_line("SEE ALSO", width, CYAN);
+        print_box_line("  CHECKPOINT, LISTCHECKPOINTS", width, RESET);
+    }
     else if (strcasecmp(cmd, "help") == 0) {
         print_box_line("SYNOPSIS", width, CYAN);
         print_box_line("  help", width, RESET);
@@ -721,10 +885,10 @@ void print_help() {
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "READ <filename>", RESET, VERTICAL, "Read file contents", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "WRITE <file> <sentence#>", RESET, VERTICAL, "Edit a sentence in file", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "STREAM <filename>", RESET, VERTICAL, "Stream file word-by-word", VERTICAL, RESET);
-    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "UNDO <filename>", RESET, VERTICAL, "Undo last write", VERTICAL, RESET);
+    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "UNDO <filename> [steps]", RESET, VERTICAL, "Undo last write(s)", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "CHECKPOINT <file> <tag>", RESET, VERTICAL, "Save a named checkpoint", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "VIEWCHECKPOINT <f> <tag>", RESET, VERTICAL, "View a checkpoint content", VERTICAL, RESET);
-    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "LISTCHECKPOINTS <file>", RESET, VERTICAL, "List checkpoint tags", VERTICAL, RESET);
+    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "LISTCHECKPOINTS <file>", RESET, VERTICAL, "List checkpoints by time", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "REVERT <file> <tag>", RESET, VERTICAL, "Revert to a checkpoint", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "VIEWTRASH", RESET, VERTICAL, "List files in trash", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, GREEN, "RESTORE <filename>", RESET, VERTICAL, "Restore file from trash", VERTICAL, RESET);
@@ -757,6 +921,8 @@ void print_help() {
     
     // Other
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "EXEC <filename>", RESET, VERTICAL, "Execute shell script", VERTICAL, RESET);
+    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "SETDURABILITY <f> <mode>", RESET, VERTICAL, "Async or quorum-acked writes", VERTICAL, RESET);
+    printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "SETRETENTION <f> <rule>", RESET, VERTICAL, "Which checkpoints to keep", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "help", RESET, VERTICAL, "Show this help", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "man <COMMAND>", RESET, VERTICAL, "Manual for a command", VERTICAL, RESET);
     printf("%s%s%s %s%-26s%s %s %-32s %s%s\n", CYAN, BOLD, VERTICAL, BLUE, "REQACCESS -R|-W <file>", RESET, VERTICAL, "Request access to a file", VERTICAL, RESET);
@@ -1266,7 +1432,35 @@ void print_file_content(const char* content, const char* filename) {
 void handle_ss_connection(const char* ss_ip, int ss_port, const char* full_command) {
     int ss_sock = connect_to_server(ss_ip, ss_port);
     
-    // 1. Send the original command to the SS
+    // 1. Send the original command to the SS. WRITE is done in two phases:
+    // LOCK now, COMMIT on a fresh connection once the user has finished editing.
+    // With -o the edit is optimistic instead: PEEK takes no lock and CAS only
+    // applies if nobody changed the sentence in the meantime. With -w <secs>
+    // a sentence someone else is editing is queued for instead of refused.
+    // A range ("2-4") or list ("1,3") of sentences is locked with LOCKSET
+    // and committed together.
+    char write_file[256] = "";
+    int write_sentence = 0;
+    char write_flag[16] = "";
+    int wait_seconds = 0;
+    char lock_command[BUFFER_SIZE];
+    if (strncmp(full_command, "WRITE", 5) == 0) {
+        char write_target[64] = "";
+        sscanf(full_command, "WRITE %255s %63s %15s %d", write_file, write_target, write_flag, &wait_seconds);
+        write_sentence = atoi(write_target);
+        if (strpbrk(write_target, "-,") != NULL) {
+            // A range or list of sentences is edited as one transaction
+            snprintf(lock_command, sizeof(lock_command), "LOCKSET %s %s\n", write_file, write_target);
+        } else if (strcmp(write_flag, "-o") == 0) {
+            snprintf(lock_command, sizeof(lock_command), "PEEK %s %d\n", write_file, write_sentence);
+        } else if (strcmp(write_flag, "-w") == 0 && wait_seconds > 0) {
+            snprintf(lock_command, sizeof(lock_command), "LOCK %s %d %d\n", write_file, write_sentence, wait_seconds);
+            printf("%sWaiting up to %d seconds for the sentence...%s\n", YELLOW, wait_seconds, RESET);
+        } else {
+            snprintf(lock_command, sizeof(lock_command), "LOCK %s %d\n", write_file, write_sentence);
+        }
+        full_command = lock_command;
+    }
     if (write(ss_sock, full_command, strlen(full_command)) < 0) {
         die("ERROR writing to SS");
     }
@@ -1309,14 +1503,101 @@ void handle_ss_connection(const char* ss_ip, int ss_port, const char* full_comma
         printf("\n%s%s--- END OF STREAM ---%s\n\n", YELLOW, BOLD, RESET);
     }
     
+    // --- Multi-sentence WRITE Logic ---
+    // Every sentence of the set is edited in turn and the whole batch is
+    // committed at once, or nothing is if the user cancels part way.
+    else if (strncmp(full_command, "LOCKSET", 7) == 0) {
+        char ack_line[BUFFER_SIZE];
+        if (read_line(ss_sock, ack_line, sizeof(ack_line)) <= 0) {
+            die("ERROR reading from SS");
+        }
+        
+        unsigned long token;
+        int lease, count;
+        if (sscanf(ack_line, "ACK_LOCKSET %lu %d %d", &token, &lease, &count) != 3 ||
+            count < 1 || count > MAX_TRANSACTION_SENTENCES) {
+            printf("%s[ERROR]%s %s\n", RED, RESET, ack_line);
+            close(ss_sock);
+            return;
+        }
+        
+        int sentence_nums[MAX_TRANSACTION_SENTENCES];
+        char (*texts)[2048] = calloc(count, sizeof(*texts));
+        for (int i = 0; i < count; i++) {
+            char sentence_line[2100];
+            int offset = 0;
+            if (read_line(ss_sock, sentence_line, sizeof(sentence_line)) < 0 ||
+                sscanf(sentence_line, "%d %n", &sentence_nums[i], &offset) != 1) {
+                sentence_nums[i] = 0;
+            }
+            snprintf(texts[i], sizeof(texts[i]), "%s", sentence_line + offset);
+        }
+        close(ss_sock);
+        
+        LeaseKeepalive ka;
+        pthread_t ka_tid;
+        int ka_running = start_lease_keepalive(&ka, &ka_tid, ss_ip, ss_port, write_file, token, lease);
+        
+        printf("%s%d sentences locked. Ctrl-D on an empty line cancels them all.%s\n", YELLOW, count, RESET);
+        int cancelled = 0;
+        for (int i = 0; i < count && !cancelled; i++) {
+            strncpy(prefill_buffer, texts[i], sizeof(prefill_buffer) - 1);
+            prefill_buffer[sizeof(prefill_buffer) - 1] = '\0';
+            char prompt[64];
+            snprintf(prompt, sizeof(prompt), "WRITE [%d] > ", sentence_nums[i]);
+            char *line = readline_with_prefill(prompt);
+            if (line == NULL) {
+                cancelled = 1;
+            } else {
+                if (line[0] != '\0') snprintf(texts[i], sizeof(texts[i]), "%s", line);
+                free(line);
+            }
+        }
+        stop_lease_keepalive(&ka, ka_tid, ka_running);
+        
+        ss_sock = connect_to_server(ss_ip, ss_port);
+        if (cancelled) {
+            char outbuf[512];
+            snprintf(outbuf, sizeof(outbuf), "UNLOCK %s %lu\n", write_file, token);
+            write(ss_sock, outbuf, strlen(outbuf));
+            read_line(ss_sock, ack_line, sizeof(ack_line));
+            printf("%s[INFO]%s Edit cancelled.\n", YELLOW, RESET);
+            close(ss_sock);
+            free(texts);
+            return;
+        }
+        
+        // COMMIT <file> <token> <count>, then one line per sentence
+        snprintf(buffer, sizeof(buffer), "COMMIT %s %lu %d\n", write_file, token, count);
+        int ok = write(ss_sock, buffer, strlen(buffer)) >= 0;
+        for (int i = 0; ok && i < count; i++) {
+            ok = write(ss_sock, texts[i], strlen(texts[i])) >= 0 && write(ss_sock, "\n", 1) >= 0;
+        }
+        free(texts);
+        if (!ok) {
+            die("ERROR writing to SS during write");
+        }
+        
+        bzero(buffer, BUFFER_SIZE);
+        read(ss_sock, buffer, BUFFER_SIZE);
+        
+        if (strncmp(buffer, "ACK_WRITE_SUCCESS", 17) == 0) {
+            printf("%s[SUCCESS]%s File saved successfully!\n", GREEN, RESET);
+        } else {
+            printf("%s[ERROR]%s %s\n", RED, RESET, buffer);
+        }
+    }
+    
     // --- WRITE Logic ---
-    else if (strncmp(full_command, "WRITE", 5) == 0) {
+    else if (strncmp(full_command, "LOCK", 4) == 0) {
         char ack_line[BUFFER_SIZE];
         if (read_line(ss_sock, ack_line, sizeof(ack_line)) <= 0) {
             die("ERROR reading from SS");
         }
         
-        if (strcmp(ack_line, "ACK_WRITE_LOCKED") != 0) {
+        unsigned long token;
+        int lease;
+        if (sscanf(ack_line, "ACK_LOCK %lu %d", &token, &lease) != 2) {
             printf("%s[ERROR]%s %s\n", RED, RESET, ack_line);
             close(ss_sock);
             return;
@@ -1326,14 +1607,29 @@ void handle_ss_connection(const char* ss_ip, int ss_port, const char* full_comma
         if (read_line(ss_sock, sentence_line, sizeof(sentence_line)) < 0) {
             sentence_line[0] = '\0';
         }
+        // The SS does not hold a connection open while we edit
+        close(ss_sock);
         
         strncpy(prefill_buffer, sentence_line, sizeof(prefill_buffer) - 1);
         prefill_buffer[sizeof(prefill_buffer) - 1] = '\0';
         
+        LeaseKeepalive ka;
+        pthread_t ka_tid;
+        int ka_running = start_lease_keepalive(&ka, &ka_tid, ss_ip, ss_port, write_file, token, lease);
+
+        printf("%sSentence locked. Ctrl-D on an empty line cancels.%s\n", YELLOW, RESET);
         char *line = readline_with_prefill("WRITE > ");
+        stop_lease_keepalive(&ka, ka_tid, ka_running);
         
+        char outbuf[2400];
+        ss_sock = connect_to_server(ss_ip, ss_port);
         if (line == NULL) {
-            line = strdup("");
+            snprintf(outbuf, sizeof(outbuf), "UNLOCK %s %lu\n", write_file, token);
+            write(ss_sock, outbuf, strlen(outbuf));
+            read_line(ss_sock, ack_line, sizeof(ack_line));
+            printf("%s[INFO]%s Edit cancelled.\n", YELLOW, RESET);
+            close(ss_sock);
+            return;
         }
 
         if (line[0] == '\0' && prefill_buffer[0] != '\0') {
@@ -1341,8 +1637,7 @@ void handle_ss_connection(const char* ss_ip, int ss_port, const char* full_comma
             line = strdup(prefill_buffer);
         }
         
-        char outbuf[2050];
-        snprintf(outbuf, sizeof(outbuf), "%s\n", line);
+        snprintf(outbuf, sizeof(outbuf), "COMMIT %s %lu\n%s\n", write_file, token, line);
         if (write(ss_sock, outbuf, strlen(outbuf)) < 0) {
             free(line);
             die("ERROR writing to SS during write");
@@ -1359,6 +1654,62 @@ void handle_ss_connection(const char* ss_ip, int ss_port, const char* full_comma
         }
     }
     
+    // --- Optimistic WRITE Logic ---
+    else if (strncmp(full_command, "PEEK", 4) == 0) {
+        char ack_line[BUFFER_SIZE];
+        if (read_line(ss_sock, ack_line, sizeof(ack_line)) <= 0) {
+            die("ERROR reading from SS");
+        }
+        
+        unsigned long version;
+        if (sscanf(ack_line, "ACK_PEEK %lu", &version) != 1) {
+            printf("%s[ERROR]%s %s\n", RED, RESET, ack_line);
+            close(ss_sock);
+            return;
+        }
+        
+        char sentence_line[2048];
+        if (read_line(ss_sock, sentence_line, sizeof(sentence_line)) < 0) {
+            sentence_line[0] = '\0';
+        }
+        close(ss_sock);
+        
+        strncpy(prefill_buffer, sentence_line, sizeof(prefill_buffer) - 1);
+        prefill_buffer[sizeof(prefill_buffer) - 1] = '\0';
+        
+        char *line = readline_with_prefill("WRITE (optimistic) > ");
+        if (line == NULL) {
+            printf("%s[INFO]%s Edit cancelled.\n", YELLOW, RESET);
+            return;
+        }
+        if (line[0] == '\0' && prefill_buffer[0] != '\0') {
+            free(line);
+            line = strdup(prefill_buffer);
+        }
+        
+        ss_sock = connect_to_server(ss_ip, ss_port);
+        char outbuf[2400];
+        snprintf(outbuf, sizeof(outbuf), "CAS %s %d %lu\n%s\n", write_file, write_sentence, version, line);
+        if (write(ss_sock, outbuf, strlen(outbuf)) < 0) {
+            free(line);
+            die("ERROR writing to SS during write");
+        }
+        free(line);
+        
+        if (read_line(ss_sock, ack_line, sizeof(ack_line)) <= 0) {
+            die("ERROR reading from SS");
+        }
+        if (strcmp(ack_line, "ACK_WRITE_SUCCESS") == 0) {
+            printf("%s[SUCCESS]%s File saved successfully!\n", GREEN, RESET);
+        } else if (strncmp(ack_line, "ERR_VERSION_CONFLICT", 20) == 0) {
+            read_line(ss_sock, sentence_line, sizeof(sentence_line));
+            printf("%s[CONFLICT]%s Sentence was changed by someone else. It now reads:\n  %s\n",
+                   RED, RESET, sentence_line);
+        } else {
+            printf("%s[ERROR]%s %s\n", RED, RESET, ack_line);
+        }
+    }
+    
     // --- UNDO Logic ---
     else if (strncmp(full_command, "UNDO", 4) == 0) { 
         // Wait for the ACK from the SS
@@ -10,4 +10,15 @@
 #define FAILURE_TIMEOUT 15       // Seconds before marking SS as failed
 #define NM_HEARTBEAT_PORT 8081   // Port for heartbeat messages
 
+// Write Durability Configuration
+#define QUORUM_WAIT_TIMEOUT 8    // Seconds the NM waits for replica acks in quorum mode
+#define NM_NOTIFY_TIMEOUT 10     // Seconds an SS waits for the NM to confirm a write
+#define SS_FSYNC_POLICY "always" // Default SS fsync policy: always, batched[:<ms>] or never
+#define FSYNC_BATCH_MS 10        // How often the batched policy syncs pending writes
+
+// Sentence Lock Configuration
+#define WRITE_LEASE_SECONDS 20   // Seconds a LOCK token stays valid unless renewed; clients renew while editing
+#define MAX_LOCK_WAIT_SECONDS 600 // Longest a LOCK may queue for a sentence someone else holds
+#define MAX_TRANSACTION_SENTENCES 32 // Most sentences one LOCKSET/COMMIT may cover
+
 #endif
@@ -36,7 +36,7 @@ int create_server_socket(int port) {
         die("ERROR on binding");
     }
 
-    if (listen(listen_fd, 5) < 0) {
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         die("ERROR on listen");
     }
     
@@ -24,6 +24,14 @@
 #define CACHE_SIZE 1024
 #define CACHE_EXPIRY_SECONDS 300
 
+// --- Hot File Replication ---
+#define HOT_TABLE_SIZE 256
+#define HOT_SAMPLE_INTERVAL 5    // Seconds between read-rate samples
+#define HOT_READ_RATE 2.0        // Reads/sec at which a file gets an extra read replica
+#define HOT_COOL_RATE 0.5        // Reads/sec below which extra replicas are dropped
+#define MAX_HOT_REPLICAS 2       // Extra read replicas per file on top of REPLICATION_FACTOR
+#define HOT_REPLICA_FILE "persistent/nm_data/hot_replicas.dat" // Extra copies, so a restart can delete them
+
 // --- Logging Configuration ---
 #define NS_LOG_FILE "logs/name_server.log"
 
@@ -313,6 +321,45 @@ int select_replica_servers(const char* primary_ss_id, char** replica_ss_ids, int
     return replica_count;
 }
 
+// Picks up to `count` active SSs for a new file or folder: the preferred IDs
+// first, in the order given, then the rest round-robin. IDs are strdup'd into
+// `out_ids`; returns how many were found, which may be fewer than asked for.
+int select_servers_for_new_file(int count, const char* preferred, char** out_ids) {
+    static int next_ss_index = 0;
+    int chosen = 0;
+    if (count > MAX_SS) count = MAX_SS;
+
+    pthread_mutex_lock(&ss_list_mutex);
+    char list[MAX_PREFERRED_LEN];
+    snprintf(list, sizeof(list), "%s", preferred != NULL ? preferred : "");
+    char* saveptr = NULL;
+    for (char* id = strtok_r(list, ",", &saveptr); id != NULL && chosen < count; id = strtok_r(NULL, ",", &saveptr)) {
+        for (int i = 0; i < ss_count; i++) {
+            if (ss_list[i].is_active && strcmp(ss_list[i].id, id) == 0) {
+                int dup = 0;
+                for (int j = 0; j < chosen; j++) {
+                    if (strcmp(out_ids[j], id) == 0) dup = 1;
+                }
+                if (!dup) out_ids[chosen++] = strdup(id);
+                break;
+            }
+        }
+    }
+
+    for (int k = 0; k < ss_count && chosen < count; k++) {
+        int i = (next_ss_index + k) % ss_count;
+        if (!ss_list[i].is_active) continue;
+        int dup = 0;
+        for (int j = 0; j < chosen; j++) {
+            if (strcmp(out_ids[j], ss_list[i].id) == 0) dup = 1;
+        }
+        if (!dup) out_ids[chosen++] = strdup(ss_list[i].id);
+    }
+    if (ss_count > 0) next_ss_index = (next_ss_index + 1) % ss_count;
+    pthread_mutex_unlock(&ss_list_mutex);
+    return chosen;
+}
+
 // Structure for async replication thread
 typedef struct {
     char filename[MAX_FILENAME];
@@ -473,6 +520,935 @@ void* replicate_folder_async(void* arg) {
     return NULL;
 }
 
+// --- Write Replication (NM_FILE_MODIFIED) ---
+// The NM pulls the new content from the SS that committed the write once,
+// then pushes it to every other replica in parallel. In quorum mode the
+// notifying SS is only answered after enough replicas have applied it.
+// Each file is replicated by its own thread, one round at a time.
+typedef struct {
+    char filename[MAX_FILENAME];
+    char* content;
+    int content_len;
+    int durable;       // Ask replicas to fsync before acking
+    int pending;       // Pushes still in flight
+    int acked;         // Replicas that applied the update
+    int refs;          // Waiter + one per push thread
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+} ReplicationBatch;
+
+typedef struct {
+    ReplicationBatch* batch;
+    char ss_id[50];
+    char ss_ip[50];
+    int ss_nm_port;
+} ReplicaPush;
+
+static void release_replication_batch(ReplicationBatch* batch) {
+    pthread_mutex_lock(&batch->mutex);
+    int refs = --batch->refs;
+    pthread_mutex_unlock(&batch->mutex);
+    if (refs == 0) {
+        pthread_mutex_destroy(&batch->mutex);
+        pthread_cond_destroy(&batch->changed);
+        free(batch->content);
+        free(batch);
+    }
+}
+
+// Reads a whole file from an SS client port. Returns a malloc'd buffer
+// (caller frees) or NULL if the SS could not serve it.
+static char* fetch_file_from_ss(const char* ss_ip, int client_port, const char* filename, int* out_len) {
+    int sock = connect_to_server_timeout(ss_ip, client_port, 2);
+    if (sock < 0) return NULL;
+
+    char cmd[BUFFER_SIZE];
+    snprintf(cmd, sizeof(cmd), "READ %s\n", filename);
+    write(sock, cmd, strlen(cmd));
+
+    int cap = 8192, len = 0, n;
+    char* content = malloc(cap);
+    while (content != NULL && (n = read(sock, content + len, cap - len)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            char* grown = realloc(content, cap);
+            if (grown == NULL) { free(content); content = NULL; break; }
+            content = grown;
+        }
+    }
+    close(sock);
+
+    if (content == NULL) return NULL;
+    if (len >= 21 && strncmp(content, "ERR_SS_FILE_NOT_FOUND", 21) == 0) {
+        free(content);
+        return NULL;
+    }
+    *out_len = len;
+    return content;
+}
+
+// Overwrites `filename` on a replica with `content`. Returns 1 on ACK.
+static int push_content_to_ss(const char* ss_ip, int nm_port, const char* filename,
+                              const char* content, int content_len, int durable) {
+    int sock = connect_to_server_timeout(ss_ip, nm_port, 2);
+    if (sock < 0) return 0;
+
+    // A replica that stops reading must not hold up its file's later rounds
+    struct timeval send_tv = { QUORUM_WAIT_TIMEOUT, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_tv, sizeof(send_tv));
+
+    char header[BUFFER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "NM_WRITECONTENT %s %d%s\n",
+                              filename, content_len, durable ? " SYNC" : "");
+    int ok = (write(sock, header, header_len) == header_len);
+    int sent = 0;
+    while (ok && sent < content_len) {
+        int n = write(sock, content + sent, content_len - sent);
+        if (n <= 0) ok = 0;
+        else sent += n;
+    }
+
+    char ack[BUFFER_SIZE] = {0};
+    if (ok) {
+        struct timeval tv = { QUORUM_WAIT_TIMEOUT, 0 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ok = read(sock, ack, BUFFER_SIZE - 1) > 0 && strncmp(ack, "ACK_NM_WRITECONTENT", 19) == 0;
+    }
+    close(sock);
+    return ok;
+}
+
+void* replica_push_thread(void* arg) {
+    ReplicaPush* push = (ReplicaPush*)arg;
+    ReplicationBatch* batch = push->batch;
+
+    int ok = push_content_to_ss(push->ss_ip, push->ss_nm_port, batch->filename,
+                                batch->content, batch->content_len, batch->durable);
+    if (ok) {
+        log_message(NS_LOG_FILE, "SUCCESS", "Replicated %s (%d bytes) to SS %s",
+                    batch->filename, batch->content_len, push->ss_id);
+    } else {
+        log_message(NS_LOG_FILE, "ERROR", "Replication of %s to SS %s failed", batch->filename, push->ss_id);
+    }
+
+    pthread_mutex_lock(&batch->mutex);
+    batch->pending--;
+    if (ok) batch->acked++;
+    pthread_cond_broadcast(&batch->changed);
+    pthread_mutex_unlock(&batch->mutex);
+
+    release_replication_batch(batch);
+    free(push);
+    return NULL;
+}
+
+// An SS waiting on `sock` for its NM_FILE_MODIFIED verdict in quorum mode
+typedef struct QuorumWaiter {
+    int sock;
+    int needed;        // Replica acks needed besides the primary's copy
+    int write_quorum;
+    time_t deadline;   // Answered ERR_QUORUM_NOT_MET after this
+    struct QuorumWaiter* next;
+} QuorumWaiter;
+
+// Replication of one file. Rounds run one at a time on the file's own
+// thread, each fetching the current content and waiting for all of its
+// pushes, so replicas see the file's versions in order. Modifications that
+// arrive during a round are folded into the next one.
+typedef struct ReplicationJob {
+    char filename[MAX_FILENAME];
+    char primary_ss_id[50];
+    int durable;             // Next round asks replicas to fsync
+    int again;               // Modified since the current round fetched it
+    QuorumWaiter* waiters;   // Answered by the next round
+    struct ReplicationJob* next;
+} ReplicationJob;
+
+static ReplicationJob* replication_jobs = NULL;
+static pthread_mutex_t replication_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void answer_quorum_waiter(QuorumWaiter* waiter, const char* filename, int acked) {
+    char reply[BUFFER_SIZE];
+    if (acked >= waiter->needed) {
+        snprintf(reply, sizeof(reply), "ACK_NM_FILE_MODIFIED QUORUM %d %d\n", acked + 1, waiter->write_quorum);
+    } else {
+        snprintf(reply, sizeof(reply), "ERR_QUORUM_NOT_MET %d %d\n", acked + 1, waiter->write_quorum);
+        log_message(NS_LOG_FILE, "WARNING", "Quorum not met for %s (%d of %d copies)",
+                    filename, acked + 1, waiter->write_quorum);
+    }
+    write(waiter->sock, reply, strlen(reply));
+    close(waiter->sock);
+    free(waiter);
+}
+
+// Fails the waiters queued for the job's next round whose deadline passed
+static void expire_queued_waiters(ReplicationJob* job) {
+    time_t now = time(NULL);
+    QuorumWaiter* expired = NULL;
+    pthread_mutex_lock(&replication_mutex);
+    QuorumWaiter** link = &job->waiters;
+    while (*link != NULL) {
+        QuorumWaiter* waiter = *link;
+        if (waiter->deadline <= now) {
+            *link = waiter->next;
+            waiter->next = expired;
+            expired = waiter;
+        } else {
+            link = &waiter->next;
+        }
+    }
+    pthread_mutex_unlock(&replication_mutex);
+
+    while (expired != NULL) {
+        QuorumWaiter* next = expired->next;
+        answer_quorum_waiter(expired, job->filename, 0);
+        expired = next;
+    }
+}
+
+// One round: pushes the primary's current content to every other copy in
+// parallel, answers `waiters` as their quorum is met or missed, and returns
+// once every push has finished.
+static void run_replication_round(ReplicationJob* job, const char* primary_ss_id, int durable,
+                                  QuorumWaiter* waiters) {
+    const char* filename = job->filename;
+
+    // Every copy other than the one that was modified is a push target
+    char* replica_ss_ids[MAX_SS];
+    int replica_count = 0;
+    pthread_mutex_lock(&file_trie_mutex);
+    FileNode* node = find_file(file_trie_root, filename);
+    for (int i = 0; node != NULL && i < node->ss_count && i < MAX_SS; i++) {
+        if (strcmp(node->ss_ids[i], primary_ss_id) != 0) {
+            replica_ss_ids[replica_count++] = strdup(node->ss_ids[i]);
+        }
+    }
+    pthread_mutex_unlock(&file_trie_mutex);
+
+    ReplicationBatch* batch = calloc(1, sizeof(ReplicationBatch));
+    snprintf(batch->filename, sizeof(batch->filename), "%s", filename);
+    batch->durable = durable;
+    batch->refs = 1;
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->changed, NULL);
+
+    StorageServer* primary_ss = get_ss_by_id(primary_ss_id);
+    if (replica_count > 0 && primary_ss != NULL) {
+        batch->content = fetch_file_from_ss(primary_ss->ip, primary_ss->client_port, filename, &batch->content_len);
+        if (batch->content == NULL) {
+            log_message(NS_LOG_FILE, "ERROR", "Could not read %s from SS %s", filename, primary_ss_id);
+        }
+    } else if (replica_count > 0) {
+        log_message(NS_LOG_FILE, "ERROR", "Primary SS %s not active", primary_ss_id);
+    }
+
+    // Fan the update out to all replicas at once
+    for (int i = 0; i < replica_count; i++) {
+        StorageServer* replica_ss = get_ss_by_id(replica_ss_ids[i]);
+        if (batch->content != NULL && replica_ss != NULL) {
+            ReplicaPush* push = malloc(sizeof(ReplicaPush));
+            push->batch = batch;
+            strncpy(push->ss_id, replica_ss->id, sizeof(push->ss_id));
+            strncpy(push->ss_ip, replica_ss->ip, sizeof(push->ss_ip));
+            push->ss_nm_port = replica_ss->nm_port;
+
+            pthread_mutex_lock(&batch->mutex);
+            batch->pending++;
+            batch->refs++;
+            pthread_mutex_unlock(&batch->mutex);
+
+            pthread_t push_tid;
+            if (pthread_create(&push_tid, NULL, replica_push_thread, push) != 0) {
+                pthread_mutex_lock(&batch->mutex);
+                batch->pending--;
+                batch->refs--;
+                pthread_mutex_unlock(&batch->mutex);
+                free(push);
+            } else {
+                pthread_detach(push_tid);
+            }
+        } else if (replica_ss == NULL) {
+            log_message(NS_LOG_FILE, "WARNING", "Replica SS %s not active, skipping", replica_ss_ids[i]);
+        }
+        free(replica_ss_ids[i]);
+    }
+
+    // Answer each waiter as soon as its verdict is known, and keep waiting
+    // for the remaining pushes so the next round cannot overtake them.
+    // Waiters queued for the next round are checked once a second.
+    pthread_mutex_lock(&batch->mutex);
+    while (1) {
+        QuorumWaiter* ready = NULL;
+        QuorumWaiter** link = &waiters;
+        time_t now = time(NULL);
+        while (*link != NULL) {
+            QuorumWaiter* waiter = *link;
+            if (batch->acked >= waiter->needed || batch->pending == 0 || waiter->deadline <= now) {
+                *link = waiter->next;
+                waiter->next = ready;
+                ready = waiter;
+            } else {
+                link = &waiter->next;
+            }
+        }
+        if (ready != NULL) {
+            int acked = batch->acked;
+            pthread_mutex_unlock(&batch->mutex);
+            while (ready != NULL) {
+                QuorumWaiter* next = ready->next;
+                answer_quorum_waiter(ready, filename, acked);
+                ready = next;
+            }
+            pthread_mutex_lock(&batch->mutex);
+            continue;
+        }
+        if (batch->pending == 0 && waiters == NULL) break;
+
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += 1;
+        if (pthread_cond_timedwait(&batch->changed, &batch->mutex, &wake) == ETIMEDOUT) {
+            pthread_mutex_unlock(&batch->mutex);
+            expire_queued_waiters(job);
+            pthread_mutex_lock(&batch->mutex);
+        }
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    release_replication_batch(batch);
+}
+
+void* replication_thread(void* arg) {
+    ReplicationJob* job = (ReplicationJob*)arg;
+    while (1) {
+        pthread_mutex_lock(&replication_mutex);
+        QuorumWaiter* waiters = job->waiters;
+        int durable = job->durable;
+        char primary_ss_id[50];
+        snprintf(primary_ss_id, sizeof(primary_ss_id), "%s", job->primary_ss_id);
+        job->waiters = NULL;
+        job->durable = 0;
+        job->again = 0;
+        pthread_mutex_unlock(&replication_mutex);
+
+        run_replication_round(job, primary_ss_id, durable, waiters);
+
+        pthread_mutex_lock(&replication_mutex);
+        if (!job->again) {
+            ReplicationJob** link = &replication_jobs;
+            while (*link != job) link = &(*link)->next;
+            *link = job->next;
+            pthread_mutex_unlock(&replication_mutex);
+            free(job);
+            return NULL;
+        }
+        pthread_mutex_unlock(&replication_mutex);
+    }
+}
+
+// Queues a replication round for `filename`, starting the file's
+// replication thread if it has none. `waiter` (may be NULL) is answered by
+// that round. Returns 0 if no round could be started.
+static int enqueue_replication(const char* filename, const char* primary_ss_id, int durable,
+                               QuorumWaiter* waiter) {
+    pthread_mutex_lock(&replication_mutex);
+    ReplicationJob* job = replication_jobs;
+    while (job != NULL && strcmp(job->filename, filename) != 0) job = job->next;
+    int started = (job != NULL);
+    if (job == NULL) {
+        job = calloc(1, sizeof(ReplicationJob));
+        if (job == NULL) {
+            pthread_mutex_unlock(&replication_mutex);
+            return 0;
+        }
+        snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    }
+    snprintf(job->primary_ss_id, sizeof(job->primary_ss_id), "%s", primary_ss_id);
+    job->durable |= durable;
+    job->again = 1;
+    if (waiter != NULL) {
+        waiter->next = job->waiters;
+        job->waiters = waiter;
+    }
+    if (!started) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, replication_thread, job) != 0) {
+            pthread_mutex_unlock(&replication_mutex);
+            free(job);
+            return 0;
+        }
+        pthread_detach(tid);
+        job->next = replication_jobs;
+        replication_jobs = job;
+    }
+    pthread_mutex_unlock(&replication_mutex);
+    return 1;
+}
+
+// Handles "NM_FILE_MODIFIED <file> <ss_id> <size> <words> <chars> <atime>" from
+// the SS that committed a write. Always answers the SS on `sock`:
+//   ACK_NM_FILE_MODIFIED ASYNC                  - replication continues in the background
+//   ACK_NM_FILE_MODIFIED QUORUM <copies> <w>    - w copies (primary included) applied it
+//   ERR_QUORUM_NOT_MET <copies> <w>             - write is on the primary but not durable
+//   ACK_NM_FILE_MODIFIED CHAIN <n> <ip:port>... - SS forwards the update itself along
+//                                                 the listed NM ports; the NM stays off
+//                                                 the data path
+// A quorum verdict is sent later by the file's replication thread, which
+// then owns `sock`. Returns 1 in that case, 0 if the caller should close it.
+int handle_file_modified(const char* buffer, int sock, int worker_id) {
+    char filename[MAX_FILENAME];
+    char modified_ss_id[50];
+    long file_size = 0;
+    long word_count = 0;
+    long char_count = 0;
+    long last_access = 0;
+    sscanf(buffer, "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld",
+           filename, modified_ss_id, &file_size, &word_count, &char_count, &last_access);
+    log_message(NS_LOG_FILE, "INFO", "Worker %d: Processing file modification for %s from SS %s (size: %ld, words: %ld)",
+               worker_id, filename, modified_ss_id, file_size, word_count);
+
+    pthread_mutex_lock(&file_trie_mutex);
+    FileNode *node = find_file(file_trie_root, filename);
+    if (node == NULL) {
+        pthread_mutex_unlock(&file_trie_mutex);
+        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - File %s not found in trie", worker_id, filename);
+        write(sock, "ERR_FILE_NOT_FOUND\n", 19);
+        return 0;
+    }
+
+    // Update file stats
+    node->size = file_size;
+    node->word_count = word_count;
+    node->char_count = char_count;
+    node->last_access = last_access;
+    node->last_modified = time(NULL);
+
+    ReplicationMode mode;
+    int write_quorum;
+    get_effective_repl_policy(file_trie_root, filename, &mode, &write_quorum);
+    if (mode == REPL_QUORUM && write_quorum <= 0) {
+        // SYNC: every persistent copy
+        write_quorum = node->ss_count - node->hot_replicas;
+    }
+    int has_replicas = (node->ss_count > 1);
+
+    if (mode == REPL_CHAIN) {
+        char* replica_ss_ids[MAX_SS];
+        int replica_count = 0;
+        for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
+            if (strcmp(node->ss_ids[i], modified_ss_id) != 0) {
+                replica_ss_ids[replica_count++] = strdup(node->ss_ids[i]);
+            }
+        }
+        pthread_mutex_unlock(&file_trie_mutex);
+
+        // Hand the SS the chain in replica order; dead replicas, and any that
+        // would not fit in the reply, are left out and catch up through the
+        // usual resync when they rejoin
+        char reply[BUFFER_SIZE];
+        int prefix_len = snprintf(reply, sizeof(reply), "ACK_NM_FILE_MODIFIED CHAIN %d", MAX_SS);
+        char hops[BUFFER_SIZE] = "";
+        int hops_len = 0;
+        int hop_count = 0;
+        for (int i = 0; i < replica_count; i++) {
+            StorageServer* replica_ss = get_ss_by_id(replica_ss_ids[i]);
+            if (replica_ss != NULL) {
+                char hop[100];
+                int hop_len = snprintf(hop, sizeof(hop), " %s:%d", replica_ss->ip, replica_ss->nm_port);
+                if (hop_len < (int)sizeof(hop) && prefix_len + hops_len + hop_len + 1 < (int)sizeof(reply)) {
+                    memcpy(hops + hops_len, hop, hop_len + 1);
+                    hops_len += hop_len;
+                    hop_count++;
+                } else {
+                    log_message(NS_LOG_FILE, "WARNING", "Worker %d: Replica SS %s does not fit in the chain reply, left out", worker_id, replica_ss_ids[i]);
+                }
+            } else {
+                log_message(NS_LOG_FILE, "WARNING", "Worker %d: Replica SS %s not active, left out of chain", worker_id, replica_ss_ids[i]);
+            }
+            free(replica_ss_ids[i]);
+        }
+        snprintf(reply, sizeof(reply), "ACK_NM_FILE_MODIFIED CHAIN %d%s\n", hop_count, hops);
+        write(sock, reply, strlen(reply));
+        log_message(NS_LOG_FILE, "INFO", "Worker %d: Chain for %s:%s", worker_id, filename, hop_count > 0 ? hops : " (primary only)");
+        return 0;
+    }
+    pthread_mutex_unlock(&file_trie_mutex);
+
+    int needed = (mode == REPL_QUORUM) ? write_quorum - 1 : 0;
+    QuorumWaiter* waiter = NULL;
+    if (needed > 0) {
+        waiter = malloc(sizeof(QuorumWaiter));
+        if (waiter != NULL) {
+            waiter->sock = sock;
+            waiter->needed = needed;
+            waiter->write_quorum = write_quorum;
+            waiter->deadline = time(NULL) + QUORUM_WAIT_TIMEOUT;
+            waiter->next = NULL;
+        }
+    }
+
+    int queued = 1;
+    if (has_replicas || waiter != NULL) {
+        queued = enqueue_replication(filename, modified_ss_id, mode == REPL_QUORUM, waiter);
+        if (!queued) {
+            log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Could not start replication of %s",
+                        worker_id, filename);
+        }
+    }
+
+    char reply[BUFFER_SIZE];
+    if (mode != REPL_QUORUM) {
+        write(sock, "ACK_NM_FILE_MODIFIED ASYNC\n", 27);
+    } else if (needed <= 0) {
+        snprintf(reply, sizeof(reply), "ACK_NM_FILE_MODIFIED QUORUM 1 %d\n", write_quorum);
+        write(sock, reply, strlen(reply));
+    } else if (waiter == NULL || !queued) {
+        snprintf(reply, sizeof(reply), "ERR_QUORUM_NOT_MET 1 %d\n", write_quorum);
+        write(sock, reply, strlen(reply));
+        free(waiter);
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+// --- Hot File Replication ---
+// READ/STREAM routing counts reads per file. Every HOT_SAMPLE_INTERVAL the
+// monitor turns the counts into a smoothed read rate, gives files above
+// HOT_READ_RATE an extra copy on the least-loaded SS and takes the extras
+// away again once the rate falls below HOT_COOL_RATE. Extras are appended
+// to the node's ss_ids, so writes, moves and deletes reach them like any
+// other replica; while a file has extras its reads rotate over every copy.
+typedef struct {
+    char filename[MAX_FILENAME];
+    int reads;              // Reads routed in the current sample window
+    double read_rate;       // Smoothed reads/sec
+    unsigned int next;      // Round-robin cursor over the file's copies
+    int extras;             // Mirrors FileNode.hot_replicas
+    char retiring_ss[50];   // SS whose extra copy is deleted on the next sweep
+    int valid;
+} HotFileEntry;
+
+HotFileEntry hot_files[HOT_TABLE_SIZE];
+pthread_mutex_t hot_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static HotFileEntry* hot_file_slot(const char* filename) {
+    unsigned int hash = 0;
+    for (const char* p = filename; *p; p++) {
+        hash = (hash * 31) + *p;
+    }
+    return &hot_files[hash % HOT_TABLE_SIZE];
+}
+
+// Counts one routed READ/STREAM. Returns 1 and a round-robin cursor if the
+// file currently has extra read replicas, 0 if reads should keep going to
+// the first active copy. A slot held by a file with extras is never taken
+// over; the colliding file simply isn't tracked until it frees up.
+int record_file_read(const char* filename, unsigned int* cursor) {
+    int spread = 0;
+    pthread_mutex_lock(&hot_files_mutex);
+    HotFileEntry* entry = hot_file_slot(filename);
+    if (!entry->valid || strcmp(entry->filename, filename) != 0) {
+        if (entry->valid && (entry->extras > 0 || entry->retiring_ss[0] != '\0')) {
+            pthread_mutex_unlock(&hot_files_mutex);
+            return 0;
+        }
+        memset(entry, 0, sizeof(HotFileEntry));
+        strncpy(entry->filename, filename, MAX_FILENAME - 1);
+        entry->valid = 1;
+    }
+    entry->reads++;
+    if (entry->extras > 0) {
+        spread = 1;
+        *cursor = entry->next++;
+    }
+    pthread_mutex_unlock(&hot_files_mutex);
+    return spread;
+}
+
+// Keeps hot-file tracking attached to a file across MOVE
+void rename_hot_file(const char* old_name, const char* new_name) {
+    pthread_mutex_lock(&hot_files_mutex);
+    HotFileEntry* old_entry = hot_file_slot(old_name);
+    if (old_entry->valid && strcmp(old_entry->filename, old_name) == 0) {
+        HotFileEntry moved = *old_entry;
+        old_entry->valid = 0;
+        HotFileEntry* new_entry = hot_file_slot(new_name);
+        if (!new_entry->valid || new_entry->extras == 0) {
+            *new_entry = moved;
+            strncpy(new_entry->filename, new_name, MAX_FILENAME - 1);
+        }
+    }
+    pthread_mutex_unlock(&hot_files_mutex);
+}
+
+// Extras are left out of the trie file, since read rates start from zero
+// again after a restart. So that their copies are not left on the SSs
+// untracked, HOT_REPLICA_FILE lists every extra ("<ss id> <file>" per
+// line). At startup the list is loaded, and once an SS registers, the
+// copies it holds that the loaded trie does not know are deleted.
+typedef struct {
+    char ss_id[50];
+    char filename[MAX_FILENAME];
+} StaleHotCopy;
+
+static StaleHotCopy* stale_hot_copies = NULL; // Extras from before the restart
+static int stale_hot_count = 0;
+static pthread_mutex_t hot_persist_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void write_hot_copies(FILE* fp, FileNode* node, char* path, size_t len) {
+    if (node->is_end_of_word && !node->is_folder) {
+        for (int i = node->ss_count - node->hot_replicas; i < node->ss_count; i++) {
+            if (i >= 0 && node->ss_ids[i] != NULL) fprintf(fp, "%s %s\n", node->ss_ids[i], path);
+        }
+    }
+    for (int c = 0; c < 128 && len + 1 < MAX_FILENAME; c++) {
+        if (node->children[c] == NULL) continue;
+        path[len] = (char)c;
+        path[len + 1] = '\0';
+        write_hot_copies(fp, node->children[c], path, len + 1);
+    }
+    path[len] = '\0';
+}
+
+// Rewrites HOT_REPLICA_FILE from the registered extras, those waiting to be
+// deleted, and those left from before a restart
+void persist_hot_replicas(void) {
+    pthread_mutex_lock(&hot_persist_mutex);
+    FILE* fp = fopen(HOT_REPLICA_FILE ".tmp", "w");
+    if (fp == NULL) {
+        pthread_mutex_unlock(&hot_persist_mutex);
+        log_message(NS_LOG_FILE, "WARNING", "Could not write %s", HOT_REPLICA_FILE);
+        return;
+    }
+    char path[MAX_FILENAME] = "";
+    pthread_mutex_lock(&file_trie_mutex);
+    if (file_trie_root != NULL) write_hot_copies(fp, file_trie_root, path, 0);
+    pthread_mutex_unlock(&file_trie_mutex);
+    pthread_mutex_lock(&hot_files_mutex);
+    for (int i = 0; i < HOT_TABLE_SIZE; i++) {
+        if (hot_files[i].valid && hot_files[i].retiring_ss[0] != '\0') {
+            fprintf(fp, "%s %s\n", hot_files[i].retiring_ss, hot_files[i].filename);
+        }
+    }
+    pthread_mutex_unlock(&hot_files_mutex);
+    for (int i = 0; i < stale_hot_count; i++) {
+        fprintf(fp, "%s %s\n", stale_hot_copies[i].ss_id, stale_hot_copies[i].filename);
+    }
+    if (fclose(fp) == 0) rename(HOT_REPLICA_FILE ".tmp", HOT_REPLICA_FILE);
+    pthread_mutex_unlock(&hot_persist_mutex);
+}
+
+// Reads the extras the previous run left; call before any SS registers
+void load_hot_replicas(void) {
+    FILE* fp = fopen(HOT_REPLICA_FILE, "r");
+    if (fp == NULL) return;
+    char line[BUFFER_SIZE];
+    StaleHotCopy copy;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%49s %255s", copy.ss_id, copy.filename) != 2) continue;
+        StaleHotCopy* grown = realloc(stale_hot_copies, (stale_hot_count + 1) * sizeof(StaleHotCopy));
+        if (grown == NULL) break;
+        stale_hot_copies = grown;
+        stale_hot_copies[stale_hot_count++] = copy;
+    }
+    fclose(fp);
+    if (stale_hot_count > 0) {
+        log_message(NS_LOG_FILE, "INFO", "%d hot file copies from before the restart to remove", stale_hot_count);
+    }
+}
+
+// Deletes the extras an SS held before the restart, unless the trie lists
+// that SS for the file. Copies that could not be deleted are tried again
+// the next time the SS registers.
+void* remove_stale_hot_copies(void* arg) {
+    char* ss_id = (char*)arg;
+    sleep(2); // Give SS time to fully initialize
+
+    pthread_mutex_lock(&hot_persist_mutex);
+    int count = 0;
+    StaleHotCopy* mine = malloc((stale_hot_count + 1) * sizeof(StaleHotCopy));
+    for (int i = 0; mine != NULL && i < stale_hot_count; i++) {
+        if (strcmp(stale_hot_copies[i].ss_id, ss_id) == 0) mine[count++] = stale_hot_copies[i];
+    }
+    pthread_mutex_unlock(&hot_persist_mutex);
+
+    StorageServer* ss = get_ss_by_id(ss_id);
+    int* done = calloc(count + 1, sizeof(int));
+    for (int i = 0; ss != NULL && done != NULL && i < count; i++) {
+        pthread_mutex_lock(&file_trie_mutex);
+        FileNode* node = find_file_any_status(file_trie_root, mine[i].filename);
+        int tracked = 0;
+        for (int j = 0; node != NULL && j < node->ss_count; j++) {
+            if (node->ss_ids[j] != NULL && strcmp(node->ss_ids[j], ss_id) == 0) tracked = 1;
+        }
+        pthread_mutex_unlock(&file_trie_mutex);
+        if (tracked) {
+            done[i] = 1;
+            continue;
+        }
+
+        // A copy that is already gone answers ERR_NM_DELETE, which is fine too
+        int ss_sock = connect_to_server_timeout(ss->ip, ss->nm_port, 2);
+        if (ss_sock < 0) continue;
+        char cmd[BUFFER_SIZE];
+        snprintf(cmd, sizeof(cmd), "NM_DELETE %s\n", mine[i].filename);
+        write(ss_sock, cmd, strlen(cmd));
+        char reply[BUFFER_SIZE] = {0};
+        int n = read(ss_sock, reply, BUFFER_SIZE - 1);
+        close(ss_sock);
+        done[i] = (n > 0 && (strncmp(reply, "ACK_NM_DELETE", 13) == 0 || strncmp(reply, "ERR_NM_DELETE", 13) == 0));
+        if (done[i]) {
+            log_message(NS_LOG_FILE, "INFO", "Removed hot file copy of %s left on SS %s by the previous run",
+                        mine[i].filename, ss_id);
+        }
+    }
+
+    pthread_mutex_lock(&hot_persist_mutex);
+    for (int i = 0; done != NULL && i < count; i++) {
+        if (!done[i]) continue;
+        for (int k = 0; k < stale_hot_count; k++) {
+            if (strcmp(stale_hot_copies[k].ss_id, ss_id) == 0 &&
+                strcmp(stale_hot_copies[k].filename, mine[i].filename) == 0) {
+                stale_hot_copies[k] = stale_hot_copies[--stale_hot_count];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&hot_persist_mutex);
+    free(done);
+    free(mine);
+    free(ss_id);
+    persist_hot_replicas();
+    return NULL;
+}
+
+// Starts removing an SS's stale extras, if the previous run left any
+static void start_stale_hot_cleanup(const char* ss_id) {
+    int any = 0;
+    pthread_mutex_lock(&hot_persist_mutex);
+    for (int i = 0; i < stale_hot_count && !any; i++) {
+        any = (strcmp(stale_hot_copies[i].ss_id, ss_id) == 0);
+    }
+    pthread_mutex_unlock(&hot_persist_mutex);
+    if (!any) return;
+    char* ss_id_copy = strdup(ss_id);
+    pthread_t cleanup_tid;
+    if (ss_id_copy != NULL && pthread_create(&cleanup_tid, NULL, remove_stale_hot_copies, ss_id_copy) == 0) {
+        pthread_detach(cleanup_tid);
+    } else {
+        free(ss_id_copy);
+    }
+}
+
+void note_ss_read(const char* ss_id) {
+    pthread_mutex_lock(&ss_list_mutex);
+    for (int i = 0; i < ss_count; i++) {
+        if (strcmp(ss_list[i].id, ss_id) == 0) {
+            ss_list[i].read_load++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ss_list_mutex);
+}
+
+// Sends a one-line NM command to an SS and returns 1 if the reply starts with `ack`
+static int send_ss_nm_command(const char* ss_ip, int nm_port, const char* cmd, const char* ack) {
+    int sock = connect_to_server_timeout(ss_ip, nm_port, 2);
+    if (sock < 0) return 0;
+    write(sock, cmd, strlen(cmd));
+    char reply[BUFFER_SIZE] = {0};
+    int n = read(sock, reply, BUFFER_SIZE - 1);
+    close(sock);
+    return n > 0 && strncmp(reply, ack, strlen(ack)) == 0;
+}
+
+// Copies `filename` to the least-loaded active SS that doesn't hold it yet
+// and registers that SS as an extra read replica. Returns 1 on success.
+static int add_hot_replica(const char* filename, const int* loads) {
+    pthread_mutex_lock(&file_trie_mutex);
+    FileNode* node = find_file(file_trie_root, filename);
+    if (node == NULL || node->is_folder || node->ss_count >= MAX_SS) {
+        pthread_mutex_unlock(&file_trie_mutex);
+        return 0;
+    }
+    int holder_count = node->ss_count;
+    char* holders[MAX_SS];
+    for (int i = 0; i < holder_count; i++) {
+        holders[i] = strdup(node->ss_ids[i]);
+    }
+    time_t modified_before = node->last_modified;
+    pthread_mutex_unlock(&file_trie_mutex);
+
+    // Pick the target by last window's routed reads, and any live holder as source
+    StorageServer target = {0}, source = {0};
+    int best_load = -1;
+    pthread_mutex_lock(&ss_list_mutex);
+    for (int i = 0; i < ss_count; i++) {
+        if (!ss_list[i].is_active) continue;
+        int holds = 0;
+        for (int j = 0; j < holder_count; j++) {
+            if (strcmp(ss_list[i].id, holders[j]) == 0) holds = 1;
+        }
+        if (holds && source.id[0] == '\0') {
+            source = ss_list[i];
+        } else if (!holds && (best_load < 0 || loads[i] < best_load)) {
+            target = ss_list[i];
+            best_load = loads[i];
+        }
+    }
+    pthread_mutex_unlock(&ss_list_mutex);
+    for (int i = 0; i < holder_count; i++) free(holders[i]);
+
+    if (best_load < 0 || source.id[0] == '\0') return 0;
+
+    int content_len = 0;
+    char* content = fetch_file_from_ss(source.ip, source.client_port, filename, &content_len);
+    if (content == NULL) return 0;
+
+    int ok = push_content_to_ss(target.ip, target.nm_port, filename, content, content_len, 0);
+    free(content);
+    if (!ok) return 0;
+
+    int registered = 0, raced = 0;
+    pthread_mutex_lock(&file_trie_mutex);
+    node = find_file(file_trie_root, filename);
+    if (node != NULL && node->ss_count < MAX_SS) {
+        node->ss_ids[node->ss_count++] = strdup(target.id);
+        node->hot_replicas++;
+        registered = 1;
+        raced = (node->last_modified != modified_before);
+    }
+    pthread_mutex_unlock(&file_trie_mutex);
+
+    if (!registered) {
+        char cmd[BUFFER_SIZE];
+        if (snprintf(cmd, sizeof(cmd), "NM_DELETE %s\n", filename) < (int)sizeof(cmd)) {
+            send_ss_nm_command(target.ip, target.nm_port, cmd, "ACK_NM_DELETE");
+        }
+        return 0;
+    }
+
+    // A write that landed while we were copying was not pushed to the new copy
+    if (raced) {
+        content = fetch_file_from_ss(source.ip, source.client_port, filename, &content_len);
+        if (content != NULL) {
+            push_content_to_ss(target.ip, target.nm_port, filename, content, content_len, 0);
+            free(content);
+        }
+    }
+
+    log_message(NS_LOG_FILE, "SUCCESS", "Hot file %s: added read replica on SS %s", filename, target.id);
+    return 1;
+}
+
+// Unregisters the newest extra replica of `filename`. The copy itself is
+// deleted on the next sweep so reads already routed there can finish.
+// Writes the SS id into `retired` and returns 1 if one was dropped.
+static int drop_hot_replica(const char* filename, char* retired) {
+    int dropped = 0;
+    pthread_mutex_lock(&file_trie_mutex);
+    FileNode* node = find_file_any_status(file_trie_root, filename);
+    if (node != NULL && node->hot_replicas > 0) {
+        node->ss_count--;
+        node->hot_replicas--;
+        strncpy(retired, node->ss_ids[node->ss_count], 49);
+        free(node->ss_ids[node->ss_count]);
+        node->ss_ids[node->ss_count] = NULL;
+        dropped = 1;
+    }
+    pthread_mutex_unlock(&file_trie_mutex);
+    if (dropped) {
+        invalidate_cache_entry(filename);
+        log_message(NS_LOG_FILE, "INFO", "Hot file %s cooled: dropped read replica on SS %s", filename, retired);
+    }
+    return dropped;
+}
+
+void* hot_file_monitor(void* arg) {
+    (void)arg;
+    log_message(NS_LOG_FILE, "INFO", "Hot file monitor started");
+
+    while (1) {
+        sleep(HOT_SAMPLE_INTERVAL);
+
+        int loads[MAX_SS] = {0};
+        pthread_mutex_lock(&ss_list_mutex);
+        for (int i = 0; i < ss_count; i++) {
+            loads[i] = ss_list[i].read_load;
+            ss_list[i].read_load = 0;
+        }
+        pthread_mutex_unlock(&ss_list_mutex);
+
+        // Fold this window into the rates and pick out the files that need work
+        static HotFileEntry work[HOT_TABLE_SIZE];
+        int work_count = 0;
+        pthread_mutex_lock(&hot_files_mutex);
+        for (int i = 0; i < HOT_TABLE_SIZE; i++) {
+            HotFileEntry* entry = &hot_files[i];
+            if (!entry->valid) continue;
+            entry->read_rate = 0.5 * entry->read_rate + 0.5 * ((double)entry->reads / HOT_SAMPLE_INTERVAL);
+            entry->reads = 0;
+            if ((entry->read_rate >= HOT_READ_RATE && entry->extras < MAX_HOT_REPLICAS) ||
+                (entry->read_rate < HOT_COOL_RATE && entry->extras > 0) ||
+                entry->retiring_ss[0] != '\0') {
+                work[work_count++] = *entry;
+                entry->retiring_ss[0] = '\0';
+            } else if (entry->extras == 0 && entry->read_rate < 0.01) {
+                entry->valid = 0;
+            }
+        }
+        pthread_mutex_unlock(&hot_files_mutex);
+
+        for (int i = 0; i < work_count; i++) {
+            HotFileEntry* item = &work[i];
+
+            if (item->retiring_ss[0] != '\0') {
+                StorageServer* ss = get_ss_by_id(item->retiring_ss);
+                if (ss != NULL) {
+                    char cmd[BUFFER_SIZE];
+                    if (snprintf(cmd, sizeof(cmd), "NM_DELETE %s\n", item->filename) < (int)sizeof(cmd)) {
+                        send_ss_nm_command(ss->ip, ss->nm_port, cmd, "ACK_NM_DELETE");
+                    }
+                }
+            }
+
+            // Trashed files count as cold; deleted ones took their extras with them
+            pthread_mutex_lock(&file_trie_mutex);
+            FileNode* node = find_file_any_status(file_trie_root, item->filename);
+            int exists = (node != NULL);
+            int live = (exists && !node->is_in_trash);
+            pthread_mutex_unlock(&file_trie_mutex);
+            if (!exists) {
+                pthread_mutex_lock(&hot_files_mutex);
+                HotFileEntry* entry = hot_file_slot(item->filename);
+                if (entry->valid && strcmp(entry->filename, item->filename) == 0) entry->valid = 0;
+                pthread_mutex_unlock(&hot_files_mutex);
+                continue;
+            }
+
+            int delta = 0;
+            char retired[50] = "";
+            if (live && item->read_rate >= HOT_READ_RATE && item->extras < MAX_HOT_REPLICAS) {
+                if (add_hot_replica(item->filename, loads)) delta = 1;
+            } else if (item->extras > 0 && (!live || item->read_rate < HOT_COOL_RATE)) {
+                if (drop_hot_replica(item->filename, retired)) delta = -1;
+            }
+
+            pthread_mutex_lock(&hot_files_mutex);
+            HotFileEntry* entry = hot_file_slot(item->filename);
+            if (entry->valid && strcmp(entry->filename, item->filename) == 0) {
+                entry->extras += delta;
+                if (retired[0] != '\0') snprintf(entry->retiring_ss, sizeof(entry->retiring_ss), "%s", retired);
+            }
+            pthread_mutex_unlock(&hot_files_mutex);
+        }
+        if (work_count > 0) persist_hot_replicas();
+    }
+    return NULL;
+}
+
 // --- Helper to traverse trie and find files that should be on a specific SS ---
 void find_files_for_ss(FileNode* node, const char* ss_id, char files[][MAX_FILENAME], int* file_count, 
                        char* current_path, int max_files) {
@@ -669,6 +1645,8 @@ void handle_ss_registration(char *buffer, int sock)
                ss_id, ip, client_port, nm_port);
         write(sock, "ACK_REG_RECOVERY\n", 17);
         
+        start_stale_hot_cleanup(ss_id);
+
         // Trigger synchronization in a separate thread
         char* ss_id_copy = strdup(ss_id);
         pthread_t sync_tid;
@@ -696,6 +1674,7 @@ void handle_ss_registration(char *buffer, int sock)
 
         log_message(NS_LOG_FILE, "SUCCESS", "Registered NEW SS %s at %s (Client:%d, NM:%d)", ss_id, ip, client_port, nm_port);
         write(sock, "ACK_REG\n", 8);
+        start_stale_hot_cleanup(ss_id);
     }
 }
 
@@ -891,6 +1870,15 @@ void handle_client_commands(char *username, int sock)
         // --- CREATE ---
         if (strcmp(command, "CREATE") == 0)
         {
+            // Format: CREATE <file> [RF=n] [MODE=ASYNC|SYNC|QUORUM|CHAIN] [W=n] [PREFER=id,...]
+            int options_offset = 0;
+            sscanf(buffer, "%*s %*s%n", &options_offset);
+            FilePolicy policy;
+            if (!parse_file_policy(options_offset > 0 ? buffer + options_offset : "", &policy)) {
+                send_response(sock, "ERR_INVALID_POLICY\n", username, arg1);
+                continue;
+            }
+
             pthread_mutex_lock(&file_trie_mutex);
             FileNode* existing = find_file_any_status(file_trie_root, arg1);
             if (existing != NULL)
@@ -905,11 +1893,21 @@ void handle_client_commands(char *username, int sock)
                     continue;
                 }
             }
+            // Options given here win; anything left out comes from the enclosing folders
+            int replication_factor;
+            char preferred_ss[MAX_PREFERRED_LEN];
+            get_effective_placement(file_trie_root, arg1, &replication_factor, preferred_ss, sizeof(preferred_ss));
             pthread_mutex_unlock(&file_trie_mutex);
+            if (policy.replication_factor > 0) replication_factor = policy.replication_factor;
+            if (policy.preferred_ss[0] != '\0') snprintf(preferred_ss, sizeof(preferred_ss), "%s", policy.preferred_ss);
 
-            StorageServer *ss = get_ss_for_new_file();
+            // First pick is the primary, the rest are replicas
+            char* all_ss_ids[MAX_SS];
+            int total_ss_count = select_servers_for_new_file(replication_factor, preferred_ss, all_ss_ids);
+            StorageServer *ss = (total_ss_count > 0) ? get_ss_by_id(all_ss_ids[0]) : NULL;
             if (ss == NULL)
             {
+                for (int i = 0; i < total_ss_count; i++) free(all_ss_ids[i]);
                 send_response(sock, "ERR_NO_SS_AVAIL\n", username, "");
                 continue;
             }
@@ -926,29 +1924,17 @@ void handle_client_commands(char *username, int sock)
 
             if (strncmp(ss_ack, "ACK_NM_CREATE", 13) == 0)
             {
-                // File created on primary SS successfully
-                // Now select replica servers and store all SS IDs
-                char* all_ss_ids[MAX_SS];
-                int total_ss_count = 1;
-                all_ss_ids[0] = strdup(ss->id);
-                
-                // Select additional replicas (REPLICATION_FACTOR - 1)
-                if (REPLICATION_FACTOR > 1 && ss_count > 1) {
-                    char* replica_ids[MAX_SS];
-                    int replica_count = select_replica_servers(ss->id, replica_ids, REPLICATION_FACTOR - 1);
-                    
-                    for (int i = 0; i < replica_count; i++) {
-                        all_ss_ids[total_ss_count++] = replica_ids[i];
-                    }
-                }
-                
-                // Insert file with all replica information
+                // File created on primary SS successfully; store all SS IDs
                 pthread_mutex_lock(&file_trie_mutex);
                 if (total_ss_count > 1) {
                     insert_file_with_replicas(file_trie_root, arg1, username, all_ss_ids, total_ss_count);
                 } else {
                     insert_file(file_trie_root, arg1, username, all_ss_ids[0]);
                 }
+                FileNode* new_node = find_file(file_trie_root, arg1);
+                if (new_node != NULL) {
+                    apply_file_policy(new_node, &policy);
+                }
                 pthread_mutex_unlock(&file_trie_mutex);
                 persist_trie(); // Save to disk
                 
@@ -973,6 +1959,11 @@ void handle_client_commands(char *username, int sock)
                     free(all_ss_ids[i]);
                 }
                 
+                if (total_ss_count < replication_factor) {
+                    log_message(NS_LOG_FILE, "WARNING", "'%s' wants %d copies but only %d SS available",
+                               arg1, replication_factor, total_ss_count);
+                }
+
                 // Cache the new file
                 cache_file_ss(arg1, ss->id);
                 
@@ -982,6 +1973,7 @@ void handle_client_commands(char *username, int sock)
             }
             else
             {
+                for (int i = 0; i < total_ss_count; i++) free(all_ss_ids[i]);
                 send_response(sock, "ERR_SS_CREATE_FAILED\n", username, arg1);
             }
         }
@@ -1276,8 +2268,14 @@ void handle_client_commands(char *username, int sock)
                 continue;
             }
 
+            // Hot files spread their reads over every copy, so they skip the
+            // single-SS cache and pick round-robin below
+            int is_read = (strcmp(command, "WRITE") != 0);
+            unsigned int read_cursor = 0;
+            int spread_reads = is_read && record_file_read(filename, &read_cursor);
+
             // Try cache first for O(1) lookup
-            StorageServer *ss = get_cached_ss(filename);
+            StorageServer *ss = spread_reads ? NULL : get_cached_ss(filename);
             PermissionLevel perm = PERM_NONE;
             char selected_ss_id[50] = "";
             char selected_ss_ip[50] = "";
@@ -1341,7 +2339,8 @@ void handle_client_commands(char *username, int sock)
                 ss = NULL;
                 
                 // Try each replica until we find an active one
-                for (int i = 0; i < ss_count_copy; i++) {
+                for (int k = 0; k < ss_count_copy; k++) {
+                    int i = spread_reads ? (int)((read_cursor + k) % (unsigned int)ss_count_copy) : k;
                     ss = get_ss_by_id(all_ss_ids[i]);
                     if (ss != NULL && ss->is_active) {
                         strcpy(selected_ss_id, all_ss_ids[i]);
@@ -1362,7 +2361,9 @@ void handle_client_commands(char *username, int sock)
                 }
                 
                 // Cache the result for next time
-                cache_file_ss(filename, selected_ss_id);
+                if (!spread_reads) {
+                    cache_file_ss(filename, selected_ss_id);
+                }
             }
 
             // Check permissions
@@ -1378,6 +2379,9 @@ void handle_client_commands(char *username, int sock)
             }
 
             // All checks passed! Send the SS info to the client
+            if (is_read) {
+                note_ss_read(selected_ss_id);
+            }
             char response[BUFFER_SIZE];
             snprintf(response, sizeof(response), "ACK_%s %s %d\n",
                      command, selected_ss_ip, selected_ss_port);
@@ -1585,9 +2589,9 @@ void handle_client_commands(char *username, int sock)
             } else if (strcmp(topic, "VIEWCHECKPOINT")==0) {
                 strcpy(out, "VIEWCHECKPOINT <filename> <tag>\n  View contents of a specific checkpoint. Requires READ access.\n");
             } else if (strcmp(topic, "LISTCHECKPOINTS")==0) {
-                strcpy(out, "LISTCHECKPOINTS <filename>\n  List all checkpoint tags saved for the file. Requires READ access.\n");
+                strcpy(out, "LISTCHECKPOINTS <filename> [offset] [count]\n  List the checkpoints saved for the file, oldest first, with time, size and content hash. Shows 20 from offset unless count says, then the retention rule (see SETRETENTION). Requires READ access.\n");
             } else if (strcmp(topic, "REVERT")==0) {
-                strcpy(out, "REVERT <filename> <tag>\n  Revert file to the specified checkpoint. Creates a .bak for UNDO. Requires WRITE access.\n");
+                strcpy(out, "REVERT <filename> <tag>\n  Revert file to the specified checkpoint. Can be taken back with UNDO. Requires WRITE access.\n");
             } else if (strcmp(topic, "REQACCESS")==0) {
                 strcpy(out, "REQACCESS -R|-W <filename>\n  Ask the owner for READ or WRITE access to a file you don't own.\n");
             } else if (strcmp(topic, "LISTREQ")==0) {
@@ -2116,6 +3120,8 @@ void handle_client_commands(char *username, int sock)
         // --- CREATEFOLDER ---
         else if (strcmp(command, "CREATEFOLDER") == 0)
         {
+            // Format: CREATEFOLDER <folder> [RF=n] [MODE=...] [W=n] [PREFER=id,...]
+            // The options become the default for everything created inside it
             char *foldername = arg1;
             if (strlen(foldername) == 0)
             {
@@ -2123,6 +3129,14 @@ void handle_client_commands(char *username, int sock)
                 continue;
             }
 
+            int options_offset = 0;
+            sscanf(buffer, "%*s %*s%n", &options_offset);
+            FilePolicy policy;
+            if (!parse_file_policy(buffer + options_offset, &policy)) {
+                write(sock, "ERR_INVALID_POLICY\n", 19);
+                continue;
+            }
+
             pthread_mutex_lock(&file_trie_mutex);
             if (find_file(file_trie_root, foldername) != NULL)
             {
@@ -2130,19 +3144,28 @@ void handle_client_commands(char *username, int sock)
                 write(sock, "ERR_FOLDER_EXISTS\n", 18);
                 continue;
             }
+            int replication_factor;
+            char preferred_ss[MAX_PREFERRED_LEN];
+            get_effective_placement(file_trie_root, foldername, &replication_factor, preferred_ss, sizeof(preferred_ss));
             pthread_mutex_unlock(&file_trie_mutex);
+            if (policy.replication_factor > 0) replication_factor = policy.replication_factor;
+            if (policy.preferred_ss[0] != '\0') snprintf(preferred_ss, sizeof(preferred_ss), "%s", policy.preferred_ss);
 
             // Select primary SS and replica SSs
-            StorageServer *primary_ss = get_ss_for_new_file();
+            char* replica_ss_ids[MAX_SS];
+            int replica_count = select_servers_for_new_file(replication_factor, preferred_ss, replica_ss_ids);
+            StorageServer *primary_ss = (replica_count > 0) ? get_ss_by_id(replica_ss_ids[0]) : NULL;
             if (primary_ss == NULL)
             {
+                for (int i = 0; i < replica_count; i++) free(replica_ss_ids[i]);
                 write(sock, "ERR_NO_SS_AVAIL\n", 16);
                 continue;
             }
 
-            // Select replica servers (different from primary)
-            char* replica_ss_ids[MAX_SS];
-            int replica_count = select_replica_servers(primary_ss->id, replica_ss_ids, REPLICATION_FACTOR - 1);
+            // Everything after the primary is a replica
+            free(replica_ss_ids[0]);
+            replica_count--;
+            memmove(replica_ss_ids, replica_ss_ids + 1, replica_count * sizeof(char*));
 
             // Create folder on primary SS
             int ss_sock = connect_to_server(primary_ss->ip, primary_ss->nm_port);
@@ -2170,6 +3193,7 @@ void handle_client_commands(char *username, int sock)
                 FileNode* folder_node = find_file(file_trie_root, foldername);
                 if (folder_node) {
                     folder_node->is_folder = 1;
+                    apply_file_policy(folder_node, &policy);
                 }
                 pthread_mutex_unlock(&file_trie_mutex);
                 persist_trie();
@@ -2208,6 +3232,135 @@ void handle_client_commands(char *username, int sock)
             }
         }
 
+        // --- SETDURABILITY ---
+        else if (strcmp(command, "SETDURABILITY") == 0)
+        {
+            // Format: SETDURABILITY <file|folder> ASYNC|SYNC|QUORUM|CHAIN|INHERIT [w]
+            char *path = arg1;
+            char *mode_str = arg2;
+            int quorum = atoi(arg3);
+
+            ReplicationMode mode;
+            if (strcasecmp(mode_str, "ASYNC") == 0) {
+                mode = REPL_ASYNC;
+                quorum = 1;
+            } else if (strcasecmp(mode_str, "QUORUM") == 0) {
+                mode = REPL_QUORUM;
+                if (quorum < 1 || quorum > MAX_SS) {
+                    write(sock, "ERR_INVALID_QUORUM\n", 19);
+                    continue;
+                }
+            } else if (strcasecmp(mode_str, "SYNC") == 0) {
+                // Quorum over every copy; w=0 is resolved per write
+                mode = REPL_QUORUM;
+                quorum = 0;
+            } else if (strcasecmp(mode_str, "CHAIN") == 0) {
+                // w is unused: the tail's ack covers every copy on the chain
+                mode = REPL_CHAIN;
+                quorum = 0;
+            } else if (strcasecmp(mode_str, "INHERIT") == 0) {
+                mode = REPL_INHERIT;
+                quorum = 0;
+            } else {
+                write(sock, "ERR_INVALID_ARGS\n", 17);
+                continue;
+            }
+
+            pthread_mutex_lock(&file_trie_mutex);
+            FileNode *node = find_file(file_trie_root, path);
+            if (node == NULL || strcmp(node->owner, username) != 0)
+            {
+                pthread_mutex_unlock(&file_trie_mutex);
+                write(sock, "ERR_FILE_NOT_FOUND_OR_NOT_OWNER\n", 32);
+                continue;
+            }
+            node->repl_mode = mode;
+            node->write_quorum = quorum;
+            pthread_mutex_unlock(&file_trie_mutex);
+            persist_trie();
+
+            char ack[BUFFER_SIZE];
+            snprintf(ack, sizeof(ack), "ACK_SETDURABILITY %s %s %d\n", path, repl_mode_str(mode), quorum);
+            write(sock, ack, strlen(ack));
+            log_message(NS_LOG_FILE, "SUCCESS", "User '%s' set durability of '%s' to %s (w=%d)",
+                       username, path, repl_mode_str(mode), quorum);
+        }
+
+        // --- SETRETENTION ---
+        else if (strcmp(command, "SETRETENTION") == 0)
+        {
+            // Format: SETRETENTION <file|folder> [KEEP=n] [HOURLY=n] [DAILY=n] | ALL | INHERIT
+            // The SSs keep the rule with the checkpoints and apply it themselves
+            char *path = arg1;
+            int rule_offset = 0;
+            sscanf(buffer, "%*s %*s%n", &rule_offset);
+            if (strlen(path) == 0 || strlen(arg2) == 0 || rule_offset == 0) {
+                write(sock, "ERR_INVALID_ARGS\n", 17);
+                continue;
+            }
+            char rule[BUFFER_SIZE];
+            snprintf(rule, sizeof(rule), "%s", buffer + rule_offset + strspn(buffer + rule_offset, " \t"));
+            rule[strcspn(rule, "\r\n")] = '\0';
+            char ss_cmd[BUFFER_SIZE];
+            if (snprintf(ss_cmd, sizeof(ss_cmd), "NM_SETRETENTION %s %s\n", path, rule) >= (int)sizeof(ss_cmd)) {
+                write(sock, "ERR_INVALID_ARGS\n", 17);
+                continue;
+            }
+
+            pthread_mutex_lock(&file_trie_mutex);
+            FileNode *node = find_file(file_trie_root, path);
+            if (node == NULL || strcmp(node->owner, username) != 0)
+            {
+                pthread_mutex_unlock(&file_trie_mutex);
+                write(sock, "ERR_FILE_NOT_FOUND_OR_NOT_OWNER\n", 32);
+                continue;
+            }
+            // A file's copies, or for a folder every SS: its files may be anywhere
+            char target_ids[MAX_SS][sizeof(ss_list[0].id)];
+            int target_count = 0;
+            if (node->is_folder) {
+                pthread_mutex_lock(&ss_list_mutex);
+                for (int i = 0; i < ss_count && target_count < MAX_SS; i++) {
+                    if (ss_list[i].is_active) memcpy(target_ids[target_count++], ss_list[i].id, sizeof(target_ids[0]));
+                }
+                pthread_mutex_unlock(&ss_list_mutex);
+            } else {
+                for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
+                    // A longer id names no SS
+                    if (snprintf(target_ids[target_count], sizeof(target_ids[0]), "%s", node->ss_ids[i]) <
+                        (int)sizeof(target_ids[0])) {
+                        target_count++;
+                    }
+                }
+            }
+            pthread_mutex_unlock(&file_trie_mutex);
+
+            int acked = 0, invalid = 0;
+            for (int i = 0; i < target_count && !invalid; i++) {
+                StorageServer *ss = get_ss_by_id(target_ids[i]);
+                int ss_sock = (ss != NULL) ? connect_to_server_timeout(ss->ip, ss->nm_port, 2) : -1;
+                if (ss_sock < 0) continue;
+                write(ss_sock, ss_cmd, strlen(ss_cmd));
+                char ss_ack[BUFFER_SIZE] = {0};
+                read(ss_sock, ss_ack, BUFFER_SIZE - 1);
+                close(ss_sock);
+                if (strncmp(ss_ack, "ACK_NM_SETRETENTION", 19) == 0) acked++;
+                else if (strncmp(ss_ack, "ERR_INVALID_RETENTION", 21) == 0) invalid = 1;
+            }
+
+            if (invalid) {
+                write(sock, "ERR_INVALID_RETENTION\n", 22);
+            } else if (acked == 0) {
+                write(sock, "ERR_SS_UNREACHABLE\n", 19);
+            } else {
+                char ack[2 * BUFFER_SIZE];
+                snprintf(ack, sizeof(ack), "ACK_SETRETENTION %s %s (%d of %d servers)\n", path, rule, acked, target_count);
+                write(sock, ack, strlen(ack));
+                log_message(NS_LOG_FILE, "SUCCESS", "User '%s' set retention of '%s' to %s on %d SS",
+                           username, path, rule, acked);
+            }
+        }
+
         // --- MOVE ---
         // --- MOVE ---
         else if (strcmp(command, "MOVE") == 0)
@@ -2292,7 +3445,15 @@ void handle_client_commands(char *username, int sock)
                 if (move_file(file_trie_root, src_path, dest_path))
                 {
                     pthread_mutex_unlock(&file_trie_mutex);
+                    char new_path[MAX_FILENAME * 2];
+                    if (strcmp(dest_path, ".") == 0) {
+                        snprintf(new_path, sizeof(new_path), "%s", get_base_filename(src_path));
+                    } else {
+                        snprintf(new_path, sizeof(new_path), "%s/%s", dest_path, get_base_filename(src_path));
+                    }
+                    rename_hot_file(src_path, new_path);
                     persist_trie(); // Save to disk
+                    persist_hot_replicas();
                     write(sock, "ACK_MOVE\n", 9);
                     log_message(NS_LOG_FILE, "SUCCESS", "File %s moved successfully on %d storage servers", src_path, moved_count);
                 } else {
@@ -2419,165 +3580,7 @@ void* worker_thread(void* arg) {
                 close(task.sock);
             } else if (strncmp(task.buffer, "NM_FILE_MODIFIED", 16) == 0) {
                 // Handle file modification notification from SS
-                char filename[MAX_FILENAME];
-                char modified_ss_id[50];
-                long file_size = 0;
-                long word_count = 0;
-                long char_count = 0;
-                long last_access = 0;
-                sscanf(task.buffer, "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld", 
-                       filename, modified_ss_id, &file_size, &word_count, &char_count, &last_access);
-                log_message(NS_LOG_FILE, "INFO", "Worker %d: Processing file modification for %s from SS %s (size: %ld, words: %ld)", 
-                           thread_id, filename, modified_ss_id, file_size, word_count);
-                
-                // Get file metadata
-                pthread_mutex_lock(&file_trie_mutex);
-                FileNode *node = find_file(file_trie_root, filename);
-                if (node == NULL) {
-                    log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - File %s not found in trie", thread_id, filename);
-                    pthread_mutex_unlock(&file_trie_mutex);
-                    close(task.sock);
-                    continue;
-                }
-                
-                // Update file stats
-                node->size = file_size;
-                node->word_count = word_count;
-                node->char_count = char_count;
-                node->last_access = last_access;
-                node->last_modified = time(NULL);
-                if (node->ss_count <= 1) {
-                    log_message(NS_LOG_FILE, "INFO", "Worker %d: File %s has only %d replica(s), skipping replication", thread_id, filename, node->ss_count);
-                    pthread_mutex_unlock(&file_trie_mutex);
-                    close(task.sock);
-                    continue;
-                }
-                
-                log_message(NS_LOG_FILE, "INFO", "Worker %d: File %s has %d replicas", thread_id, filename, node->ss_count);
-                
-                // Use the SS that sent the notification as the source
-                char primary_ss_id[50];
-                strcpy(primary_ss_id, modified_ss_id);
-                
-                // Get all other SS IDs (excluding the one that was modified)
-                char* replica_ss_ids[MAX_SS];
-                int replica_count = 0;
-                for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
-                    if (strcmp(node->ss_ids[i], modified_ss_id) != 0) {
-                        replica_ss_ids[replica_count++] = strdup(node->ss_ids[i]);
-                    }
-                }
-                pthread_mutex_unlock(&file_trie_mutex);
-                
-                log_message(NS_LOG_FILE, "INFO", "Worker %d: Found %d other replicas to sync", thread_id, replica_count);
-                
-                // Trigger replication to all replicas
-                for (int i = 0; i < replica_count; i++) {
-                    log_message(NS_LOG_FILE, "INFO", "Worker %d: Replicating to SS %s", thread_id, replica_ss_ids[i]);
-                    StorageServer* replica_ss = get_ss_by_id(replica_ss_ids[i]);
-                    if (replica_ss == NULL) {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - SS %s not found", thread_id, replica_ss_ids[i]);
-                        free(replica_ss_ids[i]);
-                        continue;
-                    }
-                    if (!replica_ss->is_active) {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - SS %s is not active", thread_id, replica_ss_ids[i]);
-                        free(replica_ss_ids[i]);
-                        continue;
-                    }
-                    
-                    StorageServer* primary_ss = get_ss_by_id(primary_ss_id);
-                    if (primary_ss == NULL) {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Primary SS %s not found", thread_id, primary_ss_id);
-                        free(replica_ss_ids[i]);
-                        continue;
-                    }
-                    if (!primary_ss->is_active) {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Primary SS %s is not active", thread_id, primary_ss_id);
-                        free(replica_ss_ids[i]);
-                        continue;
-                    }
-                    
-                    // Read file content from primary
-                    log_message(NS_LOG_FILE, "INFO", "Worker %d: Reading from primary SS %s at %s:%d", thread_id, primary_ss_id, primary_ss->ip, primary_ss->client_port);
-                    int primary_sock = connect_to_server(primary_ss->ip, primary_ss->client_port);
-                    if (primary_sock < 0) {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Failed to connect to primary SS %s", thread_id, primary_ss_id);
-                        free(replica_ss_ids[i]);
-                        continue;
-                    }
-                    
-                    char read_cmd[BUFFER_SIZE];
-                    snprintf(read_cmd, sizeof(read_cmd), "READ %s\n", filename);
-                    write(primary_sock, read_cmd, strlen(read_cmd));
-                    
-                    char file_content[8192] = {0};
-                    int content_len = read(primary_sock, file_content, sizeof(file_content) - 1);
-                    close(primary_sock);
-                    
-                    log_message(NS_LOG_FILE, "INFO", "Worker %d: Read %d bytes from primary", thread_id, content_len);
-                    
-                    if (content_len > 0) {
-                        file_content[content_len] = '\0';
-                        
-                        // Delete and recreate file on replica
-                        log_message(NS_LOG_FILE, "INFO", "Worker %d: Deleting old file on replica SS %s", thread_id, replica_ss->id);
-                        int replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                        if (replica_sock >= 0) {
-                            char delete_cmd[BUFFER_SIZE];
-                            snprintf(delete_cmd, sizeof(delete_cmd), "NM_DELETE %s\n", filename);
-                            write(replica_sock, delete_cmd, strlen(delete_cmd));
-                            
-                            char ack[BUFFER_SIZE];
-                            read(replica_sock, ack, BUFFER_SIZE);
-                            close(replica_sock);
-                            
-                            // Create new file
-                            log_message(NS_LOG_FILE, "INFO", "Worker %d: Creating new file on replica SS %s", thread_id, replica_ss->id);
-                            replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                            char create_cmd[BUFFER_SIZE];
-                            snprintf(create_cmd, sizeof(create_cmd), "NM_CREATE %s\n", filename);
-                            write(replica_sock, create_cmd, strlen(create_cmd));
-                            read(replica_sock, ack, BUFFER_SIZE);
-                            close(replica_sock);
-                            
-                            // Copy content using NM_WRITECONTENT command
-                            log_message(NS_LOG_FILE, "INFO", "Worker %d: Writing %d bytes to replica SS %s", thread_id, content_len, replica_ss->id);
-                            replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                            if (replica_sock >= 0) {
-                                char write_cmd[BUFFER_SIZE + 8192];
-                                int cmd_len = snprintf(write_cmd, sizeof(write_cmd), 
-                                                     "NM_WRITECONTENT %s %d\n", filename, content_len);
-                                int bytes_sent = write(replica_sock, write_cmd, cmd_len);
-                                log_message(NS_LOG_FILE, "INFO", "Worker %d: Sent command (%d bytes)", thread_id, bytes_sent);
-                                
-                                bytes_sent = write(replica_sock, file_content, content_len);
-                                log_message(NS_LOG_FILE, "INFO", "Worker %d: Sent content (%d bytes)", thread_id, bytes_sent);
-                                
-                                char ack[BUFFER_SIZE] = {0};
-                                int ack_len = read(replica_sock, ack, BUFFER_SIZE - 1);
-                                log_message(NS_LOG_FILE, "INFO", "Worker %d: Received ACK (%d bytes): %s", thread_id, ack_len, ack_len > 0 ? ack : "NONE");
-                                close(replica_sock);
-                                
-                                if (ack_len > 0) {
-                                    log_message(NS_LOG_FILE, "SUCCESS", "Replicated %s (%d bytes) from SS %s to SS %s", 
-                                           filename, content_len, primary_ss_id, replica_ss->id);
-                                } else {
-                                    log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - No ACK received (ack_len=%d)", thread_id, ack_len);
-                                }
-                            } else {
-                                log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Failed to connect for writing content", thread_id);
-                            }
-                        } else {
-                            log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - Failed to connect for deleting file", thread_id);
-                        }
-                    } else {
-                        log_message(NS_LOG_FILE, "ERROR", "Worker %d: ERROR - No content read from primary (len=%d)", thread_id, content_len);
-                    }
-                    free(replica_ss_ids[i]);
-                }
-                
-                close(task.sock);
+                if (!handle_file_modified(task.buffer, task.sock, thread_id)) close(task.sock);
             } else if (strncmp(task.buffer, "REG_CLIENT", 10) == 0) {
                 char username[100];
                 sscanf(task.buffer, "REG_CLIENT %s", username);
@@ -2669,110 +3672,8 @@ void *handle_connection(void *socket_desc)
         // --- SS File Modification Notification ---
         else if (strncmp(buffer, "NM_FILE_MODIFIED", 16) == 0)
         {
-            char filename[MAX_FILENAME];
-            char modified_ss_id[50];
-            long file_size = 0;
-            long word_count = 0;
-            long char_count = 0;
-            long last_access = 0;
-            sscanf(buffer, "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld", 
-                   filename, modified_ss_id, &file_size, &word_count, &char_count, &last_access);
-            log_message(NS_LOG_FILE, "INFO", "Received file modification notification for: %s from SS %s (size: %ld, words: %ld)", 
-                       filename, modified_ss_id, file_size, word_count);
-            
-            // Get file metadata
-            pthread_mutex_lock(&file_trie_mutex);
-            FileNode *node = find_file(file_trie_root, filename);
-            if (node == NULL || node->ss_count <= 1) {
-                // File not found or no replicas to sync
-                pthread_mutex_unlock(&file_trie_mutex);
-                close(sock);
-                return 0;
-            }
-            
-            // Update file stats
-            node->size = file_size;
-            node->word_count = word_count;
-            node->char_count = char_count;
-            node->last_access = last_access;
-            node->last_modified = time(NULL);
-            
-            // Use the SS that sent the notification as the source (it has the latest version)
-            char primary_ss_id[50];
-            strcpy(primary_ss_id, modified_ss_id);
-            
-            // Get all other SS IDs (excluding the one that was modified)
-            char* replica_ss_ids[MAX_SS];
-            int replica_count = 0;
-            for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
-                if (strcmp(node->ss_ids[i], modified_ss_id) != 0) {
-                    replica_ss_ids[replica_count++] = strdup(node->ss_ids[i]);
-                }
-            }
-            pthread_mutex_unlock(&file_trie_mutex);
-            
-            // Trigger async replication to all replicas
-            for (int i = 0; i < replica_count; i++) {
-                StorageServer* replica_ss = get_ss_by_id(replica_ss_ids[i]);
-                if (replica_ss != NULL && replica_ss->is_active) {
-                    StorageServer* primary_ss = get_ss_by_id(primary_ss_id);
-                    if (primary_ss != NULL && primary_ss->is_active) {
-                        // Read file content from primary
-                        int primary_sock = connect_to_server(primary_ss->ip, primary_ss->client_port);
-                        if (primary_sock >= 0) {
-                            char read_cmd[BUFFER_SIZE];
-                            snprintf(read_cmd, sizeof(read_cmd), "READ %s\n", filename);
-                            write(primary_sock, read_cmd, strlen(read_cmd));
-                            
-                            char file_content[8192] = {0};
-                            int content_len = read(primary_sock, file_content, sizeof(file_content) - 1);
-                            close(primary_sock);
-                            
-                            if (content_len > 0) {
-                                file_content[content_len] = '\0';
-                                
-                                // Delete and recreate file on replica
-                                int replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                                if (replica_sock >= 0) {
-                                    char delete_cmd[BUFFER_SIZE];
-                                    snprintf(delete_cmd, sizeof(delete_cmd), "NM_DELETE %s\n", filename);
-                                    write(replica_sock, delete_cmd, strlen(delete_cmd));
-                                    
-                                    char ack[BUFFER_SIZE];
-                                    read(replica_sock, ack, BUFFER_SIZE);
-                                    close(replica_sock);
-                                    
-                                    // Create new file
-                                    replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                                    char create_cmd[BUFFER_SIZE];
-                                    snprintf(create_cmd, sizeof(create_cmd), "NM_CREATE %s\n", filename);
-                                    write(replica_sock, create_cmd, strlen(create_cmd));
-                                    read(replica_sock, ack, BUFFER_SIZE);
-                                    close(replica_sock);
-                                    
-                                    // Copy content using NM_WRITECONTENT command
-                                    replica_sock = connect_to_server(replica_ss->ip, replica_ss->nm_port);
-                                    if (replica_sock >= 0) {
-                                        char write_cmd[BUFFER_SIZE + 8192];
-                                        int cmd_len = snprintf(write_cmd, sizeof(write_cmd), 
-                                                             "NM_WRITECONTENT %s %d\n", filename, content_len);
-                                        write(replica_sock, write_cmd, cmd_len);
-                                        write(replica_sock, file_content, content_len);
-                                        read(replica_sock, ack, BUFFER_SIZE);
-                                        close(replica_sock);
-                                        
-                                        log_message(NS_LOG_FILE, "SUCCESS", "Replicated %s (%d bytes) from %s to %s", 
-                                               filename, content_len, primary_ss_id, replica_ss->id);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                free(replica_ss_ids[i]);
-            }
-            
-            close(sock);
+            if (!handle_file_modified(buffer, sock, -1)) close(sock);
+            return 0;
         }
 
         // --- Client Registration ---
@@ -2921,6 +3822,7 @@ int main(int argc, char *argv[])
     } else {
         log_message(NS_LOG_FILE, "INFO", "Starting with empty file system");
     }
+    load_hot_replicas();
     
     // --- Start Worker Thread Pool ---
     log_message(NS_LOG_FILE, "INFO", "Starting thread pool with %d workers", THREAD_POOL_SIZE);
@@ -2953,6 +3855,14 @@ int main(int argc, char *argv[])
     pthread_detach(monitor_tid);
     log_message(NS_LOG_FILE, "SUCCESS", "Failure monitoring thread started");
 
+    // --- Start Hot File Monitor Thread ---
+    pthread_t hot_tid;
+    if (pthread_create(&hot_tid, NULL, hot_file_monitor, NULL) < 0) {
+        perror("ERROR creating hot file monitor thread");
+        exit(1);
+    }
+    pthread_detach(hot_tid);
+
     // --- Create listening socket ---
     int listen_fd = create_server_socket(NM_PORT);
     log_message(NS_LOG_FILE, "INFO", "Name Server listening on port %d", NM_PORT);
@@ -110,6 +110,13 @@ int delete_file(FileNode* root, const char* filename, int depth) {
         for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
             if (node->ss_ids[i]) free(node->ss_ids[i]);
         }
+        // Don't let a later file at the same path inherit this one's policy
+        node->repl_mode = REPL_INHERIT;
+        node->write_quorum = 0;
+        node->hot_replicas = 0;
+        node->replication_factor = 0;
+        free(node->preferred_ss);
+        node->preferred_ss = NULL;
         // ... and clear ACLs
         return 1; // Success
     }
@@ -143,6 +150,120 @@ PermissionLevel check_permission(FileNode* node, const char* username) {
     return PERM_NONE;
 }
 
+// Resolves the durability policy that applies to `path`: the node's own
+// setting, else the nearest enclosing folder's, else async.
+void get_effective_repl_policy(FileNode* root, const char* path, ReplicationMode* mode, int* write_quorum) {
+    char prefix[MAX_FILENAME * 2];
+    snprintf(prefix, sizeof(prefix), "%s", path);
+
+    FileNode* node = find_file_any_status(root, prefix);
+    while (1) {
+        if (node != NULL && node->repl_mode != REPL_INHERIT) {
+            *mode = node->repl_mode;
+            *write_quorum = node->write_quorum;
+            return;
+        }
+        // Step up to the parent folder
+        char* last_slash = strrchr(prefix, '/');
+        if (last_slash == NULL) break;
+        *last_slash = '\0';
+        node = find_folder(root, prefix);
+    }
+
+    *mode = REPL_ASYNC;
+    *write_quorum = 1;
+}
+
+// Parses CREATE/CREATEFOLDER options: any of RF=<n>, MODE=ASYNC|SYNC|QUORUM|CHAIN,
+// W=<n> and PREFER=<ss_id>[,<ss_id>...], separated by spaces. SYNC is QUORUM over
+// every copy. Returns 1 if all options were valid.
+int parse_file_policy(const char* options, FilePolicy* policy) {
+    memset(policy, 0, sizeof(FilePolicy));
+    char* copy = strdup(options);
+    if (copy == NULL) return 0;
+    int valid = 1;
+
+    char* saveptr = NULL;
+    for (char* opt = strtok_r(copy, " \t\r\n", &saveptr); valid && opt != NULL; opt = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        if (strncasecmp(opt, "RF=", 3) == 0) {
+            policy->replication_factor = atoi(opt + 3);
+            if (policy->replication_factor < 1 || policy->replication_factor > MAX_SS) valid = 0;
+        } else if (strncasecmp(opt, "W=", 2) == 0) {
+            policy->write_quorum = atoi(opt + 2);
+            if (policy->write_quorum < 1 || policy->write_quorum > MAX_SS) valid = 0;
+        } else if (strncasecmp(opt, "MODE=", 5) == 0) {
+            const char* mode = opt + 5;
+            if (strcasecmp(mode, "ASYNC") == 0) policy->repl_mode = REPL_ASYNC;
+            else if (strcasecmp(mode, "SYNC") == 0) policy->repl_mode = REPL_QUORUM;
+            else if (strcasecmp(mode, "QUORUM") == 0) policy->repl_mode = REPL_QUORUM;
+            else if (strcasecmp(mode, "CHAIN") == 0) policy->repl_mode = REPL_CHAIN;
+            else valid = 0;
+        } else if (strncasecmp(opt, "PREFER=", 7) == 0) {
+            if (strlen(opt + 7) == 0 || strlen(opt + 7) >= MAX_PREFERRED_LEN) valid = 0;
+            snprintf(policy->preferred_ss, MAX_PREFERRED_LEN, "%s", opt + 7);
+        } else {
+            valid = 0;
+        }
+    }
+    free(copy);
+    // W only means something for quorum writes
+    if (policy->write_quorum > 0 && policy->repl_mode != REPL_QUORUM) valid = 0;
+    return valid;
+}
+
+// Stores the options that were actually given on a newly created node
+void apply_file_policy(FileNode* node, const FilePolicy* policy) {
+    if (policy->replication_factor > 0) {
+        node->replication_factor = policy->replication_factor;
+    }
+    if (policy->repl_mode != REPL_INHERIT) {
+        node->repl_mode = policy->repl_mode;
+        node->write_quorum = (policy->repl_mode == REPL_QUORUM) ? policy->write_quorum : 0;
+    }
+    if (policy->preferred_ss[0] != '\0') {
+        free(node->preferred_ss);
+        node->preferred_ss = strdup(policy->preferred_ss);
+    }
+}
+
+// Resolves where copies of `path` should go: RF and preferred servers are each
+// taken from the node itself, else the nearest enclosing folder that sets them,
+// else REPLICATION_FACTOR and no preference. `path` need not exist yet.
+void get_effective_placement(FileNode* root, const char* path, int* replication_factor,
+                             char* preferred_ss, size_t preferred_len) {
+    char prefix[MAX_FILENAME * 2];
+    snprintf(prefix, sizeof(prefix), "%s", path);
+    *replication_factor = 0;
+    preferred_ss[0] = '\0';
+
+    FileNode* node = find_file_any_status(root, prefix);
+    while (*replication_factor == 0 || preferred_ss[0] == '\0') {
+        if (node != NULL) {
+            if (*replication_factor == 0 && node->replication_factor > 0) {
+                *replication_factor = node->replication_factor;
+            }
+            if (preferred_ss[0] == '\0' && node->preferred_ss != NULL) {
+                snprintf(preferred_ss, preferred_len, "%s", node->preferred_ss);
+            }
+        }
+        char* last_slash = strrchr(prefix, '/');
+        if (last_slash == NULL) break;
+        *last_slash = '\0';
+        node = find_folder(root, prefix);
+    }
+
+    if (*replication_factor == 0) *replication_factor = REPLICATION_FACTOR;
+}
+
+const char* repl_mode_str(ReplicationMode mode) {
+    switch (mode) {
+        case REPL_ASYNC:  return "ASYNC";
+        case REPL_QUORUM: return "QUORUM";
+        case REPL_CHAIN:  return "CHAIN";
+        default:          return "INHERIT";
+    }
+}
+
 void traverse_trie_recursive(FileNode* node, const char* username, int list_all, int show_details, char* output_buffer, char* current_prefix) {
     if (node == NULL) {
         return;
@@ -298,6 +419,11 @@ int move_file_to_folder(FileNode* root, const char* filename, const char* folder
         new_node->size = file_node->size;
         new_node->creation_time = file_node->creation_time;
         new_node->last_modified = file_node->last_modified;
+        new_node->repl_mode = file_node->repl_mode;
+        new_node->write_quorum = file_node->write_quorum;
+        new_node->hot_replicas = file_node->hot_replicas;
+        new_node->replication_factor = file_node->replication_factor;
+        new_node->preferred_ss = file_node->preferred_ss ? strdup(file_node->preferred_ss) : NULL;
         // Copy ACLs
         for (int i = 0; i < file_node->acl.read_count; i++) {
             new_node->acl.read_users[new_node->acl.read_count++] = strdup(file_node->acl.read_users[i]);
@@ -364,6 +490,11 @@ int move_file(FileNode* root, const char* src_path, const char* dest_folder_path
         new_node->creation_time = file_node->creation_time;
         new_node->last_modified = time(NULL); // Update modified time
         new_node->is_in_trash = file_node->is_in_trash; // Preserve trash status
+        new_node->repl_mode = file_node->repl_mode;
+        new_node->write_quorum = file_node->write_quorum;
+        new_node->hot_replicas = file_node->hot_replicas;
+        new_node->replication_factor = file_node->replication_factor;
+        new_node->preferred_ss = file_node->preferred_ss ? strdup(file_node->preferred_ss) : NULL;
         
         // Copy ACLs
         for (int i = 0; i < file_node->acl.read_count; i++) {
@@ -496,9 +627,10 @@ static void serialize_node(FileNode* node, FILE* fp, char* path, int depth) {
         // Write node data
         write_string(fp, node->owner);
         
-        // Write replica count and all SS IDs
-        fwrite(&node->ss_count, sizeof(int), 1, fp);
-        for (int i = 0; i < node->ss_count && i < MAX_SS; i++) {
+        // Write replica count and all SS IDs (hot-file read replicas are transient)
+        int persisted_ss_count = node->ss_count - node->hot_replicas;
+        fwrite(&persisted_ss_count, sizeof(int), 1, fp);
+        for (int i = 0; i < persisted_ss_count && i < MAX_SS; i++) {
             write_string(fp, node->ss_ids[i]);
         }
         
@@ -508,6 +640,15 @@ static void serialize_node(FileNode* node, FILE* fp, char* path, int depth) {
         fwrite(&node->is_folder, sizeof(int), 1, fp);
         fwrite(&node->is_in_trash, sizeof(int), 1, fp);
         
+        // Write durability policy (NMTRIE03)
+        int repl_mode = (int)node->repl_mode;
+        fwrite(&repl_mode, sizeof(int), 1, fp);
+        fwrite(&node->write_quorum, sizeof(int), 1, fp);
+        
+        // Write placement policy (NMTRIE04)
+        fwrite(&node->replication_factor, sizeof(int), 1, fp);
+        write_string(fp, node->preferred_ss);
+        
         // Write ACL
         fwrite(&node->acl.read_count, sizeof(int), 1, fp);
         for (int i = 0; i < node->acl.read_count; i++) {
@@ -537,8 +678,9 @@ void save_trie_to_file(FileNode* root, const char* filepath) {
         return;
     }
     
-    // Write a magic header (updated version for multi-replica support)
-    char magic[] = "NMTRIE02";
+    // Write a magic header (NMTRIE03 added per-node durability policy,
+    // NMTRIE04 per-node placement policy)
+    char magic[] = "NMTRIE04";
     fwrite(magic, sizeof(char), 8, fp);
     
     // Serialize the trie
@@ -569,9 +711,10 @@ int load_trie_from_file(FileNode** root, const char* filepath) {
         return -1;
     }
     magic[8] = '\0';
-    // Accept both old (NMTRIE01) and new (NMTRIE02) formats
-    if (strcmp(magic, "NMTRIE02") != 0 && strcmp(magic, "NMTRIE01") != 0) {
-        printf("[NM] ERROR: Invalid magic header '%s' in persistence file (expected NMTRIE02)\n", magic);
+    // Accept the old (NMTRIE01-03) and current (NMTRIE04) formats
+    if (strcmp(magic, "NMTRIE04") != 0 && strcmp(magic, "NMTRIE03") != 0 &&
+        strcmp(magic, "NMTRIE02") != 0 && strcmp(magic, "NMTRIE01") != 0) {
+        printf("[NM] ERROR: Invalid magic header '%s' in persistence file (expected NMTRIE04)\n", magic);
         printf("[NM] Deleting corrupted file and starting fresh\n");
         fclose(fp);
         remove(filepath);
@@ -588,6 +731,11 @@ int load_trie_from_file(FileNode** root, const char* filepath) {
         return 0;
     }
     
+    // NMTRIE02 predates durability policies and NMTRIE03 placement policies;
+    // their nodes load as inheriting both
+    int has_repl_policy = (strcmp(magic, "NMTRIE03") == 0 || strcmp(magic, "NMTRIE04") == 0);
+    int has_placement = (strcmp(magic, "NMTRIE04") == 0);
+    
     // Create new root if needed
     if (*root == NULL) {
         *root = create_file_node();
@@ -627,6 +775,18 @@ int load_trie_from_file(FileNode** root, const char* filepath) {
             int is_in_trash = 0;
             fread(&is_in_trash, sizeof(int), 1, fp);
             
+            int repl_mode = REPL_INHERIT, write_quorum = 0;
+            if (has_repl_policy) {
+                fread(&repl_mode, sizeof(int), 1, fp);
+                fread(&write_quorum, sizeof(int), 1, fp);
+            }
+            int replication_factor = 0;
+            char* preferred_ss = NULL;
+            if (has_placement) {
+                fread(&replication_factor, sizeof(int), 1, fp);
+                preferred_ss = read_string(fp);
+            }
+            
             // Insert into trie
             if (is_folder) {
                 insert_folder(*root, path, owner, ss_ids[0]); // Folders use first SS only
@@ -645,6 +805,10 @@ int load_trie_from_file(FileNode** root, const char* filepath) {
                 node->creation_time = creation_time;
                 node->last_modified = last_modified;
                 node->is_in_trash = is_in_trash;
+                node->repl_mode = (ReplicationMode)repl_mode;
+                node->write_quorum = write_quorum;
+                node->replication_factor = replication_factor;
+                node->preferred_ss = preferred_ss;
                 
                 // Read ACL
                 int read_count, write_count;
@@ -24,6 +24,14 @@ typedef enum {
     PERM_WRITE
 } PermissionLevel;
 
+// --- Write Durability ---
+typedef enum {
+    REPL_INHERIT = 0, // Use the enclosing folder's mode (async at the root)
+    REPL_ASYNC,       // Ack the writer first, replicate in the background
+    REPL_QUORUM,      // Ack only after write_quorum copies have applied the update
+    REPL_CHAIN        // Primary forwards along the replica chain; ack once the tail has it
+} ReplicationMode;
+
 // --- FileTrie Node ---
 typedef struct FileNode {
     char* owner;
@@ -40,8 +48,22 @@ typedef struct FileNode {
     int is_end_of_word; // 1 if this node marks the end of a filename
     int is_folder; // 1 if this node is a folder, 0 if it's a file
     int is_in_trash; // 1 if file is in trash, 0 otherwise
+    ReplicationMode repl_mode; // Durability mode for writes (REPL_INHERIT by default)
+    int write_quorum;          // Copies (primary included) that must apply a write in REPL_QUORUM (0 = all)
+    int hot_replicas;          // Trailing ss_ids added for read load (not persisted)
+    int replication_factor;    // Copies placed at creation (0 = inherit from folder)
+    char* preferred_ss;        // Comma-separated SS IDs to place copies on first (NULL = inherit)
 } FileNode;
 
+// --- Placement/durability options accepted by CREATE and CREATEFOLDER ---
+#define MAX_PREFERRED_LEN 256
+typedef struct {
+    int replication_factor;    // 0 = not given
+    ReplicationMode repl_mode; // REPL_INHERIT = not given
+    int write_quorum;          // 0 with REPL_QUORUM = every copy
+    char preferred_ss[MAX_PREFERRED_LEN]; // "" = not given
+} FilePolicy;
+
 // --- Storage Server Info ---
 typedef struct {
     char id[50];
@@ -50,6 +72,7 @@ typedef struct {
     int nm_port;     // Port for NM to connect (for CREATE/DELETE)
     int is_active;
     time_t last_heartbeat; // For failure detection
+    int read_load;         // READ/STREAM requests routed here in the current hot-file window
 } StorageServer;
 
 // --- Connected Client Info ---
@@ -81,6 +104,16 @@ void list_trash_recursive(FileNode* node, const char* username, char* output_buf
 void list_trash(FileNode* root, const char* username, char* output_buffer);
 char* get_base_filename(const char* path);
 
+// --- Durability Policy ---
+void get_effective_repl_policy(FileNode* root, const char* path, ReplicationMode* mode, int* write_quorum);
+const char* repl_mode_str(ReplicationMode mode);
+
+// --- Placement Policy ---
+int parse_file_policy(const char* options, FilePolicy* policy);
+void apply_file_policy(FileNode* node, const FilePolicy* policy);
+void get_effective_placement(FileNode* root, const char* path, int* replication_factor,
+                             char* preferred_ss, size_t preferred_len);
+
 // --- Permission Check ---
 PermissionLevel check_permission(FileNode* node, const char* username);
 // (You will also need functions for 'traverse_files' for VIEW)
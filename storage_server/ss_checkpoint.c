@@ -0,0 +1,1177 @@
+#include "ss_checkpoint.h"
+#include "ss_document.h"
+#include "../common/config.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static char checkpoint_root[BUFFER_SIZE]; // <data dir>/.checkpoints
+static char objects_dir[BUFFER_SIZE / 2]; // Leaves room for the chunk names in it
+
+// What a chunk is called: two independent 64-bit hashes of its content,
+// and its length
+typedef struct {
+    unsigned long h1;
+    unsigned long h2;
+    size_t len;
+} ChunkId;
+
+// A stored chunk and how many manifest entries list it
+typedef struct ChunkRef {
+    ChunkId id;
+    int refs;
+    int stored; // Its object is on disk
+    struct ChunkRef* next;
+} ChunkRef;
+
+#define CHUNK_TABLE_MIN_BUCKETS 1024
+
+static ChunkRef** chunk_buckets = NULL;
+static size_t chunk_bucket_count = 0;
+static size_t chunk_entries = 0;
+static CheckpointStoreStats store_stats;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER; // Protects the above and the objects
+
+// --- Chunks ---
+
+static unsigned long mix_bits(unsigned long h) {
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9UL;
+    return h ^ (h >> 29);
+}
+
+// Hashes a word at a time: two different mixes, so the pair works as one
+// 128-bit name
+static void hash_chunk(const char* text, size_t len, ChunkId* id) {
+    unsigned long h1 = 14695981039346656037UL ^ len;
+    unsigned long h2 = 0x9E3779B97F4A7C15UL + len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        unsigned long word;
+        memcpy(&word, text + i, 8);
+        h1 = (h1 ^ word) * 1099511628211UL;
+        h1 ^= h1 >> 32;
+        h2 = mix_bits(h2 + word);
+    }
+    unsigned long tail = 0;
+    memcpy(&tail, text + i, len - i);
+    id->h1 = mix_bits(h1 ^ tail);
+    id->h2 = mix_bits(h2 + tail);
+    id->len = len;
+}
+
+// Length of the chunk `text` starts with. A chunk ends after a sentence
+// whose last 16 bytes hash right, once it is CHUNK_MIN_BYTES long, so where
+// the cuts fall depends on nearby text only and survives edits elsewhere.
+static size_t next_chunk_length(const char* text, size_t len) {
+    static const char marks[3] = {'.', '!', '?'};
+    size_t limit = (len < CHUNK_MAX_BYTES) ? len : CHUNK_MAX_BYTES;
+    if (limit < CHUNK_MIN_BYTES) return limit;
+    // Next end of each kind; memchr finds them much faster than a byte loop
+    const char* next[3];
+    for (int k = 0; k < 3; k++) {
+        next[k] = memchr(text + CHUNK_MIN_BYTES - 1, marks[k], limit - CHUNK_MIN_BYTES + 1);
+    }
+    while (1) {
+        int first = -1;
+        for (int k = 0; k < 3; k++) {
+            if (next[k] != NULL && (first < 0 || next[k] < next[first])) first = k;
+        }
+        if (first < 0) return limit;
+        size_t end = next[first] - text + 1;
+        unsigned long window[2];
+        memcpy(window, text + end - sizeof(window), sizeof(window));
+        if ((mix_bits(window[0] ^ mix_bits(window[1])) & CHUNK_CUT_MASK) == 0) return end;
+        next[first] = memchr(text + end, marks[first], limit - end);
+    }
+}
+
+static void object_path(const ChunkId* id, char* path, size_t size) {
+    snprintf(path, size, "%s/%02lx/%016lx%016lx", objects_dir, id->h1 >> 56, id->h1, id->h2);
+}
+
+// --- Reference table, caller holds store_mutex ---
+
+static size_t chunk_bucket(const ChunkId* id, size_t bucket_count) {
+    return (id->h1 ^ id->h2) % bucket_count;
+}
+
+static int grow_chunk_table(void) {
+    size_t new_count = chunk_bucket_count ? chunk_bucket_count * 2 : CHUNK_TABLE_MIN_BUCKETS;
+    ChunkRef** new_buckets = calloc(new_count, sizeof(ChunkRef*));
+    if (new_buckets == NULL) return 0;
+    for (size_t b = 0; b < chunk_bucket_count; b++) {
+        ChunkRef* r = chunk_buckets[b];
+        while (r != NULL) {
+            ChunkRef* next = r->next;
+            size_t nb = chunk_bucket(&r->id, new_count);
+            r->next = new_buckets[nb];
+            new_buckets[nb] = r;
+            r = next;
+        }
+    }
+    free(chunk_buckets);
+    chunk_buckets = new_buckets;
+    chunk_bucket_count = new_count;
+    return 1;
+}
+
+static ChunkRef* find_chunk(const ChunkId* id, int create) {
+    if (chunk_bucket_count > 0) {
+        for (ChunkRef* r = chunk_buckets[chunk_bucket(id, chunk_bucket_count)]; r != NULL; r = r->next) {
+            if (r->id.h1 == id->h1 && r->id.h2 == id->h2 && r->id.len == id->len) return r;
+        }
+    }
+    if (!create) return NULL;
+    if (chunk_entries >= chunk_bucket_count * 2 && !grow_chunk_table()) return NULL;
+    ChunkRef* r = calloc(1, sizeof(ChunkRef));
+    if (r == NULL) return NULL;
+    r->id = *id;
+    size_t b = chunk_bucket(id, chunk_bucket_count);
+    r->next = chunk_buckets[b];
+    chunk_buckets[b] = r;
+    chunk_entries++;
+    return r;
+}
+
+static void remove_chunk(ChunkRef* ref) {
+    ChunkRef** link = &chunk_buckets[chunk_bucket(&ref->id, chunk_bucket_count)];
+    while (*link != ref) link = &(*link)->next;
+    *link = ref->next;
+    chunk_entries--;
+    free(ref);
+}
+
+// Drops one reference; the chunk's object goes with the last one
+static void release_chunk(const ChunkId* id) {
+    ChunkRef* ref = find_chunk(id, 0);
+    if (ref == NULL || --ref->refs > 0) return;
+    if (ref->stored) {
+        char path[BUFFER_SIZE];
+        object_path(id, path, sizeof(path));
+        unlink(path);
+        store_stats.chunks--;
+        store_stats.chunk_bytes -= id->len;
+    }
+    remove_chunk(ref);
+}
+
+// Whether the stored object of `id` holds exactly `text`. The name is a
+// hash, so two texts could share it; reuse must not take one for the other.
+static int object_matches(const ChunkId* id, const char* text) {
+    char path[BUFFER_SIZE], buf[CHUNK_MAX_BYTES];
+    object_path(id, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    size_t got = 0;
+    ssize_t n = 1;
+    while (got < id->len && n > 0) {
+        size_t want = id->len - got < sizeof(buf) ? id->len - got : sizeof(buf);
+        n = read(fd, buf, want);
+        if (n > 0 && memcmp(buf, text + got, n) != 0) n = -1;
+        if (n > 0) got += n;
+    }
+    close(fd);
+    return got == id->len;
+}
+
+// Takes a reference on a chunk, storing it if it is not stored yet.
+// Returns 1 on success.
+static int retain_chunk(const ChunkId* id, const char* text) {
+    ChunkRef* ref = find_chunk(id, 1);
+    if (ref == NULL) return 0;
+    if (ref->stored) {
+        if (!object_matches(id, text)) {
+            printf("[SS] ERROR: Chunk %016lx%016lx is stored with other content\n", id->h1, id->h2);
+            return 0;
+        }
+        ref->refs++;
+        store_stats.reused++;
+        return 1;
+    }
+    ref->refs++;
+    char path[BUFFER_SIZE], dir[BUFFER_SIZE], tmp_path[BUFFER_SIZE];
+    snprintf(dir, sizeof(dir), "%s/%02lx", objects_dir, id->h1 >> 56);
+    mkdir(dir, 0755);
+    object_path(id, path, sizeof(path));
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    if (fd >= 0 && finish_file_replace(fd, tmp_path, path, write(fd, text, id->len) == (ssize_t)id->len, 0)) {
+        ref->stored = 1;
+        store_stats.chunks++;
+        store_stats.chunk_bytes += id->len;
+        store_stats.written++;
+        return 1;
+    }
+    release_chunk(id);
+    return 0;
+}
+
+// --- Manifests ---
+
+// A checkpoint's chunk list, as its manifest gives it
+typedef struct {
+    ChunkId* ids;
+    int count;
+    size_t total;                   // Text length
+    int chain;                      // Deltas replayed to build it, 0 for a full manifest
+    char parent[CHECKPOINT_TAG_MAX]; // Checkpoint it is a delta against, "" if full
+} Manifest;
+
+// One edit turning a parent's chunk list into its child's: the `removed`
+// parent chunks from `at` give way to `added` of the child's, from `from`
+typedef struct {
+    int at;
+    int removed;
+    int from;
+    int added;
+} ChunkEdit;
+
+// The manifest of checkpoint `tag` in the same directory as `path`
+static void sibling_manifest(const char* path, const char* tag, char* out, size_t size) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path + 1) : 0;
+    snprintf(out, size, "%.*s%s.chk", dir_len, path, tag);
+}
+
+static int same_chunk(const ChunkId* a, const ChunkId* b) {
+    return a->h1 == b->h1 && a->h2 == b->h2 && a->len == b->len;
+}
+
+static int read_entries(FILE* f, ChunkId* ids, int count) {
+    for (int i = 0; i < count; i++) {
+        if (fscanf(f, "%16lx%16lx %zu\n", &ids[i].h1, &ids[i].h2, &ids[i].len) != 3) return 0;
+    }
+    return 1;
+}
+
+static int write_entries(FILE* f, const ChunkId* ids, int count) {
+    for (int i = 0; i < count; i++) {
+        if (fprintf(f, "%016lx%016lx %zu\n", ids[i].h1, ids[i].h2, ids[i].len) < 0) return 0;
+    }
+    return 1;
+}
+
+static int load_manifest(const char* path, int depth, Manifest* m);
+
+// Builds m's list from its parent's list and the `edits` edits that follow
+// in `f`
+static int apply_delta(FILE* f, const char* path, int depth, int edits, Manifest* m) {
+    char parent_path[BUFFER_SIZE];
+    sibling_manifest(path, m->parent, parent_path, sizeof(parent_path));
+    Manifest base;
+    if (load_manifest(parent_path, depth + 1, &base) != 1) return 0;
+    int from = 0, out = 0, ok = 1;
+    for (int e = 0; ok && e < edits; e++) {
+        int at, removed, added;
+        ok = (fscanf(f, "%d %d %d\n", &at, &removed, &added) == 3 && at >= from && removed >= 0 &&
+              added >= 0 && removed <= base.count - at && out + (at - from) + added <= m->count);
+        if (ok) {
+            memcpy(m->ids + out, base.ids + from, (at - from) * sizeof(ChunkId));
+            out += at - from;
+            ok = read_entries(f, m->ids + out, added);
+            out += added;
+            from = at + removed;
+        }
+    }
+    ok = ok && out + (base.count - from) == m->count;
+    if (ok) memcpy(m->ids + out, base.ids + from, (base.count - from) * sizeof(ChunkId));
+    m->chain = base.chain + 1;
+    free(base.ids);
+    return ok;
+}
+
+// Reads a manifest, replaying the chain of deltas it sits on. Returns 1
+// with m->ids malloc'd (caller frees), 0 if there is no manifest at `path`
+// (it is missing, or an older checkpoint holding the text itself), or -1 if
+// the manifest cannot be read (it is cut short, or a link of its chain is).
+static int load_manifest(const char* path, int depth, Manifest* m) {
+    m->ids = NULL;
+    m->count = 0;
+    m->chain = 0;
+    m->parent[0] = '\0';
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return 0;
+    char line[BUFFER_SIZE];
+    int edits = 0;
+    int ok = (fgets(line, sizeof(line), f) != NULL);
+    int delta = ok && sscanf(line, "CHECKPOINT DELTA %zu %d %127s %d", &m->total, &m->count, m->parent, &edits) == 4;
+    if (!delta) m->parent[0] = '\0';
+    int header = ok && (delta || sscanf(line, "CHECKPOINT 1 %zu %d", &m->total, &m->count) == 2);
+    ok = header && m->count >= 0 && edits >= 0;
+    if (ok) {
+        m->ids = malloc((m->count > 0 ? m->count : 1) * sizeof(ChunkId));
+        ok = (m->ids != NULL);
+    }
+    if (ok && delta) {
+        // The limit only stops a loop; CHECKPOINT_CHAIN_MAX keeps chains short
+        ok = depth < CHECKPOINT_CHAIN_LIMIT && apply_delta(f, path, depth, edits, m);
+    } else if (ok) {
+        ok = read_entries(f, m->ids, m->count);
+    }
+    fclose(f);
+    if (!ok) {
+        free(m->ids);
+        m->ids = NULL;
+        m->count = 0;
+        m->parent[0] = '\0';
+    }
+    return ok ? 1 : (header ? -1 : 0);
+}
+
+// Writes a manifest: a full one if `parent` is NULL, otherwise `edits`
+// against that checkpoint
+static int write_manifest(const char* path, const Manifest* m, const char* parent, const ChunkEdit* edits,
+                          int edit_count) {
+    char tmp_path[BUFFER_SIZE];
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    if (fd < 0) return 0;
+    FILE* f = fdopen(dup(fd), "w");
+    int ok = (f != NULL);
+    if (ok && parent == NULL) {
+        ok = fprintf(f, "CHECKPOINT 1 %zu %d\n", m->total, m->count) > 0 && write_entries(f, m->ids, m->count);
+    } else if (ok) {
+        ok = fprintf(f, "CHECKPOINT DELTA %zu %d %s %d\n", m->total, m->count, parent, edit_count) > 0;
+        for (int e = 0; ok && e < edit_count; e++) {
+            ok = fprintf(f, "%d %d %d\n", edits[e].at, edits[e].removed, edits[e].added) > 0 &&
+                 write_entries(f, m->ids + edits[e].from, edits[e].added);
+        }
+    }
+    if (f != NULL && fclose(f) != 0) ok = 0;
+    return finish_file_replace(fd, tmp_path, path, ok, 0);
+}
+
+// First position at or after `from` where `base` has chunk `id`, or -1.
+// `index` maps chunks to their positions, open addressed.
+static int find_base_chunk(const int* index, size_t mask, const ChunkId* base, const ChunkId* id, int from) {
+    int found = -1;
+    for (size_t slot = chunk_bucket(id, mask + 1); index[slot] >= 0; slot = (slot + 1) & mask) {
+        int at = index[slot];
+        if (at >= from && (found < 0 || at < found) && same_chunk(&base[at], id)) found = at;
+    }
+    return found;
+}
+
+// The edits turning `base`'s list into `m`'s: matching runs are skipped and
+// each mismatch is replaced up to the next chunk both lists have. Returns a
+// malloc'd array (caller frees) or NULL if out of memory.
+static ChunkEdit* diff_manifests(const Manifest* base, const Manifest* m, int* edit_count) {
+    size_t slots = 2;
+    while (slots < (size_t)base->count * 2) slots *= 2;
+    size_t mask = slots - 1;
+    int* index = malloc(slots * sizeof(int));
+    ChunkEdit* edits = malloc(sizeof(ChunkEdit));
+    int capacity = 1;
+    *edit_count = 0;
+    if (index == NULL || edits == NULL) {
+        free(index);
+        free(edits);
+        return NULL;
+    }
+    memset(index, -1, slots * sizeof(int));
+    for (int i = 0; i < base->count; i++) {
+        size_t slot = chunk_bucket(&base->ids[i], slots);
+        while (index[slot] >= 0) slot = (slot + 1) & mask;
+        index[slot] = i;
+    }
+
+    int i = 0, j = 0;
+    while (edits != NULL && (j < m->count || i < base->count)) {
+        if (j < m->count && i < base->count && same_chunk(&base->ids[i], &m->ids[j])) {
+            i++;
+            j++;
+            continue;
+        }
+        int next_j = j, next_i = -1;
+        while (next_j < m->count && (next_i = find_base_chunk(index, mask, base->ids, &m->ids[next_j], i)) < 0) {
+            next_j++;
+        }
+        if (next_i < 0) next_i = base->count;
+        if (*edit_count == capacity) {
+            capacity *= 2;
+            ChunkEdit* grown = realloc(edits, capacity * sizeof(ChunkEdit));
+            if (grown == NULL) free(edits);
+            edits = grown;
+            if (edits == NULL) break;
+        }
+        edits[(*edit_count)++] = (ChunkEdit){i, next_i - i, j, next_j - j};
+        i = next_i;
+        j = next_j;
+    }
+    free(index);
+    return edits;
+}
+
+// Size of `m` written as a full manifest
+static size_t full_manifest_size(const Manifest* m) {
+    size_t size = 64;
+    for (int i = 0; i < m->count; i++) {
+        size_t digits = 1;
+        for (size_t n = m->ids[i].len; n >= 10; n /= 10) digits++;
+        size += 34 + digits;
+    }
+    return size;
+}
+
+// Rewrites a delta manifest as a full one. Its chunk list, and so the
+// lists of the checkpoints built on it, stay the same.
+static int rebase_manifest(const char* path) {
+    Manifest m;
+    if (load_manifest(path, 0, &m) != 1) return 0;
+    int ok = (m.parent[0] == '\0' || write_manifest(path, &m, NULL, NULL, 0));
+    if (ok && m.parent[0] != '\0') store_stats.rebased++;
+    free(m.ids);
+    return ok;
+}
+
+// --- Catalog ---
+
+typedef struct {
+    CheckpointInfo* entries;
+    int count;
+} Catalog;
+
+static void manifest_path(const char* checkpoint_dir, const char* tag, char* path, size_t size) {
+    snprintf(path, size, "%s/%s.chk", checkpoint_dir, tag);
+}
+
+// Copies the word at *p to `out` and moves *p past it. Returns 1 if it was
+// not empty and fit.
+static int take_word(char** p, char* out, size_t size) {
+    size_t len = strcspn(*p, " ");
+    if (len == 0 || len >= size) return 0;
+    memcpy(out, *p, len);
+    out[len] = '\0';
+    *p += len;
+    if (**p == ' ') (*p)++;
+    return 1;
+}
+
+// Parses one catalog line; every lookup parses the whole catalog, so this
+// avoids sscanf
+static int parse_entry(char* line, CheckpointInfo* info) {
+    char* p = line;
+    char* end;
+    info->created = strtol(p, &end, 10);
+    int ok = (end != p && *end == ' ');
+    p = end + 1;
+    info->size = ok ? strtoul(p, &end, 10) : 0;
+    ok = ok && end != p && *end == ' ';
+    p = end + 1;
+    info->hash = ok ? strtoul(p, &end, 16) : 0;
+    ok = ok && end != p && *end == ' ';
+    p = end + 1;
+    ok = ok && take_word(&p, info->tag, sizeof(info->tag)) && take_word(&p, info->parent, sizeof(info->parent));
+    if (ok && strcmp(info->parent, "-") == 0) info->parent[0] = '\0';
+    return ok;
+}
+
+// Reads a catalog in one read; a missing one is empty. Returns 1 on
+// success, with c->entries malloc'd (caller frees).
+static int read_catalog(const char* checkpoint_dir, Catalog* c) {
+    c->entries = NULL;
+    c->count = 0;
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", checkpoint_dir, CHECKPOINT_CATALOG_FILE);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    char* data = malloc(st.st_size + 1);
+    ssize_t got = (data != NULL) ? read(fd, data, st.st_size) : -1;
+    close(fd);
+    if (got != st.st_size) {
+        free(data);
+        return 0;
+    }
+    data[got] = '\0';
+
+    int lines = 0;
+    for (ssize_t i = 0; i < got; i++) {
+        if (data[i] == '\n') lines++;
+    }
+    c->entries = malloc((lines > 0 ? lines : 1) * sizeof(CheckpointInfo));
+    int ok = (c->entries != NULL);
+    for (char* line = data; ok && *line != '\0';) {
+        char* end = strchr(line, '\n');
+        if (end == NULL) break; // Cut short; the rest is rebuilt at startup
+        *end = '\0';
+        if (parse_entry(line, &c->entries[c->count])) c->count++;
+        line = end + 1;
+    }
+    free(data);
+    return ok;
+}
+
+static int write_catalog(const char* checkpoint_dir, const Catalog* c) {
+    char path[BUFFER_SIZE], tmp_path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", checkpoint_dir, CHECKPOINT_CATALOG_FILE);
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    if (fd < 0) return 0;
+    FILE* f = fdopen(dup(fd), "w");
+    int ok = (f != NULL);
+    for (int i = 0; ok && i < c->count; i++) {
+        const CheckpointInfo* info = &c->entries[i];
+        ok = fprintf(f, "%ld %zu %016lx %s %s\n", info->created, info->size, info->hash, info->tag,
+                     info->parent[0] ? info->parent : "-") > 0;
+    }
+    if (f != NULL && fclose(f) != 0) ok = 0;
+    return finish_file_replace(fd, tmp_path, path, ok, 0);
+}
+
+static int find_entry(const Catalog* c, const char* tag) {
+    for (int i = 0; i < c->count; i++) {
+        if (strcmp(c->entries[i].tag, tag) == 0) return i;
+    }
+    return -1;
+}
+
+// Removes entry `index` if there is one and adds `info` as the newest
+static int replace_entry(Catalog* c, int index, const CheckpointInfo* info) {
+    if (index >= 0) {
+        memmove(&c->entries[index], &c->entries[index + 1], (c->count - index - 1) * sizeof(CheckpointInfo));
+        c->count--;
+    }
+    CheckpointInfo* grown = realloc(c->entries, (c->count + 1) * sizeof(CheckpointInfo));
+    if (grown == NULL) return 0;
+    c->entries = grown;
+    c->entries[c->count++] = *info;
+    return 1;
+}
+
+// Hash of a checkpoint's text, from its chunk list: the same text always
+// cuts into the same chunks
+static unsigned long content_hash(const Manifest* m) {
+    unsigned long hash = 0x9E3779B97F4A7C15UL ^ m->total;
+    for (int i = 0; i < m->count; i++) {
+        hash = mix_bits(hash ^ m->ids[i].h1) + m->ids[i].h2;
+    }
+    return mix_bits(hash);
+}
+
+// Cuts `text` into chunks: m's list, and where each starts in *starts
+// (both malloc'd, caller frees). Returns 1 on success.
+static int chunk_text(const char* text, size_t len, Manifest* m, size_t** starts) {
+    int capacity = 64;
+    m->ids = malloc(capacity * sizeof(ChunkId));
+    m->count = 0;
+    m->total = len;
+    m->chain = 0;
+    m->parent[0] = '\0';
+    *starts = malloc(capacity * sizeof(size_t));
+    int ok = (m->ids != NULL && *starts != NULL);
+    for (size_t at = 0; ok && at < len; at += m->ids[m->count - 1].len) {
+        if (m->count == capacity) {
+            capacity *= 2;
+            ChunkId* grown_ids = realloc(m->ids, capacity * sizeof(ChunkId));
+            if (grown_ids != NULL) m->ids = grown_ids;
+            size_t* grown_starts = realloc(*starts, capacity * sizeof(size_t));
+            if (grown_starts != NULL) *starts = grown_starts;
+            ok = (grown_ids != NULL && grown_starts != NULL);
+            if (!ok) break;
+        }
+        (*starts)[m->count] = at;
+        hash_chunk(text + at, next_chunk_length(text + at, len - at), &m->ids[m->count]);
+        m->count++;
+    }
+    return ok;
+}
+
+// --- Saving and reading checkpoints ---
+
+// Rebases the checkpoints that are deltas against `tag`, before it is
+// replaced or deleted. Only ones taken after it can be. Returns 1 if none
+// is left depending on it.
+static int rebase_children(const char* checkpoint_dir, const Catalog* catalog, const char* tag) {
+    int ok = 1;
+    for (int i = 0; i < catalog->count; i++) {
+        if (strcmp(catalog->entries[i].parent, tag) != 0) continue;
+        char path[BUFFER_SIZE], line[BUFFER_SIZE], parent[CHECKPOINT_TAG_MAX];
+        manifest_path(checkpoint_dir, catalog->entries[i].tag, path, sizeof(path));
+        FILE* f = fopen(path, "r");
+        if (f == NULL) continue;
+        int child = (fgets(line, sizeof(line), f) != NULL &&
+                     sscanf(line, "CHECKPOINT DELTA %*u %*d %127s", parent) == 1 && strcmp(parent, tag) == 0);
+        fclose(f);
+        if (child && !rebase_manifest(path)) {
+            printf("[SS] WARNING: Could not rebase checkpoint %s off %s\n", path, tag);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+// Loads the checkpoint a new one is to be a delta against, unless its
+// chain is already CHECKPOINT_CHAIN_MAX long. Returns 1 on success.
+static int load_parent(const char* checkpoint_dir, const char* parent_tag, Manifest* parent) {
+    char path[BUFFER_SIZE];
+    manifest_path(checkpoint_dir, parent_tag, path, sizeof(path));
+    if (parent_tag[0] == '\0' || load_manifest(path, 0, parent) != 1) return 0;
+    if (parent->chain >= CHECKPOINT_CHAIN_MAX) {
+        free(parent->ids);
+        parent->ids = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+int save_checkpoint(const char* checkpoint_dir, const char* tag, const char* text, size_t len) {
+    // Cut the text up before taking the lock
+    Manifest m;
+    size_t* starts;
+    int ok = chunk_text(text, len, &m, &starts);
+    char path[BUFFER_SIZE];
+    manifest_path(checkpoint_dir, tag, path, sizeof(path));
+
+    pthread_mutex_lock(&store_mutex);
+    Catalog catalog;
+    ok = read_catalog(checkpoint_dir, &catalog) && ok;
+    int existing = find_entry(&catalog, tag);
+    Manifest old, parent = {NULL, 0, 0, 0, ""};
+    int replacing = (load_manifest(path, 0, &old) == 1);
+    // What is built on the checkpoint being replaced keeps its own list, or
+    // it is not replaced
+    if (ok && replacing) ok = rebase_children(checkpoint_dir, &catalog, tag);
+
+    // It follows the file's newest checkpoint, or what that followed if it
+    // is the one being replaced
+    CheckpointInfo info = {"", time(NULL), len, content_hash(&m), ""};
+    snprintf(info.tag, sizeof(info.tag), "%s", tag);
+    if (catalog.count > 0) {
+        const CheckpointInfo* newest = &catalog.entries[catalog.count - 1];
+        snprintf(info.parent, sizeof(info.parent), "%s",
+                 strcmp(newest->tag, tag) == 0 ? newest->parent : newest->tag);
+    }
+    ChunkEdit* edits = NULL;
+    int edit_count = 0;
+    if (ok && load_parent(checkpoint_dir, info.parent, &parent)) edits = diff_manifests(&parent, &m, &edit_count);
+
+    int retained = 0;
+    while (ok && retained < m.count) {
+        ok = retain_chunk(&m.ids[retained], text + starts[retained]);
+        if (ok) retained++;
+    }
+    ok = ok && write_manifest(path, &m, edits ? info.parent : NULL, edits, edit_count);
+    if (ok) {
+        if (edits != NULL) store_stats.deltas++;
+        // The manifest holds the references now, so this cannot undo it
+        if (!replace_entry(&catalog, existing, &info) || !write_catalog(checkpoint_dir, &catalog)) {
+            printf("[SS] WARNING: Could not add checkpoint %s to the catalog; restart to rebuild it\n", path);
+        }
+    }
+    // Whichever manifest is not on disk now gives its references back
+    const ChunkId* drop = ok ? old.ids : m.ids;
+    int drop_count = ok ? old.count : retained;
+    for (int i = 0; i < drop_count; i++) release_chunk(&drop[i]);
+    pthread_mutex_unlock(&store_mutex);
+
+    free(catalog.entries);
+    free(edits);
+    free(parent.ids);
+    free(old.ids);
+    free(m.ids);
+    free(starts);
+    return ok;
+}
+
+// Copies an older checkpoint that holds the text itself
+static int write_plain_checkpoint(const char* path, int fd) {
+    int in = open(path, O_RDONLY);
+    if (in < 0) return 0;
+    struct stat st;
+    int ok = (fstat(in, &st) == 0 && send_file_bytes(fd, in, st.st_size));
+    close(in);
+    return ok ? 1 : -1;
+}
+
+int find_checkpoint(const char* checkpoint_dir, const char* tag, CheckpointInfo* info) {
+    Catalog catalog;
+    pthread_mutex_lock(&store_mutex);
+    int found = read_catalog(checkpoint_dir, &catalog) ? find_entry(&catalog, tag) : -1;
+    pthread_mutex_unlock(&store_mutex);
+    if (found >= 0 && info != NULL) *info = catalog.entries[found];
+    free(catalog.entries);
+    return found >= 0;
+}
+
+int list_checkpoints(const char* checkpoint_dir, CheckpointInfo** infos) {
+    Catalog catalog;
+    pthread_mutex_lock(&store_mutex);
+    int ok = read_catalog(checkpoint_dir, &catalog);
+    pthread_mutex_unlock(&store_mutex);
+    *infos = catalog.entries;
+    return ok ? catalog.count : -1;
+}
+
+int write_checkpoint(const char* checkpoint_dir, const char* tag, int fd) {
+    if (!find_checkpoint(checkpoint_dir, tag, NULL)) return 0;
+    char path[BUFFER_SIZE];
+    manifest_path(checkpoint_dir, tag, path, sizeof(path));
+    Manifest m;
+    pthread_mutex_lock(&store_mutex);
+    int found = load_manifest(path, 0, &m);
+    pthread_mutex_unlock(&store_mutex);
+    if (found == 0) return write_plain_checkpoint(path, fd);
+    if (found < 0) {
+        printf("[SS] ERROR: Checkpoint %s cannot be read\n", path);
+        return -1;
+    }
+
+    // Chunks are small; corked, a socket sends them on in full segments
+    // (a file is not a socket and ignores this)
+    int cork = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+    int ok = 1;
+    for (int i = 0; ok && i < m.count; i++) {
+        // A chunk is only deleted under the lock, so open it under the lock;
+        // an open chunk stays readable whatever happens to it after
+        char chunk_path[BUFFER_SIZE];
+        object_path(&m.ids[i], chunk_path, sizeof(chunk_path));
+        pthread_mutex_lock(&store_mutex);
+        int in = open(chunk_path, O_RDONLY);
+        pthread_mutex_unlock(&store_mutex);
+        struct stat st;
+        ok = (in >= 0 && fstat(in, &st) == 0 && (size_t)st.st_size == m.ids[i].len &&
+              send_file_bytes(fd, in, m.ids[i].len));
+        if (in >= 0) close(in);
+        if (!ok) printf("[SS] ERROR: Checkpoint %s is missing chunk %d\n", path, i);
+    }
+    cork = 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+    free(m.ids);
+    return ok ? 1 : -1;
+}
+
+// --- Retention ---
+
+// A count in a rule
+static int parse_rule_count(const char* text, int* out) {
+    char* end;
+    long n = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || n < 1 || n > 1000000) return 0;
+    *out = (int)n;
+    return 1;
+}
+
+int parse_retention_rule(const char* text, RetentionRule* rule) {
+    memset(rule, 0, sizeof(RetentionRule));
+    char copy[BUFFER_SIZE];
+    snprintf(copy, sizeof(copy), "%s", text);
+    int valid = 1, words = 0, all = 0;
+    char* saveptr = NULL;
+    for (char* word = strtok_r(copy, " \t\r\n", &saveptr); valid && word != NULL;
+         word = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        words++;
+        if (strcasecmp(word, "ALL") == 0) all = 1;
+        else if (strncasecmp(word, "KEEP=", 5) == 0) valid = parse_rule_count(word + 5, &rule->keep);
+        else if (strncasecmp(word, "HOURLY=", 7) == 0) valid = parse_rule_count(word + 7, &rule->hourly);
+        else if (strncasecmp(word, "DAILY=", 6) == 0) valid = parse_rule_count(word + 6, &rule->daily);
+        else valid = 0;
+    }
+    return valid && words > 0 && (!all || words == 1);
+}
+
+void format_retention_rule(const RetentionRule* rule, char* out, size_t size) {
+    snprintf(out, size, "%s", "ALL");
+    size_t used = 0;
+    if (rule->keep > 0) used += snprintf(out + used, size - used, "KEEP=%d ", rule->keep);
+    if (rule->hourly > 0 && used < size) used += snprintf(out + used, size - used, "HOURLY=%d ", rule->hourly);
+    if (rule->daily > 0 && used < size) used += snprintf(out + used, size - used, "DAILY=%d ", rule->daily);
+    if (used > 0 && used <= size) out[used - 1] = '\0';
+}
+
+// Reads the rule set on `dir` itself. Returns 1 if there is one.
+static int read_retention_file(const char* dir, RetentionRule* rule) {
+    char path[BUFFER_SIZE], text[128];
+    snprintf(path, sizeof(path), "%s/%s", dir, CHECKPOINT_RETENTION_FILE);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    text[n > 0 ? n : 0] = '\0';
+    if (parse_retention_rule(text, rule)) return 1;
+    printf("[SS] WARNING: Retention rule %s cannot be read, ignoring it\n", path);
+    return 0;
+}
+
+int set_retention_rule(const char* checkpoint_dir, const RetentionRule* rule) {
+    char path[BUFFER_SIZE], tmp_path[BUFFER_SIZE], text[128];
+    snprintf(path, sizeof(path), "%s/%s", checkpoint_dir, CHECKPOINT_RETENTION_FILE);
+    if (rule == NULL) return unlink(path) == 0 || errno == ENOENT;
+    format_retention_rule(rule, text, sizeof(text) - 1);
+    strcat(text, "\n");
+    size_t len = strlen(text);
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    return fd >= 0 && finish_file_replace(fd, tmp_path, path, write(fd, text, len) == (ssize_t)len, 0);
+}
+
+int get_retention_rule(const char* checkpoint_dir, RetentionRule* rule) {
+    // The file's own, else the nearest folder's
+    char dir[BUFFER_SIZE];
+    snprintf(dir, sizeof(dir), "%s", checkpoint_dir);
+    size_t root_len = strlen(checkpoint_root);
+    while (strlen(dir) > root_len) {
+        if (read_retention_file(dir, rule)) return 1;
+        char* slash = strrchr(dir, '/');
+        if (slash == NULL) break;
+        *slash = '\0';
+    }
+    return 0;
+}
+
+// Marks in `keep` the checkpoints of `c` that `rule` keeps at `now`
+static void plan_retention(const Catalog* c, const RetentionRule* rule, time_t now, char* keep) {
+    // Days run from local midnight
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    long offset = tm_now.tm_gmtoff;
+    long hour_now = now / 3600, day_now = (now + offset) / 86400;
+    int all = (rule->keep == 0 && rule->hourly == 0 && rule->daily == 0);
+    for (int i = c->count - 1; i >= 0; i--) {
+        long hour = c->entries[i].created / 3600, day = (c->entries[i].created + offset) / 86400;
+        // The catalog is oldest first, so the newest of an hour or a day is
+        // the one the next checkpoint is not in
+        int newest = (i == c->count - 1);
+        int newest_of_hour = newest || c->entries[i + 1].created / 3600 != hour;
+        int newest_of_day = newest || (c->entries[i + 1].created + offset) / 86400 != day;
+        keep[i] = all || c->count - 1 - i < rule->keep || (newest_of_hour && hour_now - hour < rule->hourly) ||
+                  (newest_of_day && day_now - day < rule->daily);
+    }
+}
+
+// Deletes the checkpoint `victim` describes, unless it was taken again
+// since. Returns 1 if it was deleted.
+static int drop_checkpoint(const char* checkpoint_dir, const CheckpointInfo* victim) {
+    char path[BUFFER_SIZE];
+    manifest_path(checkpoint_dir, victim->tag, path, sizeof(path));
+    pthread_mutex_lock(&store_mutex);
+    Catalog catalog;
+    Manifest m = {NULL, 0, 0, 0, ""};
+    int index = read_catalog(checkpoint_dir, &catalog) ? find_entry(&catalog, victim->tag) : -1;
+    int ok = (index >= 0 && catalog.entries[index].created == victim->created &&
+              catalog.entries[index].hash == victim->hash);
+    // One that cannot be read is left for someone to look at
+    ok = ok && load_manifest(path, 0, &m) >= 0 && rebase_children(checkpoint_dir, &catalog, victim->tag);
+    if (ok) {
+        // What followed it now follows what it followed
+        for (int i = 0; i < catalog.count; i++) {
+            if (strcmp(catalog.entries[i].parent, victim->tag) != 0) continue;
+            snprintf(catalog.entries[i].parent, sizeof(catalog.entries[i].parent), "%s",
+                     catalog.entries[index].parent);
+        }
+        memmove(&catalog.entries[index], &catalog.entries[index + 1],
+                (catalog.count - index - 1) * sizeof(CheckpointInfo));
+        catalog.count--;
+        // The manifest goes first: startup drops an entry that has none
+        ok = (unlink(path) == 0);
+        if (ok && !write_catalog(checkpoint_dir, &catalog)) {
+            printf("[SS] WARNING: Could not remove checkpoint %s from the catalog; restart to rebuild it\n", path);
+        }
+    }
+    if (ok) {
+        for (int i = 0; i < m.count; i++) release_chunk(&m.ids[i]);
+        store_stats.retired++;
+    }
+    pthread_mutex_unlock(&store_mutex);
+    free(m.ids);
+    free(catalog.entries);
+    return ok;
+}
+
+// --- Compaction ---
+
+// ioprio_set(2) has no glibc wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_IDLE (3 << 13) // Class 3: disk time no one else wants
+
+// Sleeps off work begun at `start`, keeping the compactor to
+// CHECKPOINT_COMPACT_DUTY_PERCENT of the time and of the store lock
+static void compactor_pause(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long worked_us = (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+    usleep(worked_us * (100 - CHECKPOINT_COMPACT_DUTY_PERCENT) / CHECKPOINT_COMPACT_DUTY_PERCENT);
+}
+
+// Deletes the checkpoints in `dir` that `rule` does not keep. Newest first:
+// deleting a run of them then rebases only the one after the run.
+static void apply_retention(const char* dir, const RetentionRule* rule) {
+    Catalog catalog;
+    pthread_mutex_lock(&store_mutex);
+    int ok = read_catalog(dir, &catalog);
+    pthread_mutex_unlock(&store_mutex);
+    char* keep = ok ? malloc(catalog.count + 1) : NULL;
+    if (keep != NULL) plan_retention(&catalog, rule, time(NULL), keep);
+    for (int i = catalog.count - 1; keep != NULL && i >= 0; i--) {
+        if (keep[i]) continue;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        drop_checkpoint(dir, &catalog.entries[i]);
+        compactor_pause(&start);
+    }
+    free(keep);
+    free(catalog.entries);
+}
+
+// Applies the retention rule covering `dir` (its own, else `inherited`)
+// to the checkpoints under it, then rebases the deltas that replay too
+// long a chain (after CHECKPOINT_CHAIN_MAX was lowered) or no longer save
+// much over a full manifest. Takes the lock one checkpoint at a time.
+static void compact_manifests(const char* dir, const RetentionRule* inherited) {
+    RetentionRule own;
+    const RetentionRule* rule = read_retention_file(dir, &own) ? &own : inherited;
+    if (rule != NULL) apply_retention(dir, rule);
+    DIR* d = opendir(dir);
+    if (d == NULL) return;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char path[BUFFER_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        size_t name_len = strlen(de->d_name);
+        if (S_ISDIR(st.st_mode)) {
+            compact_manifests(path, rule);
+            continue;
+        }
+        if (name_len <= 4 || strcmp(de->d_name + name_len - 4, ".chk") != 0) continue;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pthread_mutex_lock(&store_mutex);
+        Manifest m;
+        if (load_manifest(path, 0, &m) == 1 && m.parent[0] != '\0' && stat(path, &st) == 0 &&
+            (m.chain > CHECKPOINT_CHAIN_MAX ||
+             (size_t)st.st_size * 100 > full_manifest_size(&m) * CHECKPOINT_REBASE_PERCENT)) {
+            rebase_manifest(path);
+        }
+        free(m.ids);
+        pthread_mutex_unlock(&store_mutex);
+        compactor_pause(&start);
+    }
+    closedir(d);
+}
+
+void* checkpoint_compactor_thread(void* arg) {
+    (void)arg;
+    // Behind foreground requests for the CPU and the disk
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, tid, 19);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_IDLE);
+    while (1) {
+        usleep(CHECKPOINT_COMPACT_INTERVAL_MS * 1000);
+        compact_manifests(checkpoint_root, NULL);
+    }
+    return NULL;
+}
+
+// --- Startup ---
+
+// Fills in what the catalog says of a checkpoint from its manifest (`m`,
+// if `found`) or, for one from before the store, from its text
+static void describe_checkpoint(const char* path, const struct stat* st, const Manifest* m, int found,
+                                CheckpointInfo* info) {
+    info->created = st->st_mtime;
+    info->size = found ? m->total : (size_t)st->st_size;
+    info->hash = found ? content_hash(m) : 0;
+    snprintf(info->parent, sizeof(info->parent), "%s", found ? m->parent : "");
+    if (found) return;
+    // Hash the text as it would be stored
+    char* text = malloc(st->st_size + 1);
+    int fd = open(path, O_RDONLY);
+    if (text != NULL && fd >= 0 && read(fd, text, st->st_size) == st->st_size) {
+        Manifest plain;
+        size_t* starts;
+        if (chunk_text(text, st->st_size, &plain, &starts)) info->hash = content_hash(&plain);
+        free(plain.ids);
+        free(starts);
+    }
+    if (fd >= 0) close(fd);
+    free(text);
+}
+
+// Oldest first, keeping the order of checkpoints taken in the same second
+static void sort_catalog(Catalog* c) {
+    for (int i = 1; i < c->count; i++) {
+        CheckpointInfo info = c->entries[i];
+        int j = i;
+        while (j > 0 && c->entries[j - 1].created > info.created) {
+            c->entries[j] = c->entries[j - 1];
+            j--;
+        }
+        c->entries[j] = info;
+    }
+}
+
+// Counts the references of every manifest under `dir`, and brings each
+// directory's catalog into line with the manifests in it
+static void scan_checkpoints(const char* dir) {
+    DIR* d = opendir(dir);
+    if (d == NULL) return;
+    Catalog catalog;
+    if (!read_catalog(dir, &catalog)) {
+        printf("[SS] WARNING: Could not read the checkpoint catalog of %s, rebuilding it\n", dir);
+        catalog.entries = NULL;
+        catalog.count = 0;
+    }
+    int cataloged = catalog.count;
+    char* present = calloc(cataloged + 1, 1); // Which of those still have a manifest
+    long* added_ns = NULL; // mtime nanoseconds of the entries added, to order ones from the same second
+    int changed = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue; // ., .., the objects, the catalog and temporary files
+        char path[BUFFER_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        size_t name_len = strlen(de->d_name);
+        if (S_ISDIR(st.st_mode)) {
+            scan_checkpoints(path);
+        } else if (name_len > 4 && strcmp(de->d_name + name_len - 4, ".chk") == 0) {
+            Manifest m;
+            int found = load_manifest(path, 0, &m);
+            for (int i = 0; i < m.count; i++) {
+                ChunkRef* ref = find_chunk(&m.ids[i], 1);
+                if (ref != NULL) ref->refs++;
+            }
+            CheckpointInfo info;
+            snprintf(info.tag, sizeof(info.tag), "%.*s", (int)(name_len - 4), de->d_name);
+            int index = find_entry(&catalog, info.tag);
+            if (found < 0) {
+                printf("[SS] WARNING: Checkpoint %s cannot be read, leaving it out of the catalog\n", path);
+            } else if (index >= 0 && index < cataloged && present != NULL) {
+                present[index] = 1;
+            } else if (index < 0) {
+                describe_checkpoint(path, &st, &m, found == 1, &info);
+                long* grown = realloc(added_ns, (catalog.count - cataloged + 1) * sizeof(long));
+                if (grown != NULL) added_ns = grown;
+                if (grown != NULL && replace_entry(&catalog, -1, &info)) {
+                    added_ns[catalog.count - 1 - cataloged] = st.st_mtim.tv_nsec;
+                    changed = 1;
+                }
+            }
+            free(m.ids);
+        }
+    }
+    closedir(d);
+
+    // The added entries in the order they were written
+    for (int i = cataloged + 1; i < catalog.count; i++) {
+        CheckpointInfo info = catalog.entries[i];
+        long ns = added_ns[i - cataloged];
+        int j = i;
+        while (j > cataloged && (catalog.entries[j - 1].created > info.created ||
+                                 (catalog.entries[j - 1].created == info.created && added_ns[j - 1 - cataloged] > ns))) {
+            catalog.entries[j] = catalog.entries[j - 1];
+            added_ns[j - cataloged] = added_ns[j - 1 - cataloged];
+            j--;
+        }
+        catalog.entries[j] = info;
+        added_ns[j - cataloged] = ns;
+    }
+    for (int i = cataloged - 1; i >= 0 && present != NULL; i--) {
+        if (present[i]) continue;
+        memmove(&catalog.entries[i], &catalog.entries[i + 1], (catalog.count - i - 1) * sizeof(CheckpointInfo));
+        catalog.count--;
+        changed = 1;
+    }
+    if (changed) {
+        sort_catalog(&catalog);
+        if (!write_catalog(dir, &catalog)) printf("[SS] WARNING: Could not write the checkpoint catalog of %s\n", dir);
+    }
+    // Named the newest checkpoint before the catalog did
+    char head_path[BUFFER_SIZE];
+    snprintf(head_path, sizeof(head_path), "%s/.head", dir);
+    unlink(head_path);
+    free(added_ns);
+    free(present);
+    free(catalog.entries);
+}
+
+// Marks referenced chunks found on disk as stored and deletes the rest.
+// Returns how many were deleted.
+static int sweep_objects(void) {
+    int removed = 0;
+    DIR* d = opendir(objects_dir);
+    if (d == NULL) return 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char sub[BUFFER_SIZE];
+        if (snprintf(sub, sizeof(sub), "%s/%s", objects_dir, de->d_name) >= (int)sizeof(sub)) continue;
+        DIR* sd = opendir(sub);
+        if (sd == NULL) continue;
+        struct dirent* oe;
+        while ((oe = readdir(sd)) != NULL) {
+            if (strcmp(oe->d_name, ".") == 0 || strcmp(oe->d_name, "..") == 0) continue;
+            char path[BUFFER_SIZE];
+            if (snprintf(path, sizeof(path), "%s/%s", sub, oe->d_name) >= (int)sizeof(path)) continue;
+            ChunkId id;
+            struct stat st;
+            ChunkRef* ref = NULL;
+            if (oe->d_name[0] != '.' && strlen(oe->d_name) == 32 &&
+                sscanf(oe->d_name, "%16lx%16lx", &id.h1, &id.h2) == 2 && stat(path, &st) == 0) {
+                id.len = st.st_size;
+                ref = find_chunk(&id, 0);
+            }
+            if (ref != NULL && !ref->stored) {
+                ref->stored = 1;
+                store_stats.chunks++;
+                store_stats.chunk_bytes += id.len;
+            } else {
+                // Unreferenced, cut short, or a temporary file left by a crash
+                unlink(path);
+                removed++;
+            }
+        }
+        closedir(sd);
+    }
+    closedir(d);
+    return removed;
+}
+
+int checkpoint_store_open(const char* data_dir) {
+    snprintf(checkpoint_root, sizeof(checkpoint_root), "%s/%s", data_dir, CHECKPOINT_DIR_NAME);
+    if (snprintf(objects_dir, sizeof(objects_dir), "%s/%s", checkpoint_root, CHECKPOINT_OBJECTS_DIR) >=
+        (int)sizeof(objects_dir)) {
+        printf("[SS] ERROR: Data directory path too long for the checkpoint store\n");
+        return 0;
+    }
+    if ((mkdir(checkpoint_root, 0755) != 0 && errno != EEXIST) ||
+        (mkdir(objects_dir, 0755) != 0 && errno != EEXIST)) {
+        perror("[SS] Checkpoint store");
+        return 0;
+    }
+    pthread_mutex_lock(&store_mutex);
+    if (!grow_chunk_table()) {
+        pthread_mutex_unlock(&store_mutex);
+        return 0;
+    }
+    scan_checkpoints(checkpoint_root);
+    int removed = sweep_objects();
+    // A chunk a manifest lists but which never reached the disk is written
+    // again by the next checkpoint that has it
+    unsigned long missing = 0;
+    for (size_t b = 0; b < chunk_bucket_count; b++) {
+        for (ChunkRef* r = chunk_buckets[b]; r != NULL; r = r->next) {
+            if (!r->stored) missing++;
+        }
+    }
+    printf("[SS] Checkpoint store: %lu chunks (%lu bytes), %d unreferenced removed, %lu missing\n",
+           store_stats.chunks, store_stats.chunk_bytes, removed, missing);
+    pthread_mutex_unlock(&store_mutex);
+    return 1;
+}
+
+void get_checkpoint_store_stats(CheckpointStoreStats* stats) {
+    pthread_mutex_lock(&store_mutex);
+    *stats = store_stats;
+    pthread_mutex_unlock(&store_mutex);
+}
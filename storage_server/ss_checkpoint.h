@@ -0,0 +1,114 @@
+#ifndef SS_CHECKPOINT_H
+#define SS_CHECKPOINT_H
+
+#include "../common/utils.h"
+
+// Checkpoint store. A checkpoint is a manifest (<tag>.chk under
+// <data dir>/.checkpoints/<file>/) listing the chunks its text is cut into,
+// and an entry in that directory's catalog. Each distinct chunk is stored
+// once, under .checkpoints/.objects/, named by a 128-bit hash of its
+// content, and is deleted when the last manifest listing it goes. Chunks
+// end at sentence ends picked by the sentence's content, so an edit only
+// changes the chunks around it and a new checkpoint only writes those, plus
+// its manifest.
+//
+// A full manifest is "CHECKPOINT 1 <length> <chunks>\n" followed by one
+// "<hash> <length>\n" per chunk. Most are deltas against the file's
+// previous checkpoint: "CHECKPOINT DELTA <length> <chunks> <parent tag>
+// <edits>\n", then per edit "<at> <removed> <added>\n" and the added
+// chunks' lines, replacing `removed` of the parent's chunks from `at`. A
+// .chk without either header is a checkpoint from before the store and
+// holds the text itself.
+//
+// The catalog (.catalog) lists a file's checkpoints oldest first, one
+// "<created> <length> <content hash> <tag> <parent tag or ->\n" each, the
+// parent being the file's newest checkpoint when it was taken. Listing and
+// finding checkpoints read it alone. Startup adds manifests it is missing
+// (a crash between the two writes, or checkpoints older than it) and drops
+// entries whose manifest is gone.
+//
+// A retention rule (.retention) in a file's checkpoint directory, or in a
+// folder's to cover the files under it, limits which checkpoints are kept;
+// the nearest one applies. The compactor deletes the rest, rebasing what
+// was built on them first, at idle priority and a bounded share of time.
+#define CHECKPOINT_DIR_NAME ".checkpoints"
+#define CHECKPOINT_OBJECTS_DIR ".objects"
+#define CHECKPOINT_CATALOG_FILE ".catalog"
+#define CHECKPOINT_RETENTION_FILE ".retention"
+#define CHECKPOINT_TAG_MAX 128
+#define CHUNK_MIN_BYTES 1024   // No cut before this...
+#define CHUNK_MAX_BYTES 16384  // ...and always one here
+#define CHUNK_CUT_MASK 63      // Cut after a sentence whose end hashes with these bits clear (about 1 in 64)
+#define CHECKPOINT_CHAIN_MAX 8     // A full manifest at least every this many deltas
+#define CHECKPOINT_CHAIN_LIMIT 64  // Longest chain read at all, against loops
+#define CHECKPOINT_REBASE_PERCENT 50          // The compactor rebases deltas bigger than this share of a full manifest
+#define CHECKPOINT_COMPACT_INTERVAL_MS 30000  // How often it looks
+#define CHECKPOINT_COMPACT_DUTY_PERCENT 10    // Most of the time it spends working rather than pausing
+#define CHECKPOINT_LIST_PAGE 20  // Checkpoints LISTCHECKPOINTS shows unless asked for more
+
+typedef struct {
+    unsigned long chunks;      // Distinct chunks stored
+    unsigned long chunk_bytes; // Their total size
+    unsigned long written;     // Chunks written since startup
+    unsigned long reused;      // Chunks a new checkpoint found already stored
+    unsigned long deltas;      // Manifests written as deltas
+    unsigned long rebased;     // Delta manifests rewritten as full ones
+    unsigned long retired;     // Checkpoints deleted by retention rules
+} CheckpointStoreStats;
+
+// One catalog entry
+typedef struct {
+    char tag[CHECKPOINT_TAG_MAX];
+    long created;                    // Unix time
+    size_t size;                     // Text length
+    unsigned long hash;              // Same for checkpoints of the same text
+    char parent[CHECKPOINT_TAG_MAX]; // "" for a file's first checkpoint
+} CheckpointInfo;
+
+// Which checkpoints a retention rule keeps: any of the `keep` newest, and
+// the newest of each of the last `hourly` hours and `daily` days. All 0
+// keeps every checkpoint.
+typedef struct {
+    int keep;
+    int hourly;
+    int daily;
+} RetentionRule;
+
+// Counts the references in every manifest, brings the catalogs up to date
+// and deletes chunks nothing references (left by a crash). Call once at
+// startup. Returns 1 on success.
+int checkpoint_store_open(const char* data_dir);
+
+// Checkpoints live in `checkpoint_dir`, the file's directory under
+// .checkpoints/, and are found by tag.
+
+// Saves `text` as the checkpoint `tag`, replacing any checkpoint of that
+// tag. Returns 1 on success.
+int save_checkpoint(const char* checkpoint_dir, const char* tag, const char* text, size_t len);
+// Writes the checkpoint's text to `fd` (a file or a socket). Returns 1 on
+// success, 0 if there is no such checkpoint, -1 on a read or write error.
+int write_checkpoint(const char* checkpoint_dir, const char* tag, int fd);
+// Returns 1 and fills *info (if not NULL) if there is a checkpoint `tag`
+int find_checkpoint(const char* checkpoint_dir, const char* tag, CheckpointInfo* info);
+// Returns the number of checkpoints, oldest first in a malloc'd *infos
+// (caller frees), or -1 on a read error
+int list_checkpoints(const char* checkpoint_dir, CheckpointInfo** infos);
+
+// Parses "KEEP=<n> HOURLY=<n> DAILY=<n>" (any of them) or "ALL". Returns
+// 1 if it is valid.
+int parse_retention_rule(const char* text, RetentionRule* rule);
+// The rule as parse_retention_rule takes it
+void format_retention_rule(const RetentionRule* rule, char* out, size_t size);
+// Sets the rule of `checkpoint_dir`, a file's or a folder's; NULL drops it
+// so the enclosing folder's applies. Returns 1 on success.
+int set_retention_rule(const char* checkpoint_dir, const RetentionRule* rule);
+// Returns 1 and fills *rule if a rule applies to a file's checkpoints
+int get_retention_rule(const char* checkpoint_dir, RetentionRule* rule);
+
+// Applies retention rules and rebases delta chains in the background; see
+// CHECKPOINT_REBASE_PERCENT and CHECKPOINT_COMPACT_DUTY_PERCENT
+void* checkpoint_compactor_thread(void* arg);
+
+void get_checkpoint_store_stats(CheckpointStoreStats* stats);
+
+#endif
@@ -0,0 +1,1049 @@
+#include "ss_document.h"
+#include "../common/config.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+// Documents held in memory: hashed by path, and kept on an LRU list so the
+// least recently used unused ones can be evicted once over budget
+static Document* document_buckets[DOC_HASH_BUCKETS];
+static Document* lru_head = NULL;
+static Document* lru_tail = NULL;
+static DocumentCacheStats cache_stats;
+static pthread_mutex_t document_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t document_loaded = PTHREAD_COND_INITIALIZER; // A load finished
+static Document* removed_documents = NULL; // Unused and out of the table, freed by unlock_table
+static unsigned long document_generation = 0; // Loads so far, for sentence IDs
+
+#define ID_GENERATION_SHIFT 40
+#define INITIAL_ID_BUCKETS 64
+
+static int is_delimiter(char c) {
+    return c == '.' || c == '!' || c == '?';
+}
+
+// --- Sentence rope ---
+
+static int node_count(const SentenceNode* n) {
+    return n ? n->count : 0;
+}
+
+static size_t node_bytes(const SentenceNode* n) {
+    return n ? n->bytes : 0;
+}
+
+static void update_node(SentenceNode* n) {
+    n->count = 1 + node_count(n->left) + node_count(n->right);
+    n->bytes = n->len + node_bytes(n->left) + node_bytes(n->right);
+    if (n->left) n->left->parent = n;
+    if (n->right) n->right->parent = n;
+}
+
+// Position of a node within the whole rope, found by walking up to the root
+static int node_index(const SentenceNode* n) {
+    int index = node_count(n->left);
+    for (; n->parent != NULL; n = n->parent) {
+        if (n == n->parent->right) index += node_count(n->parent->left) + 1;
+    }
+    return index;
+}
+
+// --- Sentence ID map ---
+
+static void id_map_link(SentenceNode** buckets, size_t bucket_count, SentenceNode* n) {
+    SentenceNode** bucket = &buckets[n->id % bucket_count];
+    n->id_next = *bucket;
+    *bucket = n;
+}
+
+static void id_map_insert(Document* doc, SentenceNode* n) {
+    // Keep chains short; if growing fails the map still works, just slower
+    if (doc->id_count >= doc->id_bucket_count * 2) {
+        size_t grown_count = doc->id_bucket_count * 2;
+        SentenceNode** grown = calloc(grown_count, sizeof(SentenceNode*));
+        if (grown != NULL) {
+            for (size_t i = 0; i < doc->id_bucket_count; i++) {
+                SentenceNode* chain = doc->id_buckets[i];
+                while (chain != NULL) {
+                    SentenceNode* next = chain->id_next;
+                    id_map_link(grown, grown_count, chain);
+                    chain = next;
+                }
+            }
+            free(doc->id_buckets);
+            doc->id_buckets = grown;
+            doc->id_bucket_count = grown_count;
+        }
+    }
+    id_map_link(doc->id_buckets, doc->id_bucket_count, n);
+    doc->id_count++;
+}
+
+static void id_map_remove(Document* doc, SentenceNode* n) {
+    SentenceNode** link = &doc->id_buckets[n->id % doc->id_bucket_count];
+    while (*link != n) link = &(*link)->id_next;
+    *link = n->id_next;
+    doc->id_count--;
+}
+
+static SentenceNode* id_map_find(Document* doc, unsigned long id) {
+    SentenceNode* n = doc->id_buckets[id % doc->id_bucket_count];
+    while (n != NULL && n->id != id) n = n->id_next;
+    return n;
+}
+
+// Creates a sentence node with the given ID, or a fresh one when id is 0
+static SentenceNode* new_node(Document* doc, const char* text, size_t len, unsigned long id) {
+    SentenceNode* n = malloc(sizeof(SentenceNode));
+    if (n == NULL) return NULL;
+    n->text = malloc(len + 1);
+    if (n->text == NULL) {
+        free(n);
+        return NULL;
+    }
+    memcpy(n->text, text, len);
+    n->text[len] = '\0';
+    n->len = len;
+    n->left = n->right = n->parent = NULL;
+    n->priority = (unsigned int)rand_r(&doc->seed);
+    n->id = id ? id : doc->next_id++;
+    update_node(n);
+    id_map_insert(doc, n);
+    return n;
+}
+
+// Frees a subtree, dropping its IDs from `doc`'s map (NULL when the whole
+// document is going away)
+static void free_nodes(Document* doc, SentenceNode* n) {
+    if (n == NULL) return;
+    free_nodes(doc, n->left);
+    free_nodes(doc, n->right);
+    if (doc != NULL) id_map_remove(doc, n);
+    free(n->text);
+    free(n);
+}
+
+// Joins two ropes, every sentence of `a` coming before those of `b`
+static SentenceNode* merge_nodes(SentenceNode* a, SentenceNode* b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    if (a->priority > b->priority) {
+        a->right = merge_nodes(a->right, b);
+        update_node(a);
+        return a;
+    }
+    b->left = merge_nodes(a, b->left);
+    update_node(b);
+    return b;
+}
+
+// Splits off the first `k` sentences into *first and the rest into *rest
+static void split_nodes(SentenceNode* n, int k, SentenceNode** first, SentenceNode** rest) {
+    if (n == NULL) {
+        *first = *rest = NULL;
+        return;
+    }
+    if (node_count(n->left) < k) {
+        split_nodes(n->right, k - node_count(n->left) - 1, &n->right, rest);
+        update_node(n);
+        *first = n;
+    } else {
+        split_nodes(n->left, k, first, &n->left);
+        update_node(n);
+        *rest = n;
+    }
+}
+
+static SentenceNode* node_at(SentenceNode* n, int index) {
+    while (n != NULL) {
+        int left = node_count(n->left);
+        if (index < left) {
+            n = n->left;
+        } else if (index == left) {
+            return n;
+        } else {
+            index -= left + 1;
+            n = n->right;
+        }
+    }
+    return NULL;
+}
+
+// Splits `text` at delimiters and appends each sentence to *rope. Text after
+// the last delimiter becomes a sentence of its own. The first sentence gets
+// `first_id` if it is not 0. Returns 1 on success.
+static int append_sentences(Document* doc, SentenceNode** rope, const char* text, size_t len, unsigned long first_id) {
+    size_t start = 0;
+    for (size_t p = 0; p <= len; p++) {
+        if (p < len && !is_delimiter(text[p])) continue;
+        size_t end = (p < len) ? p + 1 : len;
+        if (end > start) {
+            SentenceNode* n = new_node(doc, text + start, end - start, first_id);
+            if (n == NULL) return 0;
+            first_id = 0;
+            *rope = merge_nodes(*rope, n);
+        }
+        start = end;
+    }
+    return 1;
+}
+
+// Growable text buffer used while re-splitting an edit
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} EditBuffer;
+
+static int edit_append(EditBuffer* buf, const char* text, size_t len) {
+    if (buf->len + len + 1 > buf->cap) {
+        size_t new_cap = (buf->cap * 2 > buf->len + len + 1) ? buf->cap * 2 : buf->len + len + 1;
+        char* grown = realloc(buf->data, new_cap);
+        if (grown == NULL) return 0;
+        buf->data = grown;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + buf->len, text, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 1;
+}
+
+// Moves the first sentence of *rope onto the end of `buf`
+static int edit_pull_next(Document* doc, EditBuffer* buf, SentenceNode** rope) {
+    SentenceNode* next;
+    split_nodes(*rope, 1, &next, rope);
+    int ok = edit_append(buf, next->text, next->len);
+    free_nodes(doc, next);
+    return ok;
+}
+
+// --- Document cache ---
+
+static void free_document(Document* doc) {
+    pthread_mutex_destroy(&doc->mutex);
+    free_nodes(NULL, doc->root);
+    free(doc->id_buckets);
+    free(doc->path);
+    free(doc->lead);
+    free(doc);
+}
+
+// A document with no text yet. Called with the table mutex held.
+static Document* new_document(const char* filepath) {
+    Document* doc = calloc(1, sizeof(Document));
+    if (doc == NULL) return NULL;
+    doc->path = strdup(filepath);
+    doc->seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)doc;
+    doc->dirty_from = SIZE_MAX;
+    doc->word_count = -1;
+    doc->next_id = (++document_generation << ID_GENERATION_SHIFT) | 1;
+    doc->id_bucket_count = INITIAL_ID_BUCKETS;
+    doc->id_buckets = calloc(INITIAL_ID_BUCKETS, sizeof(SentenceNode*));
+    pthread_mutex_init(&doc->mutex, NULL);
+    if (doc->path == NULL || doc->id_buckets == NULL) {
+        free_document(doc);
+        return NULL;
+    }
+    return doc;
+}
+
+// Reads the file and builds its sentence rope. Returns 1 on success.
+static int read_document(Document* doc) {
+    char* text = NULL;
+    size_t len = 0;
+    FILE* f = fopen(doc->path, "r");
+    if (f != NULL) {
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        text = malloc(size > 0 ? size : 1);
+        if (text != NULL && size > 0) {
+            len = fread(text, 1, size, f);
+        }
+        fclose(f);
+    } else {
+        doc->missing = 1;
+        text = malloc(1);
+    }
+
+    size_t lead_len = 0;
+    while (text != NULL && lead_len < len && isspace((unsigned char)text[lead_len])) lead_len++;
+    doc->lead = text ? malloc(lead_len + 1) : NULL;
+    if (doc->lead == NULL || !append_sentences(doc, &doc->root, text + lead_len, len - lead_len, 0)) {
+        free(text);
+        return 0;
+    }
+    memcpy(doc->lead, text, lead_len);
+    doc->lead[lead_len] = '\0';
+    doc->lead_len = lead_len;
+    doc->disk_len = len;
+    if (doc->root) doc->root->parent = NULL;
+    free(text);
+    return 1;
+}
+
+static unsigned int path_bucket(const char* path) {
+    unsigned int hash = 5381;
+    for (const unsigned char* p = (const unsigned char*)path; *p; p++) {
+        hash = hash * 33 + *p;
+    }
+    return hash % DOC_HASH_BUCKETS;
+}
+
+// Approximate memory held by a document, malloc overhead included
+static size_t document_footprint(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    size_t bytes = sizeof(Document) + strlen(doc->path) + doc->lead_len + node_bytes(doc->root) +
+                   (size_t)node_count(doc->root) * (sizeof(SentenceNode) + 32) +
+                   doc->id_bucket_count * sizeof(SentenceNode*);
+    pthread_mutex_unlock(&doc->mutex);
+    return bytes;
+}
+
+// The helpers below are called with the table mutex held
+
+static void lru_unlink(Document* doc) {
+    if (doc->lru_prev) doc->lru_prev->lru_next = doc->lru_next; else lru_head = doc->lru_next;
+    if (doc->lru_next) doc->lru_next->lru_prev = doc->lru_prev; else lru_tail = doc->lru_prev;
+    doc->lru_prev = doc->lru_next = NULL;
+}
+
+static void lru_push_front(Document* doc) {
+    doc->lru_prev = NULL;
+    doc->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = doc; else lru_tail = doc;
+    lru_head = doc;
+}
+
+// Takes a document out of the cache. It is freed now if unused, otherwise
+// by its last close.
+static void remove_cached_document(Document* doc) {
+    Document** link = &document_buckets[path_bucket(doc->path)];
+    while (*link != doc) link = &(*link)->hash_next;
+    *link = doc->hash_next;
+    lru_unlink(doc);
+    cache_stats.documents--;
+    cache_stats.bytes -= doc->charged;
+    doc->charged = 0;
+    if (doc->refcount == 0) {
+        doc->hash_next = removed_documents;
+        removed_documents = doc;
+    } else {
+        doc->stale = 1;
+    }
+}
+
+// Releases the table mutex, then frees the documents removed while it was
+// held; a large document has many sentences to free
+static void unlock_table(void) {
+    Document* doc = removed_documents;
+    removed_documents = NULL;
+    pthread_mutex_unlock(&document_table_mutex);
+    while (doc != NULL) {
+        Document* next = doc->hash_next;
+        free_document(doc);
+        doc = next;
+    }
+}
+
+// Evicts unused documents, least recently used first, until within budget
+static void evict_unused_documents(void) {
+    Document* doc = lru_tail;
+    while (cache_stats.bytes > DOC_CACHE_MAX_BYTES && doc != NULL) {
+        Document* prev = doc->lru_prev;
+        // An unused document's mutex should be free, but it is only tried:
+        // the table is never held waiting on a document
+        if (doc->refcount == 0 && pthread_mutex_trylock(&doc->mutex) == 0) {
+            int dirty = (doc->dirty_from != SIZE_MAX);
+            pthread_mutex_unlock(&doc->mutex);
+            if (!dirty) {
+                remove_cached_document(doc);
+                cache_stats.evictions++;
+            }
+        }
+        doc = prev;
+    }
+}
+
+static Document* find_cached_document(const char* filepath) {
+    for (Document* doc = document_buckets[path_bucket(filepath)]; doc != NULL; doc = doc->hash_next) {
+        if (strcmp(doc->path, filepath) == 0) return doc;
+    }
+    return NULL;
+}
+
+// Drops a reference to a document that is out of the table
+static void release_stale_document(Document* doc) {
+    if (--doc->refcount == 0) {
+        doc->hash_next = removed_documents;
+        removed_documents = doc;
+    }
+}
+
+Document* open_document(const char* filepath) {
+    pthread_mutex_lock(&document_table_mutex);
+    unsigned int bucket = path_bucket(filepath);
+    Document* cached = find_cached_document(filepath);
+    if (cached != NULL) {
+        cached->refcount++;
+        lru_unlink(cached);
+        lru_push_front(cached);
+        cache_stats.hits++;
+        while (cached->loading) pthread_cond_wait(&document_loaded, &document_table_mutex);
+        if (cached->load_failed) {
+            release_stale_document(cached);
+            cached = NULL;
+        }
+        unlock_table();
+        return cached;
+    }
+
+    // The file is read with the table unlocked, so opening other files goes
+    // on meanwhile. Until then the entry stands in for the document: opens
+    // of the same file wait for it, and it is neither evicted (it is in use)
+    // nor dirty.
+    cache_stats.misses++;
+    Document* doc = new_document(filepath);
+    if (doc == NULL) {
+        pthread_mutex_unlock(&document_table_mutex);
+        return NULL;
+    }
+    doc->refcount = 1;
+    doc->loading = 1;
+    doc->hash_next = document_buckets[bucket];
+    document_buckets[bucket] = doc;
+    lru_push_front(doc);
+    cache_stats.documents++;
+    pthread_mutex_unlock(&document_table_mutex);
+
+    int loaded = read_document(doc);
+
+    pthread_mutex_lock(&document_table_mutex);
+    doc->loading = 0;
+    if (!loaded) {
+        doc->load_failed = 1;
+        if (!doc->stale) remove_cached_document(doc);
+        release_stale_document(doc);
+        doc = NULL;
+    } else if (!doc->stale) {
+        doc->charged = document_footprint(doc);
+        cache_stats.bytes += doc->charged;
+        evict_unused_documents();
+    }
+    pthread_cond_broadcast(&document_loaded);
+    unlock_table();
+    return doc;
+}
+
+void close_document(Document* doc) {
+    if (doc == NULL) return;
+    pthread_mutex_lock(&document_table_mutex);
+    if (doc->stale) {
+        release_stale_document(doc);
+    } else if (--doc->refcount == 0) {
+        // Edits may have grown or shrunk it since it was charged
+        size_t footprint = document_footprint(doc);
+        cache_stats.bytes += footprint - doc->charged;
+        doc->charged = footprint;
+        evict_unused_documents();
+    }
+    unlock_table();
+}
+
+void invalidate_document(const char* filepath) {
+    pthread_mutex_lock(&document_table_mutex);
+    Document* doc = find_cached_document(filepath);
+    if (doc != NULL) remove_cached_document(doc);
+    unlock_table();
+}
+
+Document* open_cached_document(const char* filepath) {
+    pthread_mutex_lock(&document_table_mutex);
+    Document* doc = find_cached_document(filepath);
+    if (doc != NULL && doc->loading) doc = NULL; // Not edited yet
+    if (doc != NULL) doc->refcount++;
+    pthread_mutex_unlock(&document_table_mutex);
+    return doc;
+}
+
+int send_uncached_file(const char* filepath, int sock) {
+    // Nothing can load the file and start editing it under the table mutex,
+    // and a file that is not cached has no edits waiting (dirty documents
+    // are never evicted), so it is current when opened. Installs rename over
+    // it or append past its end, so the open file keeps these bytes.
+    pthread_mutex_lock(&document_table_mutex);
+    int fd = (find_cached_document(filepath) == NULL) ? open(filepath, O_RDONLY) : -1;
+    pthread_mutex_unlock(&document_table_mutex);
+    if (fd < 0) return 0;
+    struct stat st;
+    int large = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= DOC_SENDFILE_MIN_BYTES);
+    if (large) send_file_bytes(sock, fd, st.st_size);
+    close(fd);
+    return large;
+}
+
+Document** open_dirty_documents(int* count) {
+    // Under the table mutex a document's mutex is only tried. One in use is
+    // taken along anyway and looked at again once the table is unlocked.
+    pthread_mutex_lock(&document_table_mutex);
+    Document** docs = malloc((cache_stats.documents + 1) * sizeof(Document*));
+    int found = 0, busy = 0;
+    for (Document* doc = lru_head; doc != NULL && docs != NULL; doc = doc->lru_next) {
+        if (doc->loading) continue; // Nothing to write yet
+        int dirty = 1;
+        if (pthread_mutex_trylock(&doc->mutex) == 0) {
+            dirty = (doc->dirty_from != SIZE_MAX);
+            pthread_mutex_unlock(&doc->mutex);
+        } else {
+            busy++;
+        }
+        if (dirty) {
+            doc->refcount++;
+            docs[found++] = doc;
+        }
+    }
+    pthread_mutex_unlock(&document_table_mutex);
+
+    *count = 0;
+    for (int i = 0; i < found; i++) {
+        int dirty = 1;
+        if (busy > 0) {
+            pthread_mutex_lock(&docs[i]->mutex);
+            dirty = (docs[i]->dirty_from != SIZE_MAX);
+            pthread_mutex_unlock(&docs[i]->mutex);
+        }
+        if (dirty) docs[(*count)++] = docs[i]; else close_document(docs[i]);
+    }
+    return docs;
+}
+
+void get_document_cache_stats(DocumentCacheStats* stats) {
+    pthread_mutex_lock(&document_table_mutex);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&document_table_mutex);
+}
+
+// --- Sentence access ---
+
+int document_missing(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    int missing = doc->missing;
+    pthread_mutex_unlock(&doc->mutex);
+    return missing;
+}
+
+size_t document_length(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    size_t len = doc->lead_len + node_bytes(doc->root);
+    pthread_mutex_unlock(&doc->mutex);
+    return len;
+}
+
+unsigned long document_version(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    unsigned long version = doc->version;
+    pthread_mutex_unlock(&doc->mutex);
+    return version;
+}
+
+static int is_word_separator(char c) {
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+// Counts whitespace-separated words; words may span sentence nodes
+static void count_words(const SentenceNode* n, int* in_word, long* words) {
+    if (n == NULL) return;
+    count_words(n->left, in_word, words);
+    for (size_t i = 0; i < n->len; i++) {
+        if (is_word_separator(n->text[i])) {
+            *in_word = 0;
+        } else if (!*in_word) {
+            *in_word = 1;
+            (*words)++;
+        }
+    }
+    count_words(n->right, in_word, words);
+}
+
+// Words that start inside `text`, which sits between the bytes `prev` and
+// `next` (0 at either end of the file), plus one if `next` starts a word
+// because of what `text` ends with. Comparing this for the old and new text
+// of an edit gives the change in the document's word count.
+static long word_starts(char prev, const char* text, size_t len, char next) {
+    long starts = 0;
+    int in_word = (prev != 0 && !is_word_separator(prev));
+    for (size_t i = 0; i < len; i++) {
+        if (is_word_separator(text[i])) {
+            in_word = 0;
+        } else if (!in_word) {
+            in_word = 1;
+            starts++;
+        }
+    }
+    if (next != 0 && !is_word_separator(next) && !in_word) starts++;
+    return starts;
+}
+
+long document_word_count(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    if (doc->word_count < 0) {
+        int in_word = 0;
+        long words = 0;
+        count_words(doc->root, &in_word, &words);
+        doc->word_count = words;
+    }
+    long words = doc->word_count;
+    pthread_mutex_unlock(&doc->mutex);
+    return words;
+}
+
+int document_sentence_count(Document* doc) {
+    pthread_mutex_lock(&doc->mutex);
+    int count = node_count(doc->root);
+    pthread_mutex_unlock(&doc->mutex);
+    return count;
+}
+
+long get_document_sentence(Document* doc, int index, char* out, size_t size) {
+    pthread_mutex_lock(&doc->mutex);
+    SentenceNode* n = (index >= 0) ? node_at(doc->root, index) : NULL;
+    if (n == NULL) {
+        pthread_mutex_unlock(&doc->mutex);
+        return -1;
+    }
+    size_t copy = (n->len < size - 1) ? n->len : size - 1;
+    memcpy(out, n->text, copy);
+    out[copy] = '\0';
+    long len = (long)n->len;
+    pthread_mutex_unlock(&doc->mutex);
+    return len;
+}
+
+char* copy_document_sentence(Document* doc, int index, size_t* offset, size_t* len) {
+    pthread_mutex_lock(&doc->mutex);
+    int count = node_count(doc->root);
+    char* text = NULL;
+    if (index >= 0 && index <= count) {
+        // Add up the bytes of every subtree passed on the left going down
+        size_t at = doc->lead_len;
+        const SentenceNode* n = doc->root;
+        const SentenceNode* found = NULL;
+        int skip = index;
+        while (n != NULL && found == NULL) {
+            int left = node_count(n->left);
+            if (skip < left) {
+                n = n->left;
+            } else {
+                at += node_bytes(n->left);
+                if (skip == left) {
+                    found = n;
+                } else {
+                    at += n->len;
+                    skip -= left + 1;
+                    n = n->right;
+                }
+            }
+        }
+        *offset = at;
+        *len = found ? found->len : 0;
+        text = malloc(*len + 1);
+        if (text != NULL) {
+            if (found) memcpy(text, found->text, *len);
+            text[*len] = '\0';
+        }
+    }
+    pthread_mutex_unlock(&doc->mutex);
+    return text;
+}
+
+unsigned long get_document_sentence_id(Document* doc, int index) {
+    pthread_mutex_lock(&doc->mutex);
+    SentenceNode* n = node_at(doc->root, index);
+    unsigned long id = n ? n->id : 0;
+    pthread_mutex_unlock(&doc->mutex);
+    return id;
+}
+
+int find_document_sentence_by_id(Document* doc, unsigned long id) {
+    pthread_mutex_lock(&doc->mutex);
+    SentenceNode* n = id_map_find(doc, id);
+    int index = n ? node_index(n) : -1;
+    pthread_mutex_unlock(&doc->mutex);
+    return index;
+}
+
+// --- Editing ---
+
+int replace_document_sentence(Document* doc, int index, const char* text) {
+    pthread_mutex_lock(&doc->mutex);
+    int count = node_count(doc->root);
+    if (index < 0 || index > count) {
+        pthread_mutex_unlock(&doc->mutex);
+        return 0;
+    }
+
+    // 1. Cut the rope around the edited sentence
+    SentenceNode *before, *old, *after;
+    split_nodes(doc->root, index, &before, &after);
+    split_nodes(after, 1, &old, &after);
+    unsigned long keep_id = old ? old->id : 0;
+
+    // As text, the edit replaces the old sentence's bytes with `text`, so
+    // the word count only changes by what happens around them
+    long word_delta = 0;
+    if (doc->word_count >= 0) {
+        char prev = doc->lead_len ? doc->lead[doc->lead_len - 1] : 0;
+        if (before != NULL) {
+            SentenceNode* last = node_at(before, node_count(before) - 1);
+            prev = last->text[last->len - 1];
+        }
+        char next = after ? node_at(after, 0)->text[0] : 0;
+        word_delta = word_starts(prev, text, strlen(text), next) -
+                     word_starts(prev, old ? old->text : "", old ? old->len : 0, next);
+    }
+    free_nodes(doc, old);
+
+    // Text appended after an unterminated last sentence continues it
+    EditBuffer region = {NULL, 0, 0};
+    int from = index;
+    int ok = 1;
+    if (index == count && count > 0) {
+        SentenceNode* last = node_at(before, count - 1);
+        if (!is_delimiter(last->text[last->len - 1])) {
+            split_nodes(before, count - 1, &before, &last);
+            ok = edit_append(&region, last->text, last->len);
+            keep_id = last->id;
+            free_nodes(doc, last);
+            from = count - 1;
+        }
+    }
+    size_t dirty = doc->lead_len + node_bytes(before);
+
+    // 2. Collect the new text plus any following sentences it now runs into
+    ok = ok && edit_append(&region, text, strlen(text));
+    while (ok && region.len > 0 && !is_delimiter(region.data[region.len - 1]) && after != NULL) {
+        ok = edit_pull_next(doc, &region, &after);
+    }
+    // At the start of the file, leading whitespace is not part of a sentence
+    while (ok && from == 0) {
+        size_t ws = 0;
+        while (ws < region.len && isspace((unsigned char)region.data[ws])) ws++;
+        if (ws > 0) {
+            char* grown = realloc(doc->lead, doc->lead_len + ws + 1);
+            if (grown == NULL) {
+                ok = 0;
+                break;
+            }
+            doc->lead = grown;
+            memcpy(doc->lead + doc->lead_len, region.data, ws);
+            doc->lead_len += ws;
+            doc->lead[doc->lead_len] = '\0';
+            memmove(region.data, region.data + ws, region.len - ws);
+            region.len -= ws;
+        }
+        if (region.len > 0 || after == NULL) break;
+        ok = edit_pull_next(doc, &region, &after);
+    }
+
+    // 3. Re-split that text and put the rope back together
+    SentenceNode* middle = NULL;
+    ok = ok && append_sentences(doc, &middle, region.data ? region.data : "", region.len, keep_id);
+    doc->root = merge_nodes(merge_nodes(before, middle), after);
+    if (doc->root) doc->root->parent = NULL;
+    if (dirty < doc->dirty_from) doc->dirty_from = dirty;
+    doc->version++;
+    doc->word_count = (ok && doc->word_count >= 0) ? doc->word_count + word_delta : -1;
+    free(region.data);
+    pthread_mutex_unlock(&doc->mutex);
+    return ok;
+}
+
+// --- Writing out ---
+
+// For descriptors sendfile does not take
+static int copy_file_bytes(int out_fd, int in_fd, size_t len) {
+    char buf[65536];
+    while (len > 0) {
+        ssize_t n = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n <= 0 || write(out_fd, buf, n) != n) return 0;
+        len -= n;
+    }
+    return 1;
+}
+
+int send_file_bytes(int out_fd, int in_fd, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, len - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS)) return copy_file_bytes(out_fd, in_fd, len);
+        if (n <= 0) return 0;
+        sent += n;
+    }
+    return 1;
+}
+
+// Copies the bytes of subtree `n` into `out`, returning the end position
+static char* copy_nodes(const SentenceNode* n, char* out) {
+    if (n == NULL) return out;
+    out = copy_nodes(n->left, out);
+    memcpy(out, n->text, n->len);
+    return copy_nodes(n->right, out + n->len);
+}
+
+// Caller holds doc->mutex
+static char* copy_text(Document* doc, size_t* len) {
+    *len = doc->lead_len + node_bytes(doc->root);
+    char* text = malloc(*len + 1);
+    if (text != NULL) {
+        memcpy(text, doc->lead, doc->lead_len);
+        copy_nodes(doc->root, text + doc->lead_len);
+        text[*len] = '\0';
+    }
+    return text;
+}
+
+static int write_bytes(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+int send_document(Document* doc, int sock) {
+    // The mutex is only held to take what will be sent, so a client that
+    // reads slowly holds up nothing but its own READ. A clean document is
+    // its file's bytes, sent from the page cache through a descriptor opened
+    // now: installs rename over the file or append past its end, so the open
+    // file keeps these bytes whatever is written once the mutex is released.
+    pthread_mutex_lock(&doc->mutex);
+    size_t len = doc->lead_len + node_bytes(doc->root);
+    int fd = -1;
+    if (len >= DOC_SENDFILE_MIN_BYTES && doc->dirty_from == SIZE_MAX && !doc->missing && doc->disk_len == len) {
+        fd = open(doc->path, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && (fstat(fd, &st) != 0 || (size_t)st.st_size != len)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    char* text = (fd < 0) ? copy_text(doc, &len) : NULL;
+    pthread_mutex_unlock(&doc->mutex);
+
+    int ok;
+    if (fd >= 0) {
+        ok = send_file_bytes(sock, fd, len);
+        close(fd);
+    } else {
+        ok = (text != NULL && write_bytes(sock, text, len));
+    }
+    free(text);
+    return ok;
+}
+
+char* copy_document_text(Document* doc, size_t* len) {
+    pthread_mutex_lock(&doc->mutex);
+    char* text = copy_text(doc, len);
+    pthread_mutex_unlock(&doc->mutex);
+    return text;
+}
+
+// --- Durable writes ---
+
+static FsyncPolicy fsync_policy = FSYNC_ALWAYS;
+static int fsync_batch_ms = FSYNC_BATCH_MS;
+static unsigned long fsync_count = 0;
+
+// Files and directories written since the last BATCHED round
+typedef struct PendingSync {
+    char* path;
+    struct PendingSync* next;
+} PendingSync;
+static PendingSync* pending_syncs = NULL;
+static pthread_mutex_t fsync_mutex = PTHREAD_MUTEX_INITIALIZER; // Protects the above
+
+int configure_fsync_policy(const char* spec) {
+    int ms = FSYNC_BATCH_MS;
+    if (strcmp(spec, "always") == 0) {
+        fsync_policy = FSYNC_ALWAYS;
+    } else if (strcmp(spec, "never") == 0) {
+        fsync_policy = FSYNC_NEVER;
+    } else if (strcmp(spec, "batched") == 0 || (sscanf(spec, "batched:%d", &ms) == 1 && ms > 0)) {
+        fsync_policy = FSYNC_BATCHED;
+        fsync_batch_ms = ms;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+FsyncPolicy get_fsync_policy(void) {
+    return fsync_policy;
+}
+
+const char* fsync_policy_name(void) {
+    return fsync_policy == FSYNC_ALWAYS ? "always" : fsync_policy == FSYNC_BATCHED ? "batched" : "never";
+}
+
+unsigned long get_fsync_count(void) {
+    pthread_mutex_lock(&fsync_mutex);
+    unsigned long count = fsync_count;
+    pthread_mutex_unlock(&fsync_mutex);
+    return count;
+}
+
+static void count_fsync(void) {
+    pthread_mutex_lock(&fsync_mutex);
+    fsync_count++;
+    pthread_mutex_unlock(&fsync_mutex);
+}
+
+// The directory holding `path`, whose entries a create or rename changes
+static void parent_dir(const char* path, char* dir, size_t size) {
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(dir, size, ".");
+    } else {
+        snprintf(dir, size, "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    }
+}
+
+static int fsync_path(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = (fsync(fd) == 0);
+    close(fd);
+    count_fsync();
+    return ok;
+}
+
+static void queue_sync(const char* path) {
+    pthread_mutex_lock(&fsync_mutex);
+    PendingSync* p = pending_syncs;
+    while (p != NULL && strcmp(p->path, path) != 0) p = p->next;
+    if (p == NULL && (p = malloc(sizeof(PendingSync))) != NULL) {
+        p->path = strdup(path);
+        p->next = pending_syncs;
+        if (p->path != NULL) {
+            pending_syncs = p;
+        } else {
+            free(p);
+        }
+    }
+    pthread_mutex_unlock(&fsync_mutex);
+}
+
+int sync_file_write(int fd, const char* path, int new_entry, int force_sync) {
+    char dir[BUFFER_SIZE];
+    parent_dir(path, dir, sizeof(dir));
+    if (force_sync || fsync_policy == FSYNC_ALWAYS) {
+        int ok = 1;
+        if (fd >= 0) {
+            ok = (fdatasync(fd) == 0);
+            count_fsync();
+        }
+        return ok && (!new_entry || fsync_path(dir));
+    }
+    if (fsync_policy == FSYNC_BATCHED) {
+        queue_sync(path);
+        if (new_entry) queue_sync(dir);
+    }
+    return 1;
+}
+
+void* fsync_batch_thread(void* arg) {
+    (void)arg;
+    while (1) {
+        usleep(fsync_batch_ms * 1000);
+        pthread_mutex_lock(&fsync_mutex);
+        PendingSync* batch = pending_syncs;
+        pending_syncs = NULL;
+        pthread_mutex_unlock(&fsync_mutex);
+        while (batch != NULL) {
+            PendingSync* next = batch->next;
+            fsync_path(batch->path);
+            free(batch->path);
+            free(batch);
+            batch = next;
+        }
+    }
+    return NULL;
+}
+
+int begin_file_replace(const char* path, char* tmp_path, size_t size) {
+    // A hidden name beside the file, so the rename stays in its directory
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path + 1) : 0;
+    snprintf(tmp_path, size, "%.*s.%s.XXXXXX", dir_len, path, path + dir_len);
+    int fd = mkstemp(tmp_path);
+    if (fd >= 0) fchmod(fd, 0644);
+    return fd;
+}
+
+int finish_file_replace(int fd, const char* tmp_path, const char* path, int ok, int force_sync) {
+    // The data must be on disk before the rename can make it the file
+    int sync_now = force_sync || fsync_policy == FSYNC_ALWAYS;
+    if (ok && sync_now) {
+        ok = (fdatasync(fd) == 0);
+        count_fsync();
+    }
+    if (close(fd) != 0) ok = 0;
+    if (ok && rename(tmp_path, path) != 0) ok = 0;
+    if (!ok) {
+        unlink(tmp_path);
+        return 0;
+    }
+    return sync_file_write(-1, path, 1, force_sync);
+}
+
+// Copies the bytes of subtree `n` (which starts at file offset `base`) that
+// lie at or after offset `from` to `out`; returns the end of the copy
+static char* copy_nodes_from(const SentenceNode* n, size_t base, size_t from, char* out) {
+    if (n == NULL || base + n->bytes <= from) return out;
+    out = copy_nodes_from(n->left, base, from, out);
+    size_t start = base + node_bytes(n->left);
+    if (start + n->len > from) {
+        size_t skip = (from > start) ? from - start : 0;
+        memcpy(out, n->text + skip, n->len - skip);
+        out += n->len - skip;
+    }
+    return copy_nodes_from(n->right, start + n->len, from, out);
+}
+
+char* copy_document_changes(Document* doc, size_t* from, size_t* len, unsigned long* version) {
+    pthread_mutex_lock(&doc->mutex);
+    char* text = NULL;
+    *version = doc->version;
+    if (doc->dirty_from != SIZE_MAX) {
+        size_t total = doc->lead_len + node_bytes(doc->root);
+        *from = (doc->dirty_from == doc->disk_len && !doc->missing) ? doc->disk_len : 0;
+        *len = total - *from;
+        text = malloc(*len + 1);
+        if (text != NULL) {
+            char* out = text;
+            if (*from < doc->lead_len) {
+                memcpy(out, doc->lead + *from, doc->lead_len - *from);
+                out += doc->lead_len - *from;
+            }
+            copy_nodes_from(doc->root, doc->lead_len, *from, out);
+        }
+    }
+    pthread_mutex_unlock(&doc->mutex);
+    return text;
+}
+
+void mark_document_written(Document* doc, unsigned long version, size_t disk_len) {
+    pthread_mutex_lock(&doc->mutex);
+    if (doc->version == version) doc->dirty_from = SIZE_MAX;
+    doc->disk_len = disk_len;
+    doc->missing = 0;
+    pthread_mutex_unlock(&doc->mutex);
+}
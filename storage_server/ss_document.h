@@ -0,0 +1,154 @@
+#ifndef SS_DOCUMENT_H
+#define SS_DOCUMENT_H
+
+#include "../common/utils.h"
+
+// One sentence of a document, stored as a node of an implicit treap (a
+// balanced rope ordered by sentence position). Subtree totals let us find a
+// sentence or its byte offset in O(log n) however large the file is.
+typedef struct SentenceNode {
+    char* text;
+    size_t len;
+    struct SentenceNode* left;
+    struct SentenceNode* right;
+    unsigned int priority;
+    int count;    // Sentences in this subtree
+    size_t bytes; // Text bytes in this subtree
+    unsigned long id;             // Stays the same while other sentences change
+    struct SentenceNode* parent;
+    struct SentenceNode* id_next; // Next in the document's ID map bucket
+} SentenceNode;
+
+// In-memory copy of a file, shared by every handler that works on the file's
+// sentences. Whitespace before a sentence belongs to it, except at the very
+// start of the file, which is kept separately in `lead`.
+typedef struct Document {
+    char* path;
+    char* lead;
+    size_t lead_len;
+    SentenceNode* root;
+    SentenceNode** id_buckets; // Sentence ID -> node
+    size_t id_bucket_count;
+    size_t id_count;
+    unsigned long next_id; // Load generation in the high bits, counter below
+    unsigned int seed;     // For node priorities
+    size_t dirty_from;     // First byte that differs from the file on disk; dirty
+                           // documents are never evicted
+    size_t disk_len;       // Length of the file on disk
+    int missing;           // The file did not exist when loaded
+    unsigned long version; // Bumped on every edit
+    long word_count;       // Cached for stats and kept up to date by edits, -1 until counted
+    pthread_mutex_t mutex; // Protects everything above
+
+    // Cache bookkeeping, protected by the table mutex
+    int refcount;          // Handlers using it
+    int loading;           // Its first opener is still reading the file
+    int load_failed;       // ...and could not
+    int stale;             // Dropped from the cache, freed on last close
+    size_t charged;        // Bytes counted against the cache budget
+    struct Document* hash_next;
+    struct Document* lru_prev; // Towards the most recently used
+    struct Document* lru_next;
+} Document;
+
+// Document cache configuration
+#define DOC_CACHE_MAX_BYTES (64 * 1024 * 1024) // Unused documents are evicted beyond this
+#define DOC_HASH_BUCKETS 1024
+#define DOC_SENDFILE_MIN_BYTES 65536 // READ sends clean files this long from the page cache with sendfile
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    int documents;
+    size_t bytes;
+} DocumentCacheStats;
+
+// Returns the document for `filepath`, loading it on first use. A missing
+// file opens as an empty document. Every open must be paired with a close.
+Document* open_document(const char* filepath);
+void close_document(Document* doc);
+
+// Sends a file of at least DOC_SENDFILE_MIN_BYTES that is not cached
+// straight from the page cache, without loading it. Returns 1 if it did,
+// 0 if the caller should send it from open_document instead.
+int send_uncached_file(const char* filepath, int sock);
+
+// Drops the cached copy after the file was changed some other way (replica
+// push, UNDO, REVERT, delete, move); the next open reloads it.
+void invalidate_document(const char* filepath);
+// Like open_document, but only if the document is already cached
+Document* open_cached_document(const char* filepath);
+// Opens every document with changes not yet written to its file. Returns a
+// malloc'd array (caller frees it and closes each document) or NULL.
+Document** open_dirty_documents(int* count);
+void get_document_cache_stats(DocumentCacheStats* stats);
+
+int document_missing(Document* doc);
+size_t document_length(Document* doc);
+long document_word_count(Document* doc);
+unsigned long document_version(Document* doc);
+// Returns a malloc'd copy of the whole text (caller frees) or NULL
+char* copy_document_text(Document* doc, size_t* len);
+// Writes the whole document to a socket. Returns 1 on success.
+int send_document(Document* doc, int sock);
+// Sends `len` bytes of `in_fd`, from its offset, to `out_fd` (a socket or
+// a file) with sendfile(2), so they are not copied through user space.
+// Returns 1 if all of them were sent.
+int send_file_bytes(int out_fd, int in_fd, size_t len);
+
+int document_sentence_count(Document* doc);
+// Copies sentence `index` (0-based) into `out`, truncating to `size`.
+// Returns its full length or -1.
+long get_document_sentence(Document* doc, int index, char* out, size_t size);
+// Returns a malloc'd copy of sentence `index` (an empty string when index ==
+// count, where an append goes) and the byte offset it starts at, or NULL.
+char* copy_document_sentence(Document* doc, int index, size_t* offset, size_t* len);
+// Sentence IDs identify a sentence for as long as it exists in this copy of
+// the document, however the sentences before it change. 0 is never an ID.
+unsigned long get_document_sentence_id(Document* doc, int index);
+// Returns the sentence's current 0-based index or -1 if it is gone.
+int find_document_sentence_by_id(Document* doc, unsigned long id);
+// Replaces sentence `index` (or appends when index == count) with `text`.
+// Only the sentences touched by the edit are re-split; the first sentence
+// of the new text keeps the replaced sentence's ID. Returns 1 on success.
+int replace_document_sentence(Document* doc, int index, const char* text);
+// Copies what bringing the file up to date needs: the text from *from
+// onwards, where *from is the file's length if text was only added at the
+// end and 0 otherwise. Returns the malloc'd copy (NULL if there is nothing
+// to write or no memory) and the version it is a copy of.
+char* copy_document_changes(Document* doc, size_t* from, size_t* len, unsigned long* version);
+// Records that the file now holds `version` of the document, `disk_len`
+// bytes long. Later edits keep the document dirty.
+void mark_document_written(Document* doc, unsigned long version, size_t disk_len);
+
+// --- Durable writes ---
+
+// When file writes are pushed to disk. ALWAYS syncs before a write is
+// acknowledged. BATCHED acknowledges at once and syncs everything written
+// since the last round every `batch_ms`. NEVER leaves it to the kernel.
+typedef enum { FSYNC_ALWAYS, FSYNC_BATCHED, FSYNC_NEVER } FsyncPolicy;
+
+// Parses "always", "batched", "batched:<ms>" or "never". Returns 1 on success.
+int configure_fsync_policy(const char* spec);
+FsyncPolicy get_fsync_policy(void);
+const char* fsync_policy_name(void);
+unsigned long get_fsync_count(void);
+// Runs the BATCHED policy's sync rounds
+void* fsync_batch_thread(void* arg);
+
+// Makes a write to `path` durable as the policy says (always when
+// `force_sync` is set). `fd` is open on the written data, or -1 when only
+// the directory entry needs syncing; `new_entry` syncs the directory too.
+// Returns 1 on success.
+int sync_file_write(int fd, const char* path, int new_entry, int force_sync);
+
+// Replacing a file: write the new contents to the descriptor returned by
+// begin_file_replace, then finish_file_replace syncs it (always when
+// `force_sync` is set, otherwise by policy), closes it and renames it over
+// `path`, so a crash leaves either the old or the new file. Pass ok = 0 to
+// abandon the replacement. Both return -1 / 0 on failure.
+int begin_file_replace(const char* path, char* tmp_path, size_t size);
+int finish_file_replace(int fd, const char* tmp_path, const char* path, int ok, int force_sync);
+
+#endif
@@ -0,0 +1,296 @@
+#include "ss_undo.h"
+#include "ss_document.h"
+#include "ss_utils.h"
+#include "../common/config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static char data_root[BUFFER_SIZE];
+static char undo_root[BUFFER_SIZE]; // <data dir>/.undo
+
+int undo_history_open(const char* data_dir) {
+    snprintf(data_root, sizeof(data_root), "%s", data_dir);
+    snprintf(undo_root, sizeof(undo_root), "%s/%s", data_dir, UNDO_DIR_NAME);
+    if (mkdir(undo_root, 0755) != 0 && errno != EEXIST) {
+        perror("[SS] Undo history");
+        return 0;
+    }
+    return 1;
+}
+
+// <data dir>/<file> keeps its history in <data dir>/.undo/<file>.undo.
+// Returns 0 if that path does not fit.
+static int undo_log_path(const char* filepath, char* path, size_t size) {
+    size_t root_len = strlen(data_root);
+    const char* rel = filepath;
+    if (strncmp(filepath, data_root, root_len) == 0 && filepath[root_len] == '/') rel += root_len + 1;
+    return snprintf(path, size, "%s/%s%s", undo_root, rel, UNDO_LOG_SUFFIX) < (int)size;
+}
+
+static unsigned long payload_checksum(const char* data, size_t len) {
+    unsigned long hash = 14695981039346656037UL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+// --- Recording a write ---
+
+static void step_append(UndoStep* step, const char* text, size_t len) {
+    if (!step->ok) return;
+    if (step->len + len > step->cap) {
+        size_t new_cap = (step->cap * 2 > step->len + len) ? step->cap * 2 : step->len + len + 256;
+        char* grown = realloc(step->data, new_cap);
+        if (grown == NULL) {
+            step->ok = 0;
+            return;
+        }
+        step->data = grown;
+        step->cap = new_cap;
+    }
+    memcpy(step->data + step->len, text, len);
+    step->len += len;
+}
+
+void begin_undo_step(UndoStep* step) {
+    step->data = NULL;
+    step->len = 0;
+    step->cap = 0;
+    step->deltas = 0;
+    step->ok = 1;
+}
+
+void add_undo_delta(UndoStep* step, size_t offset, const char* old_text, size_t old_len,
+                    const char* new_text, size_t new_len) {
+    char header[80];
+    int header_len = snprintf(header, sizeof(header), "%zu %zu %zu\n", offset, old_len, new_len);
+    step_append(step, header, header_len);
+    step_append(step, old_text, old_len);
+    step_append(step, new_text, new_len);
+    step->deltas++;
+}
+
+void discard_undo_step(UndoStep* step) {
+    free(step->data);
+    begin_undo_step(step);
+}
+
+// --- Reading the history ---
+
+// One step as found in the log
+typedef struct {
+    size_t start;        // Offset of its record in the log
+    size_t end;          // Offset just past it
+    const char* payload;
+    size_t payload_len;
+    int deltas;
+    size_t length;       // Text length after the step
+} StepRecord;
+
+// Reads the log and finds its steps up to the first torn one. The newest
+// MAX_UNDO_STEPS are left in `records`, record i of `*total` at
+// records[i % MAX_UNDO_STEPS]. Returns the malloc'd log (caller frees) or
+// NULL if there is none.
+static char* read_history(const char* filepath, size_t* log_len, StepRecord* records, int* total) {
+    char path[BUFFER_SIZE];
+    *total = 0;
+    if (!undo_log_path(filepath, path, sizeof(path))) return NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    char* log = NULL;
+    if (fstat(fd, &st) == 0) log = malloc(st.st_size + 1);
+    size_t got = 0;
+    ssize_t n = 1;
+    while (log != NULL && got < (size_t)st.st_size && n > 0) {
+        n = read(fd, log + got, st.st_size - got);
+        if (n > 0) got += n;
+    }
+    close(fd);
+    if (log == NULL) return NULL;
+    log[got] = '\0';
+    *log_len = got;
+
+    size_t pos = 0;
+    while (pos < got) {
+        char* newline = memchr(log + pos, '\n', got - pos);
+        if (newline == NULL) break;
+        StepRecord r;
+        unsigned long checksum;
+        if (sscanf(log + pos, "U %d %zu %zu %lu", &r.deltas, &r.payload_len, &r.length, &checksum) != 4) break;
+        size_t body = newline - log + 1;
+        if (r.payload_len > got - body || body + r.payload_len >= got || log[body + r.payload_len] != '\n' ||
+            payload_checksum(log + body, r.payload_len) != checksum) {
+            break;
+        }
+        r.start = pos;
+        r.payload = log + body;
+        r.end = body + r.payload_len + 1;
+        records[*total % MAX_UNDO_STEPS] = r;
+        (*total)++;
+        pos = r.end;
+    }
+    return log;
+}
+
+// Takes one step back off *text. Returns 1 on success or -1 if the text is
+// not what the step left.
+static int undo_step(const StepRecord* r, char** text, size_t* len) {
+    if (*len != r->length || r->deltas <= 0) return -1;
+    const char** deltas = malloc(r->deltas * sizeof(const char*));
+    if (deltas == NULL) return -1;
+
+    // Find every delta first: they are taken back last to first
+    const char* p = r->payload;
+    const char* end = r->payload + r->payload_len;
+    int ok = 1;
+    for (int i = 0; i < r->deltas && ok; i++) {
+        size_t offset, old_len, new_len;
+        const char* newline = memchr(p, '\n', end - p);
+        ok = (newline != NULL && sscanf(p, "%zu %zu %zu", &offset, &old_len, &new_len) == 3 &&
+              old_len + new_len <= (size_t)(end - newline - 1));
+        deltas[i] = p;
+        if (ok) p = newline + 1 + old_len + new_len;
+    }
+    ok = ok && p == end;
+
+    for (int i = r->deltas - 1; i >= 0 && ok; i--) {
+        size_t offset, old_len, new_len;
+        sscanf(deltas[i], "%zu %zu %zu", &offset, &old_len, &new_len);
+        const char* old_text = (const char*)memchr(deltas[i], '\n', end - deltas[i]) + 1;
+        const char* new_text = old_text + old_len;
+        ok = (offset <= *len && new_len <= *len - offset && memcmp(*text + offset, new_text, new_len) == 0);
+        if (ok && old_len > new_len) {
+            char* grown = realloc(*text, *len - new_len + old_len + 1);
+            ok = (grown != NULL);
+            if (ok) *text = grown;
+        }
+        if (ok) {
+            memmove(*text + offset + old_len, *text + offset + new_len, *len - offset - new_len);
+            memcpy(*text + offset, old_text, old_len);
+            *len = *len - new_len + old_len;
+            (*text)[*len] = '\0';
+        }
+    }
+    free(deltas);
+    return ok ? 1 : -1;
+}
+
+int undo_steps(const char* filepath, int steps, char** text, size_t* len, size_t* keep) {
+    StepRecord records[MAX_UNDO_STEPS];
+    int total;
+    size_t log_len;
+    char* log = read_history(filepath, &log_len, records, &total);
+    int available = (total < MAX_UNDO_STEPS) ? total : MAX_UNDO_STEPS;
+    if (log == NULL || steps > available) {
+        free(log);
+        return 0;
+    }
+    int result = 1;
+    for (int k = 0; k < steps && result == 1; k++) {
+        const StepRecord* r = &records[(total - 1 - k) % MAX_UNDO_STEPS];
+        result = undo_step(r, text, len);
+        *keep = r->start;
+    }
+    free(log);
+    return result;
+}
+
+// --- Keeping it bounded ---
+
+// Rewrites the log with only its newest steps: as many as fit in
+// UNDO_LOG_KEEP_BYTES, up to MAX_UNDO_STEPS, and always the newest one
+static void compact_history(const char* filepath) {
+    StepRecord records[MAX_UNDO_STEPS];
+    int total;
+    size_t log_len;
+    char* log = read_history(filepath, &log_len, records, &total);
+    if (log == NULL || total == 0) {
+        free(log);
+        return;
+    }
+    const StepRecord* newest = &records[(total - 1) % MAX_UNDO_STEPS];
+    size_t from = newest->start;
+    for (int k = 1; k < total && k < MAX_UNDO_STEPS; k++) {
+        const StepRecord* r = &records[(total - 1 - k) % MAX_UNDO_STEPS];
+        if (newest->end - r->start > UNDO_LOG_KEEP_BYTES) break;
+        from = r->start;
+    }
+
+    char path[BUFFER_SIZE], tmp_path[BUFFER_SIZE];
+    if (!undo_log_path(filepath, path, sizeof(path))) {
+        free(log);
+        return;
+    }
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    if (fd >= 0) {
+        size_t keep = newest->end - from;
+        finish_file_replace(fd, tmp_path, path, write(fd, log + from, keep) == (ssize_t)keep, 0);
+    }
+    free(log);
+}
+
+int save_undo_step(UndoStep* step, const char* filepath, size_t length) {
+    if (step->ok && step->deltas == 0) {
+        discard_undo_step(step);
+        return 1;
+    }
+    char path[BUFFER_SIZE];
+    int named = undo_log_path(filepath, path, sizeof(path));
+    int ok = step->ok && named;
+    off_t size = 0;
+    if (ok) {
+        char header[128];
+        int header_len = snprintf(header, sizeof(header), "U %d %zu %zu %lu\n", step->deltas, step->len,
+                                  length, payload_checksum(step->data, step->len));
+        struct iovec iov[3] = {{header, header_len}, {step->data, step->len}, {(void*)"\n", 1}};
+        size_t total = header_len + step->len + 1;
+        ensure_parent_dir(path); // A file in a folder
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        ok = (fd >= 0 && writev(fd, iov, 3) == (ssize_t)total);
+        if (ok) size = lseek(fd, 0, SEEK_END);
+        if (fd >= 0) close(fd);
+    }
+    discard_undo_step(step);
+    if (!ok) {
+        // Without this step the history no longer leads to the file's text
+        printf("[SS] WARNING: Could not record undo step for %s, dropping its history\n", filepath);
+        if (named) unlink(path);
+        return 0;
+    }
+    if (size > UNDO_LOG_MAX_BYTES) compact_history(filepath);
+    return 1;
+}
+
+void trim_undo_history(const char* filepath, size_t keep) {
+    char path[BUFFER_SIZE];
+    if (!undo_log_path(filepath, path, sizeof(path))) return;
+    if (keep == 0) {
+        unlink(path);
+    } else if (truncate(path, keep) != 0) {
+        perror("[SS] Trimming undo history");
+    }
+}
+
+void drop_undo_history(const char* filepath) {
+    char path[BUFFER_SIZE];
+    if (undo_log_path(filepath, path, sizeof(path))) unlink(path);
+}
+
+void move_undo_history(const char* from, const char* to) {
+    char from_path[BUFFER_SIZE], to_path[BUFFER_SIZE];
+    if (!undo_log_path(to, to_path, sizeof(to_path))) {
+        drop_undo_history(from);
+        return;
+    }
+    if (!undo_log_path(from, from_path, sizeof(from_path))) {
+        unlink(to_path); // Its history could never have been saved
+        return;
+    }
+    ensure_parent_dir(to_path);
+    if (rename(from_path, to_path) != 0 && errno == ENOENT) unlink(to_path);
+}
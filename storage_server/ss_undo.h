@@ -0,0 +1,58 @@
+#ifndef SS_UNDO_H
+#define SS_UNDO_H
+
+#include "../common/utils.h"
+
+// Undo history of a file, kept in <data dir>/.undo/<file>.undo, out of the
+// files' own namespace as the checkpoint store is. Every write adds
+// one step holding its edits as reverse deltas: where in the text each edit
+// happened, the text it replaced and the text it put there. So a write costs
+// the size of its edits, not of the file. UNDO takes steps back newest
+// first, checking that the text each one put in place is still there.
+//
+// A step is "U <deltas> <payload len> <length after> <checksum>\n", then
+// one "<offset> <old len> <new len>\n<old text><new text>" per delta, then
+// "\n". The checksum (FNV-1a over the payload) finds a step torn by a
+// crash; nothing after it is used.
+#define UNDO_DIR_NAME ".undo"
+#define UNDO_LOG_SUFFIX ".undo"
+#define UNDO_LOG_MAX_BYTES (1024 * 1024) // Older steps are dropped beyond this...
+#define UNDO_LOG_KEEP_BYTES (256 * 1024)  // ...keeping the newest steps that fit in this
+#define MAX_UNDO_STEPS 64                 // Most steps the history keeps, and one UNDO takes back
+
+// The reverse deltas of one write, built up while its edits are applied
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    int deltas;
+    int ok; // Every delta was recorded
+} UndoStep;
+
+// Sets the data directory whose files have histories. Call once at startup.
+// Returns 1 on success.
+int undo_history_open(const char* data_dir);
+
+void begin_undo_step(UndoStep* step);
+// Records that the `old_len` bytes at `offset` were replaced by `new_text`
+void add_undo_delta(UndoStep* step, size_t offset, const char* old_text, size_t old_len,
+                    const char* new_text, size_t new_len);
+// Adds the step to the file's history and frees it. Call once the edits are
+// durable; `length` is the length of the text after them. Returns 1 on
+// success.
+int save_undo_step(UndoStep* step, const char* filepath, size_t length);
+void discard_undo_step(UndoStep* step);
+
+// Takes the newest `steps` steps back off `*text` (`*len` bytes, malloc'd,
+// reallocated as needed). Returns 1 on success, 0 if the history is
+// shorter, -1 if the text no longer matches it. *keep is how much of the
+// history to keep once the undone text is written.
+int undo_steps(const char* filepath, int steps, char** text, size_t* len, size_t* keep);
+// Cuts the history back to `keep` bytes, as returned by undo_steps
+void trim_undo_history(const char* filepath, size_t keep);
+// For files changed outside the sentence API, which the history no longer
+// describes, and files renamed
+void drop_undo_history(const char* filepath);
+void move_undo_history(const char* from, const char* to);
+
+#endif
@@ -2,196 +2,627 @@
 #include <ctype.h>
 #include "../common/config.h"
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <errno.h>
-// Global lock list
-FileLock file_locks[MAX_FILE_LOCKS];
-int file_lock_count = 0;
-pthread_mutex_t file_lock_list_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Finds a lock struct for a file, or creates one
-FileLock* get_or_create_file_lock(const char* filename) {
-    pthread_mutex_lock(&file_lock_list_mutex);
-    
-    // 1. Try to find existing lock
-    for (int i = 0; i < file_lock_count; i++) {
-        if (strcmp(file_locks[i].filename, filename) == 0) {
-            pthread_mutex_unlock(&file_lock_list_mutex);
-            return &file_locks[i];
+#include <poll.h>
+#include <netinet/tcp.h>
+// Lock table, sharded by a hash of the file name
+typedef struct {
+    pthread_mutex_t mutex;
+    FileLock* buckets[LOCK_SHARD_BUCKETS];
+} LockShard;
+
+static LockShard lock_shards[LOCK_TABLE_SHARDS];
+static pthread_once_t lock_table_once = PTHREAD_ONCE_INIT;
+
+static void init_lock_table(void) {
+    for (int i = 0; i < LOCK_TABLE_SHARDS; i++) {
+        pthread_mutex_init(&lock_shards[i].mutex, NULL);
+    }
+}
+
+static unsigned int hash_filename(const char* filename) {
+    unsigned int hash = 5381;
+    for (const unsigned char* p = (const unsigned char*)filename; *p; p++) {
+        hash = hash * 33 + *p;
+    }
+    return hash;
+}
+
+// Looks a file up in the lock table, optionally creating its entry. The
+// returned lock holds a reference.
+static FileLock* lookup_file_lock(const char* filename, int create) {
+    pthread_once(&lock_table_once, init_lock_table);
+    unsigned int hash = hash_filename(filename);
+    LockShard* shard = &lock_shards[hash % LOCK_TABLE_SHARDS];
+    FileLock** bucket = &shard->buckets[(hash / LOCK_TABLE_SHARDS) % LOCK_SHARD_BUCKETS];
+
+    pthread_mutex_lock(&shard->mutex);
+    for (FileLock* lock = *bucket; lock != NULL; lock = lock->next) {
+        if (strcmp(lock->filename, filename) == 0) {
+            lock->refcount++;
+            pthread_mutex_unlock(&shard->mutex);
+            return lock;
         }
     }
-    
-    // 2. Not found, create a new one
-    if (file_lock_count >= MAX_FILE_LOCKS) {
-        pthread_mutex_unlock(&file_lock_list_mutex);
-        return NULL; // No space for new locks
+    if (!create) {
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
     }
-    
-    FileLock* new_lock = &file_locks[file_lock_count];
-    strcpy(new_lock->filename, filename);
-    new_lock->locked_count = 0;
-    for (int i = 0; i < MAX_LOCKED_SENTENCES; i++) {
-        new_lock->locked_sentences[i].sentence_num = -1;
-        new_lock->locked_sentences[i].sentence_content[0] = '\0';
+
+    FileLock* new_lock = calloc(1, sizeof(FileLock));
+    if (new_lock != NULL) new_lock->filename = strdup(filename);
+    if (new_lock == NULL || new_lock->filename == NULL) {
+        free(new_lock);
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
     }
     pthread_mutex_init(&new_lock->mutex, NULL);
-    
-    file_lock_count++;
-    
-    pthread_mutex_unlock(&file_lock_list_mutex);
+    pthread_mutex_init(&new_lock->write_mutex, NULL);
+    new_lock->refcount = 1;
+    new_lock->next = *bucket;
+    *bucket = new_lock;
+
+    pthread_mutex_unlock(&shard->mutex);
     return new_lock;
 }
 
-// Tries to lock a sentence for a file
-// Returns 1 on success, 0 on failure (already locked)
-int lock_sentence(const char* filename, int sentence_num, const char* sentence_content) {
-    FileLock* lock = get_or_create_file_lock(filename);
-    if (lock == NULL) return 0; // Failed to get lock struct
+FileLock* acquire_file_lock(const char* filename) {
+    return lookup_file_lock(filename, 1);
+}
+
+FileLock* begin_file_change(const char* filepath) {
+    FileLock* lock = acquire_file_lock(filepath);
+    if (lock == NULL) return NULL;
+    pthread_mutex_lock(&lock->write_mutex);
+    if (!wal_release_file(filepath)) {
+        end_file_change(lock);
+        return NULL;
+    }
+    return lock;
+}
 
+void end_file_change(FileLock* lock) {
+    if (lock == NULL) return;
+    pthread_mutex_unlock(&lock->write_mutex);
+    release_file_lock(lock);
+}
+
+static void reap_expired_locks(FileLock* lock);
+
+// Drops a reference, freeing the entry if it was the last one and no
+// sentence of the file is locked any more
+void release_file_lock(FileLock* lock) {
+    if (lock == NULL) return;
+    unsigned int hash = hash_filename(lock->filename);
+    LockShard* shard = &lock_shards[hash % LOCK_TABLE_SHARDS];
+
+    pthread_mutex_lock(&shard->mutex);
+    if (--lock->refcount > 0) {
+        pthread_mutex_unlock(&shard->mutex);
+        return;
+    }
     pthread_mutex_lock(&lock->mutex);
-    
-    // Check if this specific sentence is already locked
+    reap_expired_locks(lock);
+    int in_use = lock->locked_count > 0;
+    pthread_mutex_unlock(&lock->mutex);
+    if (!in_use) {
+        FileLock** link = &shard->buckets[(hash / LOCK_TABLE_SHARDS) % LOCK_SHARD_BUCKETS];
+        while (*link != lock) link = &(*link)->next;
+        *link = lock->next;
+        pthread_mutex_destroy(&lock->mutex);
+        pthread_mutex_destroy(&lock->write_mutex);
+        free(lock->locked_sentences);
+        free(lock->filename);
+        free(lock);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// Generates a lock token. Never returns 0, which callers use for failure.
+static unsigned long next_lock_token(void) {
+    static unsigned int seed = 0;
+    static unsigned long counter = 0;
+    static pthread_mutex_t token_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&token_mutex);
+    if (seed == 0) {
+        seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+    }
+    unsigned long token = ((unsigned long)rand_r(&seed) << 20) ^ ++counter;
+    pthread_mutex_unlock(&token_mutex);
+    return token ? token : 1;
+}
+
+// LOCK wait counters for SSSTATS
+static pthread_mutex_t lock_wait_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int lock_waiters = 0;
+static unsigned long lock_waits = 0;
+static unsigned long lock_wait_timeouts = 0;
+
+// Lease timer wheel. Each lease handed out is filed under the slot for the
+// second it expires in; the sweeper visits every slot as its second comes
+// round. Renewing only moves the lease's expiry, and an entry that fires
+// early is filed again under the new expiry. Entries for locks released in
+// the meantime are simply dropped when they fire.
+typedef struct LeaseTimer {
+    char* filename;
+    unsigned long token;
+    time_t expiry;
+    struct LeaseTimer* next;
+} LeaseTimer;
+
+static LeaseTimer* lease_wheel[LEASE_WHEEL_SLOTS];
+static pthread_mutex_t lease_wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_lease_timer(LeaseTimer* timer) {
+    pthread_mutex_lock(&lease_wheel_mutex);
+    LeaseTimer** slot = &lease_wheel[timer->expiry % LEASE_WHEEL_SLOTS];
+    timer->next = *slot;
+    *slot = timer;
+    pthread_mutex_unlock(&lease_wheel_mutex);
+}
+
+// Files a new lease on the wheel. If this fails the lease still expires,
+// just not until someone next looks at the file's locks.
+static void schedule_lease(const char* filename, unsigned long token, time_t expiry) {
+    LeaseTimer* timer = malloc(sizeof(LeaseTimer));
+    if (timer == NULL) return;
+    timer->filename = strdup(filename);
+    if (timer->filename == NULL) {
+        free(timer);
+        return;
+    }
+    timer->token = token;
+    timer->expiry = expiry;
+    add_lease_timer(timer);
+}
+
+// Unlinks and returns the longest waiting LOCK for a sentence, or NULL.
+// Caller holds lock->mutex.
+static LockWaiter* take_waiter(FileLock* lock, unsigned long sentence_id) {
+    LockWaiter* prev = NULL;
+    for (LockWaiter* w = lock->waiters_head; w != NULL; prev = w, w = w->next) {
+        if (w->sentence_id != sentence_id) continue;
+        if (prev) prev->next = w->next; else lock->waiters_head = w->next;
+        if (lock->waiters_tail == w) lock->waiters_tail = prev;
+        w->next = NULL;
+        return w;
+    }
+    return NULL;
+}
+
+// Removes entry `i` from the lock's list, or hands the sentence over to the
+// first LOCK waiting for it. Caller holds lock->mutex.
+static void remove_sentence_lock(FileLock* lock, int i) {
+    LockWaiter* waiter = take_waiter(lock, lock->locked_sentences[i].sentence_id);
+    if (waiter != NULL) {
+        waiter->token = next_lock_token();
+        lock->locked_sentences[i].token = waiter->token;
+        lock->locked_sentences[i].lease_expiry = time(NULL) + WRITE_LEASE_SECONDS;
+        schedule_lease(lock->filename, waiter->token, lock->locked_sentences[i].lease_expiry);
+        pthread_cond_signal(&waiter->cond);
+        return;
+    }
+    for (int j = i; j < lock->locked_count - 1; j++) {
+        lock->locked_sentences[j] = lock->locked_sentences[j + 1];
+    }
+    lock->locked_count--;
+    if (lock->locked_count == 0) {
+        close_document(lock->pinned);
+        lock->pinned = NULL;
+    }
+}
+
+// Drops locks whose lease ran out, e.g. a client that took a LOCK and never
+// came back. Caller holds lock->mutex.
+static void reap_expired_locks(FileLock* lock) {
+    time_t now = time(NULL);
+    for (int i = lock->locked_count - 1; i >= 0; i--) {
+        if (lock->locked_sentences[i].lease_expiry <= now) {
+            printf("[SS] Lease expired for sentence id %lu of %s\n",
+                   lock->locked_sentences[i].sentence_id, lock->filename);
+            remove_sentence_lock(lock, i);
+        }
+    }
+}
+
+// Index of the lock entry for a sentence, or -1. Caller holds lock->mutex.
+static int find_sentence_lock(FileLock* lock, unsigned long sentence_id) {
     for (int i = 0; i < lock->locked_count; i++) {
-        if (lock->locked_sentences[i].sentence_num == sentence_num) {
-            // This sentence is already locked
-            pthread_mutex_unlock(&lock->mutex);
-            return 0; // Failure
+        if (lock->locked_sentences[i].sentence_id == sentence_id) return i;
+    }
+    return -1;
+}
+
+// Queues for a held sentence until it is handed to us or `wait_seconds`
+// pass. Returns the token or 0 on timeout. Caller holds lock->mutex.
+static unsigned long wait_for_sentence(FileLock* lock, unsigned long sentence_id, int wait_seconds) {
+    LockWaiter waiter = {sentence_id, 0, PTHREAD_COND_INITIALIZER, NULL};
+    if (lock->waiters_tail) lock->waiters_tail->next = &waiter; else lock->waiters_head = &waiter;
+    lock->waiters_tail = &waiter;
+    pthread_mutex_lock(&lock_wait_stats_mutex);
+    lock_waiters++;
+    lock_waits++;
+    pthread_mutex_unlock(&lock_wait_stats_mutex);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_seconds;
+    while (waiter.token == 0) {
+        // An abandoned holder is reaped by the lease sweeper, which hands
+        // the sentence over like an UNLOCK would
+        pthread_cond_timedwait(&waiter.cond, &lock->mutex, &deadline);
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int past_deadline = now.tv_sec > deadline.tv_sec ||
+                            (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+        if (waiter.token == 0 && past_deadline) {
+            // Give up our place in the queue
+            LockWaiter** link = &lock->waiters_head;
+            LockWaiter* prev = NULL;
+            while (*link != &waiter) {
+                prev = *link;
+                link = &(*link)->next;
+            }
+            *link = waiter.next;
+            if (lock->waiters_tail == &waiter) lock->waiters_tail = prev;
+            break;
         }
     }
+    pthread_cond_destroy(&waiter.cond);
+
+    pthread_mutex_lock(&lock_wait_stats_mutex);
+    lock_waiters--;
+    if (waiter.token == 0) lock_wait_timeouts++;
+    pthread_mutex_unlock(&lock_wait_stats_mutex);
+    return waiter.token;
+}
+
+// Adds a lock entry for a free sentence. Returns 0 if the lock list could
+// not grow. Caller holds lock->mutex.
+static int add_sentence_lock(FileLock* lock, unsigned long sentence_id, unsigned long token, time_t lease_expiry) {
+    if (lock->locked_count >= MAX_LOCKED_SENTENCES) return 0;
+    if (lock->locked_count == lock->locked_capacity) {
+        int capacity = lock->locked_capacity ? lock->locked_capacity * 2 : 4;
+        if (capacity > MAX_LOCKED_SENTENCES) capacity = MAX_LOCKED_SENTENCES;
+        SentenceLock* grown = realloc(lock->locked_sentences, capacity * sizeof(SentenceLock));
+        if (grown == NULL) return 0;
+        lock->locked_sentences = grown;
+        lock->locked_capacity = capacity;
+    }
     
-    // Check if we have space for another lock
-    if (lock->locked_count >= MAX_LOCKED_SENTENCES) {
+    // Keep the document, and with it the sentence IDs, from being evicted
+    // while the lock is held. A reloaded document gets pinned afresh.
+    Document* doc = open_document(lock->filename);
+    if (doc != lock->pinned) {
+        close_document(lock->pinned);
+        lock->pinned = doc;
+    } else {
+        close_document(doc);
+    }
+
+    SentenceLock* entry = &lock->locked_sentences[lock->locked_count];
+    entry->sentence_id = sentence_id;
+    entry->token = token;
+    entry->lease_expiry = lease_expiry;
+    lock->locked_count++;
+    return 1;
+}
+
+// Tries to lock a sentence (by document sentence ID) for a file
+// Returns the lock token on success, 0 on failure (already locked)
+unsigned long lock_sentence(const char* filename, unsigned long sentence_id, int wait_seconds, int* timed_out) {
+    *timed_out = 0;
+    FileLock* lock = acquire_file_lock(filename);
+    if (lock == NULL) return 0; // Failed to get lock struct
+
+    pthread_mutex_lock(&lock->mutex);
+    reap_expired_locks(lock);
+    
+    // Queue behind the holder if the sentence is already locked
+    if (find_sentence_lock(lock, sentence_id) >= 0) {
+        unsigned long token = 0;
+        if (wait_seconds > 0) {
+            token = wait_for_sentence(lock, sentence_id, wait_seconds);
+            *timed_out = (token == 0);
+        }
         pthread_mutex_unlock(&lock->mutex);
-        return 0; // No space for more locks
+        release_file_lock(lock);
+        return token;
     }
     
-    // Lock this sentence and store its content
-    lock->locked_sentences[lock->locked_count].sentence_num = sentence_num;
-    strncpy(lock->locked_sentences[lock->locked_count].sentence_content, sentence_content, 2047);
-    lock->locked_sentences[lock->locked_count].sentence_content[2047] = '\0';
-    lock->locked_count++;
+    unsigned long token = next_lock_token();
+    time_t lease_expiry = time(NULL) + WRITE_LEASE_SECONDS;
+    if (add_sentence_lock(lock, sentence_id, token, lease_expiry)) {
+        schedule_lease(filename, token, lease_expiry);
+    } else {
+        token = 0; // No space for more locks
+    }
     
     pthread_mutex_unlock(&lock->mutex);
-    return 1; // Success
+    release_file_lock(lock);
+    return token;
 }
 
-// Unlocks a sentence
-void unlock_sentence(const char* filename, int sentence_num) {
-    FileLock* lock = get_or_create_file_lock(filename); // Should exist
-    if (lock == NULL) return;
+// Locks several sentences of a file under one token, all or none. Sets do
+// not queue: waiting while holding part of a set could deadlock.
+unsigned long lock_sentence_set(const char* filename, const unsigned long* sentence_ids, int count) {
+    FileLock* lock = acquire_file_lock(filename);
+    if (lock == NULL) return 0;
 
     pthread_mutex_lock(&lock->mutex);
+    reap_expired_locks(lock);
     
-    // Find and remove this sentence from the locked list
-    for (int i = 0; i < lock->locked_count; i++) {
-        if (lock->locked_sentences[i].sentence_num == sentence_num) {
-            // Found it - shift remaining entries left
-            for (int j = i; j < lock->locked_count - 1; j++) {
-                lock->locked_sentences[j] = lock->locked_sentences[j + 1];
+    int available = lock->locked_count + count <= MAX_LOCKED_SENTENCES;
+    for (int i = 0; available && i < count; i++) {
+        available = find_sentence_lock(lock, sentence_ids[i]) < 0;
+    }
+    unsigned long token = 0;
+    if (available) {
+        token = next_lock_token();
+        time_t lease_expiry = time(NULL) + WRITE_LEASE_SECONDS;
+        int added = 0;
+        while (added < count && add_sentence_lock(lock, sentence_ids[added], token, lease_expiry)) {
+            added++;
+        }
+        if (added == count) {
+            schedule_lease(filename, token, lease_expiry);
+        } else {
+            // Out of memory part way: give back what we took
+            for (int i = lock->locked_count - 1; i >= 0; i--) {
+                if (lock->locked_sentences[i].token == token) remove_sentence_lock(lock, i);
             }
-            lock->locked_sentences[lock->locked_count - 1].sentence_num = -1;
-            lock->locked_sentences[lock->locked_count - 1].sentence_content[0] = '\0';
-            lock->locked_count--;
-            break;
+            token = 0;
         }
     }
     
     pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return token;
 }
 
-// Check if a file has any active locks
-int is_file_locked(const char* filename) {
-    pthread_mutex_lock(&file_lock_list_mutex);
+void get_lock_wait_stats(int* waiters, unsigned long* waits, unsigned long* timeouts) {
+    pthread_mutex_lock(&lock_wait_stats_mutex);
+    *waiters = lock_waiters;
+    *waits = lock_waits;
+    *timeouts = lock_wait_timeouts;
+    pthread_mutex_unlock(&lock_wait_stats_mutex);
+}
+
+// Releases the sentence lock held under `token`
+void unlock_sentence(const char* filename, unsigned long token) {
+    FileLock* lock = lookup_file_lock(filename, 0);
+    if (lock == NULL) return;
+
+    pthread_mutex_lock(&lock->mutex);
     
-    printf("[SS] Checking locks for file: '%s'\n", filename);
-    printf("[SS] Current lock list has %d files:\n", file_lock_count);
-    for (int i = 0; i < file_lock_count; i++) {
-        printf("[SS]   File %d: '%s' (locked_count: %d)\n", i, file_locks[i].filename, file_locks[i].locked_count);
+    // Find and remove every sentence locked under the token. Removing an
+    // entry only moves the ones after it, which were already checked.
+    for (int i = lock->locked_count - 1; i >= 0; i--) {
+        if (lock->locked_sentences[i].token == token) {
+            remove_sentence_lock(lock, i);
+        }
     }
     
-    // Search for this file in the lock list
-    for (int i = 0; i < file_lock_count; i++) {
-        if (strcmp(file_locks[i].filename, filename) == 0) {
-            pthread_mutex_lock(&file_locks[i].mutex);
-            int locked = (file_locks[i].locked_count > 0);
-            pthread_mutex_unlock(&file_locks[i].mutex);
-            pthread_mutex_unlock(&file_lock_list_mutex);
-            printf("[SS] Lock check result: %s (locked_count: %d)\n", locked ? "LOCKED" : "UNLOCKED", file_locks[i].locked_count);
-            return locked;
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+}
+
+// Looks up the sentence IDs a lock token was issued for, in the order they
+// were locked. Returns how many there are (at most `max_ids` are copied),
+// 0 if the token is unknown, -1 if its lease has expired (the locks are
+// dropped in that case).
+int find_lock_by_token(const char* filename, unsigned long token, unsigned long* sentence_ids, int max_ids) {
+    if (token == 0) return 0;
+    FileLock* lock = lookup_file_lock(filename, 0);
+    if (lock == NULL) return 0;
+
+    int found = 0;
+    int expired = 0;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&lock->mutex);
+    for (int i = 0; i < lock->locked_count; i++) {
+        if (lock->locked_sentences[i].token != token) continue;
+        if (lock->locked_sentences[i].lease_expiry <= now) expired = 1;
+        if (found < max_ids) sentence_ids[found] = lock->locked_sentences[i].sentence_id;
+        found++;
+    }
+    if (expired) {
+        for (int i = lock->locked_count - 1; i >= 0; i--) {
+            if (lock->locked_sentences[i].token == token) remove_sentence_lock(lock, i);
         }
+        found = -1;
     }
-    
-    pthread_mutex_unlock(&file_lock_list_mutex);
-    printf("[SS] Lock check result: UNLOCKED (file not in lock list)\n");
-    return 0; // File not found in lock list, so not locked
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return found;
 }
 
-// Find a sentence by its content (used when sentence numbers shift)
-int find_sentence_by_content(const char* filepath, const char* locked_content, int original_num) {
-    char (*sentences)[2048] = malloc(100 * sizeof(char[2048]));
-    if (!sentences) return -1;
-    
-    int sentence_count = read_sentences_from_file(filepath, sentences, 100);
-    
-    printf("[SS] find_sentence_by_content: Searching for locked content (len=%zu)\n", strlen(locked_content));
-    printf("[SS]   Locked content: '%s'\n", locked_content);
-    printf("[SS]   Original position: %d, Current sentence count: %d\n", original_num, sentence_count);
-    
-    // First try the original position
-    if (original_num > 0 && original_num <= sentence_count) {
-        printf("[SS]   Checking original position %d: '%s'\n", original_num, sentences[original_num - 1]);
-        if (strcmp(sentences[original_num - 1], locked_content) == 0) {
-            printf("[SS]   ✓ Found at original position %d\n", original_num);
-            free(sentences);
-            return original_num;
+int renew_sentence_lock(const char* filename, unsigned long token) {
+    if (token == 0) return 0;
+    FileLock* lock = lookup_file_lock(filename, 0);
+    if (lock == NULL) return 0;
+
+    int result = 0;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&lock->mutex);
+    for (int i = lock->locked_count - 1; i >= 0; i--) {
+        if (lock->locked_sentences[i].token != token) continue;
+        if (lock->locked_sentences[i].lease_expiry <= now) {
+            remove_sentence_lock(lock, i);
+            result = -1;
+        } else if (result == 0) {
+            result = 1;
         }
     }
-    
-    // Search for the sentence by content
-    for (int i = 0; i < sentence_count; i++) {
-        printf("[SS]   Checking position %d: '%s' (len=%zu)\n", i + 1, sentences[i], strlen(sentences[i]));
-        if (strcmp(sentences[i], locked_content) == 0) {
-            printf("[SS]   ✓ Found at position %d (moved from %d)\n", i + 1, original_num);
-            free(sentences);
-            return i + 1; // Return 1-indexed
+    // The wheel entry reschedules itself when it finds the new expiry
+    for (int i = 0; result == 1 && i < lock->locked_count; i++) {
+        if (lock->locked_sentences[i].token == token) {
+            lock->locked_sentences[i].lease_expiry = now + WRITE_LEASE_SECONDS;
         }
     }
-    
-    printf("[SS]   ✗ Sentence not found in file!\n");
-    free(sentences);
-    return -1; // Not found
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return result;
+}
+
+// Handles a lease whose wheel slot came round. Returns 1 if the timer was
+// filed again under a later expiry, 0 if it is finished with.
+static int fire_lease_timer(LeaseTimer* timer, time_t now) {
+    FileLock* lock = lookup_file_lock(timer->filename, 0);
+    if (lock == NULL) return 0;
+
+    int rescheduled = 0;
+    pthread_mutex_lock(&lock->mutex);
+    for (int i = lock->locked_count - 1; i >= 0; i--) {
+        if (lock->locked_sentences[i].token != timer->token) continue;
+        if (lock->locked_sentences[i].lease_expiry <= now) {
+            printf("[SS] Lease expired for sentence id %lu of %s\n",
+                   lock->locked_sentences[i].sentence_id, lock->filename);
+            remove_sentence_lock(lock, i);
+        } else if (!rescheduled) {
+            // All sentences locked under one token share a lease
+            timer->expiry = lock->locked_sentences[i].lease_expiry;
+            add_lease_timer(timer);
+            rescheduled = 1;
+        }
+    }
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return rescheduled;
+}
+
+void* lease_sweeper_thread(void* arg) {
+    (void)arg;
+    time_t swept = time(NULL);
+    while (1) {
+        sleep(1);
+        time_t now = time(NULL);
+        // After a clock jump, one full turn of the wheel covers every slot
+        if (now - swept > LEASE_WHEEL_SLOTS) swept = now - LEASE_WHEEL_SLOTS;
+        if (now < swept) swept = now;
+        for (; swept < now; swept++) {
+            pthread_mutex_lock(&lease_wheel_mutex);
+            LeaseTimer** slot = &lease_wheel[(swept + 1) % LEASE_WHEEL_SLOTS];
+            LeaseTimer* due = *slot;
+            *slot = NULL;
+            pthread_mutex_unlock(&lease_wheel_mutex);
+
+            while (due != NULL) {
+                LeaseTimer* timer = due;
+                due = due->next;
+                if (!fire_lease_timer(timer, now)) {
+                    free(timer->filename);
+                    free(timer);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+// Check if one sentence of a file is currently locked
+int is_sentence_locked(const char* filename, unsigned long sentence_id) {
+    FileLock* lock = lookup_file_lock(filename, 0);
+    if (lock == NULL) return 0;
+
+    int locked = 0;
+    pthread_mutex_lock(&lock->mutex);
+    reap_expired_locks(lock);
+    for (int i = 0; i < lock->locked_count; i++) {
+        if (lock->locked_sentences[i].sentence_id == sentence_id) {
+            locked = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return locked;
+}
+
+// Check if a file has any active locks
+int is_file_locked(const char* filename) {
+    FileLock* lock = lookup_file_lock(filename, 0);
+    if (lock == NULL) return 0; // Nobody has locked anything in it
+
+    pthread_mutex_lock(&lock->mutex);
+    reap_expired_locks(lock);
+    int locked = (lock->locked_count > 0);
+    pthread_mutex_unlock(&lock->mutex);
+    release_file_lock(lock);
+    return locked;
 }
 
 // --- File I/O Handlers ---
 
 void handle_read(int sock, const char* filepath) {
-    FILE* f = fopen(filepath, "r");
-    if (f == NULL) {
+    // A large file that is not cached goes out by sendfile without being
+    // loaded; the rest is served from the document cache, a hot file
+    // costing no disk I/O
+    if (send_uncached_file(filepath, sock)) return;
+    Document* doc = open_document(filepath);
+    if (doc == NULL || document_missing(doc)) {
+        close_document(doc);
         write(sock, "ERR_SS_FILE_NOT_FOUND\n", 22);
         return;
     }
-    
-    char buffer[BUFFER_SIZE];
-    size_t n;
-    while ((n = fread(buffer, 1, BUFFER_SIZE, f)) > 0) {
-        if (write(sock, buffer, n) < 0) {
-            break; // Client disconnected
-        }
-    }
-    fclose(f);
+    send_document(doc, sock);
+    close_document(doc);
+}
+
+// Reports document cache, lock wait, commit, fsync, WAL and checkpoint
+// store counters:
+// ACK_SSSTATS key=value ...
+void handle_ssstats(int sock) {
+    DocumentCacheStats stats;
+    get_document_cache_stats(&stats);
+    int waiters;
+    unsigned long waits, timeouts;
+    get_lock_wait_stats(&waiters, &waits, &timeouts);
+    unsigned long commits, batches;
+    get_group_commit_stats(&commits, &batches);
+    WalStats wal;
+    get_wal_stats(&wal);
+    CheckpointStoreStats store;
+    get_checkpoint_store_stats(&store);
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response),
+             "ACK_SSSTATS cache_hits=%lu cache_misses=%lu cache_evictions=%lu cache_documents=%d cache_bytes=%zu "
+             "lock_waiters=%d lock_waits=%lu lock_wait_timeouts=%lu commits=%lu commit_batches=%lu "
+             "fsync_policy=%s fsyncs=%lu wal_records=%lu wal_syncs=%lu wal_checkpoints=%lu "
+             "checkpoint_chunks=%lu checkpoint_chunk_bytes=%lu chunks_written=%lu chunks_reused=%lu "
+             "checkpoint_deltas=%lu checkpoints_rebased=%lu checkpoints_retired=%lu\n",
+             stats.hits, stats.misses, stats.evictions, stats.documents, stats.bytes,
+             waiters, waits, timeouts, commits, batches, fsync_policy_name(), get_fsync_count(),
+             wal.records, wal.syncs, wal.checkpoints,
+             store.chunks, store.chunk_bytes, store.written, store.reused, store.deltas, store.rebased,
+             store.retired);
+    write(sock, response, strlen(response));
 }
 
 // In storage_server/ss_utils.c
 void handle_stream(int sock, const char* filepath) {
-    FILE* f = fopen(filepath, "r");
-    if (f == NULL) {
+    // Take a snapshot so the document isn't held while we pace the stream
+    Document* doc = open_document(filepath);
+    if (doc == NULL || document_missing(doc)) {
+        close_document(doc);
+        write(sock, "ERR_SS_FILE_NOT_FOUND\n", 22);
+        return;
+    }
+    size_t len;
+    char* text = copy_document_text(doc, &len);
+    close_document(doc);
+    if (text == NULL) {
         write(sock, "ERR_SS_FILE_NOT_FOUND\n", 22);
         return;
     }
 
     char word[256];
     int ch, i = 0;
-    while ((ch = fgetc(f)) != EOF) {
+    for (size_t pos = 0; pos < len; pos++) {
+        ch = (unsigned char)text[pos];
         if (ch == '.' || ch == '!' || ch == '?') {
             // Punctuation. Attach to word and send.
             word[i++] = ch;
@@ -226,7 +657,7 @@ void handle_stream(int sock, const char* filepath) {
         write(sock, word, strlen(word));
         usleep(100000);
     }
-    fclose(f);
+    free(text);
 }
 // Structure to store write operations
 typedef struct {
@@ -257,86 +688,225 @@ int split_sentence_into_words(const char* sentence, char words[][256], int max_w
     return word_count;
 }
 
-// Helper function to read all sentences from a file
-int read_sentences_from_file(const char* filepath, char sentences[][2048], int max_sentences) {
-    FILE* f = fopen(filepath, "r");
-    if (!f) return 0;
+// Replication mode of each file as of its last NM_FILE_MODIFIED reply
+typedef struct ReplModeEntry {
+    char* filename;
+    int async;
+    struct ReplModeEntry* next;
+} ReplModeEntry;
+
+static ReplModeEntry* repl_mode_buckets[REPL_MODE_CACHE_BUCKETS];
+static pthread_mutex_t repl_mode_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void remember_repl_mode(const char* filename, int async) {
+    ReplModeEntry** bucket = &repl_mode_buckets[hash_filename(filename) % REPL_MODE_CACHE_BUCKETS];
+    pthread_mutex_lock(&repl_mode_mutex);
+    ReplModeEntry* entry = *bucket;
+    while (entry != NULL && strcmp(entry->filename, filename) != 0) entry = entry->next;
+    if (entry == NULL) {
+        entry = malloc(sizeof(ReplModeEntry));
+        if (entry != NULL) entry->filename = strdup(filename);
+        if (entry != NULL && entry->filename == NULL) {
+            free(entry);
+            entry = NULL;
+        }
+        if (entry != NULL) {
+            entry->next = *bucket;
+            *bucket = entry;
+        }
+    }
+    if (entry != NULL) entry->async = async;
+    pthread_mutex_unlock(&repl_mode_mutex);
+}
+
+// Returns 1 only if the NM last said the file replicates asynchronously
+static int known_async_file(const char* filename) {
+    int async = 0;
+    pthread_mutex_lock(&repl_mode_mutex);
+    for (ReplModeEntry* entry = repl_mode_buckets[hash_filename(filename) % REPL_MODE_CACHE_BUCKETS];
+         entry != NULL; entry = entry->next) {
+        if (strcmp(entry->filename, filename) == 0) {
+            async = entry->async;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&repl_mode_mutex);
+    return async;
+}
+
+// Reports a committed modification of `filepath` to the NM (which triggers
+// replication) and waits for its verdict. Returns 1 if the write may be
+// acknowledged to the client, 0 if the file's write quorum was not met.
+int notify_nm_file_modified(const char* filepath) {
+    // Path relative to the data directory (e.g. "folder/file.txt")
+    const char* filename = strchr(filepath, '/');
+    filename = (filename != NULL) ? filename + 1 : filepath;
     
-    int sentence_count = 0;
-    int ch, idx = 0;
+    extern char SS_ID[50];
     
-    // Skip leading whitespace before first sentence only
-    while ((ch = fgetc(f)) != EOF && isspace(ch));
-    if (ch != EOF) ungetc(ch, f);
+    // Get file stats
+    struct stat st;
+    long file_size = 0;
+    long total_words = 0;
+    long char_count = 0;
+    time_t last_access = 0;
     
-    while ((ch = fgetc(f)) != EOF && sentence_count < max_sentences) {
-        // Don't skip spaces - they're part of the sentence content
-        
-        // Check for buffer overflow
-        if (idx >= 2047) {
-            fprintf(stderr, "[SS] Warning: Sentence too long, truncating at 2048 chars\n");
-            sentences[sentence_count][idx] = '\0';
-            // Skip to next delimiter or EOF
-            while ((ch = fgetc(f)) != EOF) {
-                if (ch == '.' || ch == '!' || ch == '?') {
-                    sentence_count++;
-                    idx = 0;
-                    break;
-                }
-            }
-            continue;
-        }
-        
-        sentences[sentence_count][idx++] = ch;
+    if (stat(filepath, &st) == 0) {
+        last_access = st.st_atime;
         
-        if (ch == '.' || ch == '!' || ch == '?') {
-            sentences[sentence_count][idx] = '\0';
-            sentence_count++;
-            idx = 0;
+        // Size and word count come from the cached document, which holds
+        // edits the file only gets at the next WAL checkpoint
+        Document* doc = open_document(filepath);
+        if (doc != NULL) {
+            file_size = (long)document_length(doc);
+            char_count = file_size;
+            total_words = document_word_count(doc);
+            close_document(doc);
         }
     }
     
-    // Handle any remaining text (sentence without delimiter)
-    // This is still part of the LAST sentence (or sentence 1 if file is empty)
-    // It doesn't create a new sentence - only delimiters create sentences
-    // But we need to include this content when reading the last sentence
-    if (idx > 0) {
-        // If we have previous sentences, this belongs to a continuation
-        // If no previous sentences, this is sentence 1 (incomplete)
-        sentences[sentence_count][idx] = '\0';
-        sentence_count++;  // Count it so it can be edited, but it's still the same sentence number
-        printf("[SS] Found incomplete sentence (no delimiter): '%s'\n", sentences[sentence_count-1]);
+    int nm_sock = connect_to_server_timeout(NM_IP, NM_PORT, 2);
+    if (nm_sock < 0) {
+        // The write is safe locally and replicas catch up on the next write
+        // or resync, which is all an ASYNC file promises. Any other mode, or
+        // one not known yet, promised copies that cannot be made now.
+        int async = known_async_file(filename);
+        printf("[SS] WARNING: NM unreachable, %s not replicated%s\n", filename,
+               async ? "" : "; write not acknowledged");
+        return async;
     }
     
-    fclose(f);
-    return sentence_count;
+    char notify_msg[BUFFER_SIZE];
+    snprintf(notify_msg, sizeof(notify_msg), "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld\n", 
+             filename, SS_ID, file_size, total_words, char_count, last_access);
+    write(nm_sock, notify_msg, strlen(notify_msg));
+    
+    struct timeval tv = { NM_NOTIFY_TIMEOUT, 0 };
+    setsockopt(nm_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char reply[BUFFER_SIZE] = {0};
+    int n = read(nm_sock, reply, sizeof(reply) - 1);
+    close(nm_sock);
+    
+    printf("[SS] Notified NM about modification to %s from SS %s (size: %ld, words: %ld): %s", 
+           filename, SS_ID, file_size, total_words, n > 0 ? reply : "no reply\n");
+    if (n <= 0) return 0;
+    remember_repl_mode(filename, strncmp(reply, "ACK_NM_FILE_MODIFIED ASYNC", 26) == 0);
+    if (strncmp(reply, "ACK_NM_FILE_MODIFIED", 20) != 0) return 0;
+
+    // Chain mode: this SS is the head, push the update down the chain ourselves
+    if (strncmp(reply, "ACK_NM_FILE_MODIFIED CHAIN", 26) == 0) {
+        char hops[MAX_SS][64];
+        int hop_count = parse_chain_hops(reply + 26, hops);
+        if (hop_count == 0) return 1;
+
+        // From the cached document, which may be ahead of the file
+        Document* doc = open_document(filepath);
+        if (doc == NULL) return 0;
+        size_t len = 0;
+        char* content = copy_document_text(doc, &len);
+        close_document(doc);
+        if (content == NULL) return 0;
+        int content_len = (int)len;
+
+        int copies = forward_chain_write(filename, content, content_len, hops, hop_count);
+        free(content);
+        printf("[SS] Chain write of %s reached %d of %d replicas\n", filename, copies, hop_count);
+        return copies == hop_count;
+    }
+    return 1;
 }
 
-void handle_write(int sock, const char* filepath, int sentence_num) {
-    // 1. FIRST validate sentence range BEFORE locking
-    // Read the file to check sentence count
-    char (*validation_sentences)[2048] = malloc(100 * sizeof(char[2048]));
-    if (!validation_sentences) {
+// Parses " <n> <ip:port> <ip:port> ..." into hops. Returns the hop count.
+int parse_chain_hops(const char* list, char hops[][64]) {
+    int count = 0, consumed = 0;
+    if (sscanf(list, "%d%n", &count, &consumed) != 1) return 0;
+    list += consumed;
+    int parsed = 0;
+    while (parsed < count && parsed < MAX_SS &&
+           sscanf(list, " %63s%n", hops[parsed], &consumed) == 1) {
+        list += consumed;
+        parsed++;
+    }
+    return parsed;
+}
+
+// Sends `content` to the first hop as NM_CHAINWRITE, handing it the rest of
+// the chain. Each hop applies the update, forwards it, and only answers once
+// everything downstream has answered, so the reply covers the whole tail.
+// Returns how many of the hops applied the update.
+int forward_chain_write(const char* filename, const char* content, int content_len,
+                        char hops[][64], int hop_count) {
+    char ip[64];
+    int port = 0;
+    char* colon = strrchr(hops[0], ':');
+    if (colon == NULL) return 0;
+    snprintf(ip, sizeof(ip), "%.*s", (int)(colon - hops[0]), hops[0]);
+    port = atoi(colon + 1);
+
+    int sock = connect_to_server_timeout(ip, port, 2);
+    if (sock < 0) {
+        printf("[SS] Chain hop %s unreachable\n", hops[0]);
+        return 0;
+    }
+
+    char header[BUFFER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "NM_CHAINWRITE %s %d %d",
+                              filename, content_len, hop_count - 1);
+    for (int i = 1; i < hop_count; i++) {
+        header_len += snprintf(header + header_len, sizeof(header) - header_len, " %s", hops[i]);
+    }
+    header_len += snprintf(header + header_len, sizeof(header) - header_len, "\n");
+
+    int ok = (write(sock, header, header_len) == header_len);
+    int sent = 0;
+    while (ok && sent < content_len) {
+        int n = write(sock, content + sent, content_len - sent);
+        if (n <= 0) ok = 0;
+        else sent += n;
+    }
+
+    // Every hop downstream may wait on its own successor
+    int copies = 0;
+    if (ok) {
+        struct timeval tv = { QUORUM_WAIT_TIMEOUT * hop_count, 0 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char ack[BUFFER_SIZE] = {0};
+        if (read(sock, ack, BUFFER_SIZE - 1) > 0) {
+            sscanf(ack, "%*s %d", &copies);
+        }
+    }
+    close(sock);
+    return copies;
+}
+
+// Checks that each of `sentence_nums` can be written (an existing sentence,
+// or the next one after a complete last sentence) and copies its current
+// text into `contents` ("" for a new sentence) and its ID into
+// `sentence_ids`. Returns the document, which the caller keeps open (and so
+// cached, with those IDs) until it is done with the IDs, or replies with the
+// error and returns NULL.
+static Document* load_target_sentences(int sock, const char* filepath, const int* sentence_nums, int count,
+                                       char (*contents)[2048], unsigned long* sentence_ids) {
+    Document* doc = open_document(filepath);
+    if (doc == NULL) {
         write(sock, "ERR_MEMORY\n", 11);
-        return;
+        return NULL;
     }
-    int sentence_count = read_sentences_from_file(filepath, validation_sentences, 100);
+    int sentence_count = document_sentence_count(doc);
     
-    printf("[SS] File has %d sentences. Requested sentence_num: %d (1-indexed)\n", sentence_count, sentence_num);
+    printf("[SS] File has %d sentences. Requested sentence_num: %d (1-indexed)\n", sentence_count, sentence_nums[0]);
     
     // Check if the last sentence ends with a delimiter
     int last_sentence_complete = 0;
     if (sentence_count > 0) {
-        char* last_sentence = validation_sentences[sentence_count - 1];
-        int len = strlen(last_sentence);
-        if (len > 0) {
+        char last_sentence[2048];
+        long len = get_document_sentence(doc, sentence_count - 1, last_sentence, sizeof(last_sentence));
+        if (len > 0 && len < (long)sizeof(last_sentence)) {
             char last_char = last_sentence[len - 1];
             last_sentence_complete = (last_char == '.' || last_char == '!' || last_char == '?');
         }
     }
     
-    printf("[SS] Last sentence complete (ends with delimiter): %s\n", last_sentence_complete ? "YES" : "NO");
-    
     // Check if sentence_num is valid (1-based)
     // For empty files (sentence_count == 0), only sentence_num == 1 is valid (creates first sentence)
     // For non-empty files with complete last sentence, sentence_num can be from 1 to sentence_count+1 (appending allowed)
@@ -350,92 +920,114 @@ void handle_write(int sock, const char* filepath, int sentence_num) {
         max_valid = sentence_count;  // Cannot append - must finish current sentence first
     }
     
-    if (sentence_num < 1 || sentence_num > max_valid) {
-        printf("[SS] Error: sentence out of range. Valid range: 1-%d\n", max_valid);
-        char err_msg[128];
-        snprintf(err_msg, sizeof(err_msg), "ERR_SENTENCE_OUT_OF_RANGE (Valid range: 1-%d)\n", max_valid);
-        write(sock, err_msg, strlen(err_msg));
-        free(validation_sentences);
-        return;
+    for (int i = 0; i < count; i++) {
+        int sentence_num = sentence_nums[i];
+        if (sentence_num < 1 || sentence_num > max_valid) {
+            printf("[SS] Error: sentence out of range. Valid range: 1-%d\n", max_valid);
+            char err_msg[128];
+            snprintf(err_msg, sizeof(err_msg), "ERR_SENTENCE_OUT_OF_RANGE (Valid range: 1-%d)\n", max_valid);
+            write(sock, err_msg, strlen(err_msg));
+            close_document(doc);
+            return NULL;
+        }
+        
+        // Remember the current sentence content ("" when appending) and its ID
+        // (SENTENCE_ID_APPEND when appending). Edits travel as one protocol line,
+        // so longer sentences cannot be edited this way.
+        contents[i][0] = '\0';
+        long len = get_document_sentence(doc, sentence_num - 1, contents[i], 2048);
+        sentence_ids[i] = get_document_sentence_id(doc, sentence_num - 1);
+        if (len >= 2048) {
+            close_document(doc);
+            write(sock, "ERR_SENTENCE_TOO_LONG\n", 22);
+            return NULL;
+        }
     }
-    
-    free(validation_sentences);
-    
-    // 2. Read the current sentence content for locking
-    char (*lock_sentences)[2048] = malloc(100 * sizeof(char[2048]));
-    if (!lock_sentences) {
-        write(sock, "ERR_MEMORY\n", 11);
-        return;
+    return doc;
+}
+
+static Document* load_target_sentence(int sock, const char* filepath, int sentence_num, char* content, unsigned long* sentence_id) {
+    return load_target_sentences(sock, filepath, &sentence_num, 1, (char (*)[2048])content, sentence_id);
+}
+
+// Copies the current text of a locked sentence into `content` ("" for the
+// append slot). Returns 1, or 0 if the sentence no longer exists.
+static int read_locked_sentence(const char* filepath, unsigned long sentence_id, char* content) {
+    content[0] = '\0';
+    if (sentence_id == SENTENCE_ID_APPEND) return 1;
+    Document* doc = open_document(filepath);
+    if (doc == NULL) return 0;
+    int index = find_document_sentence_by_id(doc, sentence_id);
+    long len = (index >= 0) ? get_document_sentence(doc, index, content, 2048) : -1;
+    close_document(doc);
+    return len >= 0 && len < 2048;
+}
+
+// Validates the requested sentence and locks it (the first half of a
+// WRITE), queueing for up to `wait_seconds` if someone else holds it. On
+// success returns the lock token and copies the locked sentence into
+// `locked_content`; otherwise replies with the error and returns 0.
+static unsigned long acquire_sentence_lock(int sock, const char* filepath, int sentence_num, int wait_seconds, char* locked_content) {
+    unsigned long sentence_id;
+    Document* doc = load_target_sentence(sock, filepath, sentence_num, locked_content, &sentence_id);
+    if (doc == NULL) {
+        return 0;
     }
-    int lock_sentence_count = read_sentences_from_file(filepath, lock_sentences, 100);
     
-    char locked_sentence_content[2048] = "";
-    if (sentence_num - 1 < lock_sentence_count) {
-        strcpy(locked_sentence_content, lock_sentences[sentence_num - 1]);
+    // 3. Now try to lock the sentence by its ID
+    int timed_out;
+    unsigned long token = lock_sentence(filepath, sentence_id, wait_seconds, &timed_out);
+    close_document(doc); // The lock keeps it cached from here
+    if (token == 0) {
+        if (timed_out) {
+            write(sock, "ERR_LOCK_TIMEOUT\n", 17);
+        } else {
+            write(sock, "ERR_SENTENCE_LOCKED\n", 20);
+        }
+        return 0;
     }
-    free(lock_sentences);
-    
-    // 3. Now try to lock the sentence with its content
-    if (!lock_sentence(filepath, sentence_num, locked_sentence_content)) {
-        write(sock, "ERR_SENTENCE_LOCKED\n", 20);
-        return;
+
+    // The sentence may have been edited, or merged away, while we queued
+    if (wait_seconds > 0 && !read_locked_sentence(filepath, sentence_id, locked_content)) {
+        unlock_sentence(filepath, token);
+        write(sock, "ERR_SENTENCE_MOVED_OR_DELETED\n", 30);
+        return 0;
     }
+    return token;
+}
 
-    // 4. Send ACK + original sentence content (trim leading whitespace for prefill)
-    char prefill_sentence[2048] = "";
-    const char *prefill_start = locked_sentence_content;
+// Copies the locked sentence with leading whitespace trimmed, which is what
+// the client pre-fills its edit prompt with.
+static void make_prefill(const char* locked_content, char* prefill, size_t size) {
+    const char *prefill_start = locked_content;
     while (*prefill_start && isspace((unsigned char)*prefill_start)) {
         prefill_start++;
     }
-    strncpy(prefill_sentence, prefill_start, sizeof(prefill_sentence) - 1);
-    prefill_sentence[sizeof(prefill_sentence) - 1] = '\0';
-    write(sock, "ACK_WRITE_LOCKED\n", 17);
-    write(sock, prefill_sentence, strlen(prefill_sentence));
-    write(sock, "\n", 1);
-    
-    // 5. Read the full edited sentence
+    strncpy(prefill, prefill_start, size - 1);
+    prefill[size - 1] = '\0';
+}
+
+// Replaces one sentence of an open document with `new_text`, keeping the
+// sentence's leading space, logs the edit and adds its reverse to `undo`.
+// An empty `new_text` leaves it as it is. Caller is between wal_begin_edits
+// and wal_end_edits. Returns 1 on success.
+static int edit_document_sentence(Document* doc, int sentence_index, const char* new_text, UndoStep* undo) {
     char new_sentence_input[2048];
-    int read_size = read(sock, new_sentence_input, sizeof(new_sentence_input) - 1);
-    if (read_size <= 0) {
-        write(sock, "ERR_WRITE_FAILED\n", 17);
-        unlock_sentence(filepath, sentence_num);
-        return;
-    }
-    new_sentence_input[read_size] = '\0';
+    strncpy(new_sentence_input, new_text, sizeof(new_sentence_input) - 1);
+    new_sentence_input[sizeof(new_sentence_input) - 1] = '\0';
     new_sentence_input[strcspn(new_sentence_input, "\r\n")] = '\0';
     
-    // 6. Read the file and parse sentences again for processing
-    char (*sentences)[2048] = malloc(100 * sizeof(char[2048]));
-    if (!sentences) {
-        write(sock, "ERR_MEMORY\n", 11);
-        unlock_sentence(filepath, sentence_num);
-        return;
-    }
-    sentence_count = read_sentences_from_file(filepath, sentences, 100);
-    
-    // 7. Find the actual sentence position by content (it may have moved!)
-    int actual_sentence_num = sentence_num;
-    if (strlen(locked_sentence_content) > 0) {
-        actual_sentence_num = find_sentence_by_content(filepath, locked_sentence_content, sentence_num);
-        if (actual_sentence_num < 0) {
-            write(sock, "ERR_SENTENCE_MOVED_OR_DELETED\n", 30);
-            unlock_sentence(filepath, sentence_num);
-            free(sentences);
-            return;
-        }
-    }
-    
-    int sentence_index = actual_sentence_num - 1;
-
+    int sentence_count = document_sentence_count(doc);
+    char current[2048] = "";
+    get_document_sentence(doc, sentence_index, current, sizeof(current));
     if (new_sentence_input[0] == '\0' && sentence_index < sentence_count) {
-        strncpy(new_sentence_input, sentences[sentence_index], sizeof(new_sentence_input) - 1);
-        new_sentence_input[sizeof(new_sentence_input) - 1] = '\0';
+        strcpy(new_sentence_input, current);
     }
     
     // Preserve leading space behavior for non-first sentences
     int has_leading_space = 0;
-    if (sentence_index < sentence_count && sentence_count > 0) {
-        has_leading_space = isspace(sentences[sentence_index][0]);
+    if (sentence_index < sentence_count) {
+        has_leading_space = isspace((unsigned char)current[0]);
     } else if (sentence_index > 0) {
         has_leading_space = 1;
     }
@@ -446,143 +1038,578 @@ void handle_write(int sock, const char* filepath, int sentence_num) {
     }
     strncat(new_sentence, new_sentence_input, sizeof(new_sentence) - strlen(new_sentence) - 1);
     
-    // 9. Create backup for UNDO (only if file exists and has content)
-    char bak_path[256];
-    snprintf(bak_path, sizeof(bak_path), "%s.bak", filepath);
-    
-    // Copy original file to backup
-    FILE* original = fopen(filepath, "r");
-    if (original) {
-        FILE* backup = fopen(bak_path, "w");
-        if (backup) {
-            char ch;
-            while ((ch = fgetc(original)) != EOF) {
-                fputc(ch, backup);
+    printf("[SS] Writing sentence %d of %s: '%s'\n", sentence_index + 1, doc->path, new_sentence);
+    // The edit replaces the old sentence's bytes, so that is all UNDO needs
+    size_t offset, old_len;
+    char* old_text = copy_document_sentence(doc, sentence_index, &offset, &old_len);
+    if (old_text == NULL) return 0;
+    int ok = replace_document_sentence(doc, sentence_index, new_sentence);
+    if (ok) add_undo_delta(undo, offset, old_text, old_len, new_sentence, strlen(new_sentence));
+    free(old_text);
+    return ok && wal_log_edit(doc, sentence_index, new_sentence);
+}
+
+// Applies the edits replacing the sentences with IDs `sentence_ids` (or
+// appending one for SENTENCE_ID_APPEND) with `new_texts` to an open
+// document, without writing it out, and adds their reverse deltas to
+// `undo`. If a sentence has gone, nothing is changed. Caller holds the
+// file's write mutex. Returns NULL on success or the error reply; after
+// ERR_WRITE_FAILED the document may be half edited.
+static const char* stage_sentence_edits(Document* doc, const unsigned long* sentence_ids,
+                                        const char* const* new_texts, int count, UndoStep* undo) {
+    int sentence_count = document_sentence_count(doc);
+    
+    // Find where each sentence is now; edits elsewhere may have moved it
+    int sentence_index[MAX_TRANSACTION_SENTENCES];
+    for (int i = 0; i < count; i++) {
+        sentence_index[i] = sentence_count;
+        if (sentence_ids[i] != SENTENCE_ID_APPEND) {
+            sentence_index[i] = find_document_sentence_by_id(doc, sentence_ids[i]);
+            if (sentence_index[i] < 0) {
+                return "ERR_SENTENCE_MOVED_OR_DELETED\n";
             }
-            fclose(backup);
         }
-        fclose(original);
     }
     
-    // 10. Write the new file
-    FILE* f = fopen(filepath, "w");
-    if (!f) {
-        printf("[SS] ERROR: Failed to open file for writing: %s\n", filepath);
-        write(sock, "ERR_WRITE_FAILED\n", 17);
-        unlock_sentence(filepath, sentence_num);
-        free(sentences);
-        return;
+    // Edit from the end of the file backwards. An edit only re-splits its
+    // own sentence and the ones after it, so the positions still to be
+    // edited stay put and every sentence is where we found it above.
+    int done[MAX_TRANSACTION_SENTENCES] = {0};
+    for (int n = 0; n < count; n++) {
+        int next = -1;
+        for (int i = 0; i < count; i++) {
+            if (!done[i] && (next < 0 || sentence_index[i] > sentence_index[next])) next = i;
+        }
+        done[next] = 1;
+        if (!edit_document_sentence(doc, sentence_index[next], new_texts[next], undo)) {
+            return "ERR_WRITE_FAILED\n";
+        }
     }
-    
-    printf("[SS] Writing to file: %s\n", filepath);
-    printf("[SS]   Sentences before modified: %d (0 to %d)\n", 
-           (sentence_index < sentence_count ? sentence_index : 0), sentence_index > 0 ? sentence_index - 1 : 0);
-    printf("[SS]   New sentence: '%s'\n", new_sentence);
-    printf("[SS]   Sentences after modified: %d (%d to %d)\n", 
-           (sentence_count > sentence_index + 1 ? sentence_count - sentence_index - 1 : 0),
-           sentence_index + 1, sentence_count - 1);
-    
-    // Write all sentences before the modified one
-    for (int i = 0; i < sentence_index && i < sentence_count; i++) {
-        fprintf(f, "%s", sentences[i]);
-        printf("[SS]   Wrote sentence %d: '%s'\n", i, sentences[i]);
+    return NULL;
+}
+
+// Makes staged edits durable: normally by syncing the write-ahead log up to
+// `lsn`. If they could not all be logged (`logged` is 0) or the log cannot
+// be synced, every changed document is written out directly instead.
+// Returns 1 on success.
+static int make_edits_durable(unsigned long lsn, int logged) {
+    if (logged && wal_sync(lsn)) return 1;
+    printf("[SS] ERROR: Write-ahead log failed, writing documents out directly\n");
+    return wal_checkpoint();
+}
+
+// Replaces one sentence and makes the edit durable. Caller holds the file's
+// write mutex. Returns NULL on success or the error reply.
+static const char* apply_sentence_edit(const char* filepath, unsigned long sentence_id, const char* new_text) {
+    Document* doc = open_document(filepath);
+    if (doc == NULL) {
+        return "ERR_MEMORY\n";
     }
-    
-    // Write the new sentence (only if it has content)
-    if (strlen(new_sentence) > 0) {
-        fprintf(f, "%s", new_sentence);
-        printf("[SS]   Wrote new sentence: '%s'\n", new_sentence);
+    UndoStep undo;
+    begin_undo_step(&undo);
+    wal_begin_edits();
+    const char* err = stage_sentence_edits(doc, &sentence_id, &new_text, 1, &undo);
+    unsigned long lsn = wal_end_edits();
+    int failed = (err != NULL && strcmp(err, "ERR_WRITE_FAILED\n") == 0);
+    if ((err == NULL || failed) && !make_edits_durable(lsn, !failed)) {
+        printf("[SS] ERROR: Failed to write file: %s\n", filepath);
+        // The copy in memory may no longer match the disk
+        discard_undo_step(&undo);
+        drop_undo_history(filepath);
+        close_document(doc);
+        invalidate_document(filepath);
+        return "ERR_WRITE_FAILED\n";
     }
-    
-    // Write all sentences after the modified one
-    for (int i = sentence_index + 1; i < sentence_count; i++) {
-        fprintf(f, "%s", sentences[i]);
+    if (failed) {
+        discard_undo_step(&undo);
+        drop_undo_history(filepath);
+    } else {
+        save_undo_step(&undo, filepath, document_length(doc));
     }
-    
-    fflush(f);  // Ensure data is written to disk
-    fclose(f);
-    
-    printf("[SS] File written successfully.\n");
-    
-    // 11. Unlock and send final ACK
-    unlock_sentence(filepath, sentence_num);
-    write(sock, "ACK_WRITE_SUCCESS\n", 18);
-    
-    // 12. Notify NM to trigger replication to other replicas
-    // Extract just the filename from the full filepath
-    const char* filename = strrchr(filepath, '/');
-    if (filename != NULL) {
-        filename++; // Skip the '/'
+    if (err == NULL) printf("[SS] File written successfully.\n");
+    close_document(doc);
+    return err;
+}
+
+// Reply for a write that has reached the disk. The NM is told before
+// acknowledging so that files in quorum mode are only acked once enough
+// replicas have applied it.
+static const char* finish_commit(const char* filepath) {
+    return notify_nm_file_modified(filepath) ? "ACK_WRITE_SUCCESS\n" : "ERR_QUORUM_NOT_MET\n";
+}
+
+// Group commit counters for SSSTATS
+static pthread_mutex_t group_commit_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long group_commits = 0;
+static unsigned long group_commit_batches = 0;
+
+void get_group_commit_stats(unsigned long* commits, unsigned long* batches) {
+    pthread_mutex_lock(&group_commit_stats_mutex);
+    *commits = group_commits;
+    *batches = group_commit_batches;
+    pthread_mutex_unlock(&group_commit_stats_mutex);
+}
+
+// Writes out every COMMIT queued on the file. Each one's edits are applied
+// in memory and logged in arrival order, then the log is synced once and
+// the NM notified once. Each COMMIT still adds its own undo step, so UNDO
+// takes back one COMMIT as it would without batching. Each request gets
+// its own reply; one whose lock expired or whose sentence has gone fails on
+// its own.
+static void write_commit_batch(FileLock* lock, const char* filepath) {
+    pthread_mutex_lock(&lock->mutex);
+    CommitRequest* batch = lock->commits_head;
+    lock->commits_head = lock->commits_tail = NULL;
+    pthread_mutex_unlock(&lock->mutex);
+
+    pthread_mutex_lock(&lock->write_mutex);
+    Document* doc = open_document(filepath);
+    int applied = 0;
+    int failed = (doc == NULL);
+    int requests = 0;
+    wal_begin_edits();
+    for (CommitRequest* r = batch; r != NULL; r = r->next) {
+        requests++;
+        begin_undo_step(&r->undo);
+        unsigned long sentence_ids[MAX_TRANSACTION_SENTENCES];
+        int found = find_lock_by_token(filepath, r->token, sentence_ids, MAX_TRANSACTION_SENTENCES);
+        if (found <= 0) {
+            r->reply = found < 0 ? "ERR_LOCK_EXPIRED\n" : "ERR_INVALID_LOCK_TOKEN\n";
+        } else if (found != r->count) {
+            r->reply = "ERR_EDIT_COUNT_MISMATCH\n"; // The lock is kept for a retry
+        } else {
+            r->reply = failed ? "ERR_WRITE_FAILED\n"
+                              : stage_sentence_edits(doc, sentence_ids, r->new_texts, r->count, &r->undo);
+            if (r->reply == NULL) {
+                r->length_after = document_length(doc);
+                applied++;
+            } else if (strcmp(r->reply, "ERR_WRITE_FAILED\n") == 0) {
+                failed = 1;
+            }
+            unlock_sentence(filepath, r->token);
+        }
+    }
+    unsigned long lsn = wal_end_edits();
+    int durable = 1;
+    if (doc != NULL && (applied > 0 || failed)) durable = make_edits_durable(lsn, !failed);
+    // One undo step per COMMIT, in the order they were applied
+    for (CommitRequest* r = batch; r != NULL; r = r->next) {
+        if (durable && !failed && doc != NULL && r->reply == NULL) {
+            save_undo_step(&r->undo, filepath, r->length_after);
+        } else {
+            discard_undo_step(&r->undo);
+        }
+    }
+    if (doc != NULL && (!durable || failed)) {
+        // The history would not lead back from what is on disk now
+        drop_undo_history(filepath);
+    }
+    if (!durable) {
+        // Nothing in this batch is known to have reached the disk, and the
+        // copy in memory may no longer match it
+        printf("[SS] ERROR: Failed to write file: %s\n", filepath);
+        for (CommitRequest* r = batch; r != NULL; r = r->next) {
+            if (r->reply == NULL) r->reply = "ERR_WRITE_FAILED\n";
+        }
+        applied = 0;
+    }
+    close_document(doc);
+    if (!durable) invalidate_document(filepath);
+    pthread_mutex_unlock(&lock->write_mutex);
+
+    if (applied > 0) {
+        printf("[SS] File written successfully (%d commit%s in one batch).\n", applied, applied == 1 ? "" : "s");
+        const char* reply = finish_commit(filepath);
+        for (CommitRequest* r = batch; r != NULL; r = r->next) {
+            if (r->reply == NULL) r->reply = reply;
+        }
+    }
+    pthread_mutex_lock(&group_commit_stats_mutex);
+    group_commits += requests;
+    group_commit_batches++;
+    pthread_mutex_unlock(&group_commit_stats_mutex);
+
+    // Hand out the replies, and the next batch to the longest waiting COMMIT
+    pthread_mutex_lock(&lock->mutex);
+    lock->last_batch_size = requests;
+    while (batch != NULL) {
+        CommitRequest* r = batch;
+        batch = batch->next;
+        r->done = 1;
+        pthread_cond_signal(&r->cond);
+    }
+    if (lock->commits_head != NULL) {
+        lock->commits_head->lead = 1;
+        pthread_cond_signal(&lock->commits_head->cond);
     } else {
-        filename = filepath; // No slash found, use whole path
+        lock->committing = 0;
     }
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+// Whether anyone but `token` has a sentence of the file locked, and so may
+// commit soon. Caller holds the lock's mutex.
+static int others_hold_locks(FileLock* lock, unsigned long token) {
+    for (int i = 0; i < lock->locked_count; i++) {
+        if (lock->locked_sentences[i].token != token) return 1;
+    }
+    return 0;
+}
+
+// Applies the edits made under `token` (the second half of a WRITE), one
+// text per locked sentence in lock order, and releases the locks. The
+// commit joins the file's group commit queue, so concurrent commits to one
+// file are written together. Returns the reply.
+static const char* commit_sentences(const char* filepath, unsigned long token, const char* const* new_texts, int count) {
+    FileLock* lock = acquire_file_lock(filepath);
+    if (lock == NULL) return "ERR_WRITE_FAILED\n";
+
+    CommitRequest req = {
+        .token = token,
+        .new_texts = new_texts,
+        .count = count,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+    pthread_mutex_lock(&lock->mutex);
+    if (lock->commits_tail) lock->commits_tail->next = &req; else lock->commits_head = &req;
+    lock->commits_tail = &req;
+    // The first COMMIT to an idle file only waits for others to join its
+    // batch when some are likely: another editor holds a lock on the file,
+    // or the last batch was shared
+    int window = 0;
+    if (!lock->committing) {
+        lock->committing = 1;
+        window = lock->last_batch_size > 1 || others_hold_locks(lock, token);
+    } else {
+        while (!req.done && !req.lead) pthread_cond_wait(&req.cond, &lock->mutex);
+    }
+    pthread_mutex_unlock(&lock->mutex);
+
+    if (!req.done) {
+        // Let commits arriving right behind this one join the batch
+        if (window) usleep(GROUP_COMMIT_WINDOW_MS * 1000);
+        write_commit_batch(lock, filepath);
+    }
+    pthread_cond_destroy(&req.cond);
+    release_file_lock(lock);
+    return req.reply;
+}
+
+static const char* commit_sentence(const char* filepath, unsigned long token, const char* new_text) {
+    return commit_sentences(filepath, token, &new_text, 1);
+}
+
+// Single-connection WRITE kept for older clients: the connection (and its
+// thread) stays open while the user edits.
+void handle_write(int sock, const char* filepath, int sentence_num) {
+    char locked_sentence_content[2048];
+    unsigned long token = acquire_sentence_lock(sock, filepath, sentence_num, 0, locked_sentence_content);
+    if (token == 0) return;
+
+    // 4. Send ACK + original sentence content (trim leading whitespace for prefill)
+    char prefill_sentence[2048];
+    make_prefill(locked_sentence_content, prefill_sentence, sizeof(prefill_sentence));
+    write(sock, "ACK_WRITE_LOCKED\n", 17);
+    write(sock, prefill_sentence, strlen(prefill_sentence));
+    write(sock, "\n", 1);
     
-    // Send async notification to NM (fire and forget)
-    // Include SS_ID so NM knows which SS has the latest version
-    extern char SS_ID[50];
-    
-    // Get file stats
-    struct stat st;
-    long file_size = 0;
-    long total_words = 0;
-    long char_count = 0;
-    time_t last_access = 0;
-    
-    if (stat(filepath, &st) == 0) {
-        file_size = st.st_size;
-        char_count = st.st_size;
-        last_access = st.st_atime;
-        
-        // Calculate word count
-        FILE *fp = fopen(filepath, "r");
-        if (fp) {
-            int in_word = 0;
-            int c;
-            while ((c = fgetc(fp)) != EOF) {
-                if (c == ' ' || c == '\n' || c == '\t') {
-                    in_word = 0;
-                } else if (!in_word) {
-                    in_word = 1;
-                    total_words++;
-                }
+    // 5. Read the full edited sentence. This client cannot renew the lease
+    // itself, so it is renewed here for as long as the connection is alive;
+    // TCP keepalive makes the read fail if the client disappears silently.
+    int keepalive = 1, idle = WRITE_KEEPALIVE_IDLE, interval = WRITE_KEEPALIVE_INTERVAL, count = WRITE_KEEPALIVE_COUNT;
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    struct pollfd pfd = {sock, POLLIN, 0};
+    while (poll(&pfd, 1, WRITE_LEASE_SECONDS * 1000 / 3) == 0) {
+        if (renew_sentence_lock(filepath, token) != 1) {
+            write(sock, "ERR_LOCK_EXPIRED\n", 17);
+            return;
+        }
+    }
+    char new_sentence_input[2048];
+    int read_size = read(sock, new_sentence_input, sizeof(new_sentence_input) - 1);
+    if (read_size <= 0) {
+        write(sock, "ERR_WRITE_FAILED\n", 17);
+        unlock_sentence(filepath, token);
+        return;
+    }
+    new_sentence_input[read_size] = '\0';
+
+    const char* reply = commit_sentence(filepath, token, new_sentence_input);
+    write(sock, reply, strlen(reply));
+}
+
+// LOCK <file> <n> [wait seconds]: locks the sentence and hands back a token
+// and the current text, then the connection is closed while the user edits.
+// With a wait, a held sentence is queued for (first come, first served)
+// instead of failing straight away with ERR_SENTENCE_LOCKED.
+// Reply: ACK_LOCK <token> <lease seconds>\n<sentence>\n
+void handle_lock(int sock, const char* filepath, int sentence_num, int wait_seconds) {
+    if (wait_seconds > MAX_LOCK_WAIT_SECONDS) wait_seconds = MAX_LOCK_WAIT_SECONDS;
+    char locked_sentence_content[2048];
+    unsigned long token = acquire_sentence_lock(sock, filepath, sentence_num, wait_seconds, locked_sentence_content);
+    if (token == 0) return;
+
+    // Don't hand the lock to a client that gave up while queued
+    char probe;
+    if (wait_seconds > 0 && recv(sock, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+        unlock_sentence(filepath, token);
+        return;
+    }
+
+    char prefill_sentence[2048];
+    make_prefill(locked_sentence_content, prefill_sentence, sizeof(prefill_sentence));
+    char header[128];
+    snprintf(header, sizeof(header), "ACK_LOCK %lu %d\n", token, WRITE_LEASE_SECONDS);
+    write(sock, header, strlen(header));
+    write(sock, prefill_sentence, strlen(prefill_sentence));
+    write(sock, "\n", 1);
+    printf("[SS] Sentence %d of %s locked with token %lu\n", sentence_num, filepath, token);
+}
+
+// Parses a sentence set such as "3-5" or "1,4,7-8" into sorted, distinct
+// sentence numbers. Returns how many, or -1 if it is malformed or too big.
+static int parse_sentence_set(const char* spec, int* sentence_nums) {
+    int count = 0;
+    const char* p = spec;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return -1;
+        }
+        if (*end != ',' && *end != '\0') return -1;
+        p = (*end == ',') ? end + 1 : end;
+        for (long n = first; n <= last; n++) {
+            int seen = 0;
+            for (int i = 0; i < count; i++) seen |= (sentence_nums[i] == n);
+            if (seen) continue;
+            if (count == MAX_TRANSACTION_SENTENCES) return -1;
+            // Insert in order
+            int i = count++;
+            while (i > 0 && sentence_nums[i - 1] > n) {
+                sentence_nums[i] = sentence_nums[i - 1];
+                i--;
             }
-            fclose(fp);
+            sentence_nums[i] = (int)n;
         }
     }
-    
-    int nm_sock = connect_to_server(NM_IP, NM_PORT);
-    if (nm_sock >= 0) {
-        char notify_msg[BUFFER_SIZE];
-        snprintf(notify_msg, sizeof(notify_msg), "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld\n", 
-                 filename, SS_ID, file_size, total_words, char_count, last_access);
-        write(nm_sock, notify_msg, strlen(notify_msg));
-        close(nm_sock);
-        printf("[SS] Notified NM about modification to %s from SS %s (size: %ld, words: %ld)\n", 
-               filename, SS_ID, file_size, total_words);
+    return count;
+}
+
+// LOCKSET <file> <sentences>: locks a set of sentences ("2-4", "1,3")
+// under one token for a transactional edit, all or none.
+// Reply: ACK_LOCKSET <token> <lease seconds> <count>\n then one
+// "<sentence number> <text>" line per sentence, in order
+void handle_lockset(int sock, const char* filepath, const char* spec) {
+    int sentence_nums[MAX_TRANSACTION_SENTENCES];
+    int count = parse_sentence_set(spec, sentence_nums);
+    if (count <= 0) {
+        write(sock, "ERR_INVALID_SENTENCE_SET\n", 25);
+        return;
     }
-    
-    // Free allocated memory
-    free(sentences);
+    char contents[MAX_TRANSACTION_SENTENCES][2048];
+    unsigned long sentence_ids[MAX_TRANSACTION_SENTENCES];
+    Document* doc = load_target_sentences(sock, filepath, sentence_nums, count, contents, sentence_ids);
+    if (doc == NULL) {
+        return;
+    }
+    unsigned long token = lock_sentence_set(filepath, sentence_ids, count);
+    close_document(doc);
+    if (token == 0) {
+        write(sock, "ERR_SENTENCE_LOCKED\n", 20);
+        return;
+    }
+
+    char header[128];
+    snprintf(header, sizeof(header), "ACK_LOCKSET %lu %d %d\n", token, WRITE_LEASE_SECONDS, count);
+    write(sock, header, strlen(header));
+    for (int i = 0; i < count; i++) {
+        char prefill_sentence[2048];
+        make_prefill(contents[i], prefill_sentence, sizeof(prefill_sentence));
+        char line[2100];
+        snprintf(line, sizeof(line), "%d %s\n", sentence_nums[i], prefill_sentence);
+        write(sock, line, strlen(line));
+    }
+    printf("[SS] %d sentences of %s locked with token %lu\n", count, filepath, token);
+}
+
+// COMMIT <file> <token> [count]\n<text>\n...: applies the edits made under a
+// LOCK or LOCKSET token, one line per locked sentence, as one write.
+void handle_commit(int sock, const char* filepath, unsigned long token, const char* const* new_texts, int count) {
+    const char* reply = commit_sentences(filepath, token, new_texts, count);
+    write(sock, reply, strlen(reply));
+}
+
+// UNLOCK <file> <token>: gives up a LOCK without writing anything.
+void handle_unlock(int sock, const char* filepath, unsigned long token) {
+    unsigned long sentence_ids[MAX_TRANSACTION_SENTENCES];
+    if (find_lock_by_token(filepath, token, sentence_ids, MAX_TRANSACTION_SENTENCES) > 0) {
+        unlock_sentence(filepath, token);
+        write(sock, "ACK_UNLOCK\n", 11);
+    } else {
+        write(sock, "ERR_INVALID_LOCK_TOKEN\n", 23);
+    }
+}
+
+// RENEW <file> <token>: keeps a LOCK alive while the user is still editing.
+// Reply: ACK_RENEW <lease seconds>
+void handle_renew(int sock, const char* filepath, unsigned long token) {
+    int renewed = renew_sentence_lock(filepath, token);
+    if (renewed == 1) {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "ACK_RENEW %d\n", WRITE_LEASE_SECONDS);
+        write(sock, reply, strlen(reply));
+    } else if (renewed < 0) {
+        write(sock, "ERR_LOCK_EXPIRED\n", 17);
+    } else {
+        write(sock, "ERR_INVALID_LOCK_TOKEN\n", 23);
+    }
+}
+
+// Version of a sentence for optimistic writes: a 64-bit FNV-1a hash of its
+// text. A sentence that does not exist yet hashes as "".
+static unsigned long sentence_version(const char* content) {
+    unsigned long hash = 14695981039346656037UL;
+    for (const unsigned char* p = (const unsigned char*)content; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+// PEEK <file> <n>: the first half of an optimistic WRITE. Returns the
+// sentence and its version without taking a lock.
+// Reply: ACK_PEEK <version>\n<sentence>\n
+void handle_peek(int sock, const char* filepath, int sentence_num) {
+    char content[2048];
+    unsigned long sentence_id;
+    Document* doc = load_target_sentence(sock, filepath, sentence_num, content, &sentence_id);
+    if (doc == NULL) return;
+    close_document(doc);
+
+    char prefill_sentence[2048];
+    make_prefill(content, prefill_sentence, sizeof(prefill_sentence));
+    char header[64];
+    snprintf(header, sizeof(header), "ACK_PEEK %lu\n", sentence_version(content));
+    write(sock, header, strlen(header));
+    write(sock, prefill_sentence, strlen(prefill_sentence));
+    write(sock, "\n", 1);
+}
+
+// CAS <file> <n> <version>\n<text>\n: writes the sentence only if it still
+// has the version the client saw. Otherwise fails straight away with the
+// current text so the client can retry:
+// ERR_VERSION_CONFLICT <version>\n<sentence>\n
+void handle_cas(int sock, const char* filepath, int sentence_num, unsigned long version, const char* new_text) {
+    FileLock* lock = acquire_file_lock(filepath);
+    if (lock == NULL) {
+        write(sock, "ERR_WRITE_FAILED\n", 17);
+        return;
+    }
+    pthread_mutex_lock(&lock->write_mutex);
+
+    char content[2048];
+    unsigned long sentence_id;
+    Document* doc = load_target_sentence(sock, filepath, sentence_num, content, &sentence_id);
+    if (doc == NULL) {
+        pthread_mutex_unlock(&lock->write_mutex);
+        release_file_lock(lock);
+        return;
+    }
+
+    // A pessimistic writer holding the sentence wins
+    if (is_sentence_locked(filepath, sentence_id)) {
+        close_document(doc);
+        pthread_mutex_unlock(&lock->write_mutex);
+        release_file_lock(lock);
+        write(sock, "ERR_SENTENCE_LOCKED\n", 20);
+        return;
+    }
+
+    unsigned long current_version = sentence_version(content);
+    if (current_version != version) {
+        close_document(doc);
+        pthread_mutex_unlock(&lock->write_mutex);
+        release_file_lock(lock);
+        printf("[SS] CAS conflict on sentence %d of %s\n", sentence_num, filepath);
+        char prefill_sentence[2048];
+        make_prefill(content, prefill_sentence, sizeof(prefill_sentence));
+        char header[64];
+        snprintf(header, sizeof(header), "ERR_VERSION_CONFLICT %lu\n", current_version);
+        write(sock, header, strlen(header));
+        write(sock, prefill_sentence, strlen(prefill_sentence));
+        write(sock, "\n", 1);
+        return;
+    }
+
+    const char* reply = apply_sentence_edit(filepath, sentence_id, new_text);
+    close_document(doc);
+    pthread_mutex_unlock(&lock->write_mutex);
+    release_file_lock(lock);
+    if (reply == NULL) reply = finish_commit(filepath);
+    write(sock, reply, strlen(reply));
 }
 
 
-void handle_undo(int sock, const char* filepath) {
-    char bak_path[BUFFER_SIZE];
-    snprintf(bak_path, sizeof(bak_path), "%s.bak", filepath);
+// Takes the newest `steps` steps of the file's undo history back and writes
+// the result over the file. Caller holds the file's write mutex and has
+// released the file from the write-ahead log. Returns the reply.
+static const char* undo_file_steps(const char* filepath, int steps) {
+    Document* doc = open_document(filepath);
+    if (doc == NULL) return "ERR_MEMORY\n";
+    size_t len = 0;
+    char* text = copy_document_text(doc, &len);
+    close_document(doc);
+    if (text == NULL) return "ERR_MEMORY\n";
 
-    // Try to rename .bak to the main file
-    if (rename(bak_path, filepath) == 0) {
-        printf("[SS] File %s reverted from backup.\n", filepath);
-        write(sock, "ACK_UNDO_SUCCESS\n", 17);
+    size_t keep = 0;
+    int result = undo_steps(filepath, steps, &text, &len, &keep);
+    const char* reply = "ACK_UNDO_SUCCESS\n";
+    if (result == 0) {
+        printf("[SS] UNDO failed: %s has fewer than %d steps of history\n", filepath, steps);
+        reply = "ERR_UNDO_FAILED\n";
+    } else if (result < 0) {
+        // Something changed the file that the history does not know about
+        printf("[SS] UNDO failed: %s no longer matches its undo history\n", filepath);
+        drop_undo_history(filepath);
+        reply = "ERR_UNDO_FAILED\n";
     } else {
-        perror("[SS] UNDO failed");
-        // This can fail if there is no .bak file
-        write(sock, "ERR_UNDO_FAILED\n", 16);
+        char tmp_path[BUFFER_SIZE];
+        int fd = begin_file_replace(filepath, tmp_path, sizeof(tmp_path));
+        if (fd < 0 || !finish_file_replace(fd, tmp_path, filepath, write(fd, text, len) == (ssize_t)len, 0)) {
+            perror("[SS] UNDO failed");
+            reply = "ERR_UNDO_FAILED\n";
+        } else {
+            trim_undo_history(filepath, keep);
+            invalidate_document(filepath);
+            printf("[SS] File %s taken back %d step(s).\n", filepath, steps);
+        }
+    }
+    free(text);
+    return reply;
+}
+
+void handle_undo(int sock, const char* filepath, int steps) {
+    if (steps < 1 || steps > MAX_UNDO_STEPS) {
+        write(sock, "ERR_BAD_UNDO_COUNT\n", 19);
+        return;
     }
+    // UNDO works on the file itself, so logged edits are written to it first
+    FileLock* lock = begin_file_change(filepath);
+    const char* reply = lock ? undo_file_steps(filepath, steps) : "ERR_UNDO_FAILED\n";
+    end_file_change(lock);
+    write(sock, reply, strlen(reply));
 }
 
 // --- Helpers for checkpoints ---
-static int mkdir_p(const char* path) {
+int mkdir_p(const char* path) {
     // Create directories recursively like `mkdir -p`
     char tmp[BUFFER_SIZE];
     snprintf(tmp, sizeof(tmp), "%s", path);
@@ -600,9 +1627,21 @@ static int mkdir_p(const char* path) {
     return 0;
 }
 
-static void build_checkpoint_paths(const char* filepath, char* dir_out, size_t dir_sz, char* file_out, size_t file_sz, const char* tag) {
+// Creates the folders leading up to `filepath`, so a copy of "folder/file.txt"
+// can land on an SS that never saw the folder being created
+int ensure_parent_dir(const char* filepath) {
+    char dir[BUFFER_SIZE];
+    snprintf(dir, sizeof(dir), "%s", filepath);
+    char* last_slash = strrchr(dir, '/');
+    if (last_slash == NULL) return 0;
+    *last_slash = '\0';
+    return mkdir_p(dir);
+}
+
+static void build_checkpoint_dir(const char* filepath, char* dir_out, size_t dir_sz) {
     // Given full data file path: <SS_DATA_DIR>/<filename or folder/...>,
-    // place checkpoints under <SS_DATA_DIR>/.checkpoints/<filename or folder/...>/<tag>.chk
+    // place checkpoints under <SS_DATA_DIR>/.checkpoints/<filename or folder/...>/
+    // (the checkpoint store finds them there by tag)
     // Find SS_DATA_DIR prefix from filepath by searching last '/'
     // We assume filepath starts with SS_DATA_DIR
     const char* last_slash = strrchr(filepath, '/');
@@ -628,34 +1667,42 @@ static void build_checkpoint_paths(const char* filepath, char* dir_out, size_t d
         const char* rest = first_slash + 1; // e.g., path/inside/file.txt
         snprintf(dir_out, dir_sz, "%s/.checkpoints/%s", root, rest);
     }
+}
 
-    // file path is dir_out + '/' + tag + ".chk"
-    snprintf(file_out, file_sz, "%s/%s.chk", dir_out, tag);
+// A tag names a manifest file and a catalog entry, so it must be a plain
+// file name and not the catalog's "no parent"
+static int valid_checkpoint_tag(const char* tag) {
+    return tag != NULL && tag[0] != '\0' && tag[0] != '.' && strchr(tag, '/') == NULL && strcmp(tag, "-") != 0;
 }
 
 void handle_checkpoint(int sock, const char* filepath, const char* tag) {
-    if (!tag || strlen(tag) == 0) {
+    if (!valid_checkpoint_tag(tag)) {
         write(sock, "ERR_BAD_CHECKPOINT_TAG\n", 23);
         return;
     }
 
-    // Build paths
-    char cp_dir[BUFFER_SIZE], cp_file[BUFFER_SIZE];
-    build_checkpoint_paths(filepath, cp_dir, sizeof(cp_dir), cp_file, sizeof(cp_file), tag);
+    char cp_dir[BUFFER_SIZE];
+    build_checkpoint_dir(filepath, cp_dir, sizeof(cp_dir));
 
     if (mkdir_p(cp_dir) == -1) {
         write(sock, "ERR_CP_DIR_CREATE\n", 19);
         return;
     }
 
-    // Read current file
-    FILE* in = fopen(filepath, "r");
-    if (!in) { write(sock, "ERR_SS_FILE_NOT_FOUND\n", 22); return; }
-    FILE* out = fopen(cp_file, "w");
-    if (!out) { fclose(in); write(sock, "ERR_CP_OPEN\n", 12); return; }
-    int ch;
-    while ((ch = fgetc(in)) != EOF) fputc(ch, out);
-    fclose(in); fclose(out);
+    // Snapshot the current content straight from the document cache. Only
+    // chunks the store does not have yet are written.
+    Document* doc = open_document(filepath);
+    if (doc == NULL || document_missing(doc)) {
+        close_document(doc);
+        write(sock, "ERR_SS_FILE_NOT_FOUND\n", 22);
+        return;
+    }
+    size_t len = 0;
+    char* text = copy_document_text(doc, &len);
+    close_document(doc);
+    int saved = (text != NULL && save_checkpoint(cp_dir, tag, text, len));
+    free(text);
+    if (!saved) { write(sock, "ERR_CP_OPEN\n", 12); return; }
     write(sock, "ACK_CHECKPOINT\n", 15);
     
     // Notify NM to trigger replication (checkpoint doesn't change content, so skip for now)
@@ -664,135 +1711,128 @@ void handle_checkpoint(int sock, const char* filepath, const char* tag) {
 
 void handle_viewcheckpoint(int sock, const char* filepath, const char* tag) {
     if (!tag || strlen(tag) == 0) { write(sock, "ERR_BAD_CHECKPOINT_TAG\n", 23); return; }
-    char cp_dir[BUFFER_SIZE], cp_file[BUFFER_SIZE];
-    build_checkpoint_paths(filepath, cp_dir, sizeof(cp_dir), cp_file, sizeof(cp_file), tag);
-    FILE* f = fopen(cp_file, "r");
-    if (!f) { write(sock, "ERR_CP_NOT_FOUND\n", 18); return; }
-    char buffer[BUFFER_SIZE]; size_t n;
-    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
-        if (write(sock, buffer, n) < 0) break;
+    char cp_dir[BUFFER_SIZE];
+    build_checkpoint_dir(filepath, cp_dir, sizeof(cp_dir));
+    if (write_checkpoint(cp_dir, tag, sock) == 0) {
+        write(sock, "ERR_CP_NOT_FOUND\n", 18);
     }
-    fclose(f);
 }
 
-void handle_listcheckpoints(int sock, const char* filepath) {
-    char cp_dir[BUFFER_SIZE], cp_file_dummy[BUFFER_SIZE];
-    build_checkpoint_paths(filepath, cp_dir, sizeof(cp_dir), cp_file_dummy, sizeof(cp_file_dummy), "__dummy__");
-    
-    // cp_dir now contains the full directory path for checkpoints
-    // cp_file_dummy contains: cp_dir/__dummy__.chk
-    // We need just the directory part from cp_file_dummy
-    // So we strip "/__dummy__.chk" by finding the directory portion of cp_file_dummy
-    
-    // Actually, let's use cp_file_dummy and strip the filename
-    char* last_slash = strrchr(cp_file_dummy, '/');
-    if (last_slash) {
-        *last_slash = '\0';  // Now cp_file_dummy contains just the directory
+void handle_listcheckpoints(int sock, const char* filepath, int offset, int count) {
+    char cp_dir[BUFFER_SIZE];
+    build_checkpoint_dir(filepath, cp_dir, sizeof(cp_dir));
+
+    // One read of the catalog, which is kept oldest first
+    CheckpointInfo* infos = NULL;
+    int total = list_checkpoints(cp_dir, &infos);
+    if (total <= 0) {
+        free(infos);
+        write(sock, "(no checkpoints)\n", 18);
+        return;
+    }
+    int end = (offset < total) ? offset + ((count < total - offset) ? count : total - offset) : offset;
+    size_t cap = (size_t)(end - offset + 1) * (2 * CHECKPOINT_TAG_MAX + 96);
+    char* reply = malloc(cap);
+    if (reply == NULL) {
+        free(infos);
+        write(sock, "ERR_CP_LIST\n", 12);
+        return;
+    }
+    size_t used = 0;
+    for (int i = offset; i < end; i++) {
+        char when[32];
+        time_t created = infos[i].created;
+        struct tm tm_created;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&created, &tm_created));
+        used += snprintf(reply + used, cap - used, "%s  %s  %zu bytes  %08lx", infos[i].tag, when, infos[i].size,
+                         infos[i].hash >> 32);
+        if (infos[i].parent[0] != '\0') used += snprintf(reply + used, cap - used, "  after %s", infos[i].parent);
+        used += snprintf(reply + used, cap - used, "\n");
     }
+    if (offset > 0 || end < total) {
+        used += (offset < end) ? snprintf(reply + used, cap - used, "(%d-%d of %d)\n", offset + 1, end, total)
+                               : snprintf(reply + used, cap - used, "(none past %d)\n", total);
+    }
+    RetentionRule rule;
+    if (get_retention_rule(cp_dir, &rule)) {
+        char rule_text[64];
+        format_retention_rule(&rule, rule_text, sizeof(rule_text));
+        used += snprintf(reply + used, cap - used, "(retention: %s)\n", rule_text);
+    }
+    write(sock, reply, used);
+    free(reply);
+    free(infos);
+}
 
-    // Open directory and list *.chk files
-    DIR* d = opendir(cp_file_dummy);
-    if (!d) { 
-        printf("[SS] DEBUG: Cannot open checkpoint dir: %s (errno: %d)\n", cp_file_dummy, errno);
-        write(sock, "(no checkpoints)\n", 18); 
-        return; 
+// Sets the retention rule of a file's or folder's checkpoints: "INHERIT"
+// drops it for the enclosing folder's, anything else must parse
+void handle_setretention(int sock, const char* filepath, const char* rule_text) {
+    char cp_dir[BUFFER_SIZE];
+    build_checkpoint_dir(filepath, cp_dir, sizeof(cp_dir));
+    char word[16] = "";
+    sscanf(rule_text, "%15s", word);
+    RetentionRule rule;
+    int inherit = (strcasecmp(word, "INHERIT") == 0);
+    if (!inherit && !parse_retention_rule(rule_text, &rule)) {
+        write(sock, "ERR_INVALID_RETENTION\n", 22);
+        return;
     }
-    
-    struct dirent* de;
-    char line[BUFFER_SIZE];
-    int found_count = 0;
-    while ((de = readdir(d)) != NULL) {
-        if (de->d_name[0] == '.') continue;
-        // expect files named <tag>.chk
-        const char* name = de->d_name;
-        size_t len = strlen(name);
-        if (len > 4 && strcmp(name + len - 4, ".chk") == 0) {
-            snprintf(line, sizeof(line), "%.*s\n", (int)(len - 4), name);
-            write(sock, line, strlen(line));
-            found_count++;
-        }
-    }
-    closedir(d);
-    
-    if (found_count == 0) {
-        write(sock, "(no checkpoints)\n", 18);
+    if (!inherit && mkdir_p(cp_dir) == -1) {
+        write(sock, "ERR_CP_DIR_CREATE\n", 18);
+        return;
+    }
+    if (!set_retention_rule(cp_dir, inherit ? NULL : &rule)) {
+        write(sock, "ERR_NM_SETRETENTION\n", 20);
+        return;
     }
+    write(sock, "ACK_NM_SETRETENTION\n", 20);
+    char applied[64] = "inherited";
+    if (!inherit) format_retention_rule(&rule, applied, sizeof(applied));
+    printf("[SS] Retention of %s: %s\n", cp_dir, applied);
 }
 
 void handle_revert_to_checkpoint(int sock, const char* filepath, const char* tag) {
     if (!tag || strlen(tag) == 0) { write(sock, "ERR_BAD_CHECKPOINT_TAG\n", 23); return; }
-    char cp_dir[BUFFER_SIZE], cp_file[BUFFER_SIZE];
-    build_checkpoint_paths(filepath, cp_dir, sizeof(cp_dir), cp_file, sizeof(cp_file), tag);
-
-    FILE* in = fopen(cp_file, "r");
-    if (!in) { write(sock, "ERR_CP_NOT_FOUND\n", 18); return; }
-
-    // Backup current file for UNDO compatibility
-    char bak_path[BUFFER_SIZE];
-    snprintf(bak_path, sizeof(bak_path), "%s.bak", filepath);
-    FILE* cur = fopen(filepath, "r");
-    if (cur) {
-        FILE* bak = fopen(bak_path, "w");
-        if (bak) {
-            int ch; while ((ch = fgetc(cur)) != EOF) fputc(ch, bak);
-            fclose(bak);
-        }
-        fclose(cur);
-    }
-
-    FILE* out = fopen(filepath, "w");
-    if (!out) { fclose(in); write(sock, "ERR_REVERT_OPEN\n", 16); return; }
-    int ch; while ((ch = fgetc(in)) != EOF) fputc(ch, out);
-    fclose(in); fclose(out);
-    write(sock, "ACK_REVERT\n", 11);
-    
-    // Notify NM to trigger replication to other replicas
-    const char* filename = strrchr(filepath, '/');
-    if (filename != NULL) {
-        filename++; // Skip the '/'
-    } else {
-        filename = filepath;
-    }
-    
-    extern char SS_ID[50];
-    
-    // Get file stats
-    struct stat st;
-    long file_size = 0;
-    long total_words = 0;
-    long char_count = 0;
-    time_t last_access = 0;
-    
-    if (stat(filepath, &st) == 0) {
-        file_size = st.st_size;
-        char_count = st.st_size;
-        last_access = st.st_atime;
-        
-        // Calculate word count
-        FILE *fp = fopen(filepath, "r");
-        if (fp) {
-            int in_word = 0;
-            int c;
-            while ((c = fgetc(fp)) != EOF) {
-                if (c == ' ' || c == '\n' || c == '\t') {
-                    in_word = 0;
-                } else if (!in_word) {
-                    in_word = 1;
-                    total_words++;
-                }
-            }
-            fclose(fp);
+    char cp_dir[BUFFER_SIZE];
+    build_checkpoint_dir(filepath, cp_dir, sizeof(cp_dir));
+
+    if (!find_checkpoint(cp_dir, tag, NULL)) { write(sock, "ERR_CP_NOT_FOUND\n", 18); return; }
+
+    FileLock* lock = begin_file_change(filepath);
+    if (lock == NULL) { write(sock, "ERR_REVERT_OPEN\n", 16); return; }
+    // The revert is one undo step that swaps the whole text back
+    UndoStep undo;
+    begin_undo_step(&undo);
+    size_t old_len = 0, new_len = 0;
+    Document* doc = open_document(filepath);
+    char* old_text = doc ? copy_document_text(doc, &old_len) : NULL;
+    close_document(doc);
+
+    char tmp_path[BUFFER_SIZE];
+    int fd = begin_file_replace(filepath, tmp_path, sizeof(tmp_path));
+    int copied = (fd >= 0 && finish_file_replace(fd, tmp_path, filepath, write_checkpoint(cp_dir, tag, fd) == 1, 0));
+    if (copied) {
+        invalidate_document(filepath);
+        doc = open_document(filepath);
+        char* new_text = doc ? copy_document_text(doc, &new_len) : NULL;
+        close_document(doc);
+        if (old_text != NULL && new_text != NULL) {
+            add_undo_delta(&undo, 0, old_text, old_len, new_text, new_len);
+            save_undo_step(&undo, filepath, new_len);
+        } else {
+            discard_undo_step(&undo);
+            drop_undo_history(filepath);
         }
+        free(new_text);
     }
+    free(old_text);
+    end_file_change(lock);
+    if (!copied) { write(sock, "ERR_REVERT_OPEN\n", 16); return; }
     
-    int nm_sock = connect_to_server(NM_IP, NM_PORT);
-    if (nm_sock >= 0) {
-        char notify_msg[BUFFER_SIZE];
-        snprintf(notify_msg, sizeof(notify_msg), "NM_FILE_MODIFIED %s %s %ld %ld %ld %ld\n", 
-                 filename, SS_ID, file_size, total_words, char_count, last_access);
-        write(nm_sock, notify_msg, strlen(notify_msg));
-        close(nm_sock);
-        printf("[SS] Notified NM about revert of %s from SS %s (size: %ld, words: %ld)\n", 
-               filename, SS_ID, file_size, total_words);
+    // Notify NM to trigger replication to other replicas
+    if (notify_nm_file_modified(filepath)) {
+        write(sock, "ACK_REVERT\n", 11);
+    } else {
+        write(sock, "ERR_QUORUM_NOT_MET\n", 19);
     }
 }
\ No newline at end of file
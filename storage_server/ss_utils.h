@@ -3,44 +3,150 @@
 
 #include "../common/utils.h"
 #include "../name_server/ns_utils.h"
+#include "ss_document.h"
+#include "ss_wal.h"
+#include "ss_undo.h"
+#include "ss_checkpoint.h"
 
-// Struct to manage sentence-level locks for a file
+// Struct to manage sentence-level locks for a file. Sentences are named by
+// their document sentence ID, so a lock keeps pointing at the same sentence
+// when others are added or removed before it.
 #define MAX_LOCKED_SENTENCES 100
+#define SENTENCE_ID_APPEND 0 // Locks the slot for a new sentence at the end
 typedef struct {
-    int sentence_num;           // 1-indexed sentence number
-    char sentence_content[2048]; // Content of the locked sentence (for verification)
+    unsigned long sentence_id; // Document sentence ID, or SENTENCE_ID_APPEND
+    unsigned long token;       // Handed out by LOCK, presented again on COMMIT
+    time_t lease_expiry;       // After this the sentence may be reclaimed by others
 } SentenceLock;
 
-typedef struct {
-    char filename[MAX_FILENAME];
-    SentenceLock locked_sentences[MAX_LOCKED_SENTENCES];
+// A LOCK queued for a sentence someone else holds. Waiters on a file are
+// kept in arrival order, and a released sentence is handed straight to the
+// first one waiting for it.
+typedef struct LockWaiter {
+    unsigned long sentence_id;
+    unsigned long token;     // Set once the sentence has been handed over
+    pthread_cond_t cond;     // Signalled on hand-over
+    struct LockWaiter* next;
+} LockWaiter;
+
+// A COMMIT in its file's group commit queue. Commits that arrive while
+// another is being written are applied together by one of them (the
+// leader), with one flush, one fsync and one NM notification, and each
+// waiting COMMIT is then handed its own reply.
+typedef struct CommitRequest {
+    unsigned long token;
+    const char* const* new_texts; // One per locked sentence
+    int count;
+    const char* reply;       // Set once the batch is written
+    int done;
+    int lead;                // Asked to write the next batch
+    pthread_cond_t cond;     // Signalled when done or asked to lead
+    struct CommitRequest* next;
+    UndoStep undo;           // Its own edits, so UNDO takes back one COMMIT at a time
+    size_t length_after;     // Text length once its edits are applied
+} CommitRequest;
+
+typedef struct FileLock {
+    char* filename;
+    SentenceLock* locked_sentences; // Grown on demand up to MAX_LOCKED_SENTENCES
+    int locked_capacity;
     int locked_count; // Number of currently locked sentences
+    Document* pinned; // Kept cached while sentences are locked, so IDs stay valid
+    LockWaiter* waiters_head; // FIFO of blocked LOCKs
+    LockWaiter* waiters_tail;
+    CommitRequest* commits_head; // COMMITs waiting for the next batch
+    CommitRequest* commits_tail;
+    int committing;              // A leader is writing a batch
+    int last_batch_size;         // COMMITs in the batch written last
     pthread_mutex_t mutex; // Protects this struct
+    pthread_mutex_t write_mutex; // Serialises commits to the file
+    int refcount; // Handlers holding it; protected by the shard mutex
+    struct FileLock* next; // Next in the shard's hash chain
 } FileLock;
 
-// A global list of locks (one per file *currently being edited*)
-#define MAX_FILE_LOCKS 100
-extern FileLock file_locks[MAX_FILE_LOCKS];
-extern int file_lock_count;
-extern pthread_mutex_t file_lock_list_mutex; // Protects the list itself
+// Lock table: one FileLock per file being edited, hashed into shards that
+// each have their own mutex. An entry is freed once nobody holds it and it
+// has no live sentence locks.
+#define LOCK_TABLE_SHARDS 64
+#define LOCK_SHARD_BUCKETS 64
+
+// How long the first COMMIT to an idle file waits for others to join its
+// batch, when other commits are likely
+#define GROUP_COMMIT_WINDOW_MS 2
+
+// Leases are also put on a timer wheel with one slot per second, which the
+// sweeper thread works through so abandoned locks expire even if nobody
+// touches the file again.
+#define LEASE_WHEEL_SLOTS 64
+
+// TCP keepalive on a single-connection WRITE, so a client that vanished
+// without closing the connection is noticed in about
+// IDLE + INTERVAL * COUNT seconds
+#define WRITE_KEEPALIVE_IDLE 5
+#define WRITE_KEEPALIVE_INTERVAL 2
+#define WRITE_KEEPALIVE_COUNT 3
+
+// The replication mode the NM last reported for each file, kept so that a
+// write while the NM is unreachable is acknowledged only for ASYNC files
+#define REPL_MODE_CACHE_BUCKETS 256
 
 // Function prototypes
-FileLock* get_or_create_file_lock(const char* filename);
-int lock_sentence(const char* filename, int sentence_num, const char* sentence_content);
-void unlock_sentence(const char* filename, int sentence_num);
-int find_sentence_by_content(const char* filepath, const char* locked_content, int original_num);
+// Returns the lock for a file, creating it if needed. Every acquire must be
+// paired with a release.
+FileLock* acquire_file_lock(const char* filename);
+void release_file_lock(FileLock* lock);
+// Starts a change to a data file made outside the sentence API (create,
+// delete, move, replica pushes): commits to it are held off and its logged
+// edits written to it. Returns its lock, to be passed to end_file_change,
+// or NULL if the file must be left as it is.
+FileLock* begin_file_change(const char* filepath);
+void end_file_change(FileLock* lock);
+// Locks a sentence, queueing for up to `wait_seconds` if it is held.
+// Returns the token, or 0 if it is still held (*timed_out says whether we
+// queued and gave up).
+unsigned long lock_sentence(const char* filename, unsigned long sentence_id, int wait_seconds, int* timed_out);
+// Locks all of `sentence_ids` under one token, or none of them. Returns the
+// token or 0.
+unsigned long lock_sentence_set(const char* filename, const unsigned long* sentence_ids, int count);
+// Current queued LOCKs, LOCKs that have queued, and queued LOCKs that gave up
+void get_lock_wait_stats(int* waiters, unsigned long* waits, unsigned long* timeouts);
+// COMMITs handled and the batches they were written in
+void get_group_commit_stats(unsigned long* commits, unsigned long* batches);
+void unlock_sentence(const char* filename, unsigned long token);
+int find_lock_by_token(const char* filename, unsigned long token, unsigned long* sentence_ids, int max_ids);
+// Extends a lock's lease by WRITE_LEASE_SECONDS. Returns 1 on success, 0 if
+// the token is unknown, -1 if its lease had already run out.
+int renew_sentence_lock(const char* filename, unsigned long token);
+// Expires leases as they run out; started once by the storage server
+void* lease_sweeper_thread(void* arg);
 int is_file_locked(const char* filename);  // NEW: Check if file has any active locks
+int is_sentence_locked(const char* filename, unsigned long sentence_id);
 
 void handle_read(int sock, const char* filepath);
 void handle_stream(int sock, const char* filepath);
+void handle_ssstats(int sock);
 void handle_write(int sock, const char* filepath, int sentence_num);
-void handle_undo(int sock, const char* filepath); 
+void handle_lock(int sock, const char* filepath, int sentence_num, int wait_seconds);
+void handle_lockset(int sock, const char* filepath, const char* spec);
+void handle_commit(int sock, const char* filepath, unsigned long token, const char* const* new_texts, int count);
+void handle_unlock(int sock, const char* filepath, unsigned long token);
+void handle_renew(int sock, const char* filepath, unsigned long token);
+void handle_peek(int sock, const char* filepath, int sentence_num);
+void handle_cas(int sock, const char* filepath, int sentence_num, unsigned long version, const char* new_text);
+// Takes the file back `steps` writes (1 to MAX_UNDO_STEPS)
+void handle_undo(int sock, const char* filepath, int steps);
+int notify_nm_file_modified(const char* filepath);
+int parse_chain_hops(const char* list, char hops[][64]);
+int forward_chain_write(const char* filename, const char* content, int content_len,
+                        char hops[][64], int hop_count);
 
 // --- Checkpoint handlers ---
 void handle_checkpoint(int sock, const char* filepath, const char* tag);
 void handle_viewcheckpoint(int sock, const char* filepath, const char* tag);
-void handle_listcheckpoints(int sock, const char* filepath);
+void handle_listcheckpoints(int sock, const char* filepath, int offset, int count);
 void handle_revert_to_checkpoint(int sock, const char* filepath, const char* tag);
-int read_sentences_from_file(const char* filepath, char sentences[][2048], int max_sentences);
+void handle_setretention(int sock, const char* filepath, const char* rule_text);
+int mkdir_p(const char* path);
+int ensure_parent_dir(const char* filepath);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,593 @@
+#include "ss_wal.h"
+#include "../common/config.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static char wal_dir[BUFFER_SIZE / 2];  // Leaves room for the file names in it
+
+// Shared while edits are applied and logged; exclusive while a checkpoint
+// cuts the log
+static pthread_rwlock_t edit_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER; // One checkpoint at a time
+
+// The segment being written
+static int segment_fd = -1;
+static char segment_path[BUFFER_SIZE];
+static unsigned long segment_seq = 0;
+static unsigned long oldest_seq = 1;  // Oldest segment that may still be on disk
+static size_t segment_bytes = 0;
+static unsigned long next_lsn = 1;    // Position of the next record
+static unsigned long synced_lsn = 0;  // Records up to here are durable
+static int syncing = 0;               // Someone is syncing for everyone
+static WalStats wal_stats;
+static pthread_mutex_t wal_mutex = PTHREAD_MUTEX_INITIALIZER; // Protects the above
+static pthread_cond_t wal_synced_cond = PTHREAD_COND_INITIALIZER;
+
+static void wal_file(unsigned long seq, const char* suffix, char* path, size_t size) {
+    snprintf(path, size, "%s/%08lu.%s", wal_dir, seq, suffix);
+}
+
+// A file being installed must be on disk before the log behind it goes
+static int install_sync(void) {
+    return get_fsync_policy() != FSYNC_NEVER;
+}
+
+// --- Records ---
+// An edit: "E <lsn> <version> <sentence id> <index> <path len> <text len>
+// <checksum>\n" followed by the path, the text and "\n".
+// A file released for a change outside the log: "F <lsn> <from> <path len>
+// <install len> <checksum>\n" followed by the path, the install file holding
+// its edits (if it had any) and "\n". Edits to the file logged before it are
+// not replayed; the install file is put in place as a checkpoint would.
+// The checksum (FNV-1a over the numbers, path and text) finds a record torn
+// by a crash.
+
+static unsigned long record_checksum(const char* numbers, const char* path, size_t path_len,
+                                     const char* text, size_t text_len) {
+    const char* parts[3] = {numbers, path, text};
+    size_t lens[3] = {strlen(numbers), path_len, text_len};
+    unsigned long hash = 14695981039346656037UL;
+    for (int i = 0; i < 3; i++) {
+        for (size_t j = 0; j < lens[i]; j++) {
+            hash ^= (unsigned char)parts[i][j];
+            hash *= 1099511628211UL;
+        }
+    }
+    return hash;
+}
+
+// Appends a record; `numbers` starts with next_lsn. Caller holds wal_mutex.
+// Returns 1 on success.
+static int append_record(char kind, const char* numbers, const char* path, size_t path_len,
+                         const char* text, size_t text_len) {
+    char header[200];
+    int header_len = snprintf(header, sizeof(header), "%c %s %lu\n", kind, numbers,
+                              record_checksum(numbers, path, path_len, text, text_len));
+    struct iovec iov[4] = {
+        {header, header_len}, {(void*)path, path_len}, {(void*)text, text_len}, {(void*)"\n", 1}};
+    size_t total = header_len + path_len + text_len + 1;
+    int ok = (segment_fd >= 0 && writev(segment_fd, iov, 4) == (ssize_t)total);
+    if (ok) {
+        next_lsn++;
+        segment_bytes += total;
+        wal_stats.records++;
+    } else if (segment_fd >= 0 && ftruncate(segment_fd, segment_bytes) != 0) {
+        // The partial record fails its checksum on replay anyway
+        perror("[SS] WAL: dropping partial record");
+    }
+    return ok;
+}
+
+void wal_begin_edits(void) {
+    pthread_rwlock_rdlock(&edit_lock);
+}
+
+int wal_log_edit(Document* doc, int index, const char* text) {
+    unsigned long version = document_version(doc);
+    unsigned long sentence_id = get_document_sentence_id(doc, index);
+    size_t path_len = strlen(doc->path);
+    size_t text_len = strlen(text);
+
+    pthread_mutex_lock(&wal_mutex);
+    char numbers[160];
+    snprintf(numbers, sizeof(numbers), "%lu %lu %lu %d %zu %zu",
+             next_lsn, version, sentence_id, index, path_len, text_len);
+    int ok = append_record('E', numbers, doc->path, path_len, text, text_len);
+    pthread_mutex_unlock(&wal_mutex);
+    return ok;
+}
+
+unsigned long wal_end_edits(void) {
+    pthread_mutex_lock(&wal_mutex);
+    unsigned long lsn = next_lsn - 1;
+    pthread_mutex_unlock(&wal_mutex);
+    pthread_rwlock_unlock(&edit_lock);
+    return lsn;
+}
+
+// Makes the log durable up to `lsn`, whatever the fsync policy if `force`
+static int sync_log(unsigned long lsn, int force) {
+    pthread_mutex_lock(&wal_mutex);
+    int ok = 1;
+    if (!force) {
+        // Batched: the fsync thread picks the segment up; never: nothing
+        if (segment_fd >= 0 && lsn > synced_lsn) sync_file_write(segment_fd, segment_path, 0, 0);
+        pthread_mutex_unlock(&wal_mutex);
+        return 1;
+    }
+    while (ok && synced_lsn < lsn) {
+        if (syncing) {
+            pthread_cond_wait(&wal_synced_cond, &wal_mutex);
+            continue;
+        }
+        // One fdatasync covers every record written so far, so whoever
+        // gets here first syncs for all those waiting
+        syncing = 1;
+        unsigned long target = next_lsn - 1;
+        int fd = segment_fd;
+        pthread_mutex_unlock(&wal_mutex);
+        ok = (fd >= 0 && fdatasync(fd) == 0);
+        pthread_mutex_lock(&wal_mutex);
+        syncing = 0;
+        wal_stats.syncs++;
+        if (ok && target > synced_lsn) synced_lsn = target;
+        pthread_cond_broadcast(&wal_synced_cond);
+    }
+    pthread_mutex_unlock(&wal_mutex);
+    return ok;
+}
+
+int wal_sync(unsigned long lsn) {
+    return sync_log(lsn, get_fsync_policy() == FSYNC_ALWAYS);
+}
+
+// Starts segment `seq`. Caller holds wal_mutex.
+static int open_segment(unsigned long seq) {
+    char path[BUFFER_SIZE];
+    wal_file(seq, "log", path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return 0;
+    sync_file_write(-1, path, 1, 0);
+    segment_fd = fd;
+    segment_seq = seq;
+    segment_bytes = 0;
+    snprintf(segment_path, sizeof(segment_path), "%s", path);
+    return 1;
+}
+
+// Ends the open segment, with its records made durable as the policy says,
+// and starts the next. Caller holds edit_lock exclusively.
+static int rotate_segment(void) {
+    pthread_mutex_lock(&wal_mutex);
+    while (syncing) pthread_cond_wait(&wal_synced_cond, &wal_mutex);
+    if (segment_fd >= 0) {
+        if (get_fsync_policy() == FSYNC_ALWAYS && synced_lsn < next_lsn - 1) {
+            fdatasync(segment_fd);
+            wal_stats.syncs++;
+        }
+        close(segment_fd);
+        segment_fd = -1;
+    }
+    synced_lsn = next_lsn - 1;
+    int ok = open_segment(segment_seq + 1);
+    pthread_mutex_unlock(&wal_mutex);
+    return ok;
+}
+
+// --- Log directory ---
+
+static int compare_seqs(const void* a, const void* b) {
+    unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+    return (x > y) - (x < y);
+}
+
+// Sequence numbers of the log files ending in `suffix`, in order. Returns a
+// malloc'd array (caller frees) or NULL if there are none.
+static unsigned long* list_wal_files(const char* suffix, int* count) {
+    *count = 0;
+    DIR* d = opendir(wal_dir);
+    if (d == NULL) return NULL;
+    unsigned long* seqs = NULL;
+    int capacity = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        unsigned long seq;
+        char ext[16];
+        if (sscanf(de->d_name, "%lu.%15s", &seq, ext) != 2 || strcmp(ext, suffix) != 0) continue;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            unsigned long* grown = realloc(seqs, capacity * sizeof(unsigned long));
+            if (grown == NULL) break;
+            seqs = grown;
+        }
+        seqs[(*count)++] = seq;
+    }
+    closedir(d);
+    if (seqs != NULL) qsort(seqs, *count, sizeof(unsigned long), compare_seqs);
+    return seqs;
+}
+
+// Removes the segments up to and including `seq`, durably, so they cannot
+// be replayed over the files a checkpoint installed
+static void drop_segments(unsigned long seq) {
+    int count;
+    unsigned long* seqs = list_wal_files("log", &count);
+    char path[BUFFER_SIZE];
+    for (int i = 0; i < count && seqs[i] <= seq; i++) {
+        wal_file(seqs[i], "log", path, sizeof(path));
+        unlink(path);
+    }
+    free(seqs);
+    wal_file(seq, "log", path, sizeof(path));
+    sync_file_write(-1, path, 1, install_sync());
+    pthread_mutex_lock(&wal_mutex);
+    if (oldest_seq <= seq) oldest_seq = seq + 1;
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+// --- Checkpoints ---
+
+// One document being written to its file
+typedef struct {
+    Document* doc;
+    char* text;       // Whole new contents, or the tail appended at `from`
+    size_t from;
+    size_t len;
+    unsigned long version;
+    char tmp_path[BUFFER_SIZE];
+} Install;
+
+// Writes the text to be installed to a new file in the log directory
+static int write_install_file(Install* in) {
+    snprintf(in->tmp_path, sizeof(in->tmp_path), "%s/install.XXXXXX", wal_dir);
+    int fd = mkstemp(in->tmp_path);
+    if (fd < 0) {
+        in->tmp_path[0] = '\0';
+        return 0;
+    }
+    fchmod(fd, 0644);
+    int ok = (write(fd, in->text, in->len) == (ssize_t)in->len) &&
+             sync_file_write(fd, in->tmp_path, 0, install_sync());
+    if (close(fd) != 0) ok = 0;
+    return ok;
+}
+
+// Lists the installs of the checkpoint ending segment `seq`:
+//   R <install file> <data file>             rename over the data file
+//   A <install file> <data file> <length>    cut the data file to length
+//                                            and append the install file
+static int write_manifest(unsigned long seq, const Install* installs, int count) {
+    char path[BUFFER_SIZE], tmp_path[BUFFER_SIZE];
+    wal_file(seq, "ckpt", path, sizeof(path));
+    int fd = begin_file_replace(path, tmp_path, sizeof(tmp_path));
+    if (fd < 0) return 0;
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        if (installs[i].from > 0) {
+            ok = dprintf(fd, "A %s %s %zu\n", installs[i].tmp_path, installs[i].doc->path, installs[i].from) > 0;
+        } else {
+            ok = dprintf(fd, "R %s %s\n", installs[i].tmp_path, installs[i].doc->path) > 0;
+        }
+    }
+    return finish_file_replace(fd, tmp_path, path, ok, install_sync());
+}
+
+static int append_install(const char* tmp_path, const char* target, size_t length) {
+    int in = open(tmp_path, O_RDONLY);
+    int out = open(target, O_WRONLY | O_CREAT, 0644);
+    int ok = (in >= 0 && out >= 0 && ftruncate(out, length) == 0 &&
+              lseek(out, length, SEEK_SET) == (off_t)length);
+    char buf[65536];
+    ssize_t n = 0;
+    while (ok && (n = read(in, buf, sizeof(buf))) > 0) {
+        ok = (write(out, buf, n) == n);
+    }
+    if (n < 0) ok = 0;
+    ok = ok && sync_file_write(out, target, 0, install_sync());
+    if (in >= 0) close(in);
+    if (out >= 0 && close(out) != 0) ok = 0;
+    if (ok) unlink(tmp_path);
+    return ok;
+}
+
+// Puts an install file in place: renamed over the target, or appended to it
+// once it is cut to `from` bytes
+static int put_install(const char* tmp_path, const char* target, size_t from) {
+    if (from > 0) return append_install(tmp_path, target, from);
+    return rename(tmp_path, target) == 0 && sync_file_write(-1, target, 1, install_sync());
+}
+
+// Carries out a manifest's installs. One whose install file is gone is
+// already done, so this can be repeated after a crash. Returns 1 on success.
+static int apply_manifest(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return 0;
+    char line[3 * BUFFER_SIZE], tmp_path[BUFFER_SIZE], target[BUFFER_SIZE];
+    int ok = 1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char kind;
+        size_t length = 0;
+        int fields = sscanf(line, "%c %1023s %1023s %zu", &kind, tmp_path, target, &length);
+        if (fields < 3 || access(tmp_path, F_OK) != 0) continue;
+        if (kind == 'R') {
+            ok = put_install(tmp_path, target, 0) && ok;
+        } else if (kind == 'A' && fields == 4) {
+            ok = put_install(tmp_path, target, length) && ok;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+// Finishes checkpoints whose installs were cut short and drops the
+// segments they cover. Returns 1 on success.
+static int finish_checkpoints(void) {
+    int count;
+    unsigned long* seqs = list_wal_files("ckpt", &count);
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        char path[BUFFER_SIZE];
+        wal_file(seqs[i], "ckpt", path, sizeof(path));
+        ok = apply_manifest(path);
+        if (ok) {
+            drop_segments(seqs[i]);
+            unlink(path);
+        }
+    }
+    free(seqs);
+    return ok;
+}
+
+// Caller holds checkpoint_mutex
+static int checkpoint(void) {
+    int ok = finish_checkpoints();
+
+    // Copy every changed document and cut the log at the same moment, so
+    // the copies hold exactly the edits logged so far
+    pthread_rwlock_wrlock(&edit_lock);
+    int count = 0;
+    Document** docs = open_dirty_documents(&count);
+    pthread_mutex_lock(&wal_mutex);
+    int logged = (segment_bytes > 0 || oldest_seq < segment_seq);
+    pthread_mutex_unlock(&wal_mutex);
+    if (docs == NULL || (count == 0 && !logged)) {
+        free(docs);
+        pthread_rwlock_unlock(&edit_lock);
+        return ok && docs != NULL;
+    }
+    Install* installs = calloc(count > 0 ? count : 1, sizeof(Install));
+    ok = ok && installs != NULL;
+    for (int i = 0; i < count && ok; i++) {
+        installs[i].doc = docs[i];
+        installs[i].text = copy_document_changes(docs[i], &installs[i].from, &installs[i].len, &installs[i].version);
+        ok = (installs[i].text != NULL);
+    }
+    unsigned long seq = segment_seq;
+    ok = ok && rotate_segment();
+    pthread_rwlock_unlock(&edit_lock);
+
+    // Write the new contents aside, record the installs, then carry them out
+    for (int i = 0; i < count && ok; i++) {
+        ok = write_install_file(&installs[i]);
+    }
+    ok = ok && write_manifest(seq, installs, count);
+    char manifest[BUFFER_SIZE];
+    wal_file(seq, "ckpt", manifest, sizeof(manifest));
+    if (ok) {
+        ok = apply_manifest(manifest);
+        if (ok) {
+            drop_segments(seq);
+            unlink(manifest);
+        }
+    } else if (installs != NULL) {
+        for (int i = 0; i < count; i++) {
+            if (installs[i].tmp_path[0] != '\0') unlink(installs[i].tmp_path);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ok) mark_document_written(docs[i], installs[i].version, installs[i].from + installs[i].len);
+        if (installs != NULL) free(installs[i].text);
+        close_document(docs[i]);
+    }
+    free(installs);
+    free(docs);
+    if (ok) {
+        pthread_mutex_lock(&wal_mutex);
+        wal_stats.checkpoints++;
+        pthread_mutex_unlock(&wal_mutex);
+    } else {
+        printf("[SS] ERROR: WAL checkpoint failed, keeping the log\n");
+    }
+    return ok;
+}
+
+int wal_checkpoint(void) {
+    pthread_mutex_lock(&checkpoint_mutex);
+    int ok = checkpoint();
+    pthread_mutex_unlock(&checkpoint_mutex);
+    return ok;
+}
+
+int wal_release_file(const char* filepath) {
+    pthread_mutex_lock(&checkpoint_mutex);
+    finish_checkpoints();
+
+    // Its edits are written aside first, then the F record naming them is
+    // made durable, and only then are they put in place: a crash part way
+    // leaves either the old records or the install to replay
+    Install in;
+    memset(&in, 0, sizeof(in));
+    in.doc = open_cached_document(filepath);
+    if (in.doc != NULL) in.text = copy_document_changes(in.doc, &in.from, &in.len, &in.version);
+    int ok = (in.text == NULL || write_install_file(&in));
+
+    unsigned long lsn = 0;
+    if (ok) {
+        size_t path_len = strlen(filepath);
+        size_t install_len = strlen(in.tmp_path);
+        pthread_mutex_lock(&wal_mutex);
+        char numbers[160];
+        lsn = next_lsn;
+        snprintf(numbers, sizeof(numbers), "%lu %zu %zu %zu", lsn, in.from, path_len, install_len);
+        ok = append_record('F', numbers, filepath, path_len, in.tmp_path, install_len);
+        pthread_mutex_unlock(&wal_mutex);
+        ok = ok && sync_log(lsn, install_sync());
+    }
+    if (!ok && in.tmp_path[0] != '\0') unlink(in.tmp_path);
+    if (ok && in.text != NULL) {
+        // Left for replay if this fails, and the caller must not change the file
+        ok = put_install(in.tmp_path, filepath, in.from);
+        if (ok) mark_document_written(in.doc, in.version, in.from + in.len);
+    }
+    if (!ok) printf("[SS] ERROR: WAL could not write out %s\n", filepath);
+    free(in.text);
+    close_document(in.doc);
+    pthread_mutex_unlock(&checkpoint_mutex);
+    return ok;
+}
+
+void* wal_checkpoint_thread(void* arg) {
+    (void)arg;
+    int since_checkpoint_ms = 0;
+    while (1) {
+        usleep(WAL_CHECKPOINT_TICK_MS * 1000);
+        since_checkpoint_ms += WAL_CHECKPOINT_TICK_MS;
+        pthread_mutex_lock(&wal_mutex);
+        int full = (segment_bytes >= WAL_SEGMENT_MAX_BYTES);
+        pthread_mutex_unlock(&wal_mutex);
+        if (full || since_checkpoint_ms >= WAL_CHECKPOINT_INTERVAL_MS) {
+            wal_checkpoint();
+            since_checkpoint_ms = 0;
+        }
+    }
+    return NULL;
+}
+
+void get_wal_stats(WalStats* stats) {
+    pthread_mutex_lock(&wal_mutex);
+    *stats = wal_stats;
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+// --- Recovery ---
+
+// Re-applies the records of segment `seq`. Stops at the first incomplete or
+// damaged record, which is where a crash cut the segment off. Returns the
+// number applied.
+static long replay_segment(unsigned long seq) {
+    char path[BUFFER_SIZE];
+    wal_file(seq, "log", path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(size > 0 ? size : 1);
+    size_t len = (buf != NULL) ? fread(buf, 1, size, f) : 0;
+    fclose(f);
+
+    size_t pos = 0;
+    long applied = 0;
+    while (pos < len) {
+        char* newline = memchr(buf + pos, '\n', len - pos);
+        if (newline == NULL) break;
+        *newline = '\0';
+        char numbers[160];
+        unsigned long lsn, version, sentence_id, checksum;
+        int index;
+        size_t from, path_len, text_len;
+        int edit = (buf[pos] == 'E');
+        if (edit) {
+            if (sscanf(buf + pos, "E %lu %lu %lu %d %zu %zu %lu", &lsn, &version, &sentence_id,
+                       &index, &path_len, &text_len, &checksum) != 7) break;
+            snprintf(numbers, sizeof(numbers), "%lu %lu %lu %d %zu %zu",
+                     lsn, version, sentence_id, index, path_len, text_len);
+        } else {
+            if (sscanf(buf + pos, "F %lu %zu %zu %zu %lu", &lsn, &from, &path_len, &text_len, &checksum) != 5 ||
+                text_len >= BUFFER_SIZE) break;
+            snprintf(numbers, sizeof(numbers), "%lu %zu %zu %zu", lsn, from, path_len, text_len);
+        }
+        size_t body = newline + 1 - buf;
+        if (path_len >= BUFFER_SIZE || body + path_len + text_len + 1 > len ||
+            buf[body + path_len + text_len] != '\n') break;
+        if (record_checksum(numbers, buf + body, path_len, buf + body + path_len, text_len) != checksum) break;
+
+        char filepath[BUFFER_SIZE];
+        memcpy(filepath, buf + body, path_len);
+        filepath[path_len] = '\0';
+        buf[body + path_len + text_len] = '\0';
+        int ok;
+        if (edit) {
+            Document* doc = open_document(filepath);
+            ok = (doc != NULL && replace_document_sentence(doc, index, buf + body + path_len));
+            close_document(doc);
+        } else {
+            // The file was changed outside the log after this: the edits
+            // replayed so far are in its install file, if it is not yet in place
+            const char* install = buf + body + path_len;
+            invalidate_document(filepath);
+            ok = (text_len == 0 || access(install, F_OK) != 0 || put_install(install, filepath, from));
+        }
+        if (!ok) {
+            printf("[SS] WAL: could not replay record %lu for %s\n", lsn, filepath);
+            break;
+        }
+        if (lsn >= next_lsn) next_lsn = lsn + 1;
+        applied++;
+        pos = body + path_len + text_len + 1;
+    }
+    if (pos < len) {
+        printf("[SS] WAL: dropped %zu bytes after the last whole record of %s\n", len - pos, path);
+    }
+    free(buf);
+    return applied;
+}
+
+// Removes install files no manifest refers to any more
+static void remove_install_files(void) {
+    DIR* d = opendir(wal_dir);
+    if (d == NULL) return;
+    struct dirent* de;
+    char path[2 * BUFFER_SIZE];
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, "install.", 8) != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", wal_dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+int wal_open(const char* data_dir) {
+    if (snprintf(wal_dir, sizeof(wal_dir), "%s/%s", data_dir, WAL_DIR_NAME) >= (int)sizeof(wal_dir)) {
+        printf("[SS] ERROR: Data directory path too long for the WAL\n");
+        return 0;
+    }
+    if (mkdir(wal_dir, 0755) == -1 && errno != EEXIST) return 0;
+
+    // 1. Finish the installs of a checkpoint the crash interrupted
+    if (!finish_checkpoints()) return 0;
+
+    // 2. Replay the rest of the log over the data files
+    int count;
+    unsigned long* seqs = list_wal_files("log", &count);
+    long replayed = 0;
+    for (int i = 0; i < count; i++) {
+        replayed += replay_segment(seqs[i]);
+    }
+    unsigned long last = (count > 0) ? seqs[count - 1] : 0;
+    oldest_seq = (count > 0) ? seqs[0] : 1;
+    free(seqs);
+    if (replayed > 0) printf("[SS] WAL: replayed %ld records from %d segment(s)\n", replayed, count);
+    // Install files no record put in place were never recorded
+    remove_install_files();
+
+    // 3. Start a new segment and write the replayed documents out
+    pthread_mutex_lock(&wal_mutex);
+    int ok = open_segment(last + 1);
+    pthread_mutex_unlock(&wal_mutex);
+    return ok && wal_checkpoint();
+}
@@ -0,0 +1,60 @@
+#ifndef SS_WAL_H
+#define SS_WAL_H
+
+#include "ss_document.h"
+
+// Write-ahead log of sentence edits. A commit is durable once its edits are
+// appended to the log and the log is synced; data files are brought up to
+// date later by checkpoints, which write every changed document to its file
+// and then drop the log segments it covers. On startup whatever is left in
+// the log is replayed over the data files.
+//
+// Under <data dir>/.wal/:
+//   <seq>.log       records, oldest segment first
+//   <seq>.ckpt      what the checkpoint ending segment <seq> installs; kept
+//                   until every install is done, so a crash part way
+//                   through can finish them
+//   install.XXXXXX  new file contents (or appended tails) being installed
+#define WAL_DIR_NAME ".wal"
+#define WAL_CHECKPOINT_INTERVAL_MS 1000        // Longest a data file lags behind the log
+#define WAL_CHECKPOINT_TICK_MS 100             // How often the checkpoint thread looks
+#define WAL_SEGMENT_MAX_BYTES (8 * 1024 * 1024) // Checkpoint early once a segment is this big
+
+typedef struct {
+    unsigned long records;
+    unsigned long syncs;
+    unsigned long checkpoints;
+} WalStats;
+
+// Finishes any interrupted checkpoint, replays the log over the data files
+// and starts a new segment. Call once at startup, before serving requests.
+// Returns 1 on success.
+int wal_open(const char* data_dir);
+
+// Edits are applied and logged between wal_begin_edits and wal_end_edits,
+// so a checkpoint never copies a document between an edit and its record.
+void wal_begin_edits(void);
+// Logs that sentence `index` of `doc` has just been replaced with `text`.
+// Returns 1 on success.
+int wal_log_edit(Document* doc, int index, const char* text);
+// Returns the log position covering everything logged so far
+unsigned long wal_end_edits(void);
+// Makes the log durable up to `lsn` as the fsync policy says. Concurrent
+// callers share one fsync. Returns 1 on success.
+int wal_sync(unsigned long lsn);
+
+// Writes every changed document to its file and drops the log behind it.
+// Returns 1 on success.
+int wal_checkpoint(void);
+// Call before changing a data file outside the sentence API (UNDO, REVERT,
+// replica pushes, create, delete, move). Writes the file's logged edits to
+// it and records that nothing logged for it so far is to be replayed; other
+// files are not touched. The caller holds the file's write mutex until the
+// change is done, so nothing new is logged for it meanwhile. Returns 1 on
+// success; on failure the file must be left as it is.
+int wal_release_file(const char* filepath);
+
+void* wal_checkpoint_thread(void* arg);
+void get_wal_stats(WalStats* stats);
+
+#endif
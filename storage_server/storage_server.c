@@ -2,10 +2,17 @@
 #include "../common/config.h"
 #include <sys/stat.h> // For mkdir
 #include <errno.h>
+#include <signal.h>
 #include "../name_server/ns_utils.h"
 #include <fcntl.h>
+#include <sys/epoll.h>
 #include "ss_utils.h"
 
+// --- Connection Dispatch Configuration ---
+#define SS_MIN_WORKERS 2          // Pool size floor on single-core machines
+#define SS_CONN_QUEUE_SIZE 1024   // Connections waiting for a worker
+#define SS_MAX_EVENTS 64          // epoll events handled per wakeup
+
 char SS_DATA_DIR[100]; // Global to store this SS's data directory (e.g., "ss1_data/")
 char SS_ID[50]; // Global to store this SS's ID
 char SS_LOG_FILE[150]; // Log file path
@@ -19,6 +26,48 @@ char* get_base_filename_ss(const char* path) {
     return (char*)(last_slash + 1); // Return the part after the slash
 }
 
+// Collects the text lines that follow a COMMIT/CAS header: whatever arrived with
+// the header in `buffer`, then the rest from the socket up to the `lines`th
+// newline. The lines are split in place into `line_starts`.
+static int receive_commit_lines(int sock, const char* buffer, char* text, size_t size,
+                                const char** line_starts, int lines) {
+    size_t len = 0;
+    const char* newline_pos = strchr(buffer, '\n');
+    if (newline_pos != NULL) {
+        snprintf(text, size, "%s", newline_pos + 1);
+        len = strlen(text);
+    }
+    text[len] = '\0';
+    int newlines = 0;
+    for (const char* p = text; (p = strchr(p, '\n')) != NULL; p++) newlines++;
+    while (newlines < lines && len + 1 < size) {
+        ssize_t n = read(sock, text + len, size - len - 1);
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) newlines += (text[len + i] == '\n');
+        len += n;
+        text[len] = '\0';
+    }
+
+    int found = 0;
+    char* p = text;
+    while (found < lines && *p) {
+        line_starts[found++] = p;
+        char* end = strchr(p, '\n');
+        if (end == NULL) break;
+        *end = '\0';
+        p = end + 1;
+    }
+    for (int i = 0; i < found; i++) {
+        ((char*)line_starts[i])[strcspn(line_starts[i], "\r")] = '\0';
+    }
+    return found;
+}
+
+static void receive_commit_text(int sock, const char* buffer, char* text, size_t size) {
+    const char* line;
+    if (receive_commit_lines(sock, buffer, text, size, &line, 1) == 0) text[0] = '\0';
+}
+
 // --- Handler for Client Connections (Phase 4 Placeholder) ---
 void *handle_client_connection(void *socket_desc) {
     int sock = *(int*)socket_desc;
@@ -33,11 +82,11 @@ void *handle_client_connection(void *socket_desc) {
     int read_size;
     
     // Read the *first* command from the client
-    if ((read_size = read(sock, buffer, BUFFER_SIZE)) > 0) {
+    if ((read_size = read(sock, buffer, BUFFER_SIZE - 1)) > 0) {
         buffer[read_size] = '\0';
         log_message(SS_LOG_FILE, "REQUEST", "Received from %s:%d: %s", client_ip, client_port, buffer);
         
-        char command[100], filename[MAX_FILENAME];
+        char command[100], filename[MAX_FILENAME] = "";
         int sentence_num;
         sscanf(buffer, "%s %s %d", command, filename, &sentence_num);
         
@@ -61,9 +110,73 @@ void *handle_client_connection(void *socket_desc) {
             // handle_write will manage the rest of the connection
             handle_write(sock, filepath, sentence_num);
         }
+        // --- LOCK / LOCKSET / COMMIT / UNLOCK / RENEW (two-phase WRITE) ---
+        else if (strcmp(command, "LOCK") == 0) {
+            int wait_seconds = 0;
+            sscanf(buffer, "%*s %*s %*d %d", &wait_seconds);
+            log_message(SS_LOG_FILE, "INFO", "Processing LOCK request for %s (sentence %d, wait %ds) from %s:%d",
+                       filename, sentence_num, wait_seconds, client_ip, client_port);
+            handle_lock(sock, filepath, sentence_num, wait_seconds);
+        }
+        else if (strcmp(command, "LOCKSET") == 0) {
+            char spec[128] = "";
+            sscanf(buffer, "%*s %*s %127s", spec);
+            log_message(SS_LOG_FILE, "INFO", "Processing LOCKSET request for %s (sentences %s) from %s:%d",
+                       filename, spec, client_ip, client_port);
+            handle_lockset(sock, filepath, spec);
+        }
+        else if (strcmp(command, "COMMIT") == 0) {
+            unsigned long token = 0;
+            int count = 1;
+            sscanf(buffer, "%*s %*s %lu %d", &token, &count);
+            log_message(SS_LOG_FILE, "INFO", "Processing COMMIT request for %s (%d edits) from %s:%d",
+                       filename, count, client_ip, client_port);
+            if (count < 1 || count > MAX_TRANSACTION_SENTENCES) {
+                write(sock, "ERR_EDIT_COUNT_MISMATCH\n", 24);
+            } else {
+                char* body = malloc(MAX_TRANSACTION_SENTENCES * 2048);
+                const char* new_texts[MAX_TRANSACTION_SENTENCES];
+                if (body == NULL) {
+                    write(sock, "ERR_MEMORY\n", 11);
+                } else if (receive_commit_lines(sock, buffer, body, MAX_TRANSACTION_SENTENCES * 2048,
+                                                new_texts, count) != count) {
+                    write(sock, "ERR_EDIT_COUNT_MISMATCH\n", 24);
+                } else {
+                    handle_commit(sock, filepath, token, new_texts, count);
+                }
+                free(body);
+            }
+        }
+        else if (strcmp(command, "UNLOCK") == 0) {
+            unsigned long token = 0;
+            sscanf(buffer, "%*s %*s %lu", &token);
+            handle_unlock(sock, filepath, token);
+        }
+        else if (strcmp(command, "RENEW") == 0) {
+            unsigned long token = 0;
+            sscanf(buffer, "%*s %*s %lu", &token);
+            handle_renew(sock, filepath, token);
+        }
+        // --- PEEK / CAS (optimistic WRITE) ---
+        else if (strcmp(command, "PEEK") == 0) {
+            handle_peek(sock, filepath, sentence_num);
+        }
+        else if (strcmp(command, "CAS") == 0) {
+            unsigned long version = 0;
+            sscanf(buffer, "%*s %*s %*d %lu", &version);
+            log_message(SS_LOG_FILE, "INFO", "Processing CAS request for %s (sentence %d) from %s:%d",
+                       filename, sentence_num, client_ip, client_port);
+            char new_text[2048];
+            receive_commit_text(sock, buffer, new_text, sizeof(new_text));
+            handle_cas(sock, filepath, sentence_num, version, new_text);
+        }
         else if (strcmp(command, "UNDO") == 0) { 
-            log_message(SS_LOG_FILE, "INFO", "Processing UNDO request for %s from %s:%d", filename, client_ip, client_port);
-            handle_undo(sock, filepath);
+            // UNDO <filename> [steps]
+            int steps = 1;
+            sscanf(buffer, "%*s %*s %d", &steps);
+            log_message(SS_LOG_FILE, "INFO", "Processing UNDO request for %s (%d steps) from %s:%d",
+                       filename, steps, client_ip, client_port);
+            handle_undo(sock, filepath, steps);
         }
         // --- CHECKPOINT ---
         else if (strcmp(command, "CHECKPOINT") == 0) {
@@ -80,7 +193,12 @@ void *handle_client_connection(void *socket_desc) {
         }
         // --- LISTCHECKPOINTS ---
         else if (strcmp(command, "LISTCHECKPOINTS") == 0) {
-            handle_listcheckpoints(sock, filepath);
+            // LISTCHECKPOINTS <filename> [offset] [count]
+            int offset = 0, count = CHECKPOINT_LIST_PAGE;
+            sscanf(buffer, "%*s %*s %d %d", &offset, &count);
+            if (offset < 0) offset = 0;
+            if (count <= 0) count = CHECKPOINT_LIST_PAGE;
+            handle_listcheckpoints(sock, filepath, offset, count);
         }
         // --- REVERT to CHECKPOINT ---
         else if (strcmp(command, "REVERT") == 0) {
@@ -88,6 +206,10 @@ void *handle_client_connection(void *socket_desc) {
             sscanf(buffer, "%*s %*s %127s", tag);
             handle_revert_to_checkpoint(sock, filepath, tag);
         }
+        // --- SSSTATS ---
+        else if (strcmp(command, "SSSTATS") == 0) {
+            handle_ssstats(sock);
+        }
         // --- SHUTDOWN ---
         else if (strcmp(command, "SHUTDOWN") == 0) {
             printf("[SS] Received SHUTDOWN command from Name Server.\n");
@@ -107,36 +229,64 @@ void *handle_client_connection(void *socket_desc) {
 }
 
 
-// --- Listener Thread for Clients ---
-void *start_client_listener(void *port_arg) {
-    int client_port = *(int*)port_arg;
-    free(port_arg);
-
-    int listen_fd = create_server_socket(client_port);
-    printf("[SS] Listening for CLIENTS on port %d\n", client_port);
+// --- Handler for Name Server Commands (Phase 3) ---
+// Copies the first line of an NM message (the header) into `header` and
+// reports how many bytes of `buffer` it occupied, newline included.
+static void split_nm_header(const char* buffer, int read_size, char* header, int* header_len) {
+    const char* newline_pos = strchr(buffer, '\n');
+    *header_len = (newline_pos != NULL) ? (newline_pos - buffer) + 1 : read_size;
+    snprintf(header, BUFFER_SIZE, "%.*s", *header_len, buffer);
+}
 
-    while (1) {
-        int conn_fd = accept(listen_fd, NULL, NULL);
-        if (conn_fd < 0) {
-            perror("ERROR on client accept");
-            continue;
-        }
-        
-        pthread_t thread_id;
-        int *new_sock = malloc(sizeof(int));
-        *new_sock = conn_fd;
-        if (pthread_create(&thread_id, NULL, handle_client_connection, (void*) new_sock) < 0) {
-            perror("ERROR creating client handler thread");
-            free(new_sock);
+// Collects the <content_len> raw bytes that follow a header: whatever arrived
+// with the header in `buffer`, then the rest from the socket. Returns a
+// malloc'd buffer (caller frees) or NULL on a short read.
+static char* receive_nm_payload(int sock, const char* buffer, int read_size, int header_len, int content_len) {
+    char* content = malloc(content_len > 0 ? content_len : 1);
+    if (content == NULL) return NULL;
+    int total_read = 0;
+    
+    int content_in_buffer = read_size - header_len;
+    if (content_in_buffer > 0) {
+        int to_copy = (content_in_buffer < content_len) ? content_in_buffer : content_len;
+        memcpy(content, buffer + header_len, to_copy);
+        total_read = to_copy;
+    }
+    
+    while (total_read < content_len) {
+        int bytes_read = read(sock, content + total_read, content_len - total_read);
+        if (bytes_read <= 0) {
+            printf("[SS-NMPort] ERROR: Failed to read content (got %d of %d bytes, errno=%d)\n", total_read, content_len, errno);
+            free(content);
+            return NULL;
         }
-        pthread_detach(thread_id);
+        total_read += bytes_read;
     }
-    close(listen_fd);
-    return 0;
+    return content;
 }
 
+// Replaces a replica's copy of a file atomically. `durable` syncs it before
+// returning whatever the fsync policy. Returns 1 on success.
+static int write_replica_content(const char* filepath, const char* content, int content_len, int durable) {
+    ensure_parent_dir(filepath);
+    FileLock* lock = begin_file_change(filepath);
+    if (lock == NULL) return 0;
+    char tmp_path[BUFFER_SIZE];
+    int fd = begin_file_replace(filepath, tmp_path, sizeof(tmp_path));
+    int ok = (fd >= 0);
+    if (!ok) {
+        perror("[SS-NMPort] ERROR opening file for writing");
+    } else if (!finish_file_replace(fd, tmp_path, filepath, write(fd, content, content_len) == content_len, durable)) {
+        perror("[SS-NMPort] ERROR writing file");
+        ok = 0;
+    } else {
+        invalidate_document(filepath);
+        drop_undo_history(filepath);
+    }
+    end_file_change(lock);
+    return ok;
+}
 
-// --- Handler for Name Server Commands (Phase 3) ---
 void *handle_nm_command(void *socket_desc) {
     int sock = *(int*)socket_desc;
     free(socket_desc);
@@ -161,7 +311,14 @@ void *handle_nm_command(void *socket_desc) {
         // --- NM_CREATE ---
         if (strcmp(command, "NM_CREATE") == 0) {
             // Create an empty file
-            int fd = open(filepath, O_CREAT | O_WRONLY, 0644);
+            ensure_parent_dir(filepath);
+            FileLock* lock = begin_file_change(filepath);
+            int fd = lock ? open(filepath, O_CREAT | O_WRONLY, 0644) : -1;
+            if (fd >= 0) {
+                invalidate_document(filepath);
+                drop_undo_history(filepath); // Left by an earlier file of the same name
+            }
+            end_file_change(lock);
             if (fd < 0) {
                 perror("ERROR creating file");
                 log_message(SS_LOG_FILE, "ERROR", "Failed to create file: %s", filepath);
@@ -176,10 +333,21 @@ void *handle_nm_command(void *socket_desc) {
         // --- NM_DELETE ---
         else if (strcmp(command, "NM_DELETE") == 0) {
             // Check if file has any active locks before deleting
-            if (is_file_locked(filename)) {
+            int deleted = 0;
+            if (!is_file_locked(filename)) {
+                // Logged edits go to the file first, so none are left to land on it later
+                FileLock* lock = begin_file_change(filepath);
+                deleted = (lock != NULL && remove(filepath) == 0);
+                if (deleted) {
+                    invalidate_document(filepath);
+                    drop_undo_history(filepath);
+                }
+                end_file_change(lock);
+            }
+            if (is_file_locked(filename) && !deleted) {
                 write(sock, "ERR_FILE_LOCKED\n", 16);
                 log_message(SS_LOG_FILE, "WARNING", "Cannot delete %s: file is locked", filepath);
-            } else if (remove(filepath) == 0) {
+            } else if (deleted) {
                 write(sock, "ACK_NM_DELETE\n", 14);
                 log_message(SS_LOG_FILE, "SUCCESS", "Deleted file: %s", filepath);
             } else {
@@ -204,13 +372,16 @@ void *handle_nm_command(void *socket_desc) {
         
         // --- NM_GETSIZE ---
         else if (strcmp(command, "NM_GETSIZE") == 0) {
-            // Get the actual file size using stat
+            // The size of the cached document, which may be ahead of the file
             struct stat st;
-            if (stat(filepath, &st) == 0) {
+            Document* doc = NULL;
+            if (stat(filepath, &st) == 0 && (doc = open_document(filepath)) != NULL) {
+                long size = (long)document_length(doc);
+                close_document(doc);
                 char size_response[BUFFER_SIZE];
-                snprintf(size_response, sizeof(size_response), "SIZE %ld\n", st.st_size);
+                snprintf(size_response, sizeof(size_response), "SIZE %ld\n", size);
                 write(sock, size_response, strlen(size_response));
-                log_message(SS_LOG_FILE, "RESPONSE", "File %s size: %ld bytes", filepath, st.st_size);
+                log_message(SS_LOG_FILE, "RESPONSE", "File %s size: %ld bytes", filepath, size);
             } else {
                 write(sock, "SIZE 0\n", 7);
                 log_message(SS_LOG_FILE, "WARNING", "Could not stat file %s", filepath);
@@ -219,34 +390,21 @@ void *handle_nm_command(void *socket_desc) {
         
         // --- NM_GETSTATS ---
         else if (strcmp(command, "NM_GETSTATS") == 0) {
-            // Get detailed file statistics: size, word count, char count, last access time
+            // Get detailed file statistics: size, word count, char count, last access time.
+            // Content figures come from the document cache; stat is only for atime.
             struct stat st;
-            if (stat(filepath, &st) == 0) {
-                // Calculate word count and character count
-                FILE *fp = fopen(filepath, "r");
-                long word_count = 0;
-                long char_count = st.st_size; // Character count is file size
-                
-                if (fp) {
-                    int in_word = 0;
-                    int c;
-                    while ((c = fgetc(fp)) != EOF) {
-                        if (c == ' ' || c == '\n' || c == '\t') {
-                            in_word = 0;
-                        } else if (!in_word) {
-                            in_word = 1;
-                            word_count++;
-                        }
-                    }
-                    fclose(fp);
-                }
-                
+            Document* doc = NULL;
+            if (stat(filepath, &st) == 0 && (doc = open_document(filepath)) != NULL) {
+                long char_count = (long)document_length(doc); // Character count is file size
+                long word_count = document_word_count(doc);
+                close_document(doc);
+
                 char stats_response[BUFFER_SIZE];
                 snprintf(stats_response, sizeof(stats_response), "STATS %ld %ld %ld %ld\n", 
-                         st.st_size, word_count, char_count, st.st_atime);
+                         char_count, word_count, char_count, st.st_atime);
                 write(sock, stats_response, strlen(stats_response));
                 log_message(SS_LOG_FILE, "RESPONSE", "File %s stats: size=%ld words=%ld chars=%ld", 
-                           filepath, st.st_size, word_count, char_count);
+                           filepath, char_count, word_count, char_count);
             } else {
                 write(sock, "STATS 0 0 0 0\n", 14);
                 log_message(SS_LOG_FILE, "WARNING", "Could not stat file %s", filepath);
@@ -266,6 +424,14 @@ void *handle_nm_command(void *socket_desc) {
             }
         }
         
+        // --- NM_SETRETENTION ---
+        else if (strcmp(command, "NM_SETRETENTION") == 0) {
+            // "NM_SETRETENTION <file|folder> <rule>"
+            int rule_offset = 0;
+            sscanf(buffer, "%*s %*s%n", &rule_offset);
+            handle_setretention(sock, filepath, rule_offset > 0 ? buffer + rule_offset : "");
+        }
+
         // --- NM_MOVE ---
         else if (strcmp(command, "NM_MOVE") == 0) {
             // arg2 contains the destination path (folder name or ".")
@@ -282,7 +448,20 @@ void *handle_nm_command(void *socket_desc) {
                 snprintf(destpath, sizeof(destpath), "%s/%s/%s", SS_DATA_DIR, arg2, get_base_filename_ss(filename));
             }
             
-            if (rename(srcpath, destpath) == 0) {
+            // Both files are locked in name order, so two moves can't each
+            // hold one waiting for the other
+            int order = strcmp(srcpath, destpath);
+            FileLock* first = begin_file_change(order < 0 ? srcpath : destpath);
+            FileLock* second = (first && order != 0) ? begin_file_change(order < 0 ? destpath : srcpath) : NULL;
+            int moved = (first != NULL && (order == 0 || second != NULL) && rename(srcpath, destpath) == 0);
+            if (moved) {
+                invalidate_document(srcpath);
+                invalidate_document(destpath);
+                move_undo_history(srcpath, destpath);
+            }
+            end_file_change(second);
+            end_file_change(first);
+            if (moved) {
                 write(sock, "ACK_NM_MOVE\n", 12);
                 printf("[SS-NMPort] Moved file %s to %s\n", srcpath, destpath);
             } else {
@@ -293,61 +472,61 @@ void *handle_nm_command(void *socket_desc) {
         
         // --- NM_WRITECONTENT ---
         else if (strcmp(command, "NM_WRITECONTENT") == 0) {
-            int content_len;
-            sscanf(buffer, "NM_WRITECONTENT %s %d", filename, &content_len);
+            // Header: "NM_WRITECONTENT <file> <len> [SYNC]\n" followed by <len> raw bytes.
+            // SYNC (sent for quorum-mode files) makes the replica fsync before acking.
+            int content_len = 0;
+            char flag[16] = "";
+            int header_len;
+            char header[BUFFER_SIZE];
+            split_nm_header(buffer, read_size, header, &header_len);
+            sscanf(header, "NM_WRITECONTENT %s %d %15s", filename, &content_len, flag);
+            int durable = (strcmp(flag, "SYNC") == 0);
             
-            printf("[SS-NMPort] NM_WRITECONTENT: file=%s, expected_len=%d, read_size=%d\n", filename, content_len, read_size);
+            printf("[SS-NMPort] NM_WRITECONTENT: file=%s, expected_len=%d, read_size=%d%s\n", filename, content_len, read_size, durable ? " (sync)" : "");
             
-            // Calculate where the content starts in the buffer
-            // The command line ends with \n, so find it
-            char* newline_pos = strchr(buffer, '\n');
-            int header_len = 0;
-            int content_in_buffer = 0;
-            
-            if (newline_pos != NULL) {
-                header_len = (newline_pos - buffer) + 1; // +1 to include the \n
-                content_in_buffer = read_size - header_len;
-                printf("[SS-NMPort] Header length: %d, content already in buffer: %d\n", header_len, content_in_buffer);
-            }
-            
-            // Prepare buffer for content
-            char content[8192];
-            int total_read = 0;
-            
-            // First, copy any content that was already read in the initial buffer
-            if (content_in_buffer > 0) {
-                int to_copy = (content_in_buffer < content_len) ? content_in_buffer : content_len;
-                memcpy(content, buffer + header_len, to_copy);
-                total_read = to_copy;
-                printf("[SS-NMPort] Copied %d bytes from initial buffer\n", to_copy);
-            }
-            
-            // Keep reading until we get all the content
-            while (total_read < content_len) {
-                int bytes_read = read(sock, content + total_read, content_len - total_read);
-                if (bytes_read <= 0) {
-                    printf("[SS-NMPort] ERROR: Failed to read content (got %d of %d bytes, errno=%d)\n", total_read, content_len, errno);
-                    write(sock, "ERR_NM_WRITECONTENT\n", 20);
-                    break;
-                }
-                total_read += bytes_read;
-                printf("[SS-NMPort] Read %d bytes (total: %d of %d)\n", bytes_read, total_read, content_len);
+            char* content = receive_nm_payload(sock, buffer, read_size, header_len, content_len);
+            if (content != NULL && write_replica_content(filepath, content, content_len, durable)) {
+                printf("[SS-NMPort] Wrote %d bytes to %s, sending ACK...\n", content_len, filepath);
+                write(sock, "ACK_NM_WRITECONTENT\n", 20);
+            } else {
+                write(sock, "ERR_NM_WRITECONTENT\n", 20);
             }
-            
-            if (total_read == content_len) {
-                // Write content to file
-                FILE* f = fopen(filepath, "w");
-                if (f != NULL) {
-                    fwrite(content, 1, total_read, f);
-                    fclose(f);
-                    printf("[SS-NMPort] Wrote %d bytes to %s, sending ACK...\n", total_read, filepath);
-                    int ack_sent = write(sock, "ACK_NM_WRITECONTENT\n", 20);
-                    printf("[SS-NMPort] ACK sent (%d bytes)\n", ack_sent);
-                } else {
-                    perror("[SS-NMPort] ERROR opening file for writing");
-                    write(sock, "ERR_NM_WRITECONTENT\n", 20);
+            free(content);
+        }
+
+        // --- NM_CHAINWRITE ---
+        else if (strcmp(command, "NM_CHAINWRITE") == 0) {
+            // Header: "NM_CHAINWRITE <file> <len> <n> <ip:port>...\n" followed by <len> raw bytes.
+            // Sent by the previous SS in a chain-mode file's replica chain. We apply the
+            // update durably, forward it to the next hop and answer with the number of
+            // copies from here to the tail: "ACK_NM_CHAINWRITE <copies>" when the whole
+            // rest of the chain applied it, "ERR_NM_CHAINWRITE <copies>" otherwise.
+            int content_len = 0, consumed = 0;
+            int header_len;
+            char header[BUFFER_SIZE];
+            split_nm_header(buffer, read_size, header, &header_len);
+            sscanf(header, "NM_CHAINWRITE %s %d%n", filename, &content_len, &consumed);
+            char hops[MAX_SS][64];
+            int hop_count = parse_chain_hops(header + consumed, hops);
+            snprintf(filepath, sizeof(filepath), "%s/%s", SS_DATA_DIR, filename);
+
+            printf("[SS-NMPort] NM_CHAINWRITE: file=%s, len=%d, %d hop(s) downstream\n", filename, content_len, hop_count);
+
+            char* content = receive_nm_payload(sock, buffer, read_size, header_len, content_len);
+            int copies = 0;
+            if (content != NULL && write_replica_content(filepath, content, content_len, 1)) {
+                copies = 1;
+                if (hop_count > 0) {
+                    copies += forward_chain_write(filename, content, content_len, hops, hop_count);
                 }
             }
+            char reply[64];
+            snprintf(reply, sizeof(reply), "%s %d\n",
+                     copies == hop_count + 1 ? "ACK_NM_CHAINWRITE" : "ERR_NM_CHAINWRITE", copies);
+            write(sock, reply, strlen(reply));
+            log_message(SS_LOG_FILE, copies == hop_count + 1 ? "SUCCESS" : "ERROR",
+                        "Chain write of %s: %d of %d copies from here to the tail", filename, copies, hop_count + 1);
+            free(content);
         }
     }
 
@@ -356,36 +535,175 @@ void *handle_nm_command(void *socket_desc) {
     return 0;
 }
 
-// --- Listener Thread for Name Server ---
-void *start_nm_listener(void *port_arg) {
-    int nm_port = *(int*)port_arg;
-    free(port_arg);
+// --- Connection Dispatcher ---
+// One epoll thread accepts on both ports and waits for each connection's
+// first request; a fixed pool of workers (one per core) then runs the
+// handler. Requests that can hold a connection for a long time get their
+// own thread so they can't starve the pool.
+typedef struct {
+    int sock;
+    int from_nm; // Accepted on the NM port
+} ConnJob;
 
-    int listen_fd = create_server_socket(nm_port);
-    log_message(SS_LOG_FILE, "SUCCESS", "Listening for NM connections on port %d", nm_port);
+typedef struct {
+    ConnJob jobs[SS_CONN_QUEUE_SIZE];
+    int front;
+    int rear;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} ConnQueue;
 
+ConnQueue conn_queue = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER
+};
+
+static void conn_queue_push(int sock, int from_nm) {
+    pthread_mutex_lock(&conn_queue.mutex);
+    while (conn_queue.count == SS_CONN_QUEUE_SIZE) {
+        pthread_cond_wait(&conn_queue.not_full, &conn_queue.mutex);
+    }
+    conn_queue.jobs[conn_queue.rear].sock = sock;
+    conn_queue.jobs[conn_queue.rear].from_nm = from_nm;
+    conn_queue.rear = (conn_queue.rear + 1) % SS_CONN_QUEUE_SIZE;
+    conn_queue.count++;
+    pthread_cond_signal(&conn_queue.not_empty);
+    pthread_mutex_unlock(&conn_queue.mutex);
+}
+
+static ConnJob conn_queue_pop() {
+    pthread_mutex_lock(&conn_queue.mutex);
+    while (conn_queue.count == 0) {
+        pthread_cond_wait(&conn_queue.not_empty, &conn_queue.mutex);
+    }
+    ConnJob job = conn_queue.jobs[conn_queue.front];
+    conn_queue.front = (conn_queue.front + 1) % SS_CONN_QUEUE_SIZE;
+    conn_queue.count--;
+    pthread_cond_signal(&conn_queue.not_full);
+    pthread_mutex_unlock(&conn_queue.mutex);
+    return job;
+}
+
+// WRITE waits on the user, STREAM paces its output, and REVERT and
+// NM_CHAINWRITE wait on other servers
+static int is_long_running(const char* command, const char* request, int from_nm) {
+    if (from_nm) {
+        return strcmp(command, "NM_CHAINWRITE") == 0;
+    }
+    // A LOCK with a wait may queue behind another editor
+    int lock_wait = 0;
+    if (strcmp(command, "LOCK") == 0 && sscanf(request, "%*s %*s %*d %d", &lock_wait) == 1 && lock_wait > 0) {
+        return 1;
+    }
+    // COMMIT and CAS can wait on replica acks in quorum mode
+    return strcmp(command, "WRITE") == 0 ||
+           strcmp(command, "COMMIT") == 0 ||
+           strcmp(command, "CAS") == 0 ||
+           strcmp(command, "STREAM") == 0 ||
+           strcmp(command, "REVERT") == 0;
+}
+
+void *conn_worker_thread(void *arg) {
+    (void)arg;
     while (1) {
-        int conn_fd = accept(listen_fd, NULL, NULL);
-        if (conn_fd < 0) {
-            perror("ERROR on NM accept");
+        ConnJob job = conn_queue_pop();
+
+        // Look at the command without consuming it; the handler reads it again
+        char peek[64];
+        int n = recv(job.sock, peek, sizeof(peek) - 1, MSG_PEEK);
+        if (n <= 0) {
+            close(job.sock);
             continue;
         }
-        
-        char nm_ip[INET_ADDRSTRLEN];
-        int nm_port_peer;
-        get_client_info(conn_fd, nm_ip, &nm_port_peer);
-        log_message(SS_LOG_FILE, "INFO", "NM connection from %s:%d", nm_ip, nm_port_peer);
-        
+        peek[n] = '\0';
+        char command[64] = "";
+        sscanf(peek, "%63s", command);
+
+        void *(*handler)(void *) = job.from_nm ? handle_nm_command : handle_client_connection;
+        int *sock_arg = malloc(sizeof(int));
+        *sock_arg = job.sock;
+
         pthread_t thread_id;
-        int *new_sock = malloc(sizeof(int));
-        *new_sock = conn_fd;
-        if (pthread_create(&thread_id, NULL, handle_nm_command, (void*) new_sock) < 0) {
-            perror("ERROR creating NM handler thread");
-            free(new_sock);
+        if (is_long_running(command, peek, job.from_nm) &&
+            pthread_create(&thread_id, NULL, handler, (void*) sock_arg) == 0) {
+            pthread_detach(thread_id);
+        } else {
+            handler(sock_arg);
+        }
+    }
+    return NULL;
+}
+
+static void epoll_watch(int epoll_fd, int fd, uint64_t tag, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("ERROR on epoll_ctl");
+        close(fd);
+    }
+}
+
+// Connection tags: low 32 bits are the fd, bit 32 marks the NM port,
+// bit 33 marks a listening socket
+#define CONN_TAG_NM (1ULL << 32)
+#define CONN_TAG_LISTEN (1ULL << 33)
+
+void *start_listeners(void *ports_arg) {
+    int client_port = ((int*)ports_arg)[0];
+    int nm_port = ((int*)ports_arg)[1];
+    free(ports_arg);
+
+    int client_listen_fd = create_server_socket(client_port);
+    int nm_listen_fd = create_server_socket(nm_port);
+    fcntl(client_listen_fd, F_SETFL, fcntl(client_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(nm_listen_fd, F_SETFL, fcntl(nm_listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    printf("[SS] Listening for CLIENTS on port %d\n", client_port);
+    log_message(SS_LOG_FILE, "SUCCESS", "Listening for NM connections on port %d", nm_port);
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        die("ERROR creating epoll instance");
+    }
+    epoll_watch(epoll_fd, client_listen_fd, CONN_TAG_LISTEN | (uint32_t)client_listen_fd, EPOLLIN);
+    epoll_watch(epoll_fd, nm_listen_fd, CONN_TAG_LISTEN | CONN_TAG_NM | (uint32_t)nm_listen_fd, EPOLLIN);
+
+    struct epoll_event events[SS_MAX_EVENTS];
+    while (1) {
+        int ready = epoll_wait(epoll_fd, events, SS_MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno != EINTR) perror("ERROR on epoll_wait");
+            continue;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            uint64_t tag = events[i].data.u64;
+            int fd = (int)(uint32_t)tag;
+            int from_nm = (tag & CONN_TAG_NM) != 0;
+
+            if (tag & CONN_TAG_LISTEN) {
+                // Drain the backlog; accepted sockets stay blocking for the handlers
+                int conn_fd;
+                while ((conn_fd = accept(fd, NULL, NULL)) >= 0) {
+                    epoll_watch(epoll_fd, conn_fd, (from_nm ? CONN_TAG_NM : 0) | (uint32_t)conn_fd,
+                                EPOLLIN | EPOLLRDHUP | EPOLLONESHOT);
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror(from_nm ? "ERROR on NM accept" : "ERROR on client accept");
+                }
+            } else {
+                // First request has arrived (or the peer hung up): hand it over.
+                // The handler closes the fd, which also drops it from the epoll set.
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                conn_queue_push(fd, from_nm);
+            }
         }
-        pthread_detach(thread_id);
     }
-    close(listen_fd);
+    close(client_listen_fd);
+    close(nm_listen_fd);
     return 0;
 }
 
@@ -419,7 +737,11 @@ void *send_heartbeat(void *arg) {
 
 int main(int argc, char *argv[]) {
     if (argc < 4) {
-        fprintf(stderr, "Usage: %s <ss_id> <client_port> <nm_port>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <ss_id> <client_port> <nm_port> [always|batched[:<ms>]|never]\n", argv[0]);
+        exit(1);
+    }
+    if (!configure_fsync_policy(argc > 4 ? argv[4] : SS_FSYNC_POLICY)) {
+        fprintf(stderr, "Unknown fsync policy '%s'; use always, batched, batched:<ms> or never\n", argv[4]);
         exit(1);
     }
 
@@ -436,6 +758,9 @@ int main(int argc, char *argv[]) {
     init_log_file(SS_LOG_FILE);
     log_message(SS_LOG_FILE, "INFO", "=== Storage Server %s Starting ===", ss_id);
 
+    // A client that hangs up mid-reply must cost only its own request
+    signal(SIGPIPE, SIG_IGN);
+
     // Create a dedicated data directory for this SS
     snprintf(SS_DATA_DIR, sizeof(SS_DATA_DIR), "ss_%s_data", ss_id);
     if (mkdir(SS_DATA_DIR, 0755) == -1 && errno != EEXIST) {
@@ -443,6 +768,17 @@ int main(int argc, char *argv[]) {
     }
     log_message(SS_LOG_FILE, "INFO", "Using data directory: %s", SS_DATA_DIR);
 
+    // Bring the data files up to date with edits logged before a crash
+    if (!wal_open(SS_DATA_DIR)) {
+        die("ERROR recovering the write-ahead log");
+    }
+    if (!checkpoint_store_open(SS_DATA_DIR)) {
+        die("ERROR opening the checkpoint store");
+    }
+    if (!undo_history_open(SS_DATA_DIR)) {
+        die("ERROR opening the undo history");
+    }
+
     // --- Step 1: Register with Name Server ---
     log_message(SS_LOG_FILE, "INFO", "Registering with Name Server at %s:%d", NM_IP, NM_PORT);
     int nm_sock = connect_to_server(NM_IP, NM_PORT);
@@ -480,29 +816,59 @@ int main(int argc, char *argv[]) {
     pthread_detach(heartbeat_tid);
     log_message(SS_LOG_FILE, "SUCCESS", "Heartbeat thread started");
 
-    // --- Step 3: Start BOTH listener threads ---
-    
-    // We need to pass heap-allocated args to the threads
-    int *client_port_ptr = malloc(sizeof(int));
-    *client_port_ptr = client_port;
-    int *nm_port_ptr = malloc(sizeof(int));
-    *nm_port_ptr = nm_port;
-    
-    pthread_t client_tid, nm_tid;
-    
-    // Start Client Listener Thread
-    if (pthread_create(&client_tid, NULL, start_client_listener, (void*) client_port_ptr) < 0) {
-        die("ERROR creating client listener thread");
+    pthread_t sweeper_tid;
+    if (pthread_create(&sweeper_tid, NULL, lease_sweeper_thread, NULL) != 0) {
+        die("ERROR creating lease sweeper thread");
+    }
+    pthread_detach(sweeper_tid);
+
+    if (get_fsync_policy() == FSYNC_BATCHED) {
+        pthread_t fsync_tid;
+        if (pthread_create(&fsync_tid, NULL, fsync_batch_thread, NULL) != 0) {
+            die("ERROR creating fsync thread");
+        }
+        pthread_detach(fsync_tid);
+    }
+    log_message(SS_LOG_FILE, "INFO", "fsync policy: %s", fsync_policy_name());
+
+    pthread_t checkpoint_tid;
+    if (pthread_create(&checkpoint_tid, NULL, wal_checkpoint_thread, NULL) != 0) {
+        die("ERROR creating WAL checkpoint thread");
     }
+    pthread_detach(checkpoint_tid);
+
+    pthread_t compactor_tid;
+    if (pthread_create(&compactor_tid, NULL, checkpoint_compactor_thread, NULL) != 0) {
+        die("ERROR creating checkpoint compactor thread");
+    }
+    pthread_detach(compactor_tid);
+
+    // --- Step 3: Start the worker pool, one worker per core ---
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_count < SS_MIN_WORKERS) worker_count = SS_MIN_WORKERS;
+    for (long i = 0; i < worker_count; i++) {
+        pthread_t worker_tid;
+        if (pthread_create(&worker_tid, NULL, conn_worker_thread, NULL) != 0) {
+            die("ERROR creating worker thread");
+        }
+        pthread_detach(worker_tid);
+    }
+    log_message(SS_LOG_FILE, "SUCCESS", "Started %ld connection workers", worker_count);
+
+    // --- Step 4: Start the listener for both ports ---
+    
+    // We need to pass heap-allocated args to the thread
+    int *ports = malloc(2 * sizeof(int));
+    ports[0] = client_port;
+    ports[1] = nm_port;
     
-    // Start NM Listener Thread
-    if (pthread_create(&nm_tid, NULL, start_nm_listener, (void*) nm_port_ptr) < 0) {
-        die("ERROR creating NM listener thread");
+    pthread_t listener_tid;
+    if (pthread_create(&listener_tid, NULL, start_listeners, (void*) ports) != 0) {
+        die("ERROR creating listener thread");
     }
 
-    // Keep the main thread alive by joining the listeners
-    pthread_join(client_tid, NULL);
-    pthread_join(nm_tid, NULL); 
+    // Keep the main thread alive by joining the listener
+    pthread_join(listener_tid, NULL);
 
     return 0;
 }
\ No newline at end of file
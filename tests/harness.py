@@ -0,0 +1,176 @@
+"""Starts a Name Server and Storage Servers from the built binaries in a
+scratch directory and talks to them over their plain-text protocols.
+
+The NM always listens on NM_PORT (common/config.h), so only one cluster can
+run at a time.
+"""
+import os
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+NM_PORT = 8080
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError(f"nothing listening on port {port}")
+
+
+def wait_for_port_closed(port, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+            time.sleep(0.05)
+        except OSError:
+            return
+    raise RuntimeError(f"port {port} still open")
+
+
+class Cluster:
+    """with Cluster(servers=1) as c: ... -- SS i listens on 9000+i for
+    clients and 9100+i for the NM, with its data in c.data_dir(i)."""
+
+    def __init__(self, servers=1, policy="always", bindir=None):
+        self.servers = servers
+        self.policy = policy
+        self.bindir = bindir or os.environ.get("DOCS_BIN", REPO)
+        self.dir = tempfile.mkdtemp(prefix="docs-test-")
+        self.nm = None
+        self.ss = {}
+
+    def __enter__(self):
+        self.start_nm()
+        for i in range(1, self.servers + 1):
+            self.start_ss(i)
+        time.sleep(0.3)  # Registration
+        return self
+
+    def __exit__(self, *exc):
+        for proc in [self.nm] + list(self.ss.values()):
+            if proc is not None and proc.poll() is None:
+                proc.kill()
+                proc.wait()
+        if exc[0] is None:
+            shutil.rmtree(self.dir, ignore_errors=True)
+        else:
+            print(f"server logs kept in {self.dir}")
+        return False
+
+    def log(self, name):
+        return open(os.path.join(self.dir, name), "a")
+
+    def start_nm(self):
+        self.nm = subprocess.Popen([os.path.join(self.bindir, "ns")], cwd=self.dir,
+                                   stdout=self.log("ns.out"), stderr=subprocess.STDOUT)
+        wait_for_port(NM_PORT)
+
+    def stop_nm(self):
+        self.nm.kill()
+        self.nm.wait()
+        wait_for_port_closed(NM_PORT)
+
+    def start_ss(self, i):
+        self.ss[i] = subprocess.Popen(
+            [os.path.join(self.bindir, "ss"), str(i), str(self.client_port(i)), str(9100 + i), self.policy],
+            cwd=self.dir, stdout=self.log(f"ss{i}.out"), stderr=subprocess.STDOUT)
+        wait_for_port(self.client_port(i))
+
+    def stop_ss(self, i):
+        self.ss[i].kill()
+        self.ss[i].wait()
+        wait_for_port_closed(self.client_port(i))
+
+    def pid(self, i):
+        return self.ss[i].pid
+
+    def client_port(self, i):
+        return 9000 + i
+
+    def data_dir(self, i):
+        return os.path.join(self.dir, f"ss_{i}_data")
+
+    def user(self, name="tester"):
+        return NMClient(name)
+
+    def request(self, msg, i=1, timeout=10):
+        """Sends one request to SS i and returns everything it answers until
+        it closes the connection."""
+        return ss_request(self.client_port(i), msg, timeout).decode()
+
+
+class NMClient:
+    """A registered client session with the NM"""
+
+    def __init__(self, name):
+        self.sock = socket.create_connection(("127.0.0.1", NM_PORT))
+        self.sock.sendall(f"REG_CLIENT {name}\n".encode())
+        self.sock.recv(4096)
+
+    def __call__(self, command, settle=0.3):
+        self.sock.sendall((command + "\n").encode())
+        time.sleep(settle)
+        return self.sock.recv(65536).decode().strip()
+
+
+def ss_request(port, msg, timeout=10):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.settimeout(timeout)
+    sock.sendall(msg.encode() if isinstance(msg, str) else msg)
+    data = b""
+    while True:
+        chunk = sock.recv(1 << 20)
+        if not chunk:
+            break
+        data += chunk
+    sock.close()
+    return data
+
+
+def write(cluster, filename, sentence, text, i=1, timeout=10):
+    """A single-connection WRITE of one sentence; returns the final reply"""
+    sock = socket.create_connection(("127.0.0.1", cluster.client_port(i)))
+    sock.settimeout(timeout)
+    sock.sendall(f"WRITE {filename} {sentence}\n".encode())
+    data = b""
+    while data.count(b"\n") < 2 and not (data.startswith(b"ERR") and data.endswith(b"\n")):
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    if not data.startswith(b"ACK_WRITE_LOCKED"):
+        sock.close()
+        return data.decode().strip()
+    sock.sendall((text + "\n").encode())
+    reply = b""
+    while not reply.endswith(b"\n"):
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        reply += chunk
+    sock.close()
+    return reply.decode().strip()
+
+
+def commit(cluster, filename, sentence, text, i=1):
+    """LOCK then COMMIT of one sentence; returns the COMMIT reply"""
+    reply = cluster.request(f"LOCK {filename} {sentence}\n", i).split()
+    if reply[0] != "ACK_LOCK":
+        return " ".join(reply)
+    return cluster.request(f"COMMIT {filename} {reply[1]}\n{text}\n", i).strip()
+
+
+def check(condition, what):
+    print(("ok   " if condition else "FAIL ") + what)
+    if not condition:
+        raise SystemExit(1)
@@ -0,0 +1,39 @@
+"""A commit that only appends writes just the new bytes, and its undo step
+holds only the appended sentence, not a copy of the file. Commits reach the
+file at the next WAL checkpoint."""
+import os
+import time
+
+from harness import Cluster, check, commit
+
+SENTENCES = 500
+
+def written_out():
+    time.sleep(1.5)  # Past the next WAL checkpoint
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    path = os.path.join(c.data_dir(1), "f.txt")
+    with open(path, "w") as f:
+        f.write("One." + " Filler sentence." * (SENTENCES - 1))
+    size = os.path.getsize(path)
+
+    check(commit(c, "f.txt", SENTENCES + 1, "Two.") == "ACK_WRITE_SUCCESS", "first append committed")
+    written_out()
+    # Change the first bytes on disk behind the cached copy, keeping the
+    # length: an append that rewrote the file would put them back
+    with open(path, "r+") as f:
+        f.write("Uno.")
+    check(commit(c, "f.txt", SENTENCES + 2, "Three.") == "ACK_WRITE_SUCCESS", "second append committed")
+    written_out()
+    text = open(path).read()
+    check(text.startswith("Uno.") and text.endswith(" Two. Three."), "only the new sentence was written")
+    history = sum(os.path.getsize(os.path.join(d, f)) for d, _, fs in os.walk(c.data_dir(1)) for f in fs
+                  if f.endswith(".undo"))
+    check(0 < history < size // 4, f"the undo history holds the appends, not the file ({history} bytes)")
+
+    with open(path, "r+") as f:
+        f.write("One.")  # Back in step with the cached copy
+    check(c.request("UNDO f.txt 2\n").strip() == "ACK_UNDO_SUCCESS", "UNDO of both appends")
+    check(os.path.getsize(path) == size, "the file is cut back")
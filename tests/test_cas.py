@@ -0,0 +1,35 @@
+"""An optimistic CAS writes only if the sentence still has the version PEEK
+returned; otherwise it gets the current version and text back."""
+from harness import Cluster, check, commit, write
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    check(write(c, "f.txt", 1, "One. Two. Three.") == "ACK_WRITE_SUCCESS", "f.txt written")
+
+    head, sentence = c.request("PEEK f.txt 2\n").split("\n")[:2]
+    check(head.startswith("ACK_PEEK ") and sentence == "Two.", f"PEEK returns a version and the sentence ({head!r})")
+    version = head.split()[1]
+    check(c.request(f"CAS f.txt 2 {version}\nSecond.\n").strip() == "ACK_WRITE_SUCCESS", "CAS at that version")
+
+    head, sentence = c.request(f"CAS f.txt 2 {version}\nStale.\n").split("\n")[:2]
+    current = c.request("PEEK f.txt 2\n").split()[1]
+    check(head == f"ERR_VERSION_CONFLICT {current}" and sentence == "Second.",
+          f"CAS at the old version gets the current one and its text ({head!r}, {sentence!r})")
+
+    # A concurrent edit between PEEK and CAS also makes the CAS fail
+    version = c.request("PEEK f.txt 3\n").split()[1]
+    check(commit(c, "f.txt", 3, "Locked edit.") == "ACK_WRITE_SUCCESS", "sentence 3 edited under a LOCK")
+    check(c.request(f"CAS f.txt 3 {version}\nLost.\n").startswith("ERR_VERSION_CONFLICT"),
+          "CAS over that edit is refused")
+
+    token = c.request("LOCK f.txt 1\n").split()[1]
+    version = c.request("PEEK f.txt 1\n").split()[1]
+    check(c.request(f"CAS f.txt 1 {version}\nSneaky.\n").startswith("ERR_SENTENCE_LOCKED"),
+          "CAS on a locked sentence is refused")
+    c.request(f"UNLOCK f.txt {token}\n")
+
+    version = c.request("PEEK f.txt 4\n").split()[1]
+    check(c.request(f"CAS f.txt 4 {version}\nAppended.\n").strip() == "ACK_WRITE_SUCCESS", "CAS appends a sentence")
+    text = c.request("READ f.txt\n").strip()
+    check(text == "One. Second. Locked edit. Appended.", f"file holds every accepted edit ({text!r})")
@@ -0,0 +1,44 @@
+"""The checkpoint catalog is brought back in line with the manifests at
+startup: a lost or damaged catalog is rebuilt in the order the checkpoints
+were taken, and a checkpoint whose manifest has gone is left out."""
+import os
+
+from harness import Cluster, check, commit
+
+def listing(c):
+    """Each checkpoint's line without its time, which a rebuild takes from
+    the manifest's mtime"""
+    lines = c.request("LISTCHECKPOINTS f.txt\n").strip().split("\n")
+    return [" ".join(w for k, w in enumerate(line.split()) if k not in (1, 2)) for line in lines]
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    for k in range(1, 4):
+        check(commit(c, "f.txt", 1, f"Version {k}.") == "ACK_WRITE_SUCCESS", f"version {k} written")
+        check(c.request(f"CHECKPOINT f.txt v{k}\n").strip() == "ACK_CHECKPOINT", f"v{k} taken")
+    before = listing(c)
+    check([line.split()[0] for line in before] == ["v1", "v2", "v3"], f"listed oldest first ({before})")
+    checkpoints = os.path.join(c.data_dir(1), ".checkpoints", "f.txt")
+    catalog = os.path.join(checkpoints, ".catalog")
+
+    c.stop_ss(1)
+    os.remove(catalog)
+    c.start_ss(1)
+    now = listing(c)
+    check(now == before, f"a lost catalog is rebuilt as it was ({now})")
+    check(os.path.exists(catalog), "and written back")
+
+    c.stop_ss(1)
+    with open(catalog, "w") as f:
+        f.write("not a catalog\n")
+    c.start_ss(1)
+    now = listing(c)
+    check(now == before, f"a damaged one too ({now})")
+
+    c.stop_ss(1)
+    os.remove(os.path.join(checkpoints, "v3.chk"))
+    c.start_ss(1)
+    now = listing(c)
+    check(now == before[:2], f"a checkpoint whose manifest has gone is dropped ({now})")
+    check(c.request("VIEWCHECKPOINT f.txt v2\n").strip() == "Version 2.", "the others still read back")
@@ -0,0 +1,24 @@
+"""A checkpoint reuses a stored chunk only if it holds the same bytes: a
+chunk is named by a hash of its content, and two texts can share a name."""
+import os
+
+from harness import Cluster, check
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE book.txt")
+    with open(os.path.join(c.data_dir(1), "book.txt"), "w") as f:
+        f.write("".join(f"Sentence number {i} of the book. " for i in range(2000)))
+    check(c.request("CHECKPOINT book.txt v1\n").strip() == "ACK_CHECKPOINT", "v1 taken")
+
+    # Stand in for a different text with the same name: same length, other bytes
+    objects = os.path.join(c.data_dir(1), ".checkpoints", ".objects")
+    stored = sorted(os.path.join(d, name) for d, _, names in os.walk(objects) for name in names)
+    check(len(stored) > 1, f"{len(stored)} chunks stored")
+    with open(stored[0], "r+b") as f:
+        first = f.read(1)
+        f.seek(0)
+        f.write(b"#" if first != b"#" else b"%")
+
+    check(c.request("CHECKPOINT book.txt v2\n").strip() != "ACK_CHECKPOINT",
+          "v2 not built on a chunk with other content")
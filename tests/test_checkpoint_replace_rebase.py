@@ -0,0 +1,33 @@
+"""Replacing a checkpoint that others are deltas against must fail, and
+leave it in place, if they cannot be rebased off it first."""
+import os
+import subprocess
+
+from harness import Cluster, check, commit
+
+def text(i):
+    return "".join(f"Sentence {n} of version {i if n == 7 else 0}. " for n in range(3000))
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE book.txt")
+    path = os.path.join(c.data_dir(1), "book.txt")
+    with open(path, "w") as f:
+        f.write(text(1))
+    check(c.request("CHECKPOINT book.txt v1\n").strip() == "ACK_CHECKPOINT", "v1 taken")
+    check(commit(c, "book.txt", 8, "Sentence 7 of version 2.") == "ACK_WRITE_SUCCESS", "edited")
+    check(c.request("CHECKPOINT book.txt v2\n").strip() == "ACK_CHECKPOINT", "v2 taken as a delta on v1")
+    v2 = c.request("VIEWCHECKPOINT book.txt v2\n")
+
+    # An immutable v2 manifest cannot be rewritten, so v2 cannot be rebased
+    child = os.path.join(c.data_dir(1), ".checkpoints", "book.txt", "v2.chk")
+    if subprocess.run(["chattr", "+i", child], capture_output=True).returncode != 0:
+        print("skip (no chattr on this filesystem)")
+        raise SystemExit(0)
+    try:
+        check(commit(c, "book.txt", 8, "Sentence 7 of version 3.") == "ACK_WRITE_SUCCESS", "edited again")
+        check(c.request("CHECKPOINT book.txt v1\n").strip() != "ACK_CHECKPOINT",
+              "v1 not replaced while v2 still depends on it")
+    finally:
+        subprocess.run(["chattr", "-i", child])
+    check(c.request("VIEWCHECKPOINT book.txt v2\n") == v2, "v2 still reads back as taken")
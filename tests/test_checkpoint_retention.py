@@ -0,0 +1,59 @@
+"""SETRETENTION takes only well-formed rules, and the compactor deletes the
+checkpoints a file's rule does not keep: beyond the KEEP newest, and all
+but the newest of each of the last HOURLY hours."""
+import os
+import time
+
+from harness import Cluster, check, commit
+
+COMPACT_INTERVAL = 30  # CHECKPOINT_COMPACT_INTERVAL_MS
+
+def tags(c, name):
+    lines = c.request(f"LISTCHECKPOINTS {name}\n").strip().split("\n")
+    return [line.split()[0] for line in lines if not line.startswith("(")]
+
+# The test must not span the start of an hour
+left = 3600 - time.time() % 3600
+if left < COMPACT_INTERVAL + 30:
+    time.sleep(left + 1)
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    for name in ("a.txt", "b.txt", "c.txt"):
+        nm(f"CREATE {name}", settle=0.1)
+        for k in range(1, 6):
+            commit(c, name, 1, f"Version {k}.")
+            c.request(f"CHECKPOINT {name} v{k}\n")
+        check(tags(c, name) == ["v1", "v2", "v3", "v4", "v5"], f"{name} has five checkpoints")
+
+    for rule in ("KEEP=0", "KEEP=x", "ALL KEEP=2", "WEEKLY=1", "KEEP=2 KEEP"):
+        reply = nm(f"SETRETENTION a.txt {rule}")
+        check(reply == "ERR_INVALID_RETENTION", f"{rule!r} is refused ({reply})")
+    reply = nm("SETRETENTION a.txt keep=2 HOURLY=3 daily=1")
+    check(reply.startswith("ACK_SETRETENTION"), f"a rule with every count is taken ({reply})")
+    listing = c.request("LISTCHECKPOINTS a.txt\n")
+    check("(retention: KEEP=2 HOURLY=3 DAILY=1)" in listing, "LISTCHECKPOINTS shows it as parsed")
+    check(nm("SETRETENTION a.txt KEEP=2").startswith("ACK_SETRETENTION"), "a.txt keeps two")
+    check(nm("SETRETENTION b.txt HOURLY=3").startswith("ACK_SETRETENTION"), "b.txt keeps three hours")
+
+    # Move b.txt's checkpoints back in time, oldest first as the catalog
+    # keeps them: v1 three hours ago, v2 and v3 two, v4 one, v5 now
+    hour = int(time.time()) // 3600
+    created = [(hour - 3) * 3600 + 10, (hour - 2) * 3600 + 10, (hour - 2) * 3600 + 20, (hour - 1) * 3600 + 10]
+    catalog = os.path.join(c.data_dir(1), ".checkpoints", "b.txt", ".catalog")
+    lines = open(catalog).read().splitlines()
+    lines = [" ".join([str(created[k])] + line.split()[1:]) if k < len(created) else line
+             for k, line in enumerate(lines)]
+    with open(catalog, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+    deadline = time.time() + COMPACT_INTERVAL + 10
+    while time.time() < deadline and (len(tags(c, "a.txt")) > 2 or len(tags(c, "b.txt")) > 3):
+        time.sleep(1)
+    check(tags(c, "a.txt") == ["v4", "v5"], f"KEEP=2 leaves the two newest ({tags(c, 'a.txt')})")
+    check(tags(c, "b.txt") == ["v3", "v4", "v5"],
+          f"HOURLY=3 leaves the newest of each of the last three hours ({tags(c, 'b.txt')})")
+    check(tags(c, "c.txt") == ["v1", "v2", "v3", "v4", "v5"], "a file with no rule keeps them all")
+    for name, k in (("a.txt", 4), ("b.txt", 3)):
+        text = c.request(f"VIEWCHECKPOINT {name} v{k}\n").strip()
+        check(text == f"Version {k}.", f"{name} v{k} still reads back ({text!r})")
@@ -0,0 +1,56 @@
+"""COMMITs written together in one group commit are still undone one at a
+time, newest first."""
+import os
+import re
+import threading
+
+from harness import Cluster, check
+
+SENTENCES = 6
+
+def stats(c):
+    return dict(re.findall(r"(\w+)=(\S+)", c.request("SSSTATS\n")))
+
+def sentences(c):
+    return c.request("READ notes.txt\n").split()
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE notes.txt")
+    with open(os.path.join(c.data_dir(1), "notes.txt"), "w") as f:
+        f.write(" ".join(f"Old{i}." for i in range(1, SENTENCES + 1)))
+
+    # Each round commits to every sentence at once, until one round has been
+    # written in fewer batches than it had COMMITs
+    batched = False
+    for round in range(1, 21):
+        before = sentences(c)
+        tokens = [c.request(f"LOCK notes.txt {i}\n").split()[1] for i in range(1, SENTENCES + 1)]
+        replies = [None] * SENTENCES
+        def send(k):
+            replies[k] = c.request(f"COMMIT notes.txt {tokens[k]}\nR{round}s{k + 1}.\n").strip()
+        start = stats(c)
+        threads = [threading.Thread(target=send, args=(k,)) for k in range(SENTENCES)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        end = stats(c)
+        check(all(r == "ACK_WRITE_SUCCESS" for r in replies), f"round {round} committed ({replies})")
+        commits = int(end["commits"]) - int(start["commits"])
+        batches = int(end["commit_batches"]) - int(start["commit_batches"])
+        if batches < commits:
+            batched = True
+            break
+    check(batched, f"{commits} COMMITs written in {batches} batches")
+
+    # Each UNDO puts back exactly one sentence, the newest written first
+    after = sentences(c)
+    for step in range(SENTENCES):
+        check(c.request("UNDO notes.txt\n").startswith("ACK"), f"UNDO {step + 1}")
+        now = sentences(c)
+        changed = [i for i in range(SENTENCES) if now[i] != after[i]]
+        check(len(changed) == 1 and now[changed[0]] == before[changed[0]],
+              f"UNDO {step + 1} took back one COMMIT ({after} -> {now})")
+        after = now
+    check(after == before, "every COMMIT of the batch taken back")
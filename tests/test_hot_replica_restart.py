@@ -0,0 +1,33 @@
+"""Extra read replicas of a hot file are not kept across an NM restart;
+the copies they left on the SSs are deleted once those SSs register."""
+import os
+import time
+
+from harness import Cluster, check
+
+with Cluster(servers=3) as c:
+    nm = c.user()
+    reply = nm("CREATE hot.txt")
+    check(reply.startswith("ACK"), f"hot.txt created with two copies ({reply})")
+    holders = [i for i in (1, 2, 3) if os.path.exists(os.path.join(c.data_dir(i), "hot.txt"))]
+    check(len(holders) == 2, f"only SS {holders} hold it")
+    other = 6 - sum(holders)
+    extra = os.path.join(c.data_dir(other), "hot.txt")
+
+    deadline = time.time() + 30
+    while not os.path.exists(extra) and time.time() < deadline:
+        nm("READ hot.txt", settle=0.1)
+    check(os.path.exists(extra), f"reads gave SS {other} an extra copy")
+
+    c.stop_nm()
+    for i in (1, 2, 3):
+        c.stop_ss(i)
+    c.start_nm()
+    for i in (1, 2, 3):
+        c.start_ss(i)
+    deadline = time.time() + 10
+    while os.path.exists(extra) and time.time() < deadline:
+        time.sleep(0.2)
+    check(not os.path.exists(extra), "extra copy deleted after the restart")
+    check(all(os.path.exists(os.path.join(c.data_dir(i), "hot.txt")) for i in holders),
+          "the registered copies are kept")
@@ -0,0 +1,39 @@
+"""LOCK hands out a leased token and the sentence; only that token can
+COMMIT or UNLOCK it, once, and concurrent commits to other sentences of the
+file are all kept."""
+import threading
+
+from harness import Cluster, check, commit, write
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    check(write(c, "f.txt", 1, "One. Two. Three. Four. Five.") == "ACK_WRITE_SUCCESS", "f.txt written")
+
+    head, sentence = c.request("LOCK f.txt 2\n").split("\n")[:2]
+    fields = head.split()
+    check(fields[0] == "ACK_LOCK" and int(fields[2]) > 0 and sentence == "Two.",
+          f"LOCK returns a token, its lease and the sentence ({head!r}, {sentence!r})")
+    token = fields[1]
+    check(c.request("LOCK f.txt 2\n").startswith("ERR_SENTENCE_LOCKED"), "a second LOCK is refused")
+    check(write(c, "f.txt", 2, "Legacy.").startswith("ERR_SENTENCE_LOCKED"), "so is a single-connection WRITE")
+    check(c.request(f"COMMIT f.txt {int(token) + 1}\nWrong.\n").strip() == "ERR_INVALID_LOCK_TOKEN",
+          "COMMIT with another token is refused")
+    check(c.request(f"COMMIT f.txt {token}\nSecond.\n").strip() == "ACK_WRITE_SUCCESS", "COMMIT with the token")
+    check(c.request(f"COMMIT f.txt {token}\nAgain.\n").strip() == "ERR_INVALID_LOCK_TOKEN", "the token is used up")
+
+    token = c.request("LOCK f.txt 3\n").split()[1]
+    check(c.request(f"UNLOCK f.txt {token}\n").strip() == "ACK_UNLOCK", "UNLOCK gives the sentence back")
+    check(c.request(f"COMMIT f.txt {token}\nLate.\n").strip() == "ERR_INVALID_LOCK_TOKEN",
+          "and its token cannot commit")
+
+    replies = []
+    threads = [threading.Thread(target=lambda k=k: replies.append(commit(c, "f.txt", k, f"Edit {k}.")))
+               for k in (1, 3, 4, 5)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    check(replies == ["ACK_WRITE_SUCCESS"] * 4, f"four concurrent commits ({replies})")
+    text = c.request("READ f.txt\n").strip()
+    check(text == "Edit 1. Second. Edit 3. Edit 4. Edit 5.", f"none of them lost ({text!r})")
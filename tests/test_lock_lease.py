@@ -0,0 +1,35 @@
+"""A LOCK nobody renews expires after WRITE_LEASE_SECONDS without any other
+traffic on the file. Its token can neither commit nor renew; a LOCK
+that is renewed outlives the lease and still commits."""
+import time
+
+from harness import Cluster, check, write
+
+LEASE = 20  # WRITE_LEASE_SECONDS
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    check(write(c, "f.txt", 1, "One. Two.") == "ACK_WRITE_SUCCESS", "f.txt written")
+    abandoned = c.request("LOCK f.txt 1\n").split()
+    renewed = c.request("LOCK f.txt 2\n").split()
+    check(abandoned[2] == str(LEASE) and renewed[2] == str(LEASE), f"both leases are {LEASE} s")
+
+    deadline = time.time() + LEASE + 3
+    while time.time() < deadline:
+        time.sleep(LEASE / 3)
+        reply = c.request(f"RENEW f.txt {renewed[1]}\n").strip()
+        check(reply == f"ACK_RENEW {LEASE}", f"RENEW extends the lease ({reply})")
+
+    reply = c.request("LOCK f.txt 1\n")
+    check(reply.startswith("ACK_LOCK"), f"the abandoned sentence can be locked again ({reply.split()[0]})")
+    token = reply.split()[1]
+    reply = c.request(f"COMMIT f.txt {abandoned[1]}\nLate.\n").strip()
+    check(reply in ("ERR_LOCK_EXPIRED", "ERR_INVALID_LOCK_TOKEN"), f"the expired token cannot commit ({reply})")
+    reply = c.request(f"RENEW f.txt {abandoned[1]}\n").strip()
+    check(reply in ("ERR_LOCK_EXPIRED", "ERR_INVALID_LOCK_TOKEN"), f"nor renew ({reply})")
+    check(c.request(f"COMMIT f.txt {token}\nNew.\n").strip() == "ACK_WRITE_SUCCESS", "its new holder commits")
+    check(c.request(f"COMMIT f.txt {renewed[1]}\nKept.\n").strip() == "ACK_WRITE_SUCCESS",
+          "the renewed lock commits after its first lease")
+    text = c.request("READ f.txt\n").strip()
+    check(text == "New. Kept.", f"both edits applied ({text!r})")
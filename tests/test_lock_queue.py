@@ -0,0 +1,51 @@
+"""A LOCK with a wait queues for a held sentence: it times out with
+ERR_LOCK_TIMEOUT, queued LOCKs are granted in arrival order with the text
+their predecessor committed, and a waiter that hung up does not keep the
+sentence."""
+import socket
+import threading
+import time
+
+from harness import Cluster, check, write
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    check(write(c, "f.txt", 1, "One. Two. Three.") == "ACK_WRITE_SUCCESS", "f.txt written")
+    holder = c.request("LOCK f.txt 2\n").split()[1]
+
+    start = time.perf_counter()
+    reply = c.request("LOCK f.txt 2 1\n").strip()
+    elapsed = time.perf_counter() - start
+    check(reply == "ERR_LOCK_TIMEOUT" and 0.9 < elapsed < 3, f"a 1 s wait times out ({reply}, {elapsed:.1f} s)")
+    check(c.request("LOCK f.txt 2\n").startswith("ERR_SENTENCE_LOCKED"), "a LOCK without a wait is refused at once")
+
+    granted = []
+    def queue(name):
+        head, sentence = c.request("LOCK f.txt 2 10\n", timeout=15).split("\n")[:2]
+        granted.append((name, sentence))
+        token = head.split()[1]
+        c.request(f"COMMIT f.txt {token}\n{name}.\n")
+    threads = []
+    for name in ("First", "Second", "Third"):
+        threads.append(threading.Thread(target=queue, args=(name,)))
+        threads[-1].start()
+        time.sleep(0.3)
+    check(c.request(f"COMMIT f.txt {holder}\nHeld.\n").strip() == "ACK_WRITE_SUCCESS", "the holder commits")
+    for t in threads:
+        t.join()
+    check(granted == [("First", "Held."), ("Second", "First."), ("Third", "Second.")],
+          f"waiters granted in order, each with the previous edit ({granted})")
+    text = c.request("READ f.txt\n").strip()
+    check(text == "One. Third. Three.", f"every queued edit applied ({text!r})")
+
+    holder = c.request("LOCK f.txt 3\n").split()[1]
+    gone = socket.create_connection(("127.0.0.1", c.client_port(1)))
+    gone.sendall(b"LOCK f.txt 3 10\n")
+    time.sleep(0.3)
+    gone.close()
+    time.sleep(0.3)
+    check(c.request(f"UNLOCK f.txt {holder}\n").strip() == "ACK_UNLOCK", "the holder unlocks")
+    time.sleep(0.5)
+    reply = c.request("LOCK f.txt 3\n")
+    check(reply.startswith("ACK_LOCK"), f"a waiter that hung up does not keep the sentence ({reply.strip()})")
@@ -0,0 +1,21 @@
+"""A document too large to stay cached once unused is still locked and
+written by the IDs its sentences had when they were looked up."""
+import os
+
+from harness import Cluster, check, commit
+
+SENTENCES = 700000  # Beyond DOC_CACHE_MAX_BYTES once loaded
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE big.txt")
+    with open(os.path.join(c.data_dir(1), "big.txt"), "w") as f:
+        f.write("".join(f"S{i:07d}. " for i in range(SENTENCES)))
+
+    reply = commit(c, "big.txt", 5, "Locked edit.")
+    check(reply == "ACK_WRITE_SUCCESS", f"LOCK and COMMIT ({reply})")
+    version = c.request("PEEK big.txt 7\n").split()[1]
+    reply = c.request(f"CAS big.txt 7 {version}\nOptimistic edit.\n").strip()
+    check(reply == "ACK_WRITE_SUCCESS", f"CAS ({reply})")
+    text = c.request("READ big.txt\n", timeout=30).split()
+    check(text[4] == "Locked" and text[7] == "Optimistic", f"both edits in place ({text[:10]})")
@@ -0,0 +1,33 @@
+"""LOCKSET locks a set of sentences all or none, and its COMMIT applies one
+line per sentence only when the count matches, keeping the locks for a
+retry when it does not."""
+from harness import Cluster, check, write
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE f.txt")
+    check(write(c, "f.txt", 1, "One. Two. Three. Four. Five.") == "ACK_WRITE_SUCCESS", "f.txt written")
+
+    other = c.request("LOCK f.txt 4\n").split()[1]
+    check(c.request("LOCKSET f.txt 2-4\n").strip() == "ERR_SENTENCE_LOCKED", "LOCKSET over a held sentence is refused")
+    token = c.request("LOCK f.txt 2\n").split()[1]
+    check(c.request(f"UNLOCK f.txt {token}\n").strip() == "ACK_UNLOCK", "and locks none of the others")
+    c.request(f"UNLOCK f.txt {other}\n")
+    check(c.request("LOCKSET f.txt 1,9\n").startswith("ERR_SENTENCE_OUT_OF_RANGE"), "a set past the end is refused")
+    check(c.request("LOCKSET f.txt 3-1\n").strip() == "ERR_INVALID_SENTENCE_SET", "so is a malformed set")
+
+    lines = c.request("LOCKSET f.txt 4,2-3\n").strip().split("\n")
+    head = lines[0].split()
+    check(head[0] == "ACK_LOCKSET" and head[3] == "3" and lines[1:] == ["2 Two.", "3 Three.", "4 Four."],
+          f"LOCKSET returns the sentences in order ({lines})")
+    token = head[1]
+    check(c.request("LOCK f.txt 3\n").startswith("ERR_SENTENCE_LOCKED"), "each of them is locked")
+
+    reply = c.request(f"COMMIT f.txt {token} 2\nA.\nB.\n").strip()
+    check(reply == "ERR_EDIT_COUNT_MISMATCH", f"COMMIT with too few lines is refused ({reply})")
+    check(c.request("LOCK f.txt 2\n").startswith("ERR_SENTENCE_LOCKED"), "and the set stays locked")
+    reply = c.request(f"COMMIT f.txt {token} 3\nA.\nB.\nC.\n").strip()
+    check(reply == "ACK_WRITE_SUCCESS", f"COMMIT with one line per sentence ({reply})")
+    text = c.request("READ f.txt\n").strip()
+    check(text == "One. A. B. C. Five.", f"all three edits applied ({text!r})")
+    check(c.request(f"COMMIT f.txt {token} 3\nX.\nY.\nZ.\n").strip() == "ERR_INVALID_LOCK_TOKEN", "the token is used up")
@@ -0,0 +1,15 @@
+"""A QUORUM write must not be acknowledged while the NM cannot confirm its
+copies; an ASYNC one still is."""
+from harness import Cluster, check, write
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE safe.txt")
+    nm("CREATE loose.txt")
+    check(nm("SETDURABILITY safe.txt QUORUM 1").startswith("ACK_SETDURABILITY"), "safe.txt set to QUORUM 1")
+    for name in ("safe.txt", "loose.txt"):
+        check(write(c, name, 1, "First.") == "ACK_WRITE_SUCCESS", f"{name} written with the NM up")
+
+    c.stop_nm()
+    check(write(c, "safe.txt", 1, "Second.") == "ERR_QUORUM_NOT_MET", "QUORUM write refused with the NM down")
+    check(write(c, "loose.txt", 1, "Second.") == "ACK_WRITE_SUCCESS", "ASYNC write acknowledged with the NM down")
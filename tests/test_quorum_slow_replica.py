@@ -0,0 +1,47 @@
+"""QUORUM writes stuck on an unresponsive replica do not tie up the NM: it
+keeps serving clients while they wait, fails them once QUORUM_WAIT_TIMEOUT
+passes, and the replica ends up with the primary's latest content."""
+import os
+import signal
+import threading
+import time
+
+from harness import Cluster, check, write
+
+WRITERS = 12  # More than the NM's worker threads
+
+with Cluster(servers=2) as c:
+    nm = c.user()
+    for k in range(WRITERS):
+        nm(f"CREATE f{k}.txt", settle=0.05)
+        nm(f"SETDURABILITY f{k}.txt QUORUM 2", settle=0.05)
+    check(write(c, "f0.txt", 1, "First.") == "ACK_WRITE_SUCCESS", "QUORUM 2 write with both copies up")
+
+    os.kill(c.pid(2), signal.SIGSTOP)
+    replies = []
+    def edit(k):
+        replies.append(write(c, f"f{k}.txt", 1, f"Edit {k}.", timeout=30))
+    threads = [threading.Thread(target=edit, args=(k,)) for k in range(WRITERS)]
+    for t in threads:
+        t.start()
+    time.sleep(1.5)
+
+    start = time.perf_counter()
+    other = c.user("other")
+    listing = other("VIEW -a", settle=0.1)
+    elapsed = time.perf_counter() - start
+    check("f0.txt" in listing and elapsed < 2, f"NM answers a new client while writes wait ({elapsed:.1f} s)")
+
+    for t in threads:
+        t.join()
+    check(len(replies) == WRITERS and all(r.startswith("ERR_QUORUM_NOT_MET") for r in replies),
+          f"every write refused without its second copy ({set(replies)})")
+
+    os.kill(c.pid(2), signal.SIGCONT)
+    time.sleep(1)
+    for k in range(5):
+        check(write(c, "f0.txt", 1, f"Final {k}.") == "ACK_WRITE_SUCCESS", f"write {k} acknowledged again")
+    time.sleep(0.5)
+    primary = open(os.path.join(c.data_dir(1), "f0.txt")).read()
+    replica = open(os.path.join(c.data_dir(2), "f0.txt")).read()
+    check(primary == replica and "Final 4." in replica, "replica holds the primary's latest content")
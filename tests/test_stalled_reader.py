@@ -0,0 +1,57 @@
+"""A READ whose client never drains its socket must not hold up other work
+on the file or the server."""
+import os
+import re
+import socket
+import time
+
+from harness import Cluster, check, commit
+
+def stalled_read(port, filename):
+    """Starts a READ and never reads the reply"""
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+    sock.connect(("127.0.0.1", port))
+    sock.sendall(f"READ {filename}\n".encode())
+    return sock
+
+def wal_checkpoints(c):
+    return int(re.search(r"wal_checkpoints=(\d+)", c.request("SSSTATS\n")).group(1))
+
+def checkpointed(c, since, limit=3.0):
+    """Waits for a WAL checkpoint after `since`"""
+    deadline = time.time() + limit
+    while wal_checkpoints(c) <= since and time.time() < deadline:
+        time.sleep(0.1)
+    return wal_checkpoints(c) > since
+
+def timed(what, action, limit=3.0):
+    start = time.time()
+    result = action()
+    check(time.time() - start < limit, f"{what} within {limit:.0f} s")
+    return result
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE big.txt")
+    nm("CREATE small.txt")
+    sentence = "A sentence that makes the file large enough to fill every socket buffer. "
+    with open(os.path.join(c.data_dir(1), "big.txt"), "w") as f:
+        f.write(sentence * (16 * 1024 * 1024 // len(sentence)))
+    check(commit(c, "small.txt", 1, "Small file.") == "ACK_WRITE_SUCCESS", "small.txt written")
+
+    # The first READ loads the document; the second finds it cached and
+    # edited
+    for state in ("uncached", "cached"):
+        # One stalled reader at a time: each takes a worker, and the pool has
+        # as few as two
+        reader = stalled_read(c.client_port(1), "big.txt")
+        time.sleep(1)
+        since = wal_checkpoints(c)
+        check(timed(f"COMMIT to big.txt with the READ ({state}) stalled",
+                    lambda: commit(c, "big.txt", 2, f"Edited while a {state} READ stalls.")) == "ACK_WRITE_SUCCESS",
+              "COMMIT succeeds")
+        check(timed("READ of another file", lambda: c.request("READ small.txt\n")) == "Small file.",
+              "other file reads back")
+        check(checkpointed(c, since), f"WAL checkpoint with the READ ({state}) stalled")
+        reader.close()
@@ -0,0 +1,35 @@
+"""A file's undo history must not take over a user's file: notes.txt.undo
+is a name like any other."""
+import os
+import time
+
+from harness import Cluster, check, commit
+
+with Cluster(servers=1) as c:
+    nm = c.user()
+    nm("CREATE notes.txt.undo")
+    check(commit(c, "notes.txt.undo", 1, "My own file.") == "ACK_WRITE_SUCCESS", "notes.txt.undo written")
+    time.sleep(1.5)  # WAL checkpoint: from here on the file on disk is what it holds
+    nm("CREATE notes.txt")
+    check(commit(c, "notes.txt", 1, "First.") == "ACK_WRITE_SUCCESS", "notes.txt written")
+    check(commit(c, "notes.txt", 1, "Second.") == "ACK_WRITE_SUCCESS", "notes.txt rewritten")
+    with open(os.path.join(c.data_dir(1), "notes.txt.undo")) as f:
+        check(f.read() == "My own file.", "notes.txt.undo untouched")
+    check(c.request("UNDO notes.txt\n").startswith("ACK_UNDO"), "notes.txt undone")
+    check(c.request("READ notes.txt\n") == "First.", "notes.txt back to its first write")
+    c.stop_ss(1)
+    c.start_ss(1)
+    check(c.request("READ notes.txt.undo\n") == "My own file.", "notes.txt.undo still untouched")
+
+    # Files in folders, and moved files, keep their history
+    nm("CREATEFOLDER docs")
+    nm("CREATE plan.txt")
+    check(commit(c, "plan.txt", 1, "Plan A.") == "ACK_WRITE_SUCCESS", "plan.txt written")
+    check(commit(c, "plan.txt", 1, "Plan B.") == "ACK_WRITE_SUCCESS", "plan.txt rewritten")
+    check(nm("MOVE plan.txt docs").startswith("ACK"), "plan.txt moved into docs")
+    check(c.request("UNDO docs/plan.txt\n").startswith("ACK_UNDO"), "docs/plan.txt undone")
+    check(c.request("READ docs/plan.txt\n") == "Plan A.", "docs/plan.txt back to its first write")
+    root = c.data_dir(1)
+    stray = [os.path.join(d, name) for d, dirs, names in os.walk(root) for name in names
+             if name.endswith(".undo") and name != "notes.txt.undo" and not d.startswith(os.path.join(root, "."))]
+    check(stray == [], f"no history among the user's files ({stray})")